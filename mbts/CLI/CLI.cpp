@@ -35,6 +35,7 @@
 
 #include <GSMConfig.h>
 #include <GSMLogicalChannel.h>
+#include <GSMTAPDump.h>
 #include <ControlCommon.h>
 //#include <TransactionTable.h>
 #include <TRXManager.h>
@@ -1010,6 +1011,36 @@ int noise(int argc, char** argv, ostream& os)
         return SUCCESS;
 }
 
+/** Print the burst pipeline latency measured by the transceiver. */
+int latency(int argc, char** argv, ostream& os)
+{
+	if (argc>2) return BAD_NUM_ARGS;
+	bool reset = false;
+	if (argc==2) {
+		if (strcmp(argv[1],"reset")) return BAD_VALUE;
+		reset = true;
+	}
+	std::string report = gTRX.ARFCN(0)->getLatency(reset);
+	if (report.empty()) {
+		os << "transceiver did not report latency" << endl;
+		return FAILURE;
+	}
+	os << report;
+	return SUCCESS;
+}
+
+int gsmtap(int argc, char** argv, ostream& os)
+{
+	if (argc>2) return BAD_NUM_ARGS;
+	bool reset = false;
+	if (argc==2) {
+		if (strcmp(argv[1],"reset")) return BAD_VALUE;
+		reset = true;
+	}
+	gGSMTAP.text(os,reset);
+	return SUCCESS;
+}
+
 int sysinfo(int argc, char** argv, ostream& os)
 {
         if (argc!=1) return BAD_NUM_ARGS;
@@ -1118,6 +1149,8 @@ void Parser::addCommands()
         addCommand("txatten", txatten, "[newTxAtten] -- get/set the TX attenuation in dB");
 	addCommand("freqcorr", freqcorr, "[newOffset] -- get/set the new radio frequency offset");
         addCommand("noise", noise, "-- report receive noise level in RSSI dB");
+	addCommand("gsmtap", gsmtap, "[reset] -- report the GSMTAP capture settings and counters, optionally starting the counters over");
+	addCommand("latency", latency, "[reset] -- report p50/p99/max burst latency per stage and timeslot in us, optionally starting a new interval");
         addCommand("reload", reload, "-- reload configuration from file");
 	addCommand("rmconfig", rmconfig, "key -- set a configuration value back to its default or remove a custom key/value pair");
 	addCommand("unconfig", unconfig, "key -- disable a configuration key by setting an empty value");
@@ -148,6 +148,41 @@ int DatagramSocket::write( const char * message, size_t length )
 	return retVal;
 }
 
+int DatagramSocket::write(const char * const * buffers, const size_t * lengths, unsigned count)
+{
+	unsigned sent = 0;
+#ifdef __linux__
+	const unsigned batch = 32;
+	struct mmsghdr msgs[batch];
+	struct iovec iovs[batch];
+	while (sent < count) {
+		unsigned n = count - sent;
+		if (n > batch) n = batch;
+		for (unsigned i=0; i<n; i++) {
+			assert(lengths[sent+i]<=MAX_UDP_LENGTH);
+			iovs[i].iov_base = (void*)buffers[sent+i];
+			iovs[i].iov_len = lengths[sent+i];
+			memset(&msgs[i],0,sizeof(msgs[i]));
+			msgs[i].msg_hdr.msg_name = mDestination;
+			msgs[i].msg_hdr.msg_namelen = addressSize();
+			msgs[i].msg_hdr.msg_iov = &iovs[i];
+			msgs[i].msg_hdr.msg_iovlen = 1;
+		}
+		int retVal = sendmmsg(mSocketFD, msgs, n, 0);
+		if (retVal <= 0) {
+			perror("DatagramSocket::write() failed");
+			break;
+		}
+		sent += retVal;
+	}
+#else
+	for ( ; sent<count; sent++) {
+		if (write(buffers[sent],lengths[sent]) < 0) break;
+	}
+#endif
+	return (sent || !count) ? (int)sent : -1;
+}
+
 int DatagramSocket::writeBack( const char * message, size_t length )
 {
 	assert(length<=MAX_UDP_LENGTH);
@@ -87,6 +87,15 @@ public:
 	*/
 	int write( const char * buffer);
 
+	/**
+		Send several binary packets to mDestination, in one system call where possible.
+		@param buffers The packets.
+		@param lengths Their lengths.
+		@param count Number of packets.
+		@return number of packets sent, or -1 on error.
+	*/
+	int write(const char * const * buffers, const size_t * lengths, unsigned count);
+
 	/**
 		Send a binary packet.
 		@param buffer The data bytes to send to mSource.
@@ -24,6 +24,7 @@
 
 #include <Logger.h>
 
+#include <sys/socket.h>
 #include <unistd.h>
 #include <errno.h>
 #include <stdlib.h>
@@ -31,7 +32,33 @@
 
 using namespace Connection;
 
+#define LOG_RING_MASK (LOG_RING_SIZE - 1)
+// Sleep interval of the writer when there is nothing to send
+#define WRITER_IDLE_US 5000
+// How long to wait on exit for the writer to send what is left in the ring
+#define WRITER_FLUSH_US 200000
+
 LogConnection* LogConnection::gSelf = 0;
+unsigned int (*LogConnection::gFrameNumber)() = 0;
+
+LogConnection::LogConnection(int fileDesc, unsigned char source)
+    : GenConnection(fileDesc),
+      mSource(source), mRing(0), mHead(0), mTail(0), mDropped(0), mWriting(false)
+{
+    if (!gSelf)
+	gSelf = this;
+}
+
+LogConnection::~LogConnection()
+{
+    if (gSelf == this)
+	gSelf = 0;
+    // The writer thread is never stopped, keep the ring
+    // Give it a chance to send the last records, often the reason of the exit
+    for (unsigned int t = 0; mWriting && valid() && mTail != mHead && t < WRITER_FLUSH_US;
+	t += WRITER_IDLE_US)
+	::usleep(WRITER_IDLE_US);
+}
 
 bool LogConnection::writeLog(unsigned char level, const char* text)
 {
@@ -50,6 +77,119 @@ bool LogConnection::writeLog(unsigned char level, const char* text)
     return ok;
 }
 
+// Put a log record in the ring, never blocks
+// This is a bounded multiple producers queue, each slot carries a sequence:
+//  slot free for position p: seq == p, filled: seq == p + 1
+bool LogConnection::queue(int level, const char* text)
+{
+    unsigned int pos = mHead;
+    Record* r = 0;
+    while (true) {
+	r = mRing + (pos & LOG_RING_MASK);
+	unsigned int seq = r->mSeq;
+	__sync_synchronize();
+	int diff = (int)(seq - pos);
+	if (!diff) {
+	    if (__sync_bool_compare_and_swap(&mHead,pos,pos + 1))
+		break;
+	}
+	else if (diff < 0) {
+	    // Full, the writer is behind
+	    __sync_fetch_and_add(&mDropped,1);
+	    return true;
+	}
+	pos = mHead;
+    }
+    r->mLen = fill(r->mData,level,text);
+    __sync_synchronize();
+    r->mSeq = pos + 1;
+    return true;
+}
+
+// Send a record right away, bypassing the ring
+bool LogConnection::sendRecord(int level, const char* text)
+{
+    unsigned char buf[LOG_RECORD_MAX];
+    return send(buf,fill(buf,level,text));
+}
+
+// Build a log record, return its length
+size_t LogConnection::fill(unsigned char* d, int level, const char* text)
+{
+    unsigned int fn = gFrameNumber ? gFrameNumber() : 0xffffffff;
+    d[0] = BTS_LOG_RECORD | (level & 0x07);
+    d[1] = mSource;
+    d[2] = (unsigned char)(fn >> 24);
+    d[3] = (unsigned char)(fn >> 16);
+    d[4] = (unsigned char)(fn >> 8);
+    d[5] = (unsigned char)fn;
+    d[6] = d[7] = 0;
+    size_t len = ::strlen(text);
+    if (len > LOG_RECORD_MAX - BTS_LOG_HEADER)
+	len = LOG_RECORD_MAX - BTS_LOG_HEADER;
+    ::memcpy(d + BTS_LOG_HEADER,text,len);
+    return BTS_LOG_HEADER + len;
+}
+
+// Send queued records, a single thread runs this
+void LogConnection::writer()
+{
+    while (valid()) {
+	Record* r = mRing + (mTail & LOG_RING_MASK);
+	unsigned int seq = r->mSeq;
+	__sync_synchronize();
+	if (seq != mTail + 1) {
+	    ::usleep(WRITER_IDLE_US);
+	    continue;
+	}
+	unsigned int dropped = __sync_lock_test_and_set(&mDropped,0);
+	if (dropped > 0xffff)
+	    dropped = 0xffff;
+	r->mData[6] = (unsigned char)(dropped >> 8);
+	r->mData[7] = (unsigned char)dropped;
+	while (true) {
+	    int fd = mSockFd;
+	    if (fd < 0)
+		return;
+	    if (::send(fd,r->mData,r->mLen,MSG_DONTWAIT) >= 0)
+		break;
+	    if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+		// Count it as dropped, don't stop the connection
+		__sync_fetch_and_add(&mDropped,1);
+		break;
+	    }
+	    // The reader is busy, keep the record and let the ring absorb the burst
+	    ::usleep(WRITER_IDLE_US);
+	}
+	__sync_synchronize();
+	r->mSeq = mTail + LOG_RING_SIZE;
+	mTail++;
+    }
+}
+
+bool LogConnection::startWriter()
+{
+    struct Local {
+	static void* runFunc(void* ptr) {
+	    static_cast<LogConnection*>(ptr)->writer();
+	    return 0;
+	}
+    };
+
+    if (mWriting)
+	return true;
+    if (!valid())
+	return false;
+    mRing = new Record[LOG_RING_SIZE];
+    for (unsigned int i = 0; i < LOG_RING_SIZE; i++)
+	mRing[i].mSeq = i;
+    mHead = mTail = 0;
+    mDropped = 0;
+    mWriteThread.start(Local::runFunc,this);
+    mWriting = true;
+    return true;
+}
+
 void LogConnection::process(const unsigned char* data, size_t len)
 {
     assert(false);
@@ -57,7 +197,16 @@ void LogConnection::process(const unsigned char* data, size_t len)
 
 bool LogConnection::hook(int level, const char* text, int offset)
 {
-    return self() && self()->write(level,text + offset);
+    LogConnection* conn = self();
+    if (!conn)
+	return false;
+    if (conn->mWriting) {
+	// Critical records are sent now, the process may be about to exit
+	if (level <= LOG_CRIT)
+	    return conn->sendRecord(level,text + offset);
+	return conn->queue(level,text + offset);
+    }
+    return conn->write(level,text + offset);
 }
 
 /* vi: set ts=8 sw=4 sts=4 noet: */
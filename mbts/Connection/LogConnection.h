@@ -27,23 +27,49 @@
 
 namespace Connection {
 
+#include "ybts.h"
+
+// Number of log records waiting to be sent, must be a power of 2
+#define LOG_RING_SIZE 256
+// Maximum length of a log record
+#define LOG_RECORD_MAX 1024
+
 class LogConnection : public GenConnection
 {
 public:
-    inline LogConnection(int fileDesc = -1)
-	: GenConnection(fileDesc)
-	{ if (!gSelf) gSelf = this; }
+    LogConnection(int fileDesc = -1, unsigned char source = LogSourceBts);
+    ~LogConnection();
     inline bool write(const char* text)
 	{ return writeLog(0xff,text); }
     inline bool write(unsigned char level, const char* text)
 	{ return writeLog(0x07 & level,text); }
+    // Start the thread sending queued log records
+    bool startWriter();
     inline static LogConnection* self()
 	{ return gSelf; }
     static bool hook(int level, const char* text, int offset);
+    // Function returning the current GSM frame number, put in log records
+    static unsigned int (*gFrameNumber)();
 private:
+    struct Record {
+	volatile unsigned int mSeq;
+	unsigned int mLen;
+	unsigned char mData[LOG_RECORD_MAX];
+    };
     virtual void process(const unsigned char* data, size_t len);
     bool writeLog(unsigned char level, const char* text);
+    bool queue(int level, const char* text);
+    bool sendRecord(int level, const char* text);
+    size_t fill(unsigned char* d, int level, const char* text);
+    void writer();
     static LogConnection* gSelf;
+    unsigned char mSource;
+    Record* mRing;
+    volatile unsigned int mHead;
+    volatile unsigned int mTail;
+    volatile unsigned int mDropped;
+    volatile bool mWriting;
+    Thread mWriteThread;
 };
 
 }; // namespace Connection
@@ -76,6 +76,38 @@ static void processPaging(const char* ident, uint8_t type)
 	LOG(ERR) << "received unknown Paging identity " << ident;
 }
 
+static void processPaging(const unsigned char* data, size_t len, uint8_t type)
+{
+    switch (data[0]) {
+	case PagingIdTMSI:
+	    if (len == 5) {
+		unsigned int tmsi = (((unsigned int)data[1]) << 24) | (((unsigned int)data[2]) << 16) |
+		    (((unsigned int)data[3]) << 8) | data[4];
+		L3MobileIdentity id(tmsi);
+		processPaging(id,type);
+		return;
+	    }
+	    break;
+	case PagingIdIMSI:
+	    if (len > 1 && len <= 16) {
+		char imsi[16];
+		::memcpy(imsi,data + 1,len - 1);
+		imsi[len - 1] = '\0';
+		L3MobileIdentity id(imsi);
+		processPaging(id,type);
+		return;
+	    }
+	    break;
+	default:
+	    // Text identity
+	    if (len >= 12) {
+		processPaging((const char*)data,type);
+		return;
+	    }
+    }
+    LOG(ERR) << "received invalid Paging identity of type " << (unsigned int)data[0] << " length " << len;
+}
+
 
 bool SigConnection::send(BtsPrimitive prim, unsigned char info)
 {
@@ -153,16 +185,10 @@ void SigConnection::process(BtsPrimitive prim, unsigned char info, const unsigne
 {
     switch (prim) {
 	case SigStartPaging:
-	    if (len >= 12)
-		processPaging((const char*)data,info);
-	    else
-		LOG(ERR) << "received short Start Paging of length " << len;
+	    processPaging(data,len,info);
 	    break;
 	case SigStopPaging:
-	    if (len >= 12)
-		processPaging((const char*)data,0xff);
-	    else
-		LOG(ERR) << "received short Stop Paging of length " << len;
+	    processPaging(data,len,0xff);
 	    break;
 	default:
 	    LOG(ERR) << "unexpected primitive " << prim << " with data";
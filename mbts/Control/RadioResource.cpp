@@ -647,23 +647,25 @@ unsigned Pager::pageAll()
 		// HACK -- So we send every page twice.
 		// That will probably mean a different Pager for each subchannel.
 		// See GSM 04.08 10.5.2.11 and GSM 05.02 6.5.2.
-		const L3MobileIdentity& id1 = lp->ID();
-		ChannelType type1 = lp->type();
+		// The IDs were encoded when added, so each request is packed
+		// from them directly, once for both copies.
+		const PagingEntry& entry1 = *lp;
 		++lp;
+		L3Frame *frame;
 		if (lp==mPageIDs.end()) {
 			// Just one ID left?
-			LOG(DEBUG) << "paging " << id1;
-			gBTS.getPCH(0)->send(L3PagingRequestType1(id1,type1));
-			gBTS.getPCH(0)->send(L3PagingRequestType1(id1,type1));
-			break;
+			LOG(DEBUG) << "paging " << entry1.ID();
+			frame = L3PagingRequestType1::frame(entry1.IDLV(),entry1.type());
+		} else {
+			// Page by pairs when possible.
+			const PagingEntry& entry2 = *lp;
+			++lp;
+			LOG(DEBUG) << "paging " << entry1.ID() << " and " << entry2.ID();
+			frame = L3PagingRequestType1::frame(entry1.IDLV(),entry1.type(),&entry2.IDLV(),entry2.type());
 		}
-		// Page by pairs when possible.
-		const L3MobileIdentity& id2 = lp->ID();
-		ChannelType type2 = lp->type();
-		++lp;
-		LOG(DEBUG) << "paging " << id1 << " and " << id2;
-		gBTS.getPCH(0)->send(L3PagingRequestType1(id1,type1,id2,type2));
-		gBTS.getPCH(0)->send(L3PagingRequestType1(id1,type1,id2,type2));
+		CCCHLogicalChannel *pch = gBTS.getPCH(0);
+		pch->send(new L3Frame(*frame));
+		pch->send(frame);
 	}
 
 	return mPageIDs.size();
@@ -107,6 +107,7 @@ class PagingEntry {
 	private:
 
 	GSM::L3MobileIdentity mID;		///< The mobile ID.
+	GSM::L3Frame mIDLV;				///< The mobile ID encoded as LV, for the pager.
 	GSM::ChannelType mType;			///< The needed channel type.
 	unsigned mTransactionID;		///< The associated transaction ID.
 	Timeval mExpiration;			///< The expiration time for this entry.
@@ -120,12 +121,16 @@ class PagingEntry {
 	*/
 	PagingEntry(const GSM::L3MobileIdentity& wID, GSM::ChannelType wType,
 			unsigned wTransactionID, unsigned wLife)
-		:mID(wID),mType(wType),mTransactionID(wTransactionID),mExpiration(wLife)
-	{}
+		:mID(wID),mIDLV(GSM::DATA,8*wID.lengthLV()),
+		mType(wType),mTransactionID(wTransactionID),mExpiration(wLife)
+	{ size_t wp=0; mID.writeLV(mIDLV,wp); }
 
 	/** Access the ID. */
 	const GSM::L3MobileIdentity& ID() const { return mID; }
 
+	/** Access the ID encoded as LV. */
+	const GSM::L3Frame& IDLV() const { return mIDLV; }
+
 	/** Access the channel type needed. */
 	GSM::ChannelType type() const { return mType; }
 
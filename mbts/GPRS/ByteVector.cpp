@@ -78,10 +78,12 @@ void ByteVector::init(size_t size)
 #if BYTEVECTOR_REFCNT
 		RN_MEMCHKNEW(ByteVectorData)
 		mData = new ByteType[size + mDataOffset];
+		gByteVectorStats.alloc(size);
 		setRefCnt(1);
 		mStart = mData + mDataOffset;
 #else
 		mData = new ByteType[size];
+		gByteVectorStats.alloc(size);
 		mStart = mData;
 #endif
 	}
@@ -96,6 +98,7 @@ void ByteVector::clone(const ByteVector &other)
 	clear();
 	init(other.size());
 	memcpy(mStart,other.mStart,other.size());
+	gByteVectorStats.copy(other.size());
 }
 
 // Make this a copy of other.
@@ -159,6 +162,7 @@ void ByteVector::setSegment(size_t start, ByteVector&other)
 	int othersize = other.size();
 	BVASSERT(mAllocEnd - base >= othersize);
 	memcpy(base,other.mStart,othersize);
+	gByteVectorStats.copy(othersize);
 	//if (mEnd - base < othersize) { mEnd = base + othersize; }	// Grow size() if necessary.
 	if (mSizeBits/8 < start+othersize) { mSizeBits = (start+othersize)*8; }
 }
@@ -174,6 +178,7 @@ void ByteVector::copyToSegment(ByteVector& other, size_t start, size_t span) con
 	//BVASSERT(mStart+span<=mEnd);
 	//BVASSERT(base+span<=other.mAllocEnd);
 	memcpy(base,mStart,span);
+	gByteVectorStats.copy(span);
 	//if (base+span > other.mEnd) { other.mEnd = base+span; }	// Increase other.size() if necessary.
 	if (other.size() < start+span) { other.mSizeBits = (start+span)*8; }
 }
@@ -188,6 +193,7 @@ void ByteVector::copyToSegment(ByteVector& other, size_t start /*=0*/) const
 void ByteVector::append(const ByteType *bytes, unsigned len)
 {
 	memcpy(&mStart[grow(len)],bytes,len);
+	gByteVectorStats.copy(len);
 }
 
 // Does change size().
@@ -208,6 +214,7 @@ void ByteVector::append(const ByteVector&other)
 void ByteVector::append(const BitVector&other)
 {
 	int othersizebits = other.size();
+	gByteVectorStats.copy((othersizebits+7)/8);
 	int bitindex = bitind();
 	if (bitindex) {
 		// Heck with it.  Optimize this if you want to use it.
@@ -546,6 +553,37 @@ bool ByteVector::eql(const ByteVector &other) const
 	//return true;
 }
 
+ByteVectorStats gByteVectorStats;
+
+void ByteVectorStats::reset()
+{
+	// The coders and the tunnel keep counting while the CLI resets
+	__sync_lock_test_and_set(&mAllocs,0);
+	__sync_lock_test_and_set(&mAllocBytes,0);
+	__sync_lock_test_and_set(&mCopies,0);
+	__sync_lock_test_and_set(&mCopyBytes,0);
+	__sync_lock_test_and_set(&mPackets,0);
+	__sync_lock_test_and_set(&mPacketBytes,0);
+	__sync_lock_test_and_set(&mBlocks,0);
+	__sync_lock_test_and_set(&mBitBlocks,0);
+}
+
+void ByteVectorStats::text(std::ostream &os) const
+{
+	unsigned long packets = mPackets;
+	os << "downlink packets=" << packets << " bytes=" << mPacketBytes << "\n";
+	os << "ByteVector allocs=" << mAllocs << " bytes=" << mAllocBytes << "\n";
+	os << "ByteVector copies=" << mCopies << " bytes=" << mCopyBytes << "\n";
+	os << "RLC blocks coded from bytes=" << mBlocks << " from BitVector=" << mBitBlocks << "\n";
+	if (packets) {
+		char buf[200];
+		snprintf(buf,sizeof(buf),"per packet: allocs=%.2f copies=%.2f copied bytes=%.1f of %.1f\n",
+			(double)mAllocs / packets,(double)mCopies / packets,
+			(double)mCopyBytes / packets,(double)mPacketBytes / packets);
+		os << buf;
+	}
+}
+
 #ifdef TEST
 void ByteVectorTest()
 {
@@ -220,6 +220,14 @@ class ByteVector //: public Vector<ByteType>
 	void setSegment(size_t start, ByteVector&other);
 
 	bool isOwner() { return !!mData; }	// Do we own any memory ourselves?
+	// Bytes of the allocated memory before begin(), that growLeft can reclaim.
+	size_t headroom() const {
+#if BYTEVECTOR_REFCNT
+		return mData ? mStart - (mData + mDataOffset) : 0;
+#else
+		return mData ? mStart - mData : 0;
+#endif
+	}
 
 	// Trim specified number of bytes from left or right in place.
 	// growLeft is the opposite: move the mStart backward by amt, throw error if no room.
@@ -379,4 +387,27 @@ class ByteVectorTemp : public ByteVector
 
 // Warning: C++ prefers an operator<< that is const to one that is not.
 std::ostream& operator<<(std::ostream&os, const ByteVector&vec);
+
+// Memory traffic of the packet data path, to measure what each downlink packet costs
+// between the tunnel read and the channel encoder.  The counters cover all ByteVectors,
+// signalling included, so they are meaningful while user data dominates.
+// Updated from the GGSN, SGSN and MAC threads with atomic adds.
+struct ByteVectorStats {
+	volatile unsigned long mAllocs;		// ByteVector memory allocations
+	volatile unsigned long mAllocBytes;
+	volatile unsigned long mCopies;		// Copies of data into a ByteVector
+	volatile unsigned long mCopyBytes;
+	volatile unsigned long mPackets;	// Downlink packets read from the tunnel
+	volatile unsigned long mPacketBytes;
+	volatile unsigned long mBlocks;		// RLC blocks channel coded from packed bytes
+	volatile unsigned long mBitBlocks;	// RLC blocks that went through a BitVector first
+	ByteVectorStats() { reset(); }
+	void alloc(unsigned bytes) { __sync_fetch_and_add(&mAllocs,1); __sync_fetch_and_add(&mAllocBytes,bytes); }
+	void copy(unsigned bytes) { __sync_fetch_and_add(&mCopies,1); __sync_fetch_and_add(&mCopyBytes,bytes); }
+	void packet(unsigned bytes) { __sync_fetch_and_add(&mPackets,1); __sync_fetch_and_add(&mPacketBytes,bytes); }
+	void block(bool packed) { __sync_fetch_and_add(packed ? &mBlocks : &mBitBlocks,1); }
+	void reset();
+	void text(std::ostream &os) const;
+};
+extern ByteVectorStats gByteVectorStats;
 #endif
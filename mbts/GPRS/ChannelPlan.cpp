@@ -0,0 +1,72 @@
+/**
+ * ChannelPlan.cpp
+ * This file is part of the Yate-BTS Project http://www.yatebts.com
+ *
+ * Dynamic PDCH allocation for the GPRS MAC
+ *
+ * Yet Another Telephony Engine - Base Transceiver Station
+ * Copyright (C) 2014 Null Team Impex SRL
+ * Copyright (C) 2014 Legba, Inc
+ *
+ * This software is distributed under multiple licenses;
+ * see the COPYING file in the main directory for licensing
+ * information for this specific distribution.
+ *
+ * This use of this software may be subject to additional restrictions.
+ * See the LEGAL file in the main directory for details.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#include "ChannelPlan.h"
+#include <math.h>
+
+namespace GPRS {
+
+void LoadForecast::sample(double value, double tau)
+{
+	if (!mStarted) {
+		mLevel = value;
+		mTrend = 0;
+		mStarted = true;
+		return;
+	}
+	double alpha = tau > 1 ? 1.0 / tau : 1.0;
+	double last = mLevel;
+	mLevel = alpha * value + (1 - alpha) * (mLevel + mTrend);
+	mTrend = alpha * (mLevel - last) + (1 - alpha) * mTrend;
+}
+
+double LoadForecast::predict(double ahead) const
+{
+	double load = mLevel + ahead * mTrend;
+	return load > 0 ? load : 0;
+}
+
+unsigned ChannelPlan::target()
+{
+	unsigned max = mMax > mMin ? mMax : mMin;
+	unsigned floor = mMin ? mMin : (mBusy ? 1 : 0);
+	if (floor > max) { floor = max; }
+
+	// Enough channels that none carries more than mPerChannel.
+	unsigned want = mPerChannel > 0 ? (unsigned)ceil(mData / mPerChannel) : mActive;
+	// Above the minimum add whole multislot groups, so that there are adjacent
+	// timeslots for the multislot MS before the load that needs them arrives.
+	if (want > mMin && mChunk > 1) { want = mMin + (want - mMin + mChunk - 1) / mChunk * mChunk; }
+	if (want > max) { want = max; }
+	if (want < floor) { want = floor; }
+
+	// Leave the TCHs the voice forecast needs, giving channels back before calls are blocked.
+	mVoiceLimited = false;
+	int voicemax = (int)(mActive + mVoiceTotal) - (int)ceil(mVoice) - (int)mVoiceReserve;
+	if ((int)want > voicemax) {
+		want = voicemax > (int)floor ? voicemax : floor;
+		mVoiceLimited = want < mActive;
+	}
+	return want;
+}
+
+}; // namespace GPRS
@@ -0,0 +1,66 @@
+/**
+ * ChannelPlan.h
+ * This file is part of the Yate-BTS Project http://www.yatebts.com
+ *
+ * Dynamic PDCH allocation for the GPRS MAC
+ *
+ * Yet Another Telephony Engine - Base Transceiver Station
+ * Copyright (C) 2014 Null Team Impex SRL
+ * Copyright (C) 2014 Legba, Inc
+ *
+ * This software is distributed under multiple licenses;
+ * see the COPYING file in the main directory for licensing
+ * information for this specific distribution.
+ *
+ * This use of this software may be subject to additional restrictions.
+ * See the LEGAL file in the main directory for details.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#ifndef GPRSCHANNELPLAN_H
+#define GPRSCHANNELPLAN_H
+
+// Decides how many GSM channels GPRS should hold, see L2MAC::macPlanChannels.
+// Like Scheduler.h this does not depend on the rest of the MAC.
+namespace GPRS {
+
+// Forecast of a load sampled at a regular period, by double exponential
+// smoothing (Holt): a smoothed level plus a smoothed trend, so a load rising
+// toward the busy hour is seen coming rather than reacted to.
+class LoadForecast {
+	double mLevel;
+	double mTrend;		// Per sample
+	bool mStarted;
+	public:
+	LoadForecast() : mLevel(0), mTrend(0), mStarted(false) {}
+	// Add a sample; tau is the smoothing time constant, in samples.
+	void sample(double value, double tau);
+	double level() const { return mLevel; }
+	double trend() const { return mTrend; }
+	// The load expected ahead samples from now, not below zero.
+	double predict(double ahead) const;
+};
+
+// The number of PDCHs wanted for the forecast data and voice loads.
+struct ChannelPlan {
+	unsigned mActive;	// PDCHs now.
+	unsigned mMin;		// GPRS.Channels.Min.C0 + GPRS.Channels.Min.CN
+	unsigned mMax;		// GPRS.Channels.Max, not below mMin.
+	unsigned mChunk;	// Multislot group size; channels above mMin are added in groups of it.
+	double mData;		// Forecast downlink utilization, see L2MAC::macComputeUtilization.
+	double mPerChannel;	// Utilization one PDCH may carry, GPRS.Channels.Congestion.Threshold.
+	bool mBusy;		// There are TBFs, so at least one channel is needed.
+	unsigned mVoiceTotal;	// TCHs not used by GPRS.
+	double mVoice;		// Forecast busy TCHs.
+	unsigned mVoiceReserve;	// TCHs kept free for voice beyond the forecast.
+	bool mVoiceLimited;	// Result: the target was cut below mActive to leave TCHs for voice.
+	ChannelPlan() : mActive(0), mMin(0), mMax(0), mChunk(1), mData(0), mPerChannel(1),
+		mBusy(false), mVoiceTotal(0), mVoice(0), mVoiceReserve(0), mVoiceLimited(false) {}
+	unsigned target();
+};
+
+}; // namespace GPRS
+#endif
@@ -0,0 +1,147 @@
+/**
+ * ChannelPlanTest.cpp
+ * This file is part of the Yate-BTS Project http://www.yatebts.com
+ *
+ * Test of the GPRS dynamic channel allocation decisions
+ *
+ * Yet Another Telephony Engine - Base Transceiver Station
+ * Copyright (C) 2014 Null Team Impex SRL
+ * Copyright (C) 2014 Legba, Inc
+ *
+ * This software is distributed under multiple licenses;
+ * see the COPYING file in the main directory for licensing
+ * information for this specific distribution.
+ *
+ * This use of this software may be subject to additional restrictions.
+ * See the LEGAL file in the main directory for details.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+/*
+	Checks ChannelPlan::target on the cases L2MAC::macPlanChannels meets:
+	the GPRS.Channels.Min floor and GPRS.Channels.Max ceiling, one channel
+	for TBFs when there is no minimum, whole multislot groups above the
+	minimum, and the TCHs left for the voice forecast, with mVoiceLimited
+	only set when voice is what cut the channels.
+	Then feeds LoadForecast a load ramping up like the busy hour, a flat
+	one and one falling away, sampled once a second like macPlanChannels,
+	and checks the forecast ahead follows each of them.
+	Failed cases are printed, all of them with -v; the return code is the
+	number that failed.
+*/
+
+#include "ChannelPlan.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <math.h>
+
+using namespace GPRS;
+
+static bool sVerbose = false;
+static double sTau = 30;	// GPRS.Channels.Smoothing
+static double sAhead = 60;	// GPRS.Channels.Forecast
+
+struct PlanCase {
+	const char *mName;
+	unsigned mActive, mMin, mMax, mChunk;
+	double mData, mPerChannel;
+	bool mBusy;
+	unsigned mVoiceTotal;
+	double mVoice;
+	unsigned mVoiceReserve;
+	// Expected
+	unsigned mTarget;
+	bool mVoiceLimited;
+};
+
+static const PlanCase sCases[] = {
+	// name				act min max chk data  per   busy  vtot voice res  target limited
+	{ "idle, no minimum",		0,  0,  4,  1,  0,    0.8,  false, 6,  0,   0,   0, false },
+	{ "TBFs, no minimum",		0,  0,  4,  1,  0,    0.8,  true,  6,  0,   0,   1, false },
+	{ "idle, minimum",		2,  2,  4,  1,  0,    0.8,  false, 6,  0,   0,   2, false },
+	{ "load over threshold",	1,  0,  8,  1,  2.5,  1,    true,  7,  0,   0,   3, false },
+	{ "load at threshold",		1,  0,  8,  1,  3,    1,    true,  7,  0,   0,   3, false },
+	{ "multislot groups",		1,  1,  8,  4,  2.5,  1,    true,  7,  0,   0,   5, false },
+	{ "group up to maximum",	1,  1,  4,  4,  2.5,  1,    true,  7,  0,   0,   4, false },
+	{ "maximum below minimum",	2,  2,  1,  1,  5,    1,    true,  6,  0,   0,   2, false },
+	{ "no threshold",		3,  0,  8,  1,  5,    0,    true,  5,  0,   0,   3, false },
+	{ "voice forecast",		4,  0,  8,  1,  4,    1,    true,  4,  3.2, 1,   3, true  },
+	{ "voice down to minimum",	4,  2,  8,  1,  4,    1,    true,  4,  4,   2,   2, true  },
+	{ "voice down to one",		2,  0,  8,  1,  4,    1,    true,  2,  3,   0,   1, true  },
+	{ "voice fits",			4,  0,  8,  1,  4,    1,    true,  4,  2,   1,   4, false },
+	{ "low load, voice busy",	4,  0,  8,  1,  1,    1,    true,  4,  3,   0,   1, false },
+	{ "voice blocks growth",	2,  0,  8,  1,  6,    1,    true,  4,  3,   1,   2, false },
+};
+
+static unsigned testPlan()
+{
+	unsigned failed = 0;
+	for (unsigned i = 0; i < sizeof(sCases)/sizeof(sCases[0]); i++) {
+		const PlanCase &c = sCases[i];
+		ChannelPlan plan;
+		plan.mActive = c.mActive;
+		plan.mMin = c.mMin;
+		plan.mMax = c.mMax;
+		plan.mChunk = c.mChunk;
+		plan.mData = c.mData;
+		plan.mPerChannel = c.mPerChannel;
+		plan.mBusy = c.mBusy;
+		plan.mVoiceTotal = c.mVoiceTotal;
+		plan.mVoice = c.mVoice;
+		plan.mVoiceReserve = c.mVoiceReserve;
+		unsigned target = plan.target();
+		bool ok = (target == c.mTarget && plan.mVoiceLimited == c.mVoiceLimited);
+		if (!ok) { failed++; }
+		if (!ok || sVerbose) {
+			printf("%-24s target %u limited %d, expected %u %d%s\n",c.mName,target,plan.mVoiceLimited,
+				c.mTarget,c.mVoiceLimited,ok ? "" : "  FAILED");
+		}
+	}
+	printf("ChannelPlan::target %u cases, %u failed\n",(unsigned)(sizeof(sCases)/sizeof(sCases[0])),failed);
+	return failed;
+}
+
+// Sample load(t) for the given seconds and compare the forecast with load(t + sAhead).
+static unsigned testForecast(const char *name, double start, double slope, unsigned seconds)
+{
+	LoadForecast fc;
+	for (unsigned t = 0; t < seconds; t++) {
+		fc.sample(start + slope * t,sTau);
+	}
+	double want = start + slope * (seconds - 1 + sAhead);
+	if (want < 0) { want = 0; }
+	double got = fc.predict(sAhead);
+	// Holt smoothing follows a linear ramp without lag once it settled.
+	bool ok = fabs(got - want) <= 0.01 + 0.02 * fabs(want);
+	printf("LoadForecast %-10s level %.3f trend %+.5f ahead %.3f, expected %.3f%s\n",name,fc.level(),
+		fc.trend(),got,want,ok ? "" : "  FAILED");
+	return ok ? 0 : 1;
+}
+
+int main(int argc, char **argv)
+{
+	int opt;
+	while ((opt = getopt(argc,argv,"t:a:vh")) != -1) {
+		switch (opt) {
+		case 't': sTau = atof(optarg); break;
+		case 'a': sAhead = atof(optarg); break;
+		case 'v': sVerbose = true; break;
+		default:
+			printf("usage: %s [-t smoothing] [-a ahead] [-v]\n",argv[0]);
+			return 1;
+		}
+	}
+
+	unsigned failed = testPlan();
+	// Utilization from idle to three busy channels in half an hour.
+	failed += testForecast("busy hour",0,3.0 / 1800,1800);
+	failed += testForecast("flat",1.5,0,600);
+	failed += testForecast("falling",2,-2.0 / 600,1200);
+	printf("%s\n",failed ? "FAILED" : "passed");
+	return failed;
+}
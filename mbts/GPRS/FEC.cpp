@@ -20,6 +20,7 @@
 #include "FEC.h"
 #include "GSMTAPDump.h"
 #include "../TransceiverRAD1/Transceiver.h"	// For Transceiver::IGPRS
+#include <algorithm>
 #define FEC_DEBUG 0
 
 namespace GPRS {
@@ -208,7 +209,7 @@ void PDCHL1Downlink::transmit(RLCBSN_t bsn, BitVector *mI, const int *qbits, int
 		mchBurst.Hu(qbits[qi++]);
 		// Send it to the radio.
 		//OBJLOG(DEBUG) << "transmit mchBurst=" << mchBurst;
-		if (gConfig.getBool("Control.GSMTAP.GPRS")) {
+		if (gGSMTAP.gprs()) {
 			// Send to GSMTAP.
 			gWriteGSMTAP(ARFCN(),TN(),gBSNNext.FN(),
 					TDMA_PDCH,
@@ -244,7 +245,7 @@ static GSM::TypeAndOffset frame2GsmTapType(BitVector &frame)
 
 void PDCHL1Downlink::send1Frame(BitVector& frame,ChannelCodingType encoding, bool idle)
 {
-	if (!idle && gConfig.getBool("Control.GSMTAP.GPRS")) {
+	if (!idle && gGSMTAP.gprs()) {
 		// Send to GSMTAP.
 		gWriteGSMTAP(ARFCN(),TN(),gBSNNext.FN(),
 				frame2GsmTapType(frame),
@@ -253,13 +254,44 @@ void PDCHL1Downlink::send1Frame(BitVector& frame,ChannelCodingType encoding, boo
 				frame);	// The data.
 	}
 
+	// The channel coders take packed bytes.
+	ByteType bytes[RLCBlockSizeBytesMax+1];
+	devassert(frame.size() <= 8*sizeof(bytes));
+	frame.pack(bytes);
+	gByteVectorStats.block(false);
+	send1Frame(bytes,encoding);
+}
+
+void PDCHL1Downlink::send1Frame(const ByteType *frame,ChannelCodingType encoding)
+{
+	if (gCodingPool.deferring()) {
+		// A second block in the same service loop; send the first one now to keep the order.
+		if (mchPending) { encodePending(); }
+		memcpy(mchPendingFrame,frame,RLCBlockSizeBytesMax);
+		mchPendingCoding = encoding;
+		mchPendingBSN = gBSNNext;
+		mchPending = true;
+		return;
+	}
+	encodeFrame(frame,encoding,gBSNNext);
+}
+
+void PDCHL1Downlink::encodePending()
+{
+	if (!mchPending) { return; }
+	mchPending = false;
+	encodeFrame(mchPendingFrame,mchPendingCoding,mchPendingBSN);
+}
+
+void PDCHL1Downlink::encodeFrame(const ByteType *frame,ChannelCodingType encoding, RLCBSN_t bsn)
+{
 	switch (encoding) {
 	case ChannelCodingCS1:
 		// Process the 184 bit (23 byte) frame, leave result in mI.
 		//mchCS1Enc.encodeFrame41(frame,0);
 		//transmit(gBSNNext,mchCS1Enc.mI,qCS1,0);
 		mchEnc.encodeCS1(frame);
-		transmit(gBSNNext,mchEnc.mI,qCS1,0);
+		transmit(bsn,mchEnc.mI,qCS1,0);
 		break;
 	case ChannelCodingCS4:
 		//std::cout << "WARNING: Using CS4\n";
@@ -268,7 +300,7 @@ void PDCHL1Downlink::send1Frame(BitVector& frame,ChannelCodingType encoding, boo
 		//mchCS4Enc.encodeCS4(frame);	// Result left in mI[].
 		//transmit(gBSNNext,mchCS4Enc.mI,qCS4,0);
 		mchEnc.encodeCS4(frame);	// Result left in mI[].
-		transmit(gBSNNext,mchEnc.mI,qCS4,0);
+		transmit(bsn,mchEnc.mI,qCS4,0);
 		break;
 	default:
 		LOG(ERR) << "unrecognized GPRS channel coding " << (int)encoding;
@@ -276,6 +308,71 @@ void PDCHL1Downlink::send1Frame(BitVector& frame,ChannelCodingType encoding, boo
 	}
 }
 
+PDCHCodingPool gCodingPool;
+
+void PDCHCodingPool::setThreads(unsigned count)
+{
+	while (mThreads < count) {
+		Thread *thread = new Thread();
+		thread->start(workerFunc,this);
+		mThreads++;
+	}
+}
+
+void *PDCHCodingPool::workerFunc(void *arg)
+{
+	PDCHCodingPool *pool = (PDCHCodingPool*)arg;
+	while (true) {
+		{
+			ScopedLock lock(pool->mLock);
+			while (pool->mNext >= pool->mJobs.size()) { pool->mWork.wait(pool->mLock); }
+		}
+		pool->work();
+	}
+	return NULL;
+}
+
+// Take jobs until there are none left.
+void PDCHCodingPool::work()
+{
+	while (true) {
+		PDCHL1Downlink *job;
+		{
+			ScopedLock lock(mLock);
+			if (mNext >= mJobs.size()) { return; }
+			job = mJobs[mNext++];
+		}
+		job->encodePending();
+		ScopedLock lock(mLock);
+		if (--mUnfinished == 0) { mDone.signal(); }
+	}
+}
+
+// Called by the MAC thread after the downlink service of every PDCH.
+void PDCHCodingPool::run()
+{
+	std::vector<PDCHL1Downlink*> jobs;
+	PDCHL1FEC *pdch;
+	RN_MAC_FOR_ALL_PDCH(pdch) {
+		if (pdch->downlink()->hasPending()) { jobs.push_back(pdch->downlink()); }
+	}
+	if (jobs.size() <= 1) {
+		if (jobs.size()) { jobs[0]->encodePending(); }
+		return;
+	}
+	{
+		ScopedLock lock(mLock);
+		mJobs.swap(jobs);
+		mNext = 0;
+		mUnfinished = mJobs.size();
+		mWork.broadcast();
+	}
+	work();
+	// The barrier: nothing in the next service loop may touch these PDCHs before they are sent.
+	ScopedLock lock(mLock);
+	while (mUnfinished) { mDone.wait(mLock); }
+}
+
 
 // Return true if we send a block on the downlink.
 bool PDCHL1Downlink::send1DataFrame(
@@ -297,6 +394,16 @@ bool PDCHL1Downlink::send1DataFrame(
 
 	tbf->talkedDown();
 
+	if (!(GPRSDebug & 1) && !FEC_DEBUG && !gGSMTAP.gprs()) {
+		// Nobody wants to see the bits, so the block goes to the coder as packed bytes,
+		// the payload straight from the TBF pdu.
+		ByteType frame[RLCBlockSizeBytesMax];
+		block->pack(frame);
+		gByteVectorStats.block(true);
+		send1Frame(frame,block->mChannelCoding);
+		return true;
+	}
+
 	BitVector tobits = block->getBitVector(); // tobits deallocated when this function exits.
 	if (block->mChannelCoding == 0) { devassert(tobits.size() == 184); }
 	if (GPRSDebug & 1) {
@@ -352,9 +459,11 @@ void PDCHL1Downlink::sendIdleFrame(RLCBSN_t bsn)
 	BitVector tobits(RLCBlockSizeInBits[ChannelCodingCS1]);
 	msg->write(tobits);
 	delete msg;
+	ByteType bytes[RLCBlockSizeBytesMax];
+	tobits.pack(bytes);
 	//mchCS1Enc.encodeFrame41(tobits,0);
 	//transmit(bsn,mchCS1Enc.mI,qCS1,Transceiver::SET_FILLER_FRAME);
-	mchEnc.encodeCS1(tobits);
+	mchEnc.encodeCS1(bytes);
 	transmit(bsn,mchEnc.mI,qCS1,Transceiver::SET_FILLER_FRAME);
 }
 
@@ -516,22 +625,33 @@ bool GprsDecoder::decodeCS4()
 	return (syndrome==0);
 }
 
-// Process the 184 bit frame, starting at offset, add parity, encode.
+// Unpack bytes into the bit per byte form of the coders, each byte least significant
+// bit first.  This is unpack followed by LSB8MSB, the order GSM 05.03 numbers the bits
+// of the RLC/MAC block in, without going through another BitVector.
+static void unpackLSB8(const ByteType *src, unsigned bytes, BitVector &dst)
+{
+	char *out = dst.begin();
+	for (unsigned i = 0; i < bytes; i++) {
+		unsigned byte = src[i];
+		for (unsigned bit = 0; bit < 8; bit++) { *out++ = (byte >> bit) & 1; }
+	}
+}
+
+// Process the 184 bit frame, add parity, encode.
 // Result is left in mI, representing 4 radio bursts.
-void GprsEncoder::encodeCS1(const BitVector &src)
+void GprsEncoder::encodeCS1(const ByteType *src)
 {
-	encodeFrame41(src,0);
+	unpackLSB8(src,23,mD);
+	encode41();
+	interleave41();
 }
 
 static BitVector mCcopy;
-void GprsEncoder::encodeCS4(const BitVector &src)
+void GprsEncoder::encodeCS4(const ByteType *src)
 {
-	//if (sFecDebug) GPRSLOG(1) <<"encodeCS4 src\n"<<src;
-	src.copyToSegment(mD_CS4,0,53*8);
-	//if (sFecDebug) GPRSLOG(1) <<"encodeCS4 mD_CS4\n"<<mD_CS4;
+	unpackLSB8(src,53,mD_CS4);
 	// mC.zero();	// DEBUG TEST!!  Did not help.
 	mD_CS4.fillField(53*8,0,7);		// zero out 7 spare bits.
-	mD_CS4.LSB8MSB();	// Ignores the last incomplete byte of 7 zero bits.
 	//if (sFecDebug) GPRSLOG(1) <<"mC before parity\n"<<mC;
 	// Parity is computed on original D before doing the USF translation above.
 	mBlockCoder_CS4.writeParityWord(mD_CS4,mP_CS4);
@@ -684,7 +804,7 @@ void PDCHL1Uplink::writeLowSideRx(const RxBurst &inBurst)
 			countGoodFrame();
 
 			// The four frame radio block has been decoded and is in mD.
-			if (gConfig.getBool("Control.GSMTAP.GPRS")) {
+			if (gGSMTAP.gprs()) {
 				// Send to GSMTAP.  Untested.
 				gWriteGSMTAP(ARFCN(),TN(),gBSNNext.FN(), //GSM::TDMA_PACCH,
 						frame2GsmTapType(*result),
@@ -740,6 +860,17 @@ void PDCHL1Downlink::mchResync()
 #endif
 
 
+// A TBF that can use a downlink block, with its scheduler priority.
+struct SchedEntry {
+	double mPriority;
+	double mRate;
+	TBFList_t::iterator mItr;	// In gL2MAC.macTBFs
+	SchedEntry(double priority, double rate, TBFList_t::iterator itr) :
+		mPriority(priority), mRate(rate), mItr(itr) {}
+	// Sorts the highest priority first.
+	bool operator<(const SchedEntry &other) const { return mPriority > other.mPriority; }
+};
+
 // Dispatch an RLC block on this downlink.
 // This must run once for every Radio Block (4 TDMA frames or so) sent.
 // It should be kept only as far enough ahead of the physical layer so that it never stalls.
@@ -781,10 +912,9 @@ void PDCHL1Downlink::dlService()
 	// Look for a data block to send.
 	// We did not queue these up in advance because the data that the engine
 	// wants to send may change every time it receives an ack/nack message.
-	//TBFList_t &list = gL2MAC.macTBFs;
-	//TBFList_t::iterator itr = list.begin(), e = list.end();
-	//for ( ; itr != e; itr++) {
-		//TBF *tbf = *itr;
+	// The TBFs that can use this downlink are offered the block in the order
+	// of gL2MAC.macScheduler; equal priorities keep the macTBFs list order.
+	std::vector<SchedEntry> cands;
 	TBF *tbf;
 	TBFList_t::iterator itr;
 	for (RListIterator<TBF*> itrl(gL2MAC.macTBFs); itrl.next(tbf,itr); ) {
@@ -794,12 +924,22 @@ void PDCHL1Downlink::dlService()
 				<< " can not use downlink:"<<this->parent();
 			continue;
 		}
+		SchedCandidate cand = tbf->mtSchedCandidate(gBSNNext);
+		cands.push_back(SchedEntry(gL2MAC.macScheduler->priority(cand),cand.mRate,itr));
+	}
+	std::stable_sort(cands.begin(),cands.end());
+
+	for (std::vector<SchedEntry>::iterator it = cands.begin(); it != cands.end(); it++) {
+		itr = it->mItr;
+		tbf = *itr;
 		TBFState::type oldstate = tbf->mtGetState();
 
 		if (tbf->mtServiceDownlink(this)) {
 			GPRSLOG(2) <<"dlService"<<tbf<<LOGVAR(oldstate)<<" state="<<tbf->mtGetState()
 				<<" reqch:"<<tbf->mtMS->msPacch
-				<<" using ch:"<<this->parent();
+				<<" using ch:"<<this->parent()
+				<<" priority:"<<it->mPriority;
+			tbf->mtSched.served(gBSNNext,gL2MAC.macSchedWindow,it->mRate);
 			// Move this tbf to end of the list so we may service someone else next time.
 			// TODO: If the tbf is using extended dynamic uplink, all ganged
 			// uplink channels are reserved at once, and so we are not sharing
@@ -25,6 +25,7 @@
 #include <GSMTransfer.h>	// for TxBurst
 #include <GSMLogicalChannel.h> // for TCHFACCHLogicalChannel
 #include "MAC.h"
+#include <vector>
 using namespace GSM;
 namespace GPRS {
 class TBF;
@@ -167,8 +168,9 @@ class GprsEncoder : public SharedL1Encoder
 		mU_CS4(mC.segment(0,12)),
 		mD_CS4(mC.segment(12-3,431))
 		{}
-	void encodeCS4(const BitVector&src);
-	void encodeCS1(const BitVector &src);
+	// The blocks are packed bytes: 53 for CS-4, 23 for CS-1.
+	void encodeCS4(const ByteType *src);
+	void encodeCS1(const ByteType *src);
 };
 
 
@@ -236,6 +238,13 @@ class PDCHL1Downlink : public PDCHCommon
 	const TDMAMapping& mchMapping;
 	BitVector mchIdleFrame;
 
+	// A block chosen by the service loop whose channel coding was deferred to gCodingPool.
+	ByteType mchPendingFrame[RLCBlockSizeBytesMax];
+	ChannelCodingType mchPendingCoding;
+	RLCBSN_t mchPendingBSN;
+	bool mchPending;
+	void encodeFrame(const ByteType *frame,ChannelCodingType encoding, RLCBSN_t bsn);
+
 	// The mDownlinkData is used only for control messages, which can stack up.
 	//InterthreadQueue<RLCDownlinkMessage> mchDownlinkMsgQ;
 
@@ -251,7 +260,9 @@ class PDCHL1Downlink : public PDCHCommon
 #endif
 		mchTotalBursts(0),
 		mchMapping(wParent->mchOldFec->encoder()->mapping()),
-		mchIdleFrame((size_t)0)
+		mchIdleFrame((size_t)0),
+		mchPendingCoding(ChannelCodingCS1),
+		mchPending(false)
 	{
 	 	initBursts(wParent->mchOldFec);
 	}
@@ -270,11 +281,41 @@ class PDCHL1Downlink : public PDCHCommon
 
 	// Send the L2Frame down to the radio now.
 	void send1Frame(BitVector& frame,ChannelCodingType encoding, bool idle);
+	void send1Frame(const ByteType *frame,ChannelCodingType encoding);
 	bool send1DataFrame(RLCDownEngine *tbfdown, RLCDownlinkDataBlock *block, int makeres,MsgTransactionType mttype,unsigned *pcounter);
 	bool send1MsgFrame(TBF *tbf,RLCDownlinkMessage *msg, int makeres, MsgTransactionType mttype,unsigned *pcounter);
 	void sendIdleFrame(RLCBSN_t bsn);
 	void bugFixIdleFrame();
+	// Code and transmit the deferred block, if any.
+	bool hasPending() const { return mchPending; }
+	void encodePending();
+};
+
+// The channel coding and burst formatting of the downlink blocks is the
+// only per PDCH work of the service loop that does not touch the MS and TBF
+// state shared between channels, so that is what is split across threads.
+// The service loop picks the blocks of every PDCH as before, then run()
+// codes them on the worker threads and the MAC thread, and returns when all
+// of them went to the radio.  With no workers the blocks are coded in line.
+class PDCHCodingPool
+{
+	Mutex mLock;
+	Signal mWork;
+	Signal mDone;
+	std::vector<PDCHL1Downlink*> mJobs;
+	unsigned mNext;		// Next job to take.
+	unsigned mUnfinished;	// Jobs not coded yet.
+	unsigned mThreads;	// Only changed by the MAC thread.
+	void work();
+	static void *workerFunc(void *arg);
+	public:
+	PDCHCodingPool() : mNext(0), mUnfinished(0), mThreads(0) {}
+	bool deferring() const { return mThreads > 0; }
+	// Start workers up to this number; they are never stopped.
+	void setThreads(unsigned count);
+	void run();
 };
+extern PDCHCodingPool gCodingPool;
 
 extern bool chCompareFunc(PDCHCommon*ch1, PDCHCommon*ch2);
 
@@ -0,0 +1,175 @@
+/**
+ * FECTest.cpp
+ * This file is part of the Yate-BTS Project http://www.yatebts.com
+ *
+ * Test of the GPRS downlink channel coding from packed bytes
+ *
+ * Yet Another Telephony Engine - Base Transceiver Station
+ * Copyright (C) 2014 Null Team Impex SRL
+ * Copyright (C) 2014 Legba, Inc
+ *
+ * This software is distributed under multiple licenses;
+ * see the COPYING file in the main directory for licensing
+ * information for this specific distribution.
+ *
+ * This use of this software may be subject to additional restrictions.
+ * See the LEGAL file in the main directory for details.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+/*
+	Checks the packed byte path of the downlink data blocks against the
+	BitVector path it replaced, on random blocks.
+	RLCDownlinkDataBlock::pack must give the bytes of getBitVector.
+	GprsEncoder::encodeCS1 on the packed block must give the bursts of
+	SharedL1Encoder::encodeFrame41 on the BitVector.
+	GprsEncoder::encodeCS4 on the packed block must give the coder input,
+	USF code, parity and bursts of the BitVector code it replaced, which
+	is kept here as the reference.
+	Each block that differs is printed, all of them with -v; the return
+	code is the number that differed.
+*/
+
+#include "GPRSInternal.h"
+#include "RLCMessages.h"
+#include "FEC.h"
+
+#include <Configuration.h>
+#include <Reporting.h>
+#include <TRXManager.h>
+#include <GSMConfig.h>
+#include <PhysicalStatus.h>
+#include <NeighborTable.h>
+#include <SigConnection.h>
+#include <MediaConnection.h>
+#include <ConnectionMap.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+using namespace GPRS;
+
+// The globals of mbts the coders drag in through the libraries, none of them is used.
+// An empty configuration, the mbts schema gives the defaults their constructors read.
+ConfigurationTable gConfig("/dev/null","FECTest",getConfigurationKeys());
+ReportingTable gReports(":memory:");
+GSM::PhysicalStatus gPhysStatus;
+GSM::GSMConfig gBTS;
+// No ARFCNs, the clock socket takes any free port.
+TransceiverManager gTRX(0,"127.0.0.1",-100);
+Peering::NeighborTable gNeighborTable;
+Connection::SigConnection gSigConn;
+Connection::MediaConnection gMediaConn;
+Connection::ConnectionMap gConnMap;
+
+static unsigned sBlocks = 2000;	// Random blocks for each coding scheme
+static bool sVerbose = false;
+
+static unsigned rnd(unsigned n) { return (unsigned)random() % n; }
+
+// GprsEncoder::encodeCS4 as it was before it took packed bytes.
+class ReferenceEncoder : public GprsEncoder
+{
+	Parity mParity;
+	public:
+	ReferenceEncoder() : mParity(sCS4Generator,16,431+16) {}
+	void encodeCS4(const BitVector &src) {
+		src.copyToSegment(mD_CS4,0,53*8);
+		mD_CS4.fillField(53*8,0,7);		// zero out 7 spare bits.
+		mD_CS4.LSB8MSB();	// Ignores the last incomplete byte of 7 zero bits.
+		mParity.writeParityWord(mD_CS4,mP_CS4);
+		int reverseUsf = mD_CS4.peekField(0,3);
+		mU_CS4.fillField(0,GPRS::GPRSUSFEncoding[reverseUsf],12);
+		interleave41();
+	}
+};
+
+static bool sameBits(const BitVector &a, const BitVector &b)
+{
+	return a.size() == b.size() && 0 == memcmp(a.begin(),b.begin(),a.size());
+}
+
+static void makeBlock(RLCDownlinkDataBlock &block)
+{
+	if (rnd(2)) { block.setRRBP(rnd(4)); }
+	block.mSP = rnd(2);
+	block.mUSF = rnd(8);
+	block.mPR = rnd(4);
+	block.mTFI = rnd(32);
+	block.mFBI = rnd(2);
+	block.mBSN = rnd(128);
+	block.mE = rnd(2);
+	unsigned size = block.getPayloadSize();
+	block.mPayload = ByteVector(size);
+	for (unsigned i = 0; i < size; i++) { block.mPayload.setByte(i,rnd(256)); }
+}
+
+static unsigned testCoding(ChannelCodingType cs)
+{
+	const char *name = (cs == ChannelCodingCS1) ? "CS-1" : "CS-4";
+	ReferenceEncoder ref;
+	GprsEncoder enc;
+	unsigned failed = 0;
+	for (unsigned n = 0; n < sBlocks; n++) {
+		RLCDownlinkDataBlock block(cs);
+		makeBlock(block);
+		BitVector bits = block.getBitVector();
+		ByteType bytes[RLCBlockSizeBytesMax], want[RLCBlockSizeBytesMax];
+		memset(bytes,0,sizeof(bytes));
+		memset(want,0,sizeof(want));
+		unsigned len = block.pack(bytes);
+		bits.pack(want);
+		bool packOk = (len * 8 == bits.size()) && 0 == memcmp(bytes,want,len);
+
+		bool codedOk = true;
+		if (cs == ChannelCodingCS1) {
+			ref.encodeFrame41(bits,0);
+			enc.encodeCS1(bytes);
+		} else {
+			ref.encodeCS4(bits);
+			enc.encodeCS4(bytes);
+			codedOk = sameBits(ref.mD_CS4,enc.mD_CS4) && sameBits(ref.mU_CS4,enc.mU_CS4) &&
+				sameBits(ref.mP_CS4,enc.mP_CS4);
+		}
+		bool burstsOk = true;
+		for (unsigned b = 0; b < 4; b++) {
+			if (!sameBits(ref.mI[b],enc.mI[b])) { burstsOk = false; }
+		}
+		bool ok = packOk && codedOk && burstsOk;
+		if (!ok) { failed++; }
+		if (!ok || sVerbose) {
+			printf("%s block %u USF=%u BSN=%u pack %s coder %s bursts %s\n",name,n,(unsigned)block.mUSF,
+				(unsigned)block.mBSN,packOk ? "ok" : "DIFFERS",codedOk ? "ok" : "DIFFERS",
+				burstsOk ? "ok" : "DIFFERS");
+		}
+	}
+	printf("%s %u blocks, %u differ\n",name,sBlocks,failed);
+	return failed;
+}
+
+int main(int argc, char **argv)
+{
+	unsigned seed = 1;
+	int opt;
+	while ((opt = getopt(argc,argv,"n:r:vh")) != -1) {
+		switch (opt) {
+		case 'n': sBlocks = atoi(optarg); break;
+		case 'r': seed = atoi(optarg); break;
+		case 'v': sVerbose = true; break;
+		default:
+			printf("usage: %s [-n blocks] [-r seed] [-v]\n",argv[0]);
+			return 1;
+		}
+	}
+	srandom(seed);
+
+	unsigned failed = testCoding(ChannelCodingCS1);
+	failed += testCoding(ChannelCodingCS4);
+	printf("%s\n",failed ? "FAILED" : "passed");
+	return failed;
+}
@@ -0,0 +1,61 @@
+/**
+ * FlowControl.cpp
+ * This file is part of the Yate-BTS Project http://www.yatebts.com
+ *
+ * Downlink flow control for the GPRS MAC
+ *
+ * Yet Another Telephony Engine - Base Transceiver Station
+ * Copyright (C) 2014 Null Team Impex SRL
+ * Copyright (C) 2014 Legba, Inc
+ *
+ * This software is distributed under multiple licenses;
+ * see the COPYING file in the main directory for licensing
+ * information for this specific distribution.
+ *
+ * This use of this software may be subject to additional restrictions.
+ * See the LEGAL file in the main directory for details.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#include "FlowControl.h"
+#include <math.h>
+
+namespace GPRS {
+
+double LeakyBucket::level(double now, double rate) const
+{
+	// 48.018 A.1: B* = B - (Tc - Tp) * R, not below zero.
+	double level = mLevel - (now - mLast) * rate;
+	return level > 0 ? level : 0;
+}
+
+void LeakyBucket::add(double now, unsigned bytes, double rate)
+{
+	mLevel = level(now,rate) + bytes;
+	mLast = now;
+}
+
+bool DelayDropper::drop(double now, double delay, double target, double interval)
+{
+	if (target <= 0 || delay < target) {
+		reset();
+		return false;
+	}
+	if (!mAbove) {
+		mAbove = now;
+		return false;
+	}
+	if (!mNext) {
+		if (now - mAbove < interval) { return false; }
+	} else if (now < mNext) {
+		return false;
+	}
+	mCount++;
+	mNext = now + interval / sqrt((double)mCount);
+	return true;
+}
+
+}; // namespace GPRS
@@ -0,0 +1,66 @@
+/**
+ * FlowControl.h
+ * This file is part of the Yate-BTS Project http://www.yatebts.com
+ *
+ * Downlink flow control for the GPRS MAC
+ *
+ * Yet Another Telephony Engine - Base Transceiver Station
+ * Copyright (C) 2014 Null Team Impex SRL
+ * Copyright (C) 2014 Legba, Inc
+ *
+ * This software is distributed under multiple licenses;
+ * see the COPYING file in the main directory for licensing
+ * information for this specific distribution.
+ *
+ * This use of this software may be subject to additional restrictions.
+ * See the LEGAL file in the main directory for details.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#ifndef GPRSFLOWCONTROL_H
+#define GPRSFLOWCONTROL_H
+
+// The building blocks of the downlink flow control, see admitDownlink in MAC.cpp.
+// Like Scheduler.h this does not depend on the rest of the MAC.
+// Times are in seconds, as returned by timef(), sizes in bytes.
+namespace GPRS {
+
+// The leaky bucket of 48.018 Annex A, which the BSS and SGSN use for BSSGP flow control.
+// The bucket leaks at a rate R and a pdu is conforming if it fits under the bucket size Bmax.
+// The rate is given on each call so it can follow the radio conditions.
+class LeakyBucket {
+	double mLevel;	// At mLast
+	double mLast;
+	public:
+	LeakyBucket() : mLevel(0), mLast(0) {}
+	double level(double now, double rate) const;
+	// Does a pdu fit?  It is not added.
+	bool fits(double now, unsigned bytes, unsigned bmax, double rate) const {
+		return level(now,rate) + bytes <= bmax;
+	}
+	void add(double now, unsigned bytes, double rate);
+};
+
+// Decides the early drops of one queue from the time its oldest pdu has waited,
+// after the CoDel control law (RFC 8289): nothing is dropped until the delay has
+// stayed above the target for an interval, then the drops come closer together,
+// interval/sqrt(count), while it stays above.  A TCP sender halves its window on
+// each drop so the queue drains well before it is full.
+class DelayDropper {
+	double mAbove;		// When the delay went above the target, 0 if below.
+	double mNext;		// When the next drop is due, 0 if not dropping yet.
+	unsigned mCount;	// Drops since the delay went above the target.
+	public:
+	DelayDropper() : mAbove(0), mNext(0), mCount(0) {}
+	// Should the pdu arriving now be dropped?  A target of 0 disables early drop.
+	bool drop(double now, double delay, double target, double interval);
+	// Back to the initial state, when the queue is empty.
+	void reset() { mAbove = mNext = 0; mCount = 0; }
+	unsigned count() const { return mCount; }
+};
+
+}; // namespace GPRS
+#endif
@@ -0,0 +1,152 @@
+/**
+ * FlowControlTest.cpp
+ * This file is part of the Yate-BTS Project http://www.yatebts.com
+ *
+ * Test of the GPRS downlink flow control building blocks
+ *
+ * Yet Another Telephony Engine - Base Transceiver Station
+ * Copyright (C) 2014 Null Team Impex SRL
+ * Copyright (C) 2014 Legba, Inc
+ *
+ * This software is distributed under multiple licenses;
+ * see the COPYING file in the main directory for licensing
+ * information for this specific distribution.
+ *
+ * This use of this software may be subject to additional restrictions.
+ * See the LEGAL file in the main directory for details.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+/*
+	Checks LeakyBucket against 48.018 Annex A: the level leaks at the
+	given rate and not below zero, a pdu fits if the level plus its size
+	is at most Bmax, and a rate change only applies from the last update.
+	Then drives DelayDropper like admitDownlink does, one pdu every 10ms
+	with the delay of the oldest queued pdu: nothing is dropped while the
+	delay is under the target or for the first interval above it, then
+	the drops come at interval/sqrt(count); the delay falling under the
+	target or a reset, as when the queue drains, start over.
+	Each check that fails is printed, all of them with -v; the return
+	code is the number that failed.
+*/
+
+#include "FlowControl.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <math.h>
+
+using namespace GPRS;
+
+static bool sVerbose = false;
+static unsigned sChecks = 0, sFailed = 0;
+
+static void check(bool ok, const char *what, double got, double want)
+{
+	sChecks++;
+	if (!ok) { sFailed++; }
+	if (!ok || sVerbose) {
+		printf("%-48s got %10.4f expected %10.4f%s\n",what,got,want,ok ? "" : "  FAILED");
+	}
+}
+
+static void checkNear(const char *what, double got, double want)
+{
+	check(fabs(got - want) < 1e-6,what,got,want);
+}
+
+static void testBucket()
+{
+	LeakyBucket b;
+	checkNear("empty bucket",b.level(5,1000),0);
+	check(b.fits(5,2000,2000,1000),"pdu of Bmax fits an empty bucket",1,1);
+	check(!b.fits(5,2001,2000,1000),"pdu over Bmax does not fit",0,0);
+	b.add(10,1500,1000);
+	checkNear("level after add",b.level(10,1000),1500);
+	checkNear("leaks at the rate",b.level(10.5,1000),1000);
+	checkNear("not below zero",b.level(20,1000),0);
+	check(!b.fits(10.2,800,2000,1000),"does not fit before it leaked",0,0);
+	check(b.fits(10.3,800,2000,1000),"fits once it leaked",1,1);
+	b.add(10.5,500,1000);
+	checkNear("add on top of the leaked level",b.level(10.5,1000),1500);
+	// The radio got slower: the new rate applies from the last add.
+	checkNear("rate given on each call",b.level(11.5,250),1250);
+	b.add(30,100,1000);
+	checkNear("add to a bucket that emptied",b.level(30,1000),100);
+}
+
+// Feed pdus every 10ms from start to end with the given delay, count the drops.
+static unsigned feed(DelayDropper &d, double start, double end, double delay, double target,
+	double interval, double *first = NULL)
+{
+	unsigned drops = 0;
+	for (double now = start; now < end - 1e-9; now += 0.01) {
+		if (d.drop(now,delay,target,interval)) {
+			if (!drops && first) { *first = now; }
+			drops++;
+		}
+	}
+	return drops;
+}
+
+static void testDropper()
+{
+	const double target = 0.5, interval = 1.0;
+	DelayDropper d;
+	unsigned drops = feed(d,0,10,0.3,target,interval);
+	check(drops == 0,"no drops under the target",drops,0);
+	drops = feed(d,10,20,5,0,interval);
+	check(drops == 0,"target 0 disables",drops,0);
+
+	double first = 0;
+	drops = feed(d,20,20 + interval,1,target,interval,&first);
+	check(drops == 0,"no drops for the first interval above",drops,0);
+	drops = feed(d,21,21.02,1,target,interval,&first);
+	check(drops == 1,"drop once the interval passed",drops,1);
+	checkNear("first drop time",first,21);
+	checkNear("count",d.count(),1);
+
+	// Drops at 21, +1, +1/sqrt(2), +1/sqrt(3), ... while the delay stays above,
+	// each on the first pdu at or after the time, so up to 10ms late.
+	double t = 21, want = 1;
+	for (unsigned n = 1; n < 5; n++) { t += interval / sqrt((double)n); want++; }
+	drops = 1 + feed(d,21.01,t + 0.045,1,target,interval);
+	check(drops == want,"drops closer together",drops,want);
+
+	drops = feed(d,25,25.01,0.2,target,interval);
+	check(drops == 0,"delay under the target",drops,0);
+	checkNear("count restarts",d.count(),0);
+	drops = feed(d,25.01,25.01 + interval,1,target,interval);
+	check(drops == 0,"waits an interval again",drops,0);
+
+	// A queue that drained does not keep the time it went above the target.
+	DelayDropper e;
+	feed(e,0,0.8,1,target,interval);
+	e.reset();
+	drops = feed(e,5,5.5,1,target,interval);
+	check(drops == 0,"reset forgets the delay",drops,0);
+	drops = feed(e,5.5,6.02,1,target,interval);
+	check(drops == 1,"interval counted from after the reset",drops,1);
+}
+
+int main(int argc, char **argv)
+{
+	int opt;
+	while ((opt = getopt(argc,argv,"vh")) != -1) {
+		switch (opt) {
+		case 'v': sVerbose = true; break;
+		default:
+			printf("usage: %s [-v]\n",argv[0]);
+			return 1;
+		}
+	}
+
+	testBucket();
+	testDropper();
+	printf("%u checks, %u failed\n%s\n",sChecks,sFailed,sFailed ? "FAILED" : "passed");
+	return sFailed;
+}
@@ -184,9 +184,29 @@ static int gprsStats(int argc, char **argv, int argi, ostream&os)
 		<< " MS=" << Stats.countMSInfo
 		<< " TBF=" << Stats.countTBF
 		<< " RACH=" << Stats.countRach
+		<< " PDCH freed=" << Stats.countPDCHFreed
+		<< " for voice=" << Stats.countPDCHVoice
 		<< "\n";
 	os << "Downlink utilization=" << gL2MAC.macDownlinkUtilization << "\n";
+	// The channel plan and its churn: the channels handed between voice and GPRS per hour.
+	time_t uptime = time(NULL) - gL2MAC.macStartTime;
+	os << "Channel plan target=" << gL2MAC.macChTarget
+		<< " forecast data=" << gL2MAC.macDataForecast.predict(gL2MAC.macChForecast)
+		<< " voice=" << gL2MAC.macVoiceForecast.predict(gL2MAC.macChForecast);
+	if (uptime > 0) {
+		os << " churn=" << (Stats.countPDCH + Stats.countPDCHFreed) * 3600.0 / uptime << "/hour";
+	}
+	os << "\n";
 	os << LOGVAR2("ServiceLoopTime",Stats.macServiceLoopTime) << "\n";
+	os << LOGVAR2("Rach",Stats.macRachTime) << LOGVAR2("Uplink",Stats.macUplinkTime)
+		<< LOGVAR2("Tbf",Stats.macTbfTime) << LOGVAR2("Ms",Stats.macMsTime) << "\n";
+	os << LOGVAR2("Downlink",Stats.macDownlinkTime) << LOGVAR2("Coding",Stats.macCodingTime)
+		<< LOGVAR2("Sgsn",Stats.macSgsnTime) << "\n";
+	os << "Downlink queued bytes=" << gL2MAC.macDownlinkQueueBytes()
+		<< " bucket=" << (unsigned)gL2MAC.macFlowBucket.level(timef(),gL2MAC.macFlowCellRate())
+		<< " dropped full=" << Stats.countDlDropFull
+		<< " cell=" << Stats.countDlDropCell
+		<< " delay=" << Stats.countDlDropDelay << "\n";
 	return 0;
 }
 
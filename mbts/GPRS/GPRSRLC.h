@@ -56,7 +56,7 @@ std::ostream& operator<<(std::ostream& os, const RLCDir::type &mode);
 
 
 extern unsigned RLCBlockSize[4];
-extern const unsigned RLCBlockSizeBytesMax;
+const unsigned RLCBlockSizeBytesMax = 53;	// CS-4 block, including the MAC header.
 extern int deltaBSN(int bsn1,int bsn2);
 
 class RLCBSN_t { // Type of radio block sequence numbers.  -1 means invalid.
@@ -43,6 +43,8 @@ L2MAC gL2MAC;
 Stats_t Stats;
 static unsigned ChIdleCounter = 0;
 static unsigned ChCongestionCounter = 0;
+static unsigned ChHoldCounter = 0;	// Seconds the channel plan has wanted fewer channels.
+static unsigned ChPlanCounter = 0;
 int ExtraClockDelay = 0;
 
 bool gFixTFIBug = 1; // Default bug fix on.
@@ -110,10 +112,7 @@ int configGetNumQ(const char *name, int defaultvalue)
 int configGprsChannelsMinCn() { return gConfig.getNum("GPRS.Channels.Min.CN"); }
 int configGprsChannelsMinC0() { return gConfig.getNum("GPRS.Channels.Min.C0"); }
 int configGprsChannelsMin() { return configGprsChannelsMinC0() + configGprsChannelsMinCn(); }
-#if GPRS_CHANNELS_MAX_SUPPORTED
-	// We are currently doing only static assignment, so take this out for now.
 int configGprsChannelsMax() { return gConfig.getNum("GPRS.Channels.Max"); }
-#endif
 int configGprsMultislotMaxUplink() { return gConfig.getNum("GPRS.Multislot.Max.Uplink"); }
 int configGprsMultislotMaxDownlink() { return gConfig.getNum("GPRS.Multislot.Max.Downlink"); }
 
@@ -403,6 +402,10 @@ void L2MAC::macConfigInit()
 	macChCongestionMax = gConfig.getNum("GPRS.Channels.Congestion.Timer") * RLCBlocksPerSecond;
 	// database number specified in percent:
 	macChCongestionThreshold = gConfig.getNum("GPRS.Channels.Congestion.Threshold") / 100.0;
+	macChForecast = gConfig.getNum("GPRS.Channels.Forecast");
+	macChSmoothing = gConfig.getNum("GPRS.Channels.Smoothing");
+	macChHold = gConfig.getNum("GPRS.Channels.Hold");
+	macChVoiceReserve = gConfig.getNum("GPRS.Channels.Voice.Reserve");
 	macDownlinkPersist = gConfig.getNum("GPRS.Downlink.Persist");
 	static bool thisMessageHasBeenPrinted = false;
 	if (macDownlinkPersist && !thisMessageHasBeenPrinted) {
@@ -412,6 +415,29 @@ void L2MAC::macConfigInit()
 	macDownlinkKeepAlive = gConfig.getNum("GPRS.Downlink.KeepAlive");
 	macUplinkPersist = gConfig.getNum("GPRS.Uplink.Persist");
 	macUplinkKeepAlive = gConfig.getNum("GPRS.Uplink.KeepAlive");
+	macFlowMSBytes = gConfig.getNum("GPRS.Downlink.MS.Bytes");
+	macFlowCellBytes = gConfig.getNum("GPRS.Downlink.Cell.Bytes");
+	macFlowTargetDelay = gConfig.getNum("GPRS.Downlink.TargetDelay") / 1000.0;
+
+	// The window and starvation limit are given in milliseconds.
+	macSchedWindow = gConfig.getNum("GPRS.Scheduler.Window") / RLCBlockTimeMsecs;
+	unsigned maxAge = gConfig.getNum("GPRS.Scheduler.MaxAge") / RLCBlockTimeMsecs;
+	std::string sched = gConfig.getStr("GPRS.Scheduler");
+	if (sched != macScheduler->name() || maxAge != macSchedMaxAge) {
+		GprsScheduler *newsched = GprsScheduler::create(sched.c_str(),maxAge);
+		if (newsched) {
+			delete macScheduler;
+			macScheduler = newsched;
+			macSchedMaxAge = maxAge;
+			GLOG(INFO) << "GPRS scheduler " << sched;
+		} else {
+			static std::string badsched;
+			if (badsched != sched) {
+				GLOG(ERR) << "Unknown GPRS.Scheduler " << sched << ", using " << macScheduler->name();
+				badsched = sched;
+			}
+		}
+	}
 
 	if (macSingleStepMode) {
 		// Set these to maximum values so we can single step the service loop
@@ -425,6 +451,17 @@ void L2MAC::macConfigInit()
 	gFixDRX = configGetNumQ("GPRS.FixDRX",(int)gFixDRX); // Default to 4 sendAssignment tries.
 	gFixIAUsePoll = configGetNumQ("GPRS.FixIAUsePoll",gFixIAUsePoll);
 	gFixConvertForeignTLLI = configGetNumQ("GPRS.FixForeignTlli",gFixConvertForeignTLLI);
+	macWorkers = configGetNumQ("GPRS.MAC.Workers",0);
+
+	// The coding scheme is chosen for every block, see MSInfo::msGetChannelCoding.
+	// We only support CS1 and CS4.
+	std::string codecs = gConfig.getStr("GPRS.Codecs.Uplink");
+	macCodecCS1[RLCDir::Up] = codecs.find('1') != std::string::npos;
+	macCodecCS4[RLCDir::Up] = codecs.find('4') != std::string::npos;
+	codecs = gConfig.getStr("GPRS.Codecs.Downlink");
+	macCodecCS1[RLCDir::Down] = codecs.find('1') != std::string::npos;
+	macCodecCS4[RLCDir::Down] = codecs.find('4') != std::string::npos;
+	macCodecRSSI = gConfig.getNum("GPRS.ChannelCodingControl.RSSI");
 }
 
 void L2MAC::macAddTBF(TBF *tbf) {
@@ -455,11 +492,12 @@ void L2MAC::macForgetTBF(TBF *tbf, bool forever)
 	}
 }
 
-void L2MAC::macAddMS(MSInfo *ms) { macMSs.push_back(ms); }
+void L2MAC::macAddMS(MSInfo *ms) { macMSs.push_back(ms); macIndexMS(ms,true); }
 
 void L2MAC::macForgetMS(MSInfo *ms, bool forever)
 {
 	macMSs.remove(ms);
+	macIndexMS(ms,false);
 	// lock unnecessary, using macLock now:
 	//macMSs.remove_safely(ms); // Usually already locked, so lock is recursive
 	//ScopedLock lock2(macExpiredMSs.mListLock);
@@ -477,11 +515,30 @@ void L2MAC::macForgetMS(MSInfo *ms, bool forever)
 	}
 }
 
-// The MS list will be short.  Just look through linearly.
+void L2MAC::macIndexMS(MSInfo *ms, bool add)
+{
+	uint32_t tllis[2] = { ms->msTlli, ms->msOldTlli };
+	for (unsigned i = 0; i < 2; i++) {
+		uint32_t key = TLLI_MASK_LOCAL(tllis[i]);
+		// The old tlli is optional, and may equal the current one but for the local bit.
+		if (i && (tllis[i] == 0 || key == TLLI_MASK_LOCAL(tllis[0]))) { continue; }
+		std::pair<MSTlliMap_t::iterator,MSTlliMap_t::iterator> range = macMSByTlli.equal_range(key);
+		MSTlliMap_t::iterator it = range.first;
+		while (it != range.second && it->second != ms) { it++; }
+		if (add) {
+			if (it == range.second) { macMSByTlli.insert(MSTlliMap_t::value_type(key,ms)); }
+		} else if (it != range.second) {
+			macMSByTlli.erase(it);
+		}
+	}
+}
+
 MSInfo *L2MAC::macFindMSByTlli(uint32_t tlli, int create /*=0*/)
 {
 	MSInfo *ms;
-	RN_MAC_FOR_ALL_MS(ms) {
+	std::pair<MSTlliMap_t::iterator,MSTlliMap_t::iterator> range = macMSByTlli.equal_range(TLLI_MASK_LOCAL(tlli));
+	for (MSTlliMap_t::iterator it = range.first; it != range.second; it++) {
+		ms = it->second;
 		// When the MS performs a Detach procedure, it will change its existing tlli
 		// from a local tlli to a foreign tlli.  Instead of having the SGSN inform us
 		// of these events, just ignore whether the tlli is local or foreign.
@@ -529,6 +586,57 @@ static void macAddOneChannel(TCHFACCHLogicalChannel *lchan)
 		<<gL2MAC.macActiveChannels()<<"\n";
 }
 
+// Allocate the GPRS.Channels.Min.C0 and GPRS.Channels.Min.CN channels.
+static void addMinChannels()
+{
+	int minChC0 = configGprsChannelsMinC0();
+	int minChCn = configGprsChannelsMinCn();
+	if (minChC0 < 0) { minChC0 = 0; }
+	if (minChCn < 0) { minChCn = 0; }
+	bool addedChannels = false;
+	//GPRSLOG(2)<<"macCheckChannel"<<LOGVAR(minChC0)<<LOGVAR(minChCn)<<LOGVAR2("active",gL2MAC.macActiveChannels());
+	if (minChC0 + minChCn > (int)gL2MAC.macActiveChannels()) {
+		// Allocate from CN0.
+		int active0 = gL2MAC.macActiveChannelsC(0);
+		{
+			TCHFACCHLogicalChannel *lchan;
+			for ( ; active0 < minChC0 && (lchan = gBTS.getTCH(true,true)); active0++) {
+				//GPRSLOG(2)<<"macCheckChannel loop"<<LOGVAR(active0)<<LOGVAR(minChC0)<<LOGVAR2("lchan",lchan->TN());
+				// We dont "open" the logical channel, which means we dont start
+				// the various timers referred to in L1Decoder::recyclable().
+				// It probably doesnt matter whether it is 'open' or not, because
+				// we hook the bursts before they get to the GSM logical channel classes.
+				macAddOneChannel(lchan);
+				addedChannels = true;
+			}
+		}
+
+		// Allocate from other ARFCNs
+		// This should probably allow a specified number of channels
+		// on each arfcn.
+		{
+			int activecn = (int)gL2MAC.macActiveChannels() - active0;
+			int nfound, need = minChCn - activecn;
+			// TODO: Prevent this from allocating from C0 if user misconfigures.
+			for (; need > 0 && (nfound = gL2MAC.macAddChannelGroup(need)); need -= nfound) {}
+		}
+	}
+	if (addedChannels) {
+		// We must keep the channel list sorted all the time because
+		// PACCH selection and extended uplink TBF both eexpect it.
+		gL2MAC.macPDCHs.sort(chCompareFunc);
+	}
+}
+
+// The group of adjacent channels an MS of the configured multislot class can use.
+static int macMultislotChunk()
+{
+	int downslots = configGprsMultislotMaxDownlink();
+	int upslots = configGprsMultislotMaxUplink();
+	int chunk = upslots>downslots ? upslots : downslots;
+	return RN_BOUND(chunk,1,4);
+}
+
 // Channel allocation for GPRS.
 // If GPRS is enabled, we need at least one channel to handle GPRS registration activity,
 // and it will be used often so it should be on the first ARFCN, CN0.
@@ -553,14 +661,11 @@ bool L2MAC::macAddChannel()
 	// 'GPRS.Channels.Max',4,0,0,'Maximum number of channels allocated for GPRS service.'
 	// 'GPRS.Channels.Min',0,0,0,'Minimum number of channels allocated for GPRS service once it starts.'
 	// ENDCONFIG
-	macCheckChannels();
-
-	// TODO: Dynamic channel assignment.
-#if GPRS_CHANNELS_MAX_SUPPORTED
-	if (macActiveChannels() >= configGprsChannelsMax()) {
-		return false;
+	addMinChannels();
+	if (! macActiveChannels() && configGprsChannelsMax() > 0) {
+		// There is no minimum, so this is the first channel, on demand.
+		macAddChannelGroup(1);
 	}
-#endif
 
 	if (! macActiveChannels()) {
 		// When you first start the BTS you will not be able to allocate until some
@@ -580,21 +685,85 @@ bool L2MAC::macAddChannel()
 }
 
 // Try to free a GPRS channel, returning it to GSM RR use.
+// Without pdch the last channel goes, which is only safe when no TBFs are running.
 // 5-24-2012: We must not free the channel that is our PACCH.
-bool L2MAC::macFreeChannel()
+bool L2MAC::macFreeChannel(PDCHL1FEC *pdch)
 {
 	ChIdleCounter = ChCongestionCounter = 0;
 	if (macActiveChannels() <= configGprsChannelsMin()) { return false; }
 
 	//PDCHL1FEC *pdch = gL2MAC.macPickChannel();	// pick the least busy channel;
-	PDCHL1FEC *pdch = gL2MAC.macPDCHs.back();
+	if (!pdch) { pdch = gL2MAC.macPDCHs.back(); }
 	GLOG(INFO) << "GPRS freeing channel" << pdch;
 	GPRSLOG(1) << "GPRS freeing channel " << pdch;
 	delete pdch;	// Among other things, removes from macPDCHs before freeing it.
 	macPacchs.clear();	// Must rebuild the pacch list.
+	Stats.countPDCHFreed++;
+	ChHoldCounter = 0;
 	return true;
 }
 
+// Pick the channel to free while there is traffic: the least busy one that no TBF uses,
+// the last one on ties since channels are added at the end of the list.
+// A channel that is some MS's PACCH is only taken if no other is idle: macForgetCh just
+// clears msPacch, so the MS has no PACCH until its next channel request.
+// The GPRS.Channels.Min.C0 channels on C0 are never picked.
+// If every channel carries a TBF there is none, unless anyway is set: then it is the
+// least busy channel all the same, and its TBFs are lost.
+PDCHL1FEC *L2MAC::macIdleChannel(bool anyway)
+{
+	PDCHL1FEC *ch, *bestch = NULL;
+	int minC0 = configGprsChannelsMinC0(), activeC0 = 0;
+	RN_MAC_FOR_ALL_PDCH(ch) {
+		if (ch->CN() == 0) { activeC0++; }
+	}
+	bool bestidle = false, bestpacch = false;
+	int bestload = 0;
+	RN_MAC_FOR_ALL_PDCH(ch) {
+		if (ch->CN() == 0 && activeC0 <= minC0) { continue; }
+		bool idle = true;
+		TBF *tbf;
+		RN_MAC_FOR_ALL_TBF(tbf) {
+			if (tbf->canUseDownlink(ch->downlink()) || tbf->canUseUplink(ch->uplink())) { idle = false; break; }
+		}
+		if (!idle && !anyway) { continue; }
+		// Same measure as macPickChannel.
+		bool pacch = false;
+		int load = 0;
+		MSInfo *ms;
+		RN_MAC_FOR_ALL_MS(ms) {
+			if (ms->msPacch == ch) { pacch = true; }
+			if (ms->msPacch == ch || ms->canUseDownlink(ch->downlink()) || ms->canUseUplink(ch->uplink())) {
+				load += 1 + ms->msDownlinkQueue.size() + ms->msTrafficMetric * 30;
+			}
+		}
+		bool better;
+		if (bestch == NULL) { better = true; }
+		else if (idle != bestidle) { better = idle; }
+		else if (pacch != bestpacch) { better = !pacch; }
+		else { better = (load <= bestload); }
+		if (better) {
+			bestch = ch; bestidle = idle; bestpacch = pacch; bestload = load;
+		}
+	}
+	return bestch;
+}
+
+// Add a group of adjacent channels, see GSMConfig::getTCHGroup.
+// Returns how many were added, maybe fewer than count.
+unsigned L2MAC::macAddChannelGroup(unsigned count)
+{
+	TCHFACCHLogicalChannel *results[8];
+	unsigned nfound = gBTS.getTCHGroup(count,results);
+	for (unsigned i = 0; i < nfound; i++) {
+		macAddOneChannel(results[i]);
+	}
+	// We must keep the channel list sorted all the time because
+	// PACCH selection and extended uplink TBF both expect it.
+	if (nfound) { macPDCHs.sort(chCompareFunc); }
+	return nfound;
+}
+
 
 // This is called during channel destruction to clean up any references to the channel.
 // The channel better not be in use.
@@ -668,9 +837,7 @@ static void macPacchAddAdjCh(PDCHL1FEC**alist,int asize)
 {
 	int downslots = configGprsMultislotMaxDownlink();	// TODO: add a separate chunk size.
 	int upslots = configGprsMultislotMaxUplink();
-	int chunk = upslots>downslots ? upslots : downslots;
-	//printf("first chunk=%d\n",chunk);
-	chunk = RN_BOUND(chunk,1,4);
+	int chunk = macMultislotChunk();
 
 	if (asize < chunk) {
 		// We cannot optimize this adjacency set.
@@ -896,11 +1063,9 @@ bool L2MAC::macStart()
 	// Sanity test and print warnings.
 	if (configGprsMultislotMaxDownlink() > 1 || configGprsMultislotMaxUplink() > 1) {
 		const char *multislotmsg = "A multislot configuration, required for high-speed GPRS service, is suggested by the config options GPRS.Multislot.Max.Downlink or GPRS.Multislot.Max.Uplink";
-#if GPRS_CHANNELS_MAX_SUPPORTED
-		if (configGprsChannelsMax() <= 1) {
+		if (configGprsChannelsMax() <= 1 && configGprsChannelsMin() <= 1) {
 			GLOG(WARNING) << multislotmsg << " but is not possible because GPRS.Channels.Max <= 1";
 		} else
-#endif
 		if (configGprsChannelsMin() <= 1) {
 			GLOG(WARNING) << multislotmsg << " but is unlikely to be achieved because GPRS.Channels.Min <= 1";
 		}
@@ -1228,7 +1393,8 @@ int findNeedyUSF(PDCHL1FEC *pdch)
 	// we will look at all the USFs on this channel and pick the best one.
 	TBF *besttbf = NULL;
 	int bestusf;
-	int bestage;	// how long since the tbf was issued a USF.
+	double bestprio;	// Scheduler priority, by default how long since the tbf was issued a USF.
+	double bestrate;
 
 	// This is an unused uplink block.
 	// Look around for an uplink TBF on this channel with data to send.
@@ -1302,15 +1468,20 @@ int findNeedyUSF(PDCHL1FEC *pdch)
 				//if (tbf->stalled()) continue;
 
 				int thisage = gBSNNext - ms->msLastUsfGrant;
-				GPRSLOG(512) << "findNeedyUSF for "<<ms <<LOGVAR(usf)<<LOGVAR(thisage)<<tbf;
+				SchedCandidate cand = tbf->mtSchedCandidate(gBSNNext);
+				cand.mAge = thisage;
+				cand.mDemand = 1.0;	// An uplink TBF in transmit can use every block.
+				double thisprio = gL2MAC.macScheduler->priority(cand);
+				GPRSLOG(512) << "findNeedyUSF for "<<ms <<LOGVAR(usf)<<LOGVAR(thisage)<<LOGVAR(thisprio)<<tbf;
 				if (besttbf) {
-					// We want to keep the TBF with the longest age.
-					if (thisage < bestage) continue;
+					// We want to keep the TBF with the highest priority.
+					if (thisprio < bestprio) continue;
 				}
 				// This is the most needy TBF encountered so far.
 				besttbf = tbf;
 				bestusf = usf;
-				bestage = thisage;
+				bestprio = thisprio;
+				bestrate = cand.mRate;
 			}
 		}
 		nextusf:;
@@ -1320,6 +1491,7 @@ int findNeedyUSF(PDCHL1FEC *pdch)
 		// In state DataReassign, dont penalize the MS for not listening,
 		// because we dont know if it is still on this chan or not.
 		besttbf->mtMS->msCountUSFGrant(besttbf->mtGetState() == TBFState::DataTransmit);
+		besttbf->mtSched.served(gBSNNext,gL2MAC.macSchedWindow,bestrate);
 		GPRSLOG(4)<<LOGVAR(bestusf)<<LOGVAR(besttbf)<<"\n";
 		return bestusf;
 	}
@@ -2047,8 +2219,85 @@ static void processBSSGMessages()
 }
 #endif
 
+double L2MAC::macFlowCellRate()
+{
+	unsigned pdchs = macPDCHs.size() ? macPDCHs.size() : 1;
+	bool cs4 = macCodecCS4[RLCDir::Down];
+	return RLCBlocksPerSecond * pdchs * RLCPayloadSizeInBytes[cs4 ? ChannelCodingCS4 : ChannelCodingCS1];
+}
+
+// Downlink flow control, in place of the BSSGP flow control the internal SGSN does not do.
+// Without it the SGSN queues whatever the internet sends, far faster than the radio
+// can carry, and the MS queues grow without bound.
+// User data goes through two leaky buckets (48.018 Annex A): one per MS leaking at
+// the rate its channels carry at its current channel coding, and one for the cell
+// leaking at the rate of all the PDCHs.  A pdu that does not fit in either is discarded.
+// The bucket sizes also bound the bytes really queued, in case the MS is not being served.
+// Before that, TCP is dropped early once the oldest pdu of the MS has waited longer than
+// GPRS.Downlink.TargetDelay, see DelayDropper, so the sender backs off instead of filling
+// the queue and the latency stays low.  Segmented N-PDUs are kept or dropped whole.
+// Signalling is never dropped.
+static bool admitDownlink(MSInfo *ms, SGSN::GprsSgsnDownlinkPdu *dlpdu)
+{
+	if (!dlpdu->mUserData) { return true; }
+	double now = timef();
+	unsigned size = dlpdu->size();
+	double msrate = ms->msFlowRate();
+	double cellrate = gL2MAC.macFlowCellRate();
+
+	if (!dlpdu->mFirstSeg) {
+		// The rest of an N-PDU follows its first segment.
+		bool drop = ms->msFlowDropping;
+		if (!dlpdu->mMoreSegs) { ms->msFlowDropping = false; }
+		if (drop) {
+			ms->msFlowDropBytes += size;
+			return false;
+		}
+	} else {
+		const char *why = NULL;
+		if (!ms->msDownlinkQueue.size()) {
+			// The queue drained, whatever delay it had is gone.
+			ms->msFlowDropper.reset();
+		} else if (dlpdu->mTcp) {
+			double delay = ms->msDownlinkQueue.front()->mDlTime.elapsed() / 1000.0;
+			// The interval is about one round trip of a TCP connection over GPRS.
+			if (ms->msFlowDropper.drop(now,delay,gL2MAC.macFlowTargetDelay,2 * gL2MAC.macFlowTargetDelay)) {
+				why = "delay";
+				ms->msFlowDropDelay++;
+				Stats.countDlDropDelay++;
+			}
+		}
+		if (!why && (ms->msDownlinkQueue.totalSize() + size > gL2MAC.macFlowMSBytes ||
+		    !ms->msFlowBucket.fits(now,size,gL2MAC.macFlowMSBytes,msrate))) {
+			why = "MS full";
+			ms->msFlowDropFull++;
+			Stats.countDlDropFull++;
+		}
+		if (!why && (gL2MAC.macDownlinkQueueBytes() + size > gL2MAC.macFlowCellBytes ||
+		    !gL2MAC.macFlowBucket.fits(now,size,gL2MAC.macFlowCellBytes,cellrate))) {
+			why = "cell full";
+			ms->msFlowDropCell++;
+			Stats.countDlDropCell++;
+		}
+		if (why) {
+			GPRSLOG(2) << ms << " downlink pdu dropped, " << why << LOGVAR(size)
+				<< LOGVAR2("queued",ms->msDownlinkQueue.totalSize()) << LOGVAR2("tcp",dlpdu->mTcp);
+			ms->msFlowDropping = dlpdu->mMoreSegs;
+			ms->msFlowDropBytes += size;
+			return false;
+		}
+	}
+	ms->msFlowBucket.add(now,size,msrate);
+	gL2MAC.macFlowBucket.add(now,size,cellrate);
+	return true;
+}
+
 static void writeQueue(MSInfo *ms, SGSN::GprsSgsnDownlinkPdu *dlpdu)
 {
+	if (!admitDownlink(ms,dlpdu)) {
+		delete dlpdu;
+		return;
+	}
 	ms->msDownlinkQueue.write(dlpdu);
 	ms->msDownlinkQStat.addPoint(ms->msDownlinkQueue.totalSize());
 	ms->msDownlinkQOldest = dlpdu->mDlTime;
@@ -2061,8 +2310,8 @@ static void processSgsnMessages()
 	while ((dlpdu = sgsnDownlinkQueue.readNoBlock())) {
     	MSInfo *ms = gL2MAC.macFindMSByTlli(dlpdu->mTlli, false);
 		if (ms) {
-			writeQueue(ms,dlpdu);
 			ms->msAliasTlli(dlpdu->mAliasTlli);
+			writeQueue(ms,dlpdu);
 		} else if (dlpdu->mAliasTlli && (ms = gL2MAC.macFindMSByTlli(dlpdu->mAliasTlli, false))) {
 			// This is a TLLI change procedure but the new MS does not already exist.
 			// This can happen in the case where the MS did not use the TLLI
@@ -2071,8 +2320,8 @@ static void processSgsnMessages()
 			// AttachAccept without a PTMSI, so the MS does not answer.
 			// In any case, we will be doing the change TLLI procedure when
 			// this message is processed.
-			writeQueue(ms,dlpdu);
 			ms->msAliasTlli(dlpdu->mTlli);
+			writeQueue(ms,dlpdu);
 		} else {
 			// The downlink message from the SGSN should be for an MSInfo
 			// that has only recently sent something to the SGSN so it should exist.
@@ -2127,72 +2376,8 @@ float L2MAC::macComputeUtilization()
 
 void L2MAC::macCheckChannels()
 {
-	int minChC0 = configGprsChannelsMinC0();
-	int minChCn = configGprsChannelsMinCn();
-	if (minChC0 < 0) { minChC0 = 0; }
-	if (minChCn < 0) { minChCn = 0; }
-	bool addedChannels = false;
-	//GPRSLOG(2)<<"macCheckChannel"<<LOGVAR(minChC0)<<LOGVAR(minChCn)<<LOGVAR2("active",macActiveChannels());
-	if (minChC0 + minChCn > (int)macActiveChannels()) {
-		// Allocate from CN0.
-		int active0 = macActiveChannelsC(0);
-		{
-			TCHFACCHLogicalChannel *lchan;
-			for ( ; active0 < minChC0 && (lchan = gBTS.getTCH(true,true)); active0++) {
-				//GPRSLOG(2)<<"macCheckChannel loop"<<LOGVAR(active0)<<LOGVAR(minChC0)<<LOGVAR2("lchan",lchan->TN());
-				// We dont "open" the logical channel, which means we dont start
-				// the various timers referred to in L1Decoder::recyclable().
-				// It probably doesnt matter whether it is 'open' or not, because
-				// we hook the bursts before they get to the GSM logical channel classes.
-				macAddOneChannel(lchan);
-				addedChannels = true;
-			}
-		}
-
-		// Allocate from other ARFCNs
-		// This should probably allow a specified number of channels
-		// on each arfcn.
-		{
-			int activecn = (int)macActiveChannels() - active0;
-			int nfound, need = minChCn - activecn;
-			TCHFACCHLogicalChannel *results[8];
-			// TODO: Prevent this from allocating from C0 if user misconfigures.
-			for (; need > 0 && (nfound = gBTS.getTCHGroup(need,results)); need -= nfound) {
-				for (int i = 0; i < nfound; i++) {
-					macAddOneChannel(results[i]);
-					addedChannels = true;
-				}
-			}
-		}
-	}
-	if (addedChannels) {
-		// We must keep the channel list sorted all the time because
-		// PACCH selection and extended uplink TBF both eexpect it.
-		gL2MAC.macPDCHs.sort(chCompareFunc);
-	}
-#if 0
-	int minchans = configGprsChannelsMin();
-	if (minchans > 0) {
-		// We are doing startup.  Allocate the initial channels from CN0.
-		int need = minchans - (int)macActiveChannels();
-		TCHFACCHLogicalChannel *lchan;
-		// Allocate from CN0 first.
-		for ( ; need > 0 && (lchan = gBTS.getTCH(true,true)); need--) {
-			macAddOneChannel(lchan);
-		}
-		// If we still need more, allocate them from the end of the list.
-		int nfound;
-		TCHFACCHLogicalChannel *results[8];
-		for ( ; need > 0 && (nfound = gBTS.getTCHGroup(need,results)); need -= nfound) {
-			for (int i = 0; i < nfound; i++) {
-				macAddOneChannel(results[i]);
-			}
-		}
-	}
-#endif
+	addMinChannels();
 
-	// TODO: Switch code to new channel allocator, but this code
-	// will move to where the channels are allocated, not here.
 	if (macTBFs.size()) {
 		ChIdleCounter = 0;
 		// If there are TBFs but no channels, try to allocate one.
@@ -2210,18 +2395,73 @@ void L2MAC::macCheckChannels()
 		}
 	}
 
-	// Maybe add another channel.
-	// We average the congestion measurement by incrementing it or decrementing it once each loop.
-	// todo: This test is too simple; needs to take into account how many channels allocated.
-	/**** TODO: This will be replaced by dynamic allocation.
-	if (macComputeUtilization() > macChCongestionThreshold) {
-		if (ChCongestionCounter++ > macChCongestionMax) {
-			macAddChannel();
+	// Maybe add or free channels as the load changes, see macPlanChannels.
+	macComputeUtilization();
+	if (++ChPlanCounter >= RLCBlocksPerSecond) {
+		ChPlanCounter = 0;
+		macPlanChannels();
+	}
+}
+
+// Dynamic channel allocation, called once a second.
+// The downlink utilization and the TCHs busy with voice are forecast macChForecast seconds
+// ahead and ChannelPlan turns them into the number of channels GPRS should hold.
+// Channels are added as soon as the forecast wants them, in multislot groups, adjacent to the
+// GPRS channels already allocated if possible.  They are freed one at a time, once fewer have
+// been wanted for macChHold seconds, so a lull does not hand them back and forth with voice.
+// Only a channel no TBF uses is freed, see macIdleChannel; until one turns up we wait.
+// The GPRS.Channels.Min.C0 channels are never freed, while other ones are left.
+// If voice is forecast to run out of TCHs, channels are freed right away instead,
+// before calls are blocked.
+void L2MAC::macPlanChannels()
+{
+	unsigned voice = gBTS.TCHActive();
+	macDataForecast.sample(macDownlinkUtilization,macChSmoothing);
+	macVoiceForecast.sample(voice,macChSmoothing);
+
+	ChannelPlan plan;
+	plan.mActive = macPDCHs.size();
+	plan.mMin = configGprsChannelsMin();
+	plan.mMax = configGprsChannelsMax();
+	plan.mChunk = macMultislotChunk();
+	plan.mData = macDataForecast.predict(macChForecast);
+	plan.mPerChannel = macChCongestionThreshold;
+	plan.mBusy = macTBFs.size();
+	plan.mVoiceTotal = gBTS.TCHTotal();
+	// The calls up now hold their TCHs however the forecast goes.
+	double forecast = macVoiceForecast.predict(macChForecast);
+	plan.mVoice = forecast > voice ? forecast : voice;
+	plan.mVoiceReserve = macChVoiceReserve;
+	macChTarget = plan.target();
+
+	if (macChTarget > plan.mActive) {
+		ChHoldCounter = 0;
+		unsigned added = macAddChannelGroup(macChTarget - plan.mActive);
+		if (added) {
+			GLOG(INFO) << "GPRS added " << added << " channels for forecast" << LOGVAR2("data",plan.mData)
+				<< LOGVAR2("voice",plan.mVoice) << LOGVAR2("target",macChTarget);
+		}
+	} else if (macChTarget < plan.mActive) {
+		if (plan.mVoiceLimited) {
+			// The one case where a busy channel is taken, TBFs and all: a blocked call
+			// is worse than a TBF that the MS or the SGSN will set up again.
+			PDCHL1FEC *pdch = macIdleChannel(true);
+			if (pdch && macFreeChannel(pdch)) {
+				Stats.countPDCHVoice++;
+				GLOG(INFO) << "GPRS freed channel for voice forecast" << LOGVAR2("voice",plan.mVoice)
+					<< LOGVAR2("free",plan.mVoiceTotal - voice) << LOGVAR2("target",macChTarget);
+			}
+		} else if (++ChHoldCounter >= macChHold) {
+			PDCHL1FEC *pdch = macIdleChannel(false);
+			if (pdch) {
+				macFreeChannel(pdch);
+			} else {
+				GPRSLOG(2) << "GPRS channel free waiting, no channel is idle" << LOGVAR2("target",macChTarget);
+			}
 		}
 	} else {
-		if (ChCongestionCounter > 0) { ChCongestionCounter--; }
+		ChHoldCounter = 0;
 	}
-	****/
 }
 
 
@@ -2389,10 +2629,11 @@ static void serviceLoopSynchronize(bool firsttime)
 //
 void L2MAC::macServiceLoop()
 {
-	double starttime = 0;	// useless initialization to shut up gcc.
 	GPRSLOG(16) << "macServiceLoop:" << LOGVAR(gBSNNext);
 
-	if (GPRSDebug) { starttime = timef(); }
+	// The steps are timed always, the cost is one clock read each.
+	double starttime = timef();
+	double steptime = starttime, now;
 	mac_debug();
 
 	// Step: Each incoming RACH will need a single block assignment.
@@ -2403,6 +2644,7 @@ void L2MAC::macServiceLoop()
 
 	// Step: Maybe add or free some radio channels.
 	macCheckChannels();
+	now = timef(); Stats.macRachTime.addPoint(now - steptime); steptime = now;
 
 	// Step:  Process uplink RadioBlocks from the last timeslot.
 	// Do this first because it may change TBF states so that they have
@@ -2415,6 +2657,7 @@ void L2MAC::macServiceLoop()
 			delete src;
 		}
 	}
+	now = timef(); Stats.macUplinkTime.addPoint(now - steptime); steptime = now;
 
 	GPRSLOG(16) << "macServiceLoop: after uplink service";
 
@@ -2430,12 +2673,14 @@ void L2MAC::macServiceLoop()
 			tbf->mtServiceUnattached();
 		}
 	}
+	now = timef(); Stats.macTbfTime.addPoint(now - steptime); steptime = now;
 
 	// Step: Service the MSs; they may want to start new TBFs.
 	MSInfo *ms;
 	RN_MAC_FOR_ALL_MS(ms) {
 		ms->msService();
 	}
+	now = timef(); Stats.macMsTime.addPoint(now - steptime); steptime = now;
 	GPRSLOG(16) << "macServiceLoop: after ms service";
 
 	// Step:  Feed each downlink PDCH with RadioBlocks.
@@ -2445,11 +2690,17 @@ void L2MAC::macServiceLoop()
 		extDyn.edSetCn(pdch->CN());
 		pdch->downlink()->dlService();
 	}
+	now = timef(); Stats.macDownlinkTime.addPoint(now - steptime); steptime = now;
+	// Step:  Channel code the chosen blocks and send them to the radio,
+	// on the coding threads if GPRS.MAC.Workers is set.
+	// Returns when every PDCH has its block sent.
+	gCodingPool.run();
+	now = timef(); Stats.macCodingTime.addPoint(now - steptime); steptime = now;
 	GPRSLOG(16) << "macServiceLoop: after downlink service";
 
 	// LONG RANGE TODO: At the end of a TBF, if the downlink TBF queue is low,
 	// we should send flow control to BSSG.  See engineRecvAckNack
-	// But sadly, the SGSN does not implement flow control, so dont bother.
+	// The internal SGSN is flow controlled in processSgsnMessages, see admitDownlink.
 
 	// Step: Service the BSSG queue.
 	// This mostly means moving any downlink PDUs into their MS.
@@ -2461,12 +2712,10 @@ void L2MAC::macServiceLoop()
 	} else {
 		processSgsnMessages();
 	}
+	now = timef(); Stats.macSgsnTime.addPoint(now - steptime);
 
 	// Step: gather statistics about this loop.
-	if (GPRSDebug) {
-		double elapsed = timef() - starttime;
-		Stats.macServiceLoopTime.addPoint(elapsed);
-	}
+	Stats.macServiceLoopTime.addPoint(now - starttime);
 }
 
 static void *macThreadFunc(void *arg)
@@ -2498,6 +2747,7 @@ static void *macThreadFunc(void *arg)
 	bool firsttime = true;		// First iteration.
 	while (!gL2MAC.macStopFlag) {
 		gL2MAC.macConfigInit();
+		gCodingPool.setThreads(gL2MAC.macWorkers);
 		advanceBSNNext(1);
 		serviceLoopSynchronize(firsttime);
 		firsttime = false;
@@ -29,9 +29,11 @@
 //#include "GSMCommon.h"	// For ChannelType
 #include "GSML3RRElements.h"	// For RequestReference
 #include "TBF.h"
+#include "ChannelPlan.h"
 #include "RList.h"
 #include "Utils.h"
 #include <list>
+#include <map>
 namespace GPRS {
 extern void mac_debug();
 
@@ -71,10 +73,24 @@ typedef RList<MSInfo*> MSInfoList_t;
 
 struct Stats_t {
 	Statistic<double> macServiceLoopTime;
+	// The steps of the service loop, the sum is about macServiceLoopTime.
+	Statistic<double> macRachTime;		// RACH queue and channel allocation.
+	Statistic<double> macUplinkTime;
+	Statistic<double> macTbfTime;		// Unattached TBFs.
+	Statistic<double> macMsTime;
+	Statistic<double> macDownlinkTime;	// Choosing the downlink blocks.
+	Statistic<double> macCodingTime;	// Channel coding them, see PDCHCodingPool.
+	Statistic<double> macSgsnTime;
 	UInt_z countPDCH;
+	UInt_z countPDCHFreed;		// PDCHs given back to GSM RR use,
+	UInt_z countPDCHVoice;		// of which early because voice was forecast to need them.
 	UInt_z countMSInfo;
 	UInt_z countTBF;
 	UInt_z countRach;
+	// Downlink pdus discarded by the flow control, see MSInfo::msFlowDropFull.
+	UInt_z countDlDropFull;
+	UInt_z countDlDropCell;
+	UInt_z countDlDropDelay;
 };
 extern struct Stats_t Stats;
 
@@ -259,6 +275,10 @@ class L2MAC
 	//Mutex macTbfListLock;
 	TBFList_t macTBFs;	// active TBFs.
 	MSInfoList_t macMSs;	// The MS we know about.
+	// Index of macMSs by msTlli and msOldTlli, the key has TLLI_LOCAL_BIT masked
+	// so the index works whichever way tlliEq compares; see macIndexMS.
+	typedef std::multimap<uint32_t,MSInfo*> MSTlliMap_t;
+	MSTlliMap_t macMSByTlli;
 
 	// For debugging, we keep expired TBF and MS around for post-mortem examination:
 	TBFList_t macExpiredTBFs;
@@ -269,11 +289,13 @@ class L2MAC
 #define RN_MAC_FOR_ALL_MS(ms) for (RListIterator<MSInfo*> itr(gL2MAC.macMSs); itr.next(ms); )
 #define RN_MAC_FOR_ALL_TBF(tbf) for (RListIterator<TBF*> itr(gL2MAC.macTBFs); itr.next(tbf); ) 
 
-	L2MAC()
+	L2MAC() : macScheduler(new RoundRobinScheduler()), macSchedWindow(1), macSchedMaxAge(0), macCodecRSSI(0)
 	{
 		gTFIs = new TFIList();
+		macCodecCS1[RLCDir::Up] = macCodecCS1[RLCDir::Down] = true;
+		macCodecCS4[RLCDir::Up] = macCodecCS4[RLCDir::Down] = false;
 	}
-	~L2MAC() { delete gTFIs; }
+	~L2MAC() { delete gTFIs; delete macScheduler; }
 
 	public:
 	unsigned macN3101Max;
@@ -287,12 +309,39 @@ class L2MAC
 	unsigned macMSIdleMax;
 	unsigned macChIdleMax;	
 	unsigned macChCongestionMax;
+	// Dynamic channel allocation, see macPlanChannels; all in seconds, which is the sample period.
+	unsigned macChForecast;		// How far ahead the loads are forecast.
+	unsigned macChSmoothing;	// Time constant of the load forecasts.
+	unsigned macChHold;		// How long fewer channels must be wanted before one is freed.
+	unsigned macChVoiceReserve;	// TCHs kept free for voice beyond the forecast.
+	LoadForecast macDataForecast;	// Of macDownlinkUtilization
+	LoadForecast macVoiceForecast;	// Of the busy TCHs
+	UInt_z macChTarget;		// Number of channels last planned.
 	unsigned macDownlinkPersist;
 	unsigned macDownlinkKeepAlive;
 	unsigned macUplinkPersist;
 	unsigned macUplinkKeepAlive;
 	float macChCongestionThreshold;
 	Float_z macDownlinkUtilization;
+	GprsScheduler *macScheduler;	// Ranks the TBFs for downlink blocks and uplink USFs, from GPRS.Scheduler.
+	unsigned macSchedWindow;	// Throughput averaging window of the scheduler, in blocks.
+	unsigned macSchedMaxAge;
+	UInt_z macWorkers;	// GPRS.MAC.Workers, applied to gCodingPool by the MAC thread.
+	// GPRS.Codecs.Uplink and GPRS.Codecs.Downlink, indexed by RLCDir::Up and RLCDir::Down,
+	// and GPRS.ChannelCodingControl.RSSI; see MSInfo::msGetChannelCoding.
+	bool macCodecCS1[2];
+	bool macCodecCS4[2];
+	int macCodecRSSI;
+	// Downlink flow control: the bucket sizes of each MS and of the cell,
+	// and the delay above which TCP is dropped early, in seconds.
+	unsigned macFlowMSBytes;
+	unsigned macFlowCellBytes;
+	double macFlowTargetDelay;
+	LeakyBucket macFlowBucket;	// The cell bucket.
+	// Bytes waiting in the downlink queues of all the MS.
+	unsigned macDownlinkQueueBytes() { return MSDownlinkQueue::allBytes(); }
+	// Bytes per second all the PDCHs carry at the best downlink coding allowed.
+	double macFlowCellRate();
 
 	Bool_z macRunning;		// The macServiceLoop is running.
 	time_t macStartTime;
@@ -302,6 +351,8 @@ class L2MAC
 	MSInfo *macFindMSByTlli(uint32_t tlli, int create = 0);
 	void macAddMS(MSInfo *ms);
 	void macForgetMS(MSInfo *ms,bool forever);
+	// Add or remove the TLLIs of the MS in macMSByTlli; call with false before changing them.
+	void macIndexMS(MSInfo *ms, bool add);
 
 	// When deleting tbfs, macForgetTBF could be called on a tbf already removed
 	// from the list, which is ok.
@@ -313,7 +364,10 @@ class L2MAC
 	PDCHL1FEC *macFindChannel(unsigned arfcn, unsigned tn);	// find specified channel, or null
 	unsigned macFindChannels(unsigned arfcn);
 	bool macAddChannel();		// Add a GSM RR channel to GPRS use.
-	bool macFreeChannel();		// Restore a GPRS channel back to GSM RR use.
+	bool macFreeChannel(PDCHL1FEC *pdch = NULL);	// Restore a GPRS channel back to GSM RR use.
+	PDCHL1FEC *macIdleChannel(bool anyway);	// The channel to free while TBFs run.
+	unsigned macAddChannelGroup(unsigned count);	// Add up to count adjacent channels.
+	void macPlanChannels();
 	void macForgetCh(PDCHL1FEC*ch);
 	void macConfigInit();
 	bool macStart();	// Fire it up.
@@ -499,6 +553,7 @@ class L1UplinkReservation
 
 extern bool setMACFields(MACDownlinkHeader *block, PDCHL1FEC *pdch, TBF *tbf, int makeres,MsgTransactionType mttype,unsigned *pcounter);
 extern int configGetNumQ(const char *name, int defaultvalue);
+extern int configGprsChannelsMax();
 extern int configGprsMultislotMaxUplink();
 extern int configGprsMultislotMaxDownlink();
 
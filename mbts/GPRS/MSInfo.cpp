@@ -806,6 +806,8 @@ void SignalQuality::setRadData(float wRSSI,float wTimingError)
 	msTimingError.addPoint(wTimingError);
 }
 
+unsigned MSDownlinkQueue::sAllBytes = 0;
+
 // Determine whether we should use slow or fast channel coding for the specified direction.
 ChannelCodingType MSInfo::msGetChannelCoding(RLCDirType wdir) const
 {
@@ -816,16 +818,14 @@ ChannelCodingType MSInfo::msGetChannelCoding(RLCDirType wdir) const
 	// 'GPRS.ChannelCodingControl.RSSI',-40,0,0,'If the initial signal strength is less than this amount in DB GPRS uses a lower bandwidth but more robust encoding CS-1'
 	// ENDCONFIG
 
-	// Allow user full control over the codecs with these options:
-	const char *option = (wdir == RLCDir::Up) ? "GPRS.Codecs.Uplink" : "GPRS.Codecs.Downlink";
-	const char *codecs = gConfig.getStr(option).c_str();
-	// We only support CS1 and CS4.
-	bool cs1allowed = strchr(codecs,'1');
-	bool cs4allowed = strchr(codecs,'4');
+	// Allow user full control over the codecs with GPRS.Codecs.Uplink and GPRS.Codecs.Downlink,
+	// read by macConfigInit since this runs for every block.
+	int dir = (wdir == RLCDir::Up) ? RLCDir::Up : RLCDir::Down;
+	bool cs1allowed = gL2MAC.macCodecCS1[dir];
+	bool cs4allowed = gL2MAC.macCodecCS4[dir];
 	if (cs1allowed && cs4allowed) {
 		// Choose codec based on initial signal strength:
-		int fastRSSI = gConfig.getNum("GPRS.ChannelCodingControl.RSSI");
-		return (msRSSI.getCurrent() < fastRSSI) ? ChannelCodingCS1 : ChannelCodingCS4;
+		return (msRSSI.getCurrent() < gL2MAC.macCodecRSSI) ? ChannelCodingCS1 : ChannelCodingCS4;
 	} else if (cs4allowed) {
 		return ChannelCodingCS4;
 	} else {
@@ -833,6 +833,12 @@ ChannelCodingType MSInfo::msGetChannelCoding(RLCDirType wdir) const
 	}
 }
 
+double MSInfo::msFlowRate() const
+{
+	unsigned slots = msPCHDowns.size() ? msPCHDowns.size() : 1;
+	return RLCBlocksPerSecond * slots * RLCPayloadSizeInBytes[msGetChannelCoding(RLCDir::Down)];
+}
+
 // UNUSED
 // Not a MSInfo member function, but still related to MSInfo.
 // This function is (was) used to implement CHANGE-TLLI from the BSSG interface.
@@ -882,6 +888,7 @@ void MSInfo::msChangeTlli(uint32_t newTlli)
 			ms2->msDelete(false);
 		}
 
+		gL2MAC.macIndexMS(this,false);
 		msOldTlli = msTlli;
 		msDeprecated = false;
 		if (msAltTlli) {
@@ -890,7 +897,9 @@ void MSInfo::msChangeTlli(uint32_t newTlli)
 		}
 	}
 	// The newTlli may differ by the TLLI_LOCAL_BIT, so always set msTlli.
+	gL2MAC.macIndexMS(this,false);
 	msTlli = newTlli;
+	gL2MAC.macIndexMS(this,true);
 }
 
 // In addition to alias tllis, we also accept foreign TLLIs, see macFindMSByTlli.
@@ -913,7 +922,9 @@ void MSInfo::msAliasTlli(uint32_t otherTlli)
 			// This code is processed by MAC when this message is first seen.
 			// Set oldTlli so that we will know the TLLI is the same MS.
 			// This may be switched by msChangeTlli when the message is processed.
+			gL2MAC.macIndexMS(this,false);
 			this->msOldTlli = otherTlli;
+			gL2MAC.macIndexMS(this,true);
 		}
 	}
 }
@@ -1073,6 +1084,15 @@ void MSInfo::msDump(std::ostream&os, SGSN::PrintOptions options)
 	os << "\t"; sgsnPrint(msTlli,options | SGSN::printNoMsId,os);
 	dumpSignalQuality(os);
 	msStatDump("\t",os);
+	// Memory held for the MS downlink and what flow control threw away, see admitDownlink.
+	os << "\t" << LOGVAR2("DownlinkQueue:pdus",msDownlinkQueue.size())
+		<< LOGVAR2("bytes",msDownlinkQueue.totalSize())
+		<< LOGVAR2("bucket",(unsigned)msFlowBucket.level(timef(),msFlowRate()));
+	if (msFlowDropFull + msFlowDropCell + msFlowDropDelay) {
+		os << " Dropped:" << LOGVAR2("full",msFlowDropFull) << LOGVAR2("cell",msFlowDropCell)
+			<< LOGVAR2("delay",msFlowDropDelay) << LOGVAR2("bytes",msFlowDropBytes);
+	}
+	os << "\n";
 
 	if (!(options & SGSN::printVerbose)) {return;}
 
@@ -23,6 +23,7 @@
 #include "GPRSRLC.h"
 //#include "RLCHdr.h"
 #include "RList.h"
+#include "FlowControl.h"
 //#include "BSSG.h"
 #include "Utils.h"
 #include "SgsnExport.h"
@@ -309,6 +310,31 @@ static __inline__ uint32_t tlliEq(uint32_t tlli1, uint32_t tlli2) {
 // TLLI is as a layer-2 transport identifier for the MS.
 // ^^^ OLD COMMENT
 
+// The downlink pdus waiting for an MS.  The bytes queued for all the MSs are counted
+// as the pdus come and go, for the cell flow control of every pdu, see admitDownlink.
+// Like the queue itself the count is only touched by the MAC thread.
+class MSDownlinkQueue : public InterthreadQueue2<SGSN::GprsSgsnDownlinkPdu,SingleLinkList<> >
+{
+	typedef InterthreadQueue2<SGSN::GprsSgsnDownlinkPdu,SingleLinkList<> > Base;
+	static unsigned sAllBytes;
+	public:
+	~MSDownlinkQueue() { sAllBytes -= totalSize(); }	// The base class deletes the pdus.
+	static unsigned allBytes() { return sAllBytes; }
+	void write(SGSN::GprsSgsnDownlinkPdu *pdu) { sAllBytes += pdu->size(); Base::write(pdu); }
+	void write_front(SGSN::GprsSgsnDownlinkPdu *pdu) { sAllBytes += pdu->size(); Base::write_front(pdu); }
+	SGSN::GprsSgsnDownlinkPdu *read() { return taken(Base::read()); }
+	SGSN::GprsSgsnDownlinkPdu *readNoBlock() { return taken(Base::readNoBlock()); }
+	private:
+	SGSN::GprsSgsnDownlinkPdu *taken(SGSN::GprsSgsnDownlinkPdu *pdu) {
+		if (pdu) { sAllBytes -= pdu->size(); }
+		return pdu;
+	}
+	// Not counted.
+	SGSN::GprsSgsnDownlinkPdu *read(unsigned timeout);
+	void clear();
+	void flushNoDelete();
+};
+
 // The MSInfo struct needs to hang around as long as the MS is in packet-transfer mode,
 // which means as long as it has TBFs, or the MS is in the T3192 period when it is camped
 // on the PACCH channel instead of the CCCH channel.
@@ -505,10 +531,18 @@ class MSInfo : public SGSN::MSUEAdapter, public SignalQuality, public MSStat
 	// This queue is not between separate threads for BSSG,
 	// and it is no longer for the internal sgsn either.
 	//InterthreadQueue<BSSG::BSSGMsgDLUnitData> msDownlinkQueue;
-	InterthreadQueue2<SGSN::GprsSgsnDownlinkPdu,SingleLinkList<> > msDownlinkQueue;
+	MSDownlinkQueue msDownlinkQueue;
 	Statistic<unsigned> msDownlinkQStat;
 	Statistic<double> msDownlinkQDelay;
 	Timeval msDownlinkQOldest;			// The timeval from the last guy in the queue.
+	// Downlink flow control, see admitDownlink in MAC.cpp.
+	LeakyBucket msFlowBucket;
+	DelayDropper msFlowDropper;
+	Bool_z msFlowDropping;		// Discarding the rest of an N-PDU whose first segment was dropped.
+	UInt_z msFlowDropFull;		// Pdus dropped because the MS bucket was full,
+	UInt_z msFlowDropCell;		// because the cell bucket was,
+	UInt_z msFlowDropDelay;		// or to slow TCP down.
+	UInt_z msFlowDropBytes;
 
 	// Can this TBF use the specified uplink?
 	bool canUseUplink(PDCHL1Uplink*up) {
@@ -564,6 +598,8 @@ class MSInfo : public SGSN::MSUEAdapter, public SignalQuality, public MSStat
 	MSStopCause::type msStopCause;
 	//void msRestart();
 	ChannelCodingType msGetChannelCoding(RLCDirType wdir) const;
+	// Bytes per second the MS downlink channels carry at its current coding, the MS bucket leak rate.
+	double msFlowRate() const;
 	int msGetTA() const { return GetTimingAdvance(msTimingError.getCurrent()); }
 	// All MS use the same power params at the moment.
 	int msGetAlpha() const { return GetPowerAlpha(); }
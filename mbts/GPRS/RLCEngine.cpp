@@ -38,7 +38,6 @@ namespace GPRS {
 
 /** RLC block size in bits for given coding standard, GSM 04.60 Table 10.2.1, plus MAC header. */
 // Index is a ChannelCodingType, 0-3 for CS-1 to CS-4.
-const unsigned RLCBlockSizeBytesMax = 53;
 unsigned RLCBlockSizeInBits[4] =
 {
 	// (pat) MAC header, plus RLC data block in octets, plus spare bits.
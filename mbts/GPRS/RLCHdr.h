@@ -268,6 +268,8 @@ struct RLCDownlinkDataBlockHeader // GSM04.60sec10.2.1
 	}
 	void writeRLCHeader(MsgCommon& dest) const;
 	void write(BitVector&dst) const;
+	// Same as write but into the 3 header bytes directly.
+	void pack(ByteType *dst) const;
 	void text(std::ostream&os) const;
 
 	//void setTFI(unsigned wTFI) { b1.mTFI = wTFI; }
@@ -290,6 +292,11 @@ struct RLCDownlinkDataBlockHeader // GSM04.60sec10.2.1
 		MACDownlinkHeader::writeMACHeader(mcw);
 		RLCDownlinkDataBlockHeader::writeRLCHeader(mcw);
 	}
+	void RLCDownlinkDataBlockHeader::pack(ByteType *dst) const {
+		dst[0] = (mPayloadType << 6) | (mRRBP << 4) | (mSP << 3) | mUSF;
+		dst[1] = (mPR << 6) | (mTFI << 1) | mFBI;
+		dst[2] = (mBSN << 1) | mE;
+	}
 	void RLCDownlinkDataBlockHeader::text(std::ostream&os) const {
 		MsgCommonText dst(os);
 		writeMACHeader(dst);
@@ -438,6 +445,9 @@ class RLCDownlinkDataBlock
 	// Convert the Downlink Data Block into a BitVector.
 	// We do this right before sending it down to the encoder.
 	BitVector getBitVector() const;
+	// Or into packed bytes, which the channel coder takes without a BitVector.
+	// Returns the block size in bytes, at most RLCBlockSizeBytesMax.
+	unsigned pack(ByteType *dst) const;
 	void text(std::ostream&os, bool includePayload) const;
 	void text(std::ostream&os) const { text(os,true); }	// Default value doesnt work. Gotta love that C++.
 	
@@ -459,6 +469,12 @@ class RLCDownlinkDataBlock
 		resultpayload.unpack(mPayload.begin()); // unpack mPayload into resultpayload
 		return result;
 	}
+	unsigned RLCDownlinkDataBlock::pack(ByteType *dst) const
+	{
+		RLCDownlinkDataBlockHeader::pack(dst);
+		memcpy(dst+3,mPayload.begin(),mPayload.size());
+		return 3+mPayload.size();
+	}
 	void RLCDownlinkDataBlock::text(std::ostream&os, bool includePayload) const {
 		os << "RLCDownlinkDataBlock=(";
 		RLCDownlinkDataBlockHeader::text(os);
@@ -0,0 +1,86 @@
+/**
+ * Scheduler.cpp
+ * This file is part of the Yate-BTS Project http://www.yatebts.com
+ *
+ * Radio block schedulers for the GPRS MAC
+ *
+ * Yet Another Telephony Engine - Base Transceiver Station
+ * Copyright (C) 2014 Null Team Impex SRL
+ * Copyright (C) 2014 Legba, Inc
+ *
+ * This software is distributed under multiple licenses;
+ * see the COPYING file in the main directory for licensing
+ * information for this specific distribution.
+ *
+ * This use of this software may be subject to additional restrictions.
+ * See the LEGAL file in the main directory for details.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#include "Scheduler.h"
+#include <math.h>
+#include <string.h>
+
+namespace GPRS {
+
+// Elapsed blocks since the last update, -1 if unknown or wrapped around.
+static int elapsed(int bsn, int last)
+{
+	if (last < 0 || bsn < last) { return -1; }
+	return bsn - last;
+}
+
+double SchedHistory::average(int bsn, unsigned window) const
+{
+	int n = elapsed(bsn,mLast);
+	if (n < 0) { return 0; }
+	if (n == 0) { return mAverage; }
+	if (window <= 1) { return 0; }
+	// Each block nothing is served multiplies the average by (1 - 1/window).
+	return mAverage * pow(1.0 - 1.0 / window, n);
+}
+
+int SchedHistory::age(int bsn) const
+{
+	int n = elapsed(bsn,mLast);
+	return (n < 0 || n > SchedNeverServed) ? SchedNeverServed : n;
+}
+
+void SchedHistory::served(int bsn, unsigned window, double bits)
+{
+	double avg = average(bsn,window);
+	if (window <= 1) {
+		mAverage = bits;
+	} else if (elapsed(bsn,mLast) == 0) {
+		// Served again in the same block, on another channel.
+		mAverage = avg + bits / window;
+	} else {
+		// The block being served is one more block of history.
+		mAverage = avg * (1.0 - 1.0 / window) + bits / window;
+	}
+	mLast = bsn;
+}
+
+
+double ProportionalFairScheduler::priority(const SchedCandidate &c) const
+{
+	if (mMaxAge && c.mAge >= (int)mMaxAge) {
+		// Starving: ahead of all the others, the oldest first.
+		return 1e9 + c.mAge;
+	}
+	// One bit keeps a TBF that got nothing lately from dividing by zero;
+	// it still ranks far above the ones that were served.
+	return c.mDemand * c.mRate / (c.mAverage + 1.0);
+}
+
+GprsScheduler *GprsScheduler::create(const char *name, unsigned maxAge)
+{
+	if (!strcmp(name,"round-robin")) { return new RoundRobinScheduler(); }
+	if (!strcmp(name,"proportional-fair")) { return new ProportionalFairScheduler(maxAge); }
+	return NULL;
+}
+
+}; // namespace GPRS
@@ -0,0 +1,93 @@
+/**
+ * Scheduler.h
+ * This file is part of the Yate-BTS Project http://www.yatebts.com
+ *
+ * Radio block schedulers for the GPRS MAC
+ *
+ * Yet Another Telephony Engine - Base Transceiver Station
+ * Copyright (C) 2014 Null Team Impex SRL
+ * Copyright (C) 2014 Legba, Inc
+ *
+ * This software is distributed under multiple licenses;
+ * see the COPYING file in the main directory for licensing
+ * information for this specific distribution.
+ *
+ * This use of this software may be subject to additional restrictions.
+ * See the LEGAL file in the main directory for details.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#ifndef GPRSSCHEDULER_H
+#define GPRSSCHEDULER_H
+
+// The MAC asks the scheduler to rank the TBFs competing for a radio block:
+// the downlink blocks in PDCHL1Downlink::dlService and the uplink USFs in findNeedyUSF.
+// This file does not depend on the rest of the MAC so the schedulers can be
+// exercised by SchedulerTest on synthetic MS populations.
+namespace GPRS {
+
+// What a scheduler knows about a TBF competing for a block.
+struct SchedCandidate {
+	double mRate;		// Payload bits a block would carry at the coding scheme the MS RSSI allows.
+	double mAverage;	// Bits per block recently served to the TBF, see SchedHistory.
+	double mDemand;		// Share of the channel the TBF can use, engineDesiredUtilization().
+	int mAge;		// Blocks since the TBF was last served.
+	SchedCandidate() : mRate(0), mAverage(0), mDemand(1), mAge(0) {}
+};
+
+// Throughput history of a TBF: an exponentially weighted average of the
+// bits served per block, with a time constant of window blocks.
+// It is only updated when the TBF is served and decays when read,
+// so the blocks nobody is served cost nothing.
+// Block numbers are RLCBSN_t values; across the hyperframe wraparound
+// the history reads as long ago, which only resets the average.
+class SchedHistory {
+	double mAverage;	// At block mLast
+	int mLast;		// Block of the last update, -1 if never served
+	public:
+	SchedHistory() : mAverage(0), mLast(-1) {}
+	double average(int bsn, unsigned window) const;
+	// Blocks since the TBF was last served, or SchedNeverServed.
+	int age(int bsn) const;
+	void served(int bsn, unsigned window, double bits);
+};
+const int SchedNeverServed = 0x7fffff;
+
+class GprsScheduler {
+	public:
+	virtual ~GprsScheduler() {}
+	virtual const char *name() const = 0;
+	// The candidate with the highest priority gets the block.
+	virtual double priority(const SchedCandidate &c) const = 0;
+	// False if priority() only looks at mAge, so the rest need not be worked out.
+	virtual bool usesRate() const { return true; }
+	// Make a scheduler from its GPRS.Scheduler name, NULL if unknown.
+	// maxAge is the starvation limit of the proportional fair scheduler, 0 for none.
+	static GprsScheduler *create(const char *name, unsigned maxAge);
+};
+
+// The original behavior: the TBF waiting the longest goes first.
+class RoundRobinScheduler : public GprsScheduler {
+	public:
+	const char *name() const { return "round-robin"; }
+	double priority(const SchedCandidate &c) const { return c.mAge; }
+	bool usesRate() const { return false; }
+};
+
+// Proportional fair: rank by the rate the TBF could get now over the rate it got lately,
+// weighted by how much of the channel it wants.  An MS in good radio conditions is served
+// more when it can use CS-4, an MS on CS-1 still gets its share, and a stalled TBF yields.
+// A TBF not served for maxAge blocks goes ahead of the others so none starves.
+class ProportionalFairScheduler : public GprsScheduler {
+	unsigned mMaxAge;
+	public:
+	ProportionalFairScheduler(unsigned maxAge) : mMaxAge(maxAge) {}
+	const char *name() const { return "proportional-fair"; }
+	double priority(const SchedCandidate &c) const;
+};
+
+}; // namespace GPRS
+#endif
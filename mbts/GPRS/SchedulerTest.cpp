@@ -0,0 +1,281 @@
+/**
+ * SchedulerTest.cpp
+ * This file is part of the Yate-BTS Project http://www.yatebts.com
+ *
+ * Simulation benchmark of the GPRS MAC schedulers
+ *
+ * Yet Another Telephony Engine - Base Transceiver Station
+ * Copyright (C) 2014 Null Team Impex SRL
+ * Copyright (C) 2014 Legba, Inc
+ *
+ * This software is distributed under multiple licenses;
+ * see the COPYING file in the main directory for licensing
+ * information for this specific distribution.
+ *
+ * This use of this software may be subject to additional restrictions.
+ * See the LEGAL file in the main directory for details.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+/*
+	Simulates a population of MSs sharing the downlink of one PDCH and
+	runs every scheduler of Scheduler.h on the same traffic.
+	Half the MSs are near the cell (mean RSSI -32dB), the other half far
+	from it (mean RSSI -48dB).  The RSSI of each MS fades around its mean;
+	like msGetChannelCoding, a block is sent with CS-4 when the RSSI is
+	above GPRS.ChannelCodingControl.RSSI (-40dB) and CS-1 otherwise.
+	Each MS receives 1500 byte packets, either as a Poisson stream of the
+	given load or with a full buffer.  Each block goes to the backlogged MS
+	of highest priority, equal priorities keeping the rotating list order
+	of PDCHL1Downlink::dlService.  The report gives the aggregate and per
+	MS throughput and the packet latency, from arrival to the last block.
+*/
+
+#include "Scheduler.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+#include <list>
+#include <deque>
+#include <vector>
+#include <algorithm>
+
+using namespace std;
+using namespace GPRS;
+
+#define BLOCK_MS	20		// Same as RLCBlockTimeMsecs
+#define CS1_BITS	(20 * 8)	// RLCPayloadSizeInBytes
+#define CS4_BITS	(50 * 8)
+#define FAST_RSSI	-40.0		// GPRS.ChannelCodingControl.RSSI default
+#define PACKET_BITS	(1500 * 8)
+
+static unsigned sMS = 8;		// Number of MSs
+static unsigned sBlocks = 30000;	// Simulated blocks, 10 minutes
+static double sLoad = 0;		// Offered kbit/s per MS, 0 for a full buffer
+static double sNear = -32, sFar = -48;	// Mean RSSI of the two halves
+static double sFading = 6;		// Standard deviation of the RSSI
+static unsigned sCoherence = 25;	// Fading correlation time, in blocks
+static unsigned sWindow = 2000;		// GPRS.Scheduler.Window
+static unsigned sMaxAge = 1000;		// GPRS.Scheduler.MaxAge
+
+// A simulated MS and its downlink TBF
+struct SimMS {
+	double mMean;		// Mean RSSI
+	double mFade;		// Current RSSI offset from the mean
+	deque<unsigned> mArrivals;	// Block each queued packet arrived
+	double mBacklog;	// Bits queued
+	double mHead;		// Bits left of the first packet
+	SchedHistory mHist;
+	// Results
+	double mBits;
+	unsigned mBlocks, mCS4Blocks;
+	vector<unsigned> mLatency;	// Of each delivered packet, in blocks
+	SimMS(double mean) : mMean(mean), mFade(0), mBacklog(0), mHead(0),
+		mBits(0), mBlocks(0), mCS4Blocks(0) {}
+	double rssi() const { return mMean + mFade; }
+	double rate() const { return rssi() >= FAST_RSSI ? CS4_BITS : CS1_BITS; }
+};
+
+// Simulation randomness, the same sequence for every scheduler.
+class SimRandom {
+	unsigned long long mState;
+	public:
+	SimRandom(unsigned seed) : mState(seed * 2862933555777941757ULL + 3037000493ULL) {}
+	double uniform() {
+		mState = mState * 6364136223846793005ULL + 1442695040888963407ULL;
+		return ((mState >> 11) + 0.5) / 9007199254740992.0;
+	}
+	double gauss() { return sqrt(-2 * log(uniform())) * cos(2 * M_PI * uniform()); }
+	// Number of events in one block of a Poisson process
+	unsigned poisson(double mean) {
+		unsigned n = 0;
+		for (double p = exp(-mean), s = p, u = uniform(); u > s; s += p) {
+			p *= mean / ++n;
+			if (n > 1000) { break; }
+		}
+		return n;
+	}
+};
+
+struct SimResult {
+	double mKbps;
+	double mFairness;	// Jain index of the per MS throughput
+	double mLatency;	// Mean packet latency, ms
+	double mLatency95;
+};
+
+static unsigned percentile(vector<unsigned> v, unsigned percent)
+{
+	if (v.empty()) { return 0; }
+	sort(v.begin(),v.end());
+	return v[(v.size() - 1) * percent / 100];
+}
+
+static SimResult simulate(GprsScheduler *sched, unsigned seed, bool verbose)
+{
+	SimRandom rnd(seed);
+	vector<SimMS> ms;
+	for (unsigned i = 0; i < sMS; i++) {
+		ms.push_back(SimMS(i < (sMS + 1) / 2 ? sNear : sFar));
+	}
+	list<unsigned> order;	// The macTBFs rotation
+	for (unsigned i = 0; i < sMS; i++) { order.push_back(i); }
+	unsigned window = sWindow / BLOCK_MS;
+	double rho = exp(-1.0 / sCoherence);
+	double innovation = sFading * sqrt(1 - rho * rho);
+	double arrivals = sLoad * BLOCK_MS / PACKET_BITS;	// Packets per block, kbit/s * ms = bits
+
+	for (unsigned bsn = 0; bsn < sBlocks; bsn++) {
+		for (unsigned i = 0; i < sMS; i++) {
+			SimMS &m = ms[i];
+			m.mFade = rho * m.mFade + innovation * rnd.gauss();
+			unsigned n = sLoad ? rnd.poisson(arrivals) : (m.mBacklog < 2 * PACKET_BITS ? 1 : 0);
+			while (n--) {
+				if (m.mArrivals.empty()) { m.mHead = PACKET_BITS; }
+				m.mArrivals.push_back(bsn);
+				m.mBacklog += PACKET_BITS;
+			}
+		}
+
+		list<unsigned>::iterator best = order.end();
+		double bestprio = 0;
+		for (list<unsigned>::iterator it = order.begin(); it != order.end(); it++) {
+			SimMS &m = ms[*it];
+			if (m.mBacklog <= 0) { continue; }
+			SchedCandidate c;
+			c.mRate = m.rate();
+			c.mAverage = m.mHist.average(bsn,window);
+			c.mDemand = 1.0;
+			c.mAge = m.mHist.age(bsn);
+			double prio = sched->priority(c);
+			if (best == order.end() || prio > bestprio) {
+				best = it;
+				bestprio = prio;
+			}
+		}
+		if (best == order.end()) { continue; }
+
+		unsigned i = *best;
+		order.erase(best);
+		order.push_back(i);
+		SimMS &m = ms[i];
+		double bits = m.rate();
+		m.mHist.served(bsn,window,bits);
+		m.mBlocks++;
+		if (bits == CS4_BITS) { m.mCS4Blocks++; }
+		// Deliver the bits to the queued packets.
+		while (bits > 0 && !m.mArrivals.empty()) {
+			double used = min(bits,m.mHead);
+			bits -= used;
+			m.mHead -= used;
+			m.mBacklog -= used;
+			m.mBits += used;
+			if (m.mHead <= 0) {
+				m.mLatency.push_back(bsn + 1 - m.mArrivals.front());
+				m.mArrivals.pop_front();
+				m.mHead = PACKET_BITS;
+			}
+		}
+		if (m.mArrivals.empty()) { m.mBacklog = 0; }
+	}
+
+	double seconds = sBlocks * BLOCK_MS / 1000.0;
+	SimResult res;
+	double total = 0, sumsq = 0;
+	vector<unsigned> all;
+	if (verbose) {
+		printf("  MS  RSSI  blocks  CS-4%%   kbit/s  packets  latency ms  p95 ms\n");
+	}
+	for (unsigned i = 0; i < sMS; i++) {
+		SimMS &m = ms[i];
+		double kbps = m.mBits / seconds / 1000;
+		total += kbps;
+		sumsq += kbps * kbps;
+		all.insert(all.end(),m.mLatency.begin(),m.mLatency.end());
+		if (verbose) {
+			double lat = 0;
+			for (unsigned j = 0; j < m.mLatency.size(); j++) { lat += m.mLatency[j]; }
+			if (m.mLatency.size()) { lat = lat / m.mLatency.size() * BLOCK_MS; }
+			printf("%4u %5.0f %7u %5.1f %8.2f %8u %11.0f %7u\n",i,m.mMean,m.mBlocks,
+				m.mBlocks ? 100.0 * m.mCS4Blocks / m.mBlocks : 0.0,kbps,
+				(unsigned)m.mLatency.size(),lat,percentile(m.mLatency,95) * BLOCK_MS);
+		}
+	}
+	res.mKbps = total;
+	res.mFairness = sumsq ? total * total / (sMS * sumsq) : 0;
+	double lat = 0;
+	for (unsigned j = 0; j < all.size(); j++) { lat += all[j]; }
+	res.mLatency = all.size() ? lat / all.size() * BLOCK_MS : 0;
+	res.mLatency95 = percentile(all,95) * BLOCK_MS;
+	return res;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,"usage: %s [options]\n"
+		"  -n count   number of MS (%u)\n"
+		"  -b blocks  simulated radio blocks (%u)\n"
+		"  -l kbps    offered load per MS, 0 for a full buffer (%g)\n"
+		"  -r near:far  mean RSSI of the two halves of the MS (%g:%g)\n"
+		"  -f dB      RSSI fading standard deviation (%g)\n"
+		"  -c blocks  fading correlation time (%u)\n"
+		"  -w msecs   GPRS.Scheduler.Window (%u)\n"
+		"  -a msecs   GPRS.Scheduler.MaxAge (%u)\n"
+		"  -x seed    random seed\n"
+		"  -v         print the per MS results\n",
+		prog,sMS,sBlocks,sLoad,sNear,sFar,sFading,sCoherence,sWindow,sMaxAge);
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned seed = 1;
+	bool verbose = false;
+	int opt;
+	while ((opt = getopt(argc,argv,"n:b:l:r:f:c:w:a:x:vh")) != -1) {
+		switch (opt) {
+		case 'n': sMS = atoi(optarg); break;
+		case 'b': sBlocks = atoi(optarg); break;
+		case 'l': sLoad = atof(optarg); break;
+		case 'r': sscanf(optarg,"%lf:%lf",&sNear,&sFar); break;
+		case 'f': sFading = atof(optarg); break;
+		case 'c': sCoherence = atoi(optarg); break;
+		case 'w': sWindow = atoi(optarg); break;
+		case 'a': sMaxAge = atoi(optarg); break;
+		case 'x': seed = atoi(optarg); break;
+		case 'v': verbose = true; break;
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+	if (!sMS || !sCoherence || !sBlocks) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	const char *names[] = { "round-robin", "proportional-fair" };
+	printf("%u MS, %u blocks, %s, RSSI %g/%g dB fading %g dB\n",sMS,sBlocks,
+		sLoad ? "Poisson traffic" : "full buffer",sNear,sFar,sFading);
+	if (sLoad) { printf("offered %.1f kbit/s per MS\n",sLoad); }
+	printf("%-18s %9s %9s %11s %8s\n","scheduler","kbit/s","fairness","latency ms","p95 ms");
+	int ret = 0;
+	for (unsigned s = 0; s < sizeof(names) / sizeof(names[0]); s++) {
+		GprsScheduler *sched = GprsScheduler::create(names[s],sMaxAge / BLOCK_MS);
+		if (!sched) {
+			fprintf(stderr,"no scheduler %s\n",names[s]);
+			ret = 1;
+			continue;
+		}
+		if (verbose) { printf("%s:\n",sched->name()); }
+		SimResult r = simulate(sched,seed,verbose);
+		printf("%-18s %9.2f %9.3f %11.0f %8.0f\n",sched->name(),r.mKbps,r.mFairness,r.mLatency,r.mLatency95);
+		delete sched;
+	}
+	return ret;
+}
@@ -141,20 +141,38 @@ TBF *TBF::newUpTBF(MSInfo *ms,RLCMsgChannelRequestDescriptionIE &mCRD,
 	return tbf;
 }
 
-ChannelCodingType TBF::mtChannelCoding() const
-{	// Return 0 - 3 for CS-1 or CS-4 for data transfer.
+ChannelCodingType TBF::mtPickChannelCoding() const
+{
 	assert(mtChannelCodingMax >= ChannelCodingCS1 && mtChannelCodingMax <= ChannelCodingCS4);
-	ChannelCodingType result;
 	if (mtChannelCodingMax == ChannelCodingCS1) {
-		result = ChannelCodingCS1;	// Locked to lowest speed.  No need to query the MS RSSI.
-	} else {
-		ChannelCodingType dynamicCS = mtMS->msGetChannelCoding(mtDir);
-		result = min(mtChannelCodingMax,dynamicCS);
+		return ChannelCodingCS1;	// Locked to lowest speed.  No need to query the MS RSSI.
 	}
+	ChannelCodingType dynamicCS = mtMS->msGetChannelCoding(mtDir);
+	return min(mtChannelCodingMax,dynamicCS);
+}
+
+ChannelCodingType TBF::mtChannelCoding() const
+{	// Return 0 - 3 for CS-1 or CS-4 for data transfer.
+	ChannelCodingType result = mtPickChannelCoding();
 	mtMS->msChannelCoding.addPoint((int)result);
 	return result;
 }
 
+// What the scheduler needs to rank this TBF for a block.
+// The rate follows the coding scheme the MS RSSI allows, see msGetChannelCoding.
+// Round robin only needs the age.
+SchedCandidate TBF::mtSchedCandidate(RLCBSN_t bsn)
+{
+	SchedCandidate c;
+	if (gL2MAC.macScheduler->usesRate()) {
+		c.mRate = RLCPayloadSizeInBytes[mtPickChannelCoding()] * 8;
+		c.mAverage = mtSched.average(bsn,gL2MAC.macSchedWindow);
+		c.mDemand = engineDesiredUtilization();
+	}
+	c.mAge = mtSched.age(bsn);
+	return c;
+}
+
 
 TBF::TBF(MSInfo *wms, RLCDirType wdir)
 	:  mtState(TBFState::Unused), mtDebugId(++Stats.countTBF), mtMS(wms), mtDir(wdir), mtTFI(-1)
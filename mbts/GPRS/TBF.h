@@ -27,6 +27,7 @@
 //#include "BSSG.h"
 #include "Utils.h"
 #include "MSInfo.h"
+#include "Scheduler.h"
 
 namespace GPRS {
 class MSInfo;
@@ -457,6 +458,11 @@ class TBF :
 	ChannelCodingType mtChannelCodingMax;	// The max channel coding (0-3) allowed for this TBF.
 	ChannelCodingType mtCCMin, mtCCMax;		// Saved for reporting purposes.
 	ChannelCodingType mtChannelCoding() const; 	// Return 0 - 3 for CS-1 or CS-4 for data transfer.
+	ChannelCodingType mtPickChannelCoding() const;	// Same, without adding to the MS statistics.
+
+	// Blocks served to this TBF, for the scheduler in gL2MAC.macScheduler.
+	SchedHistory mtSched;
+	SchedCandidate mtSchedCandidate(RLCBSN_t bsn);
 
 	// Note that this TBF is a base class of either an RLCEngineUp or RLCEngineDown,
 	// depending on the TBF direction.
@@ -38,7 +38,7 @@ GSMConfig::GSMConfig()
 	mSI1(NULL),mSI2(NULL),mSI3(NULL),mSI4(NULL),
 	mSI5(NULL),mSI6(NULL),
 	mStartTime(::time(NULL)),
-	mChangemark(0)
+	mChangemark(0),mSI5Changemark(0)
 {
 }
 
@@ -176,6 +176,13 @@ void GSMConfig::regenerateSI5()
 	std::vector<unsigned> neighbors = gNeighborTable.ARFCNList();
 	// if the neighbor list is emtpy, put ourselves on it
 	if (neighbors.size()==0) neighbors.push_back(gConfig.getNum("GSM.Radio.C0"));
+	// Every SACCH asks for this before each SI5 it sends.
+	// Keep the encoded frame until the beacon or the neighbor list changes,
+	// unless random neighbors must be added to each copy.
+	if (mSI5 && mSI5Changemark==mChangemark && mSI5Neighbors==neighbors &&
+		gConfig.getFloat("GSM.Cipher.RandomNeighbor")==0) return;
+	mSI5Changemark = mChangemark;
+	mSI5Neighbors = neighbors;
 	L3SystemInformationType5 *SI5 = new L3SystemInformationType5(neighbors);
 	if (mSI5) delete mSI5;
 	mSI5 = SI5;
@@ -263,7 +270,7 @@ int testGoodness(vector<ChanType*>& chanList, int lo, int hi)
 	}
 	if (hi < (int)chanList.size()-1) {
 		ChanType *ch2 = chanList[hi+1];	// ch2 is above ch hi
-		if (testAdjacent(ch2,chanList[hi])) {
+		if (testAdjacent(chanList[hi],ch2)) {
 			if (ch2->inUseByGPRS()) { goodness += 2; }
 			else if (ch2->recyclable()) { goodness += 1; }
 		}
@@ -282,46 +289,38 @@ int testGoodness(vector<ChanType*>& chanList, int lo, int hi)
 // Return the allocated channels in the array pointed to by results and
 // return number of channels found.
 template <class ChanType>
-static unsigned getChanGroup(vector<ChanType*>& chanList, ChanType **results)
+static bool chanGroupFree(ChanType *chan)
 {
-	const unsigned sz = chanList.size();
-	if (sz==0) return 0;
+	return !chan->inUseByGPRS() && chan->recyclable();
+}
 
-	const bool backwards = true;	// Currently we always search backwards.
-	// To search forwards, dont forget to invert besti,bestn below
-	ChanType *prevFreeCh = NULL;	// unneeded initialization
-	int curN = 0;					// current number of adjacent free channels.
-	int bestI=0, bestN=0;			// best match
+template <class ChanType>
+static unsigned getChanGroup(vector<ChanType*>& chanList, unsigned groupSize, ChanType **results)
+{
+	const int sz = chanList.size();
+	if (groupSize > 8) { groupSize = 8; }	// No more than the timeslots of one ARFCN.
+	int bestLo = 0, bestN = 0;		// best match
 	int bestGoodness = 0;			// goodness of best match
-	for (unsigned i=0; i<sz; i++) {
-		ChanType *chan = chanList[backwards ? sz-i-1 : i];
-		if (chan->inUseByGPRS()) { continue; }
-		if (! chan->recyclable()) { continue; }
-		if (bestN == 0) {
-			bestI = i;
-			curN = bestN = 1;
-			bestGoodness = testGoodness(chanList,bestI,bestN);
-		} else {
-			if (testAdjacent<ChanType>(chan,prevFreeCh)) {
-				curN++; 	// chan is adjacent to prevCh.
-				int curGoodness = testGoodness(chanList,i,curN);
-				if (curN > bestN || (curN == bestN && curGoodness > bestGoodness)) {
-					// Best so far, so remember it.
-					bestN = curN;
-					bestI = i;
-					bestGoodness = curGoodness;
-					// optional early termination test
-					//if (bestN >= groupSize && bestIsAdjacent) { goto finished; }
-				}
-			} else {
-				curN = 0;
-			}
+	// Each free channel, searching backwards, is the top of a group extending down
+	// over the adjacent free channels, up to groupSize of them.
+	for (int hi = sz-1; hi >= 0; hi--) {
+		if (! chanGroupFree(chanList[hi])) { continue; }
+		int lo = hi;
+		while (lo > 0 && hi-lo+1 < (int)groupSize && chanGroupFree(chanList[lo-1]) &&
+		       testAdjacent<ChanType>(chanList[lo-1],chanList[lo])) {
+			lo--;
+		}
+		int curN = hi-lo+1;
+		int curGoodness = testGoodness(chanList,lo,hi);
+		if (curN > bestN || (curN == bestN && curGoodness > bestGoodness)) {
+			// Best so far, so remember it.
+			bestN = curN;
+			bestLo = lo;
+			bestGoodness = curGoodness;
 		}
-		prevFreeCh = chan;
 	}
-	//finished:
 	for (int j = 0; j < bestN; j++) {
-		results[j] = chanList[bestI+j];
+		results[j] = chanList[bestLo+j];
 	}
 	return bestN;
 }
@@ -331,7 +330,7 @@ static unsigned getChanGroup(vector<ChanType*>& chanList, ChanType **results)
 int GSMConfig::getTCHGroup(int groupSize,TCHFACCHLogicalChannel **results)
 {
 	ScopedLock lock(mLock);
-	int nfound = getChanGroup<TCHFACCHLogicalChannel>(mTCHPool,results);
+	int nfound = getChanGroup<TCHFACCHLogicalChannel>(mTCHPool,groupSize,results);
 	for (int i = 0; i < nfound; i++) {
 		results[i]->debugGetL1()->setGPRS(true,NULL);
 	}
@@ -131,6 +131,12 @@ class GSMConfig {
 
 	unsigned mChangemark;
 
+	/**@name What mSI5Frame was last encoded from. */
+	//@{
+	unsigned mSI5Changemark;
+	std::vector<unsigned> mSI5Neighbors;
+	//@}
+
 
 
 	void crackPagingFromImsi(unsigned imsiMod1000,unsigned &ccch_group,unsigned &paging_Index);;
@@ -199,6 +205,7 @@ class GSMConfig {
 	/**
 		SI5 is generated separately because it may get random
 		neighbors added each time it's sent.
+		Otherwise it is only re-encoded when the beacon or the neighbor list changed.
 	*/
 	void regenerateSI5();
 
@@ -858,7 +858,7 @@ void XCCHL1Decoder::handleGoodFrame()
 			LOG(NOTICE) << "fuzzing input frame, flipped bit " << i;
 		}
 		// Send all bits to GSMTAP
-		if (gConfig.getBool("Control.GSMTAP.GSM")) {
+		if (gGSMTAP.gsm()) {
 			// FIXME -- This repeatLengh>51 is a bit of a hack.
 			gWriteGSMTAP(ARFCN(),TN(),mReadTime.FN(),typeAndOffset(),mMapping.repeatLength()>51,true,mD);
 		}
@@ -1032,7 +1032,7 @@ void XCCHL1Encoder::sendFrame(const L2Frame& frame)
 
 	// Send to GSMTAP
 	frame.copyToSegment(mU,headerOffset());
-	if (gConfig.getBool("Control.GSMTAP.GSM")) {
+	if (gGSMTAP.gsm()) {
 		gWriteGSMTAP(ARFCN(),TN(),mNextWriteTime.FN(),typeAndOffset(),mMapping.repeatLength()>51,false,mU);
 	}
 
@@ -1280,30 +1280,76 @@ void NDCCHL1Encoder::serviceLoop()
 
 
 
+BCCHL1Encoder::BCCHL1Encoder(L1FEC *wParent)
+	:NDCCHL1Encoder(0,0,gBCCHMapping,wParent)
+{
+	for (unsigned si=0; si<sNumSI; si++) {
+		for (int B=0; B<4; B++) mSIBursts[si][B] = BitVector(114);
+		mSIChangemark[si] = 0;
+		mSIValid[si] = false;
+	}
+}
+
+
+// The SI messages only change in GSMConfig::regenerateBeacon, which bumps
+// the changemark, so each one is channel coded once and its bursts replayed
+// until then.
 void BCCHL1Encoder::generate()
 {
 	OBJLOG(DEBUG) << "BCCHL1Encoder " << mNextWriteTime;
-	// Make a copy of the desired frame with the system information locked
-	L2Frame frame;
-	gBTS.infoLock().lock();
 	// BCCH mapping, GSM 05.02 6.3.1.3
 	// Since we're not doing GPRS or VGCS, it's just SI1-4 over and over.
 	// pat 8-2011: If we are doing GPRS, the SI13 must be in slot 4.
+	// Index 0-3 is SI1-4, 4 is SI13.
+	unsigned si;
 	switch (mNextWriteTime.TC()) {
-		// (pat) Maps to: XCCHL1Encoder::writeHighSide.
-		case 0: frame = gBTS.SI1Frame(); break;
-		case 1: frame = gBTS.SI2Frame(); break;
-		case 2: frame = gBTS.SI3Frame(); break;
-		case 3: frame = gBTS.SI4Frame(); break;
-		case 4: frame = GPRS::GPRSConfig::IsEnabled() ? gBTS.SI13Frame() : gBTS.SI3Frame();
-			break;
-		case 5: frame = gBTS.SI2Frame(); break;
-		case 6: frame = gBTS.SI3Frame(); break;
-		case 7: frame = gBTS.SI4Frame(); break;
+		case 0: si = 0; break;
+		case 1: si = 1; break;
+		case 2: si = 2; break;
+		case 3: si = 3; break;
+		case 4: si = GPRS::GPRSConfig::IsEnabled() ? 4 : 2; break;
+		case 5: si = 1; break;
+		case 6: si = 2; break;
+		case 7: si = 3; break;
 		default: assert(0);
 	}
+	// Make a copy of a changed frame with the system information locked
+	bool stale = false;
+	gBTS.infoLock().lock();
+	if (!mSIValid[si] || mSIChangemark[si] != gBTS.changemark()) {
+		stale = true;
+		switch (si) {
+			case 0: mSIFrame[si] = gBTS.SI1Frame(); break;
+			case 1: mSIFrame[si] = gBTS.SI2Frame(); break;
+			case 2: mSIFrame[si] = gBTS.SI3Frame(); break;
+			case 3: mSIFrame[si] = gBTS.SI4Frame(); break;
+			case 4: mSIFrame[si] = gBTS.SI13Frame(); break;
+		}
+		mSIChangemark[si] = gBTS.changemark();
+		mSIValid[si] = true;
+	}
 	gBTS.infoLock().unlock();
-	writeHighSide(frame);
+
+	if (!active()) { LOG(INFO) << "BCCHL1Encoder sending on non-active channel"; }
+	resync();
+	if (mDownstream==NULL) {
+		LOG(WARNING) << "BCCHL1Encoder with no downstream";
+		return;
+	}
+	// Same as XCCHL1Encoder::sendFrame, but the channel coding is skipped
+	// unless the frame changed.
+	const L2Frame& frame = mSIFrame[si];
+	if (stale || gGSMTAP.gsm()) frame.copyToSegment(mU,headerOffset());
+	if (gGSMTAP.gsm()) {
+		gWriteGSMTAP(ARFCN(),TN(),mNextWriteTime.FN(),typeAndOffset(),mMapping.repeatLength()>51,false,mU);
+	}
+	if (stale) {
+		OBJLOG(INFO) << "BCCHL1Encoder encoding SI index " << si << " changemark " << mSIChangemark[si];
+		encodeFrame41(frame,headerOffset(),false);
+		for (int B=0; B<4; B++) mI[B].copyToSegment(mSIBursts[si][B],0);
+	}
+	const int qCS1[8] = { 1,1,1,1,1,1,1,1 };   // magically identifies CS-1.
+	transmit(mSIBursts[si],mE,qCS1);
 }
 
 
@@ -1787,7 +1833,7 @@ void TCHFACCHL1Encoder::dispatch()
 		OBJLOG(DEBUG) <<"TCHFACCHL1Encoder FACCH " << *fFrame;
 		currentFACCH = true;
 		// Send to GSMTAP
-		if (gConfig.getBool("Control.GSMTAP.GSM")) {
+		if (gGSMTAP.gsm()) {
 			gWriteGSMTAP(ARFCN(),TN(),mNextWriteTime.FN(),typeAndOffset(),mMapping.repeatLength()>51,false,*fFrame);
 		}
 		// Copy the L2 frame into u[] for processing.
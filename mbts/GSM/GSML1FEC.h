@@ -1272,11 +1272,18 @@ void *NDCCHL1EncoderServiceLoopAdapter(NDCCHL1Encoder*);
 */
 class BCCHL1Encoder : public NDCCHL1Encoder {
 
+	/**@name SI1-4 and SI13 encoded down to the interleaved bursts. */
+	//@{
+	static const unsigned sNumSI = 5;
+	L2Frame mSIFrame[sNumSI];		///< the frames, for GSMTAP
+	BitVector mSIBursts[sNumSI][4];	///< i[][] of each frame
+	unsigned mSIChangemark[sNumSI];	///< gBTS.changemark() when encoded
+	bool mSIValid[sNumSI];
+	//@}
+
 	public:
 
-	BCCHL1Encoder(L1FEC *wParent)
-		:NDCCHL1Encoder(0,0,gBCCHMapping,wParent)
-	{}
+	BCCHL1Encoder(L1FEC *wParent);
 
 	private:
 
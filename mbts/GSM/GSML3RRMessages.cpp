@@ -231,6 +231,31 @@ void L3PagingRequestType1::writeBody(L3Frame& dest, size_t &wp) const
 }
 
 
+L3Frame* L3PagingRequestType1::frame(const L3Frame& id1, ChannelType type1,
+	const L3Frame* id2, ChannelType type2)
+{
+	// Same layout as write() and writeBody() above.
+	size_t len = 3 + id1.length();
+	if (id2) len += 1 + id2->length();
+	L3Frame *dest = new L3Frame(UNIT_DATA,8*len);
+	size_t wp = 0;
+	dest->writeField(wp,0,4);
+	dest->writeField(wp,L3RadioResourcePD,4);
+	dest->writeField(wp,PagingRequestType1,8);
+	dest->writeField(wp,channelNeededCode(id2 ? type2 : AnyDCCHType),2);
+	dest->writeField(wp,channelNeededCode(type1),2);
+	dest->writeField(wp,0x0,4);
+	id1.copyToSegment(*dest,wp);
+	wp += id1.size();
+	if (id2) {
+		dest->writeField(wp,0x17,8);
+		id2->copyToSegment(*dest,wp);
+	}
+	dest->L2Length(len);
+	return dest;
+}
+
+
 void L3PagingRequestType1::text(ostream& os) const
 {
 	L3RRMessage::text(os);
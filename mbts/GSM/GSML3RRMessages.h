@@ -225,6 +225,15 @@ class L3PagingRequestType1 : public L3RRMessageNRO {
 
 	unsigned chanCode(ChannelType) const;
 
+	/**
+		Encode the message from mobile IDs already written with writeLV,
+		without building the message object.  This is the pager fast path.
+		@param id2 The second mobile ID, or NULL.
+		@return A new UNIT_DATA frame, the same as L3Frame(L3PagingRequestType1(...),UNIT_DATA).
+	*/
+	static L3Frame* frame(const L3Frame& id1, ChannelType type1,
+		const L3Frame* id2=NULL, ChannelType type2=AnyDCCHType);
+
 	int MTI() const { return PagingRequestType1; }
 
 	size_t l2BodyLength() const;
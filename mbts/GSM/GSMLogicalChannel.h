@@ -517,6 +517,9 @@ class CCCHLogicalChannel : public NDCCHLogicalChannel {
 			mQ.write(new L3Frame((const L3Message&)msg,UNIT_DATA));
 		}
 
+	/** Queue an encoded UNIT_DATA frame, the channel takes ownership. */
+	void send(L3Frame* frame) { mQ.write(frame); }
+
 	void send(const L3Message&) { assert(0); }
 
 	/** This is a loop in its own thread that empties mQ. */
@@ -18,8 +18,22 @@
 #include <Sockets.h>
 #include <Globals.h>
 #include <Logger.h>
+#include <Utils.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <errno.h>
+
+#define GSMTAP_RING_MASK (GSMTAP_RING_SIZE - 1)
+// Most packets sent in one system call
+#define GSMTAP_BATCH_MAX 32
+// Sleep interval of the capture thread when there is nothing to send
+#define GSMTAP_IDLE_US 5000
+// pcapng link type of GSMTAP packets without the UDP/IP encapsulation, LINKTYPE_GSMTAP_UM
+#define PCAPNG_LINKTYPE_GSMTAP_UM 217
 
 UDPSocket GSMTAPSocket;
+GSMTAPCapture gGSMTAP;
 
 void gWriteGSMTAP(unsigned ARFCN, unsigned TS, unsigned FN,
                   GSM::TypeAndOffset to, bool is_saach,
@@ -27,20 +41,7 @@ void gWriteGSMTAP(unsigned ARFCN, unsigned TS, unsigned FN,
                   const BitVector& frame,
 				  unsigned wType)	// Defaults to GSMTAP_TYPE_UM
 {
-	char buffer[MAX_UDP_LENGTH];
-	int ofs = 0;
-
-	// Check if GSMTap is enabled
-	if (!gConfig.defines("Control.GSMTAP.TargetIP")) return;
-
-	// Port configuration
-	unsigned port = GSMTAP_UDP_PORT;	// default port for GSM-TAP
-	if (gConfig.defines("Control.GSMTAP.TargetPort"))
-		port = gConfig.getNum("Control.GSMTAP.TargetPort");
-
-	// Set socket destination
-	GSMTAPSocket.destination(port,gConfig.getStr("Control.GSMTAP.TargetIP").c_str());
-
+	// The settings are read by the capture thread, see GSMTAPCapture::refresh.
 	// Decode TypeAndOffset
 	uint8_t stype, scn;
 
@@ -109,15 +110,79 @@ void gWriteGSMTAP(unsigned ARFCN, unsigned TS, unsigned FN,
 	if (is_saach)
 		stype |= GSMTAP_CHANNEL_ACCH;
 
-	// Flags in ARFCN
-	if (gConfig.getNum("GSM.Radio.Band") == 1900)
-		ARFCN |= GSMTAP_ARFCN_F_PCS;
+	gGSMTAP.queue(stype,scn,TS,ARFCN,ul_dln,FN,frame,wType);
+}
+
+
+GSMTAPCapture::GSMTAPCapture()
+	:mRing(NULL),mHead(0),mTail(0),
+	mGSM(false),mGPRS(false),mPCS(false),mChannels(0xffffffff),mTimeslots(0xff),
+	mSending(false),mWriting(false),mMaxRate(0),mFile(NULL),
+	mQueued(0),mFiltered(0),mDropped(0),mLimited(0),mSent(0),mSendErrors(0),mWritten(0),mBatches(0)
+{ }
+
+
+void GSMTAPCapture::start()
+{
+	if (mRing) return;
+	mRing = new Record[GSMTAP_RING_SIZE];
+	for (unsigned i=0; i<GSMTAP_RING_SIZE; i++) mRing[i].mSeq = i;
+	mHead = mTail = 0;
+	refresh();
+	mThread.start(runFunc,this);
+}
+
+
+bool GSMTAPCapture::wanted(uint8_t subType, unsigned TS) const
+{
+	if (!(mTimeslots & (1 << (TS & 7)))) return false;
+	if (subType & GSMTAP_CHANNEL_ACCH) return mChannels & (1U << 31);
+	return mChannels & (1U << (subType & 0x1f));
+}
 
-	if (ul_dln)
-		ARFCN |= GSMTAP_ARFCN_F_UPLINK;
+
+// Copy a packet into the ring, never blocks.
+// This is the bounded multiple producers queue of LogConnection:
+// the slot for position p is free when its sequence is p and filled at p + 1.
+void GSMTAPCapture::queue(uint8_t subType, uint8_t subSlot, unsigned TS, unsigned ARFCN, bool uplink,
+	unsigned FN, const BitVector& frame, unsigned wType)
+{
+	if (!mRing || (!mSending && !mWriting)) return;
+	if (!wanted(subType,TS)) {
+		__sync_fetch_and_add(&mFiltered,1);
+		return;
+	}
+	unsigned len = sizeof(struct gsmtap_hdr) + ((frame.size() + 7) >> 3);
+	if (len > GSMTAP_RECORD_MAX) {
+		__sync_fetch_and_add(&mDropped,1);
+		return;
+	}
+
+	unsigned pos = mHead;
+	Record* r;
+	while (true) {
+		r = mRing + (pos & GSMTAP_RING_MASK);
+		unsigned seq = r->mSeq;
+		__sync_synchronize();
+		int diff = (int)(seq - pos);
+		if (!diff) {
+			if (__sync_bool_compare_and_swap(&mHead,pos,pos + 1)) break;
+		} else if (diff < 0) {
+			// Full, the capture thread is behind.
+			__sync_fetch_and_add(&mDropped,1);
+			return;
+		}
+		pos = mHead;
+	}
+
+	gettimeofday(&r->mTime,NULL);
+
+	// Flags in ARFCN
+	if (mPCS) ARFCN |= GSMTAP_ARFCN_F_PCS;
+	if (uplink) ARFCN |= GSMTAP_ARFCN_F_UPLINK;
 
 	// Build header
-	struct gsmtap_hdr *header = (struct gsmtap_hdr *)buffer;
+	struct gsmtap_hdr *header = (struct gsmtap_hdr *)r->mData;
 	header->version			= GSMTAP_VERSION;
 	header->hdr_len			= sizeof(struct gsmtap_hdr) >> 2;
 	header->type			= wType;	//GSMTAP_TYPE_UM;
@@ -126,19 +191,239 @@ void gWriteGSMTAP(unsigned ARFCN, unsigned TS, unsigned FN,
 	header->signal_dbm		= 0; /* FIXME */
 	header->snr_db			= 0; /* FIXME */
 	header->frame_number	= htonl(FN);
-	header->sub_type		= stype;
+	header->sub_type		= subType;
 	header->antenna_nr		= 0;
-	header->sub_slot		= scn;
+	header->sub_slot		= subSlot;
 	header->res				= 0;
 
-	ofs += sizeof(*header);
-
 	// Add frame data
-	frame.pack((unsigned char*)&buffer[ofs]);
-	ofs += (frame.size() + 7) >> 3;
+	frame.pack(r->mData + sizeof(struct gsmtap_hdr));
+	r->mLen = len;
+	__sync_synchronize();
+	r->mSeq = pos + 1;
+	__sync_fetch_and_add(&mQueued,1);
+}
+
+
+void* GSMTAPCapture::runFunc(void* arg)
+{
+	static_cast<GSMTAPCapture*>(arg)->run();
+	return NULL;
+}
+
 
-	// Write the GSMTAP packet
-	GSMTAPSocket.write(buffer, ofs);
+// The capture thread: read the settings once a second, drain the ring in batches.
+void GSMTAPCapture::run()
+{
+	const char* buffers[GSMTAP_BATCH_MAX];
+	size_t lengths[GSMTAP_BATCH_MAX];
+	Record* batch[GSMTAP_BATCH_MAX];
+	double lastRefresh = timef();
+	double last = lastRefresh;
+	// Start with a full bucket, the first second is not cut short.
+	double tokens = mMaxRate;
+	while (true) {
+		double now = timef();
+		if (now - lastRefresh >= 1.0) {
+			refresh();
+			if (mFile) fflush(mFile);
+			lastRefresh = now;
+		}
+		// Rate limit: a token bucket holding up to one second of Control.GSMTAP.MaxRate.
+		if (mMaxRate) {
+			tokens += (now - last) * mMaxRate;
+			if (tokens > mMaxRate) tokens = mMaxRate;
+		}
+		last = now;
+
+		unsigned n = 0;
+		while (n < GSMTAP_BATCH_MAX) {
+			Record* r = mRing + (mTail & GSMTAP_RING_MASK);
+			unsigned seq = r->mSeq;
+			__sync_synchronize();
+			if (seq != mTail + 1) break;
+			mTail++;
+			if (mMaxRate) {
+				if (tokens < 1) {
+					__sync_fetch_and_add(&mLimited,1);
+					r->mSeq = seq - 1 + GSMTAP_RING_SIZE;
+					continue;
+				}
+				tokens -= 1;
+			}
+			batch[n] = r;
+			buffers[n] = (const char*)r->mData;
+			lengths[n] = r->mLen;
+			n++;
+		}
+		if (!n) {
+			usleep(GSMTAP_IDLE_US);
+			continue;
+		}
+
+		if (mSending) {
+			int sent = GSMTAPSocket.write(buffers,lengths,n);
+			if (sent < 0) sent = 0;
+			__sync_fetch_and_add(&mSent,sent);
+			__sync_fetch_and_add(&mSendErrors,n - sent);
+			__sync_fetch_and_add(&mBatches,1);
+		}
+		if (mFile) {
+			for (unsigned i=0; i<n; i++) writeFile(batch[i]);
+		}
+		// Give the slots back to the writers.
+		__sync_synchronize();
+		for (unsigned i=0; i<n; i++) batch[i]->mSeq += GSMTAP_RING_SIZE - 1;
+	}
+}
+
+
+// Read the Control.GSMTAP settings.
+void GSMTAPCapture::refresh()
+{
+	mGSM = gConfig.getBool("Control.GSMTAP.GSM");
+	mGPRS = gConfig.getBool("Control.GSMTAP.GPRS");
+	mPCS = gConfig.getNum("GSM.Radio.Band") == 1900;
+	mMaxRate = gConfig.getNum("Control.GSMTAP.MaxRate");
+
+	// Destination
+	std::string target;
+	if (gConfig.defines("Control.GSMTAP.TargetIP")) {
+		std::string ip = gConfig.getStr("Control.GSMTAP.TargetIP");
+		unsigned port = GSMTAP_UDP_PORT;	// default port for GSM-TAP
+		if (gConfig.defines("Control.GSMTAP.TargetPort"))
+			port = gConfig.getNum("Control.GSMTAP.TargetPort");
+		if (ip.size()) {
+			target = format("%s:%u",ip.c_str(),port);
+			if (target != mTarget) GSMTAPSocket.destination(port,ip.c_str());
+		}
+	}
+	if (target != mTarget) {
+		ScopedLock lock(mLock);
+		mTarget = target;
+	}
+	mSending = !target.empty();
+
+	std::string filter = gConfig.getStr("Control.GSMTAP.Filter");
+	if (filter != mFilter) {
+		// Channel names and timeslots TN0..TN7; none of a kind means all of them.
+		unsigned channels = 0, timeslots = 0;
+		char *copy = strdup(filter.c_str());
+		char *save = NULL;
+		for (char *tok = strtok_r(copy," ,",&save); tok; tok = strtok_r(NULL," ,",&save)) {
+			if (!strncasecmp(tok,"TN",2) && tok[2] >= '0' && tok[2] <= '7' && !tok[3])
+				timeslots |= 1 << (tok[2] - '0');
+			else if (!strcasecmp(tok,"BCCH"))
+				channels |= 1 << GSMTAP_CHANNEL_BCCH;
+			else if (!strcasecmp(tok,"CCCH"))
+				channels |= (1 << GSMTAP_CHANNEL_CCCH) | (1 << GSMTAP_CHANNEL_RACH) |
+					(1 << GSMTAP_CHANNEL_AGCH) | (1 << GSMTAP_CHANNEL_PCH);
+			else if (!strcasecmp(tok,"SDCCH"))
+				channels |= (1 << GSMTAP_CHANNEL_SDCCH) | (1 << GSMTAP_CHANNEL_SDCCH4) |
+					(1 << GSMTAP_CHANNEL_SDCCH8);
+			else if (!strcasecmp(tok,"TCH"))
+				channels |= (1 << GSMTAP_CHANNEL_TCH_F) | (1 << GSMTAP_CHANNEL_TCH_H);
+			else if (!strcasecmp(tok,"CBCH"))
+				channels |= (1 << GSMTAP_CHANNEL_CBCH51) | (1 << GSMTAP_CHANNEL_CBCH52);
+			else if (!strcasecmp(tok,"PDCH"))
+				channels |= (1 << GSMTAP_CHANNEL_PDCH) | (1 << GSMTAP_CHANNEL_PACCH);
+			else if (!strcasecmp(tok,"PTCCH"))
+				channels |= 1 << GSMTAP_CHANNEL_PTCCH;
+			else if (!strcasecmp(tok,"SACCH"))
+				channels |= 1U << 31;
+			else
+				LOG(WARNING) << "unknown Control.GSMTAP.Filter entry " << tok;
+		}
+		free(copy);
+		mChannels = channels ? channels : 0xffffffff;
+		mTimeslots = timeslots ? timeslots : 0xff;
+		ScopedLock lock(mLock);
+		mFilter = filter;
+	}
+
+	std::string fileName = gConfig.getStr("Control.GSMTAP.File");
+	if (fileName != mFileName) {
+		openFile(fileName);
+		ScopedLock lock(mLock);
+		mFileName = fileName;
+	}
+}
+
+
+// Start a pcapng file: a section header and one interface of GSMTAP packets.
+void GSMTAPCapture::openFile(const std::string& name)
+{
+	mWriting = false;
+	if (mFile) {
+		fclose(mFile);
+		mFile = NULL;
+	}
+	if (name.empty()) return;
+	FILE* file = fopen(name.c_str(),"wb");
+	if (!file) {
+		LOG(ERR) << "cannot open GSMTAP capture file " << name << ": " << strerror(errno);
+		return;
+	}
+	// Section Header Block, in host byte order; the magic tells the readers which.
+	uint32_t shb[7] = { 0x0a0d0d0a, 28, 0x1a2b3c4d, 0x00000001, 0xffffffff, 0xffffffff, 28 };
+	// Interface Description Block, microsecond timestamps by default.
+	uint32_t idb[5] = { 0x00000001, 20, PCAPNG_LINKTYPE_GSMTAP_UM, 0, 20 };
+	if (fwrite(shb,sizeof(shb),1,file) != 1 || fwrite(idb,sizeof(idb),1,file) != 1) {
+		LOG(ERR) << "cannot write GSMTAP capture file " << name;
+		fclose(file);
+		return;
+	}
+	LOG(NOTICE) << "writing GSMTAP capture to " << name;
+	mFile = file;
+	mWriting = true;
+}
+
+
+// Append an Enhanced Packet Block.
+void GSMTAPCapture::writeFile(const Record* r)
+{
+	unsigned padded = (r->mLen + 3) & ~3;
+	uint32_t total = 32 + padded;
+	uint64_t usec = (uint64_t)r->mTime.tv_sec * 1000000 + r->mTime.tv_usec;
+	uint32_t hdr[7] = { 0x00000006, total, 0, (uint32_t)(usec >> 32), (uint32_t)usec, r->mLen, r->mLen };
+	static const unsigned char pad[4] = { 0, 0, 0, 0 };
+	if (fwrite(hdr,sizeof(hdr),1,mFile) != 1 ||
+	    fwrite(r->mData,r->mLen,1,mFile) != 1 ||
+	    (padded > r->mLen && fwrite(pad,padded - r->mLen,1,mFile) != 1) ||
+	    fwrite(&total,sizeof(total),1,mFile) != 1) {
+		LOG(ERR) << "cannot write GSMTAP capture file " << mFileName << ", closing it";
+		mWriting = false;
+		fclose(mFile);
+		mFile = NULL;
+		return;
+	}
+	__sync_fetch_and_add(&mWritten,1);
+}
+
+
+void GSMTAPCapture::text(std::ostream& os, bool reset)
+{
+	os << "GSMTAP GSM=" << (mGSM ? "on" : "off") << " GPRS=" << (mGPRS ? "on" : "off");
+	{
+		ScopedLock lock(mLock);
+		if (mSending) os << " target=" << mTarget;
+		if (mWriting) os << " file=" << mFileName;
+		if (mFilter.size()) os << " filter=\"" << mFilter << "\"";
+	}
+	os << std::endl;
+	os << "queued=" << mQueued << " filtered=" << mFiltered << " dropped=" << mDropped
+		<< " limited=" << mLimited << " sent=" << mSent << " send errors=" << mSendErrors
+		<< " batches=" << mBatches << " written=" << mWritten << std::endl;
+	if (reset) {
+		__sync_lock_test_and_set(&mQueued,0);
+		__sync_lock_test_and_set(&mFiltered,0);
+		__sync_lock_test_and_set(&mDropped,0);
+		__sync_lock_test_and_set(&mLimited,0);
+		__sync_lock_test_and_set(&mSent,0);
+		__sync_lock_test_and_set(&mSendErrors,0);
+		__sync_lock_test_and_set(&mBatches,0);
+		__sync_lock_test_and_set(&mWritten,0);
+	}
 }
 
 
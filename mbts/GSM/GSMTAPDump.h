@@ -20,12 +20,101 @@
 #include "gsmtap.h"
 #include "GSMCommon.h"
 #include "GSMTransfer.h"
+#include <Threads.h>
+#include <sys/time.h>
+#include <stdio.h>
+#include <ostream>
+#include <string>
 
 
 void gWriteGSMTAP(unsigned ARFCN, unsigned TS, unsigned FN,
                   GSM::TypeAndOffset to, bool is_sacch, bool ul_dln,
                   const BitVector& frame,
 				  unsigned wType = GSMTAP_TYPE_UM);
+
+// Number of captured frames waiting for the capture thread, must be a power of 2
+#define GSMTAP_RING_SIZE 1024
+// Maximum length of a captured GSMTAP packet, header included
+#define GSMTAP_RECORD_MAX 128
+
+/**
+	The capture behind gWriteGSMTAP.
+	The L1 and GPRS threads only filter each frame and copy it into a bounded
+	lock-free ring; they never block, a frame that does not fit is counted and dropped.
+	The capture thread sends the frames in batches to Control.GSMTAP.TargetIP and/or
+	writes them to the pcapng file Control.GSMTAP.File, at most Control.GSMTAP.MaxRate
+	frames per second.  It also reads the Control.GSMTAP settings once a second,
+	so the writers do not look up the configuration for every frame.
+*/
+class GSMTAPCapture {
+
+	public:
+
+	GSMTAPCapture();
+
+	/** Start the capture thread. */
+	void start();
+
+	/** Are GSM or GPRS frames being tapped?  Use these instead of the config. */
+	bool gsm() const { return mGSM; }
+	bool gprs() const { return mGPRS; }
+
+	/** Queue a GSMTAP packet, called by gWriteGSMTAP. */
+	void queue(uint8_t subType, uint8_t subSlot, unsigned TS, unsigned ARFCN, bool uplink,
+		unsigned FN, const BitVector& frame, unsigned wType);
+
+	/** Print the counters, optionally starting them over. */
+	void text(std::ostream& os, bool reset);
+
+	private:
+
+	struct Record {
+		volatile unsigned mSeq;		///< free for position p: p, filled: p + 1
+		unsigned mLen;
+		struct timeval mTime;
+		unsigned char mData[GSMTAP_RECORD_MAX];
+	};
+
+	Record* mRing;
+	volatile unsigned mHead;
+	unsigned mTail;
+	Thread mThread;
+
+	// Settings, written by the capture thread only.
+	volatile bool mGSM;
+	volatile bool mGPRS;
+	volatile bool mPCS;			///< GSM.Radio.Band is 1900
+	volatile unsigned mChannels;		///< Filter: bit per GSMTAP sub-type, bit 31 for SACCH
+	volatile unsigned mTimeslots;		///< Filter: bit per timeslot
+	volatile bool mSending;			///< Control.GSMTAP.TargetIP is set
+	volatile bool mWriting;			///< Control.GSMTAP.File is open
+	unsigned mMaxRate;
+	Mutex mLock;				///< Protects the strings below, which the CLI reads
+	std::string mTarget;			///< Current destination, host:port
+	std::string mFilter;
+	std::string mFileName;
+	FILE* mFile;				///< The pcapng file, if any
+
+	// Counters, the CLI may reset them while they are counted
+	volatile unsigned mQueued;		///< copied into the ring
+	volatile unsigned mFiltered;		///< not wanted by Control.GSMTAP.Filter
+	volatile unsigned mDropped;		///< ring full or packet too long
+	volatile unsigned mLimited;		///< over Control.GSMTAP.MaxRate
+	volatile unsigned mSent;
+	volatile unsigned mSendErrors;
+	volatile unsigned mWritten;		///< to the pcapng file
+	volatile unsigned mBatches;
+
+	static void* runFunc(void* arg);
+	void run();
+	void refresh();
+	void openFile(const std::string& name);
+	void writeFile(const Record* r);
+	bool wanted(uint8_t subType, unsigned TS) const;
+};
+
+extern GSMTAPCapture gGSMTAP;
+
 #endif
 
 // vim: ts=4 sw=4
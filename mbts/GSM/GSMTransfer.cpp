@@ -266,7 +266,7 @@ L2Frame::L2Frame(const L2Header& header, const BitVector& l3, bool noran)
 	size_t wp = header.write(*this);
 	l3.copyToSegment(*this,wp);
 	// FIXME - figure out why randomizeFiller doesn't like the "noran" headers
-	if (gConfig.getBool("GSM.Cipher.ScrambleFiller") && !noran) randomizeFiller(header);
+	if (!noran && gConfig.getBool("GSM.Cipher.ScrambleFiller")) randomizeFiller(header);
 }
 
 
@@ -285,6 +285,7 @@ static void setPco(ByteVector &resultpco, ByteVector &pcoReq)
 						memcpy(&op[2], &mg_dns[mg_dns[1] ? 1 : 0], 4);	// addr in network order.
 						break;
 					case 2:
+						// GPRS negotiates header compression with SNDCP XID instead.
 						what = "IP Compression Protocol"; goto bad_ipcp;
 					case 0x82:
 						what = "primary NBNS [NetBios Name Service]"; goto bad_ipcp;
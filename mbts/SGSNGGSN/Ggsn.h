@@ -24,6 +24,7 @@
 #include "GPRSL3Messages.h"
 #include "GSMCommon.h"	// For Z100Timer - I really dont want to include the other stuff here.
 #include "miniggsn.h"
+#include "SndcpComp.h"
 
 namespace SGSN {
 class LlcEntityGmm;
@@ -138,13 +139,14 @@ class PdpContext
 #endif
 
 	void pdpWriteLowSide(ByteVector &payload);
-	void pdpWriteHighSide(unsigned char *packet, unsigned packetlen);
+	void pdpWriteHighSide(ByteVector &packet);
 
 	// Once the connection is set up we dont care about this stuff any more,
 	// but we have to cache it for UMTS because the PdpContextAccept message is not sent out instantly.
 	// You cant save the pco - each one has uniquifying identifiers in it.
 	ByteVector mPcoReq;	// Requested Protocol Config Options - from L3 uplink message.
 	ByteVector mQoSReq;	// Requested QoS, which we are not currently using.
+	bool mCompression;	// The APN allows SNDCP compression to be negotiated.
 	//ByteVector mPdpAddr;
 	//ByteVector mApName;
 
@@ -213,6 +215,7 @@ class PdpContext
 		mPcoReq = pdpr.mPco;
 		mQoSReq = pdpr.mQoS;
 		mTransactionId = pdpr.mTransactionId;
+		mCompression = sndcpCompressionAllowed(pdpr.mApName);
 	}
 
 	PdpContext::PdpContext(GmmInfo *wgmm, mg_con_t *wmgp, int nsapi, int llcsapi) :
@@ -229,6 +232,7 @@ class PdpContext
 		//mPdpAddr(pdpr.mPdpAddress),
 		//mApName(pdpr.mApName),
 		//mTransactionId(pdpr.mTransactionId)
+		mCompression(false),
 		mUmtsStatePending(0)
 	{
 		//mT3385.configure(gConfig.getNum("UMTS.Timers.T3385",8));
@@ -240,11 +244,10 @@ class PdpContext
 		PdpPdu *newpdu = new PdpPdu(payload,this->mgp);
 		gGgsn.mTxQ.write(newpdu);
 	}
-	void PdpContext::pdpWriteHighSide(unsigned char *packet, unsigned packetlen) {
-		SNDCPDEBUG("pdpWriteHighSide"<<LOGVAR2("packetlen",packetlen));
-		ByteVectorTemp sdu(packet,packetlen);
-		//mpdpDownstream->snWriteHighSide(sdu);
-		mpcGmm->getSI()->sgsnWriteHighSide(sdu,mNSapi);
+	void PdpContext::pdpWriteHighSide(ByteVector &packet) {
+		SNDCPDEBUG("pdpWriteHighSide"<<LOGVAR2("packetlen",packet.size()));
+		//mpdpDownstream->snWriteHighSide(packet);
+		mpcGmm->getSI()->sgsnWriteHighSide(packet,mNSapi);
 	}
 #endif
 
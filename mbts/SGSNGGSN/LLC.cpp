@@ -134,7 +134,8 @@ static void handleXid(LlcEntity *lle, ByteVector &xids)
   try {
 	int totlen = xids.size();	// 3 to remove the FCS checksum.
 	// Create an outbound xid command
-	LlcFrameXid uframe(totlen+5);	// Add room for 2 byte header, 3 byte FCS checksum.
+	// Add room for 2 byte header, 3 byte FCS checksum, and the SNDCP version we may add.
+	LlcFrameXid uframe(totlen+5+3);
 	uframe.setAppendP(0);
 	// 6.2.2: This is a downlink response, so the C/R bit is 0.
 	uframe.appendAddrHeader(lle->getLlcSapi(),false);
@@ -152,7 +153,18 @@ static void handleXid(LlcEntity *lle, ByteVector &xids)
 			int xidlen = xl ? xids.getField2(n,6,8) : xids.getField2(n,6,2);
 			n += (xl ? 2 : 1);
 			unsigned value = 0;
-			if (xidlen <= 4) {
+			if (xidtype == LlcFrameXid::layer3) {
+				// SNDCP XID parameters, they only make sense on the user data SAPIs.
+				if (LlcEngine::isValidDataSapi(lle->getLlcSapi()) && gConfig.getBool("SGSN.Compression.Protocol")) {
+					ByteVector req(xids.segment(n,xidlen));
+					ByteVector rsp(xidlen+3);
+					rsp.setAppendP(0);
+					static_cast<LlcEntityUserData*>(lle)->sndcpXid(req,rsp);
+					if (rsp.size()) { uframe.appendXidItem(xidtype,rsp); }
+				} else {
+					LLCWARN("LLC ignoring SNDCP XID parameters:"<<LOGVAR2("bytes",xids.segment(n,xidlen).hexstr()));
+				}
+			} else if (xidlen <= 4) {
 				value = xids.getField2(n,0,8*xidlen);
 				uframe.appendXidItem(xidtype, xidlen,value);
 				LLCWARN("LLC XID"<<LOGVAR(xidtype)<<LOGVAR(xidlen)<<LOGVAR(value));
@@ -371,6 +383,18 @@ void LlcEntityUserData::lleUplinkData(ByteVector &payload)
 	sndcp->sndcpWriteLowSide(sframe);
 }
 
+void LlcEntityUserData::sndcpXid(ByteVector &req, ByteVector &rsp)
+{
+	// Compression may be added to the NSAPIs on this sapi whose APN allows it.
+	unsigned allowed = 0;
+	for (unsigned nsapi = 5; nsapi < 16; nsapi++) {
+		PdpContext *pdp = mSI->getPdp(nsapi);
+		if (pdp && pdp->mCompression && pdp->mLlcSapi == (int)mLlcSapi) { allowed |= 1 << nsapi; }
+	}
+	LLCINFO("SNDCP XID"<<LOGVAR2("llcsapi",mLlcSapi)<<LOGHEX(allowed)<<LOGVAR2("bytes",req.hexstr()));
+	mComp.xid(req,rsp,allowed);
+}
+
 //Sndcp *LlcEntityUserData::getSndcp(unsigned nsapi) { return getSgsnInfo()->mSndcp[nsapi]; }
 //void LlcEntityUserData::setSndcp(unsigned nsapi, Sndcp*ptr) { getSgsnInfo()->mSndcp[nsapi] = ptr; }
 #if SNDCP_IN_PDP
@@ -527,6 +551,10 @@ void Sndcp::flush(unsigned num, bool force)
 				sp->segs[i].clear();
 			}
 			sp->mSegCount = 0;
+			if (! mlle->mComp.decompress(mNSapi,result,sp->mPcomp,sp->mDcomp)) {
+				LLCWARN("SNDCP pdu discarded after decompression failure"<<LOGVAR(num)<<LOGVAR2("nsapi",mNSapi));
+				return;
+			}
 			//mPdp->pdpWriteLowSide(result);
 			getSgsnInfo()->sgsnSend2PdpLowSide(mNSapi,result);
 			//PdpContext *pdp = mlle->getSgsnInfo()->getPdp(mNSapi);
@@ -547,10 +575,14 @@ void Sndcp::flush(unsigned num, bool force)
 
 	if (force) {
 		// Delete all segments.
+		bool lost = sp->mSegCount;
 		for (i = 0; i < 16; i++) {
+			if (sp->segs[i].size()) { lost = true; }
 			sp->segs[i].clear();
 		}
 		sp->mSegCount = 0;
+		// The header decompressor must resync after a lost pdu.
+		if (lost) { mlle->mComp.lost(mNSapi); }
 	}
 }
 
@@ -594,6 +626,8 @@ void Sndcp::sndcpWriteLowSide(SndcpFrame &frame)
 			LOG(ERR) <<"invalid Sndcp pdu with F and seg number != 0";
 			segnum = 0;	// Lets pretend.
 		}
+		mSegs[pdunum%sMemory].mPcomp = frame.getPcomp();
+		mSegs[pdunum%sMemory].mDcomp = frame.getDcomp();
 	}
 	mSegs[pdunum%sMemory].segs[segnum] = payload;
 	if (!frame.getM()) {
@@ -604,18 +638,32 @@ void Sndcp::sndcpWriteLowSide(SndcpFrame &frame)
 
 // Send the pdu segment on its way.
 // TODO: we are assuming unacknowledged mode.
-void Sndcp::sndcpWriteSegment(ByteVector &pduSeg, unsigned segnum, unsigned flags)
-{
-	LlcDlFrame result(pduSeg.size()+4);	// May be overkill by one or more bytes.
-	result.appendByte(flags);
-	if (flags & F_BIT) {
-		// 6.7.1.1: First segment has DCOMP and PCOMP parameters.
-		// Amusingly, only make the pdu bigger.
-		result.appendByte(0);	// No compression.
+void Sndcp::sndcpWriteSegment(ByteVector &pduSeg, unsigned segnum, unsigned flags, unsigned comp)
+{
+	// 6.7.1.1: First segment has DCOMP and PCOMP parameters.
+	unsigned hdrlen = (flags & F_BIT) ? 4 : 3;
+	ByteVector frame;
+	if (pduSeg.getRefCnt() == 1 && pduSeg.headroom() >= hdrlen + LlcFrame::UIHeaderLength
+	    && pduSeg.sizeRemaining() >= 3) {
+		// The segment is alone in a buffer with room for the SNDCP and LLC headers
+		// in front and the FCS behind, as made by miniggsn_rcv_npdu, so the headers
+		// go in place.  Only the last segment of a pdu qualifies: the others are
+		// followed by the next segment, which the FCS would overwrite.
+		pduSeg.growLeft(hdrlen);
+		frame = pduSeg;
+	} else {
+		LlcDlFrame result(pduSeg.size()+hdrlen);
+		result.setAppendP(hdrlen);
+		result.append(pduSeg);
+		frame = result;
 	}
-	result.appendField(segnum,4);	// segment number.
-	result.appendField(mSendNPdu % mSNS,12);	// pdu number.
-	result.append(pduSeg);
+	unsigned npdu = mSendNPdu % mSNS;
+	unsigned wp = 0;
+	frame.setByte(wp++,flags);
+	if (flags & F_BIT) { frame.setByte(wp++,comp); }
+	frame.setByte(wp++,(segnum << 4) | (npdu >> 8));	// segment number, pdu number high bits.
+	frame.setByte(wp++,npdu & 0xff);
+	LlcDlFrame result(frame);
 	// TODO: Is this a command or a response?
 	mlle->lleWriteHighSide(result,true,"user pdu");
 }
@@ -624,6 +672,10 @@ void Sndcp::sndcpWriteSegment(ByteVector &pduSeg, unsigned segnum, unsigned flag
 // It needs to be segmented and sent to LLC Entity for yet another header.
 void Sndcp::sndcpWriteHighSide(ByteVector &sdu)
 {
+	// Compress before segmenting, the DCOMP/PCOMP values go in the first segment.
+	unsigned pcomp, dcomp;
+	mlle->mComp.compress(mNSapi,sdu,pcomp,dcomp);
+	unsigned comp = (dcomp << 4) | pcomp;
 	// Set the first byte flags.
 	unsigned flags = mNSapi;
 	flags |= T_BIT;	// UNITDATA PDU
@@ -635,12 +687,12 @@ void Sndcp::sndcpWriteHighSide(ByteVector &sdu)
 	for (; sdu.size() > segsize; segnum++) {
 		flags |= M_BIT;	// Not last segment.
 		ByteVector seg(sdu.segment(0,segsize));
-		sndcpWriteSegment(seg,segnum,flags);
+		sndcpWriteSegment(seg,segnum,flags,comp);
 		sdu.trimLeft(segsize);
 		flags &= ~F_BIT;	// Not first segment.
 	}
 	flags &= ~M_BIT;	// Now it is the last segment.
-	sndcpWriteSegment(sdu,segnum,flags);
+	sndcpWriteSegment(sdu,segnum,flags,comp);
 	mSendNPdu = (mSendNPdu+1) % mSNS;
 }
 
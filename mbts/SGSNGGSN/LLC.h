@@ -23,6 +23,7 @@
 #include <ByteVector.h>
 #include "SgsnBase.h"
 #include "GPRSL3Messages.h"
+#include "SndcpComp.h"
 #include <MemoryLeak.h>
 //#include "TBF.h"
 
@@ -188,6 +189,8 @@ struct LlcDlFrame : public LlcFrame
 		trimLeft(8);	// Room for headers.
 		setAppendP(0);
 	}
+	// A frame already laid out with its headroom, sharing the memory.
+	explicit LlcDlFrame(const ByteVector &frame) : LlcFrame(frame) {}
 };
 
 // 05.64 6.3
@@ -300,6 +303,22 @@ struct LlcFrameXid : public LlcFrameU
 			appendField(value,8*len);
 		}
 	}
+	// For the items longer than 4 bytes, only the layer-3 parameters.
+	void appendXidItem(unsigned xidtype, ByteVector &value)
+	{
+		unsigned len = value.size();
+		if (len <= 3) {
+			appendField(0,1);
+			appendField(xidtype,5);
+			appendField(len,2);
+		} else {
+			appendField(1,1);
+			appendField(xidtype,5);
+			appendField(len,8);
+			appendField(0,2);
+		}
+		append(value);
+	}
 };
 
 // 3GPP 04.64 Logical Link Entity part of LLC.
@@ -359,6 +378,7 @@ struct LlcEntityUserData : public LlcEntity
 {
 	unsigned mLlcSapi;	// The LLC sapi of this entity.
 	unsigned mN201U;
+	SndcpCompression mComp;	// The compression entities negotiated by SNDCP XID on this sapi.
 	LlcEntityUserData(unsigned wLlcSapi, SgsnInfo *si) :
 		LlcEntity(si),
 		mLlcSapi(wLlcSapi)
@@ -371,6 +391,8 @@ struct LlcEntityUserData : public LlcEntity
 	Sndcp *getSndcp(unsigned nsapi);
 	void setSndcp(unsigned nsapi, Sndcp*ptr);
 	void lleUplinkData(ByteVector &payload);
+	// Handle the SNDCP XID parameters found in an LLC XID command.
+	void sndcpXid(ByteVector &req, ByteVector &rsp);
 };
 #if LLC_IMPLEMENTATION
 #endif
@@ -451,6 +473,8 @@ class Sndcp
 	static const unsigned sMemory = 32;
 	struct OneSdu {
 		UInt_z mSegCount;	// Number of segs, derived from 'm' bit.
+		UInt_z mPcomp;		// From the first segment.
+		UInt_z mDcomp;
 		ByteVector segs[16];	// The segments.
 	};
 	OneSdu mSegs[sMemory];		// This stuff is all deleted automatically.
@@ -465,7 +489,7 @@ class Sndcp
 	int diffSNS(int v1, int v2);
 	// SDU segmented to this size.  May be negotiated using XID command, which we dont implement.
 	unsigned getMaxPduSize();
-	void sndcpWriteSegment(ByteVector &pduSeg, unsigned segnum, unsigned flags);
+	void sndcpWriteSegment(ByteVector &pduSeg, unsigned segnum, unsigned flags, unsigned comp);
 
 	public:
 	// downlink data from internet comes in here.
@@ -489,7 +513,7 @@ Sndcp::~Sndcp()
 {
 	// Test mlle and mPdp and setting to 0 after are cautious overkill.
 	// The setSndcp() is also redundant, since our caller does it too.
-	if (mlle) {mlle->setSndcp(mNSapi,0); mlle = 0;}
+	if (mlle) {mlle->mComp.detach(mNSapi); mlle->setSndcp(mNSapi,0); mlle = 0;}
 	//if (mPdp) {delete mPdp; mPdp = 0;}
 }
 #endif
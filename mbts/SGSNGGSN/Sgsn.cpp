@@ -17,6 +17,7 @@
 */
 
 #include <list>
+#include <netinet/in.h>	// IPPROTO_TCP
 //#include "RList.h"
 #include "LLC.h"
 //#include "MSInfo.h"
@@ -27,6 +28,9 @@
 #include "Globals.h"
 //#include "MAC.h"
 #include "miniggsn.h"
+#include <map>
+#include <tr1/unordered_map>
+#include <algorithm>
 using namespace Utils;
 #define CASENAME(x) case x: return #x;
 #define SRB3 3
@@ -39,6 +43,19 @@ static SgsnInfoList_t sSgsnInfoList;
 typedef std::list<GmmInfo*> GmmInfoList_t;
 static GmmInfoList_t sGmmInfoList;
 static Mutex sSgsnListMutex;	// One lock sufficient for all lists maintained by SGSN.
+// Indexes into the lists above, so the per packet lookups do not scan them.
+typedef std::tr1::unordered_map<uint32_t,SgsnInfo*> SgsnInfoMap_t;
+static SgsnInfoMap_t sSgsnInfoByHandle;	// By TLLI or URNTI, and alternate TLLI.
+typedef std::tr1::unordered_map<std::string,GmmInfo*> GmmInfoMap_t;
+static GmmInfoMap_t sGmmByImsi;		// By the IMSI octets.
+typedef std::tr1::unordered_map<uint32_t,GmmInfo*> GmmPTmsiMap_t;
+static GmmPTmsiMap_t sGmmByPTmsi;
+// Expiry queues: when to look at a context next, and its handle or P-TMSI.
+// Entries are not moved when the context is used; a due entry is rescheduled
+// from the last use time, or dropped if the context went away meanwhile.
+typedef std::multimap<time_t,uint32_t> ExpiryQueue_t;
+static ExpiryQueue_t sSgsnInfoIdle;
+static ExpiryQueue_t sGmmDetach;
 static void dumpGmmInfo();
 #if RN_UMTS
 //static void sendAuthenticationRequest(SgsnInfo *si, string IMSI);
@@ -97,6 +114,22 @@ const char *GmmCause::name(unsigned mt, bool ornull)
 	}
 }
 
+static std::string imsiKey(const ByteVector &imsi)
+{
+	return std::string((const char*)imsi.begin(),imsi.size());
+}
+
+// Remove an SgsnInfo from the handle index; its idle queue entry goes stale.
+static void sgsnUnindex(SgsnInfo *si)
+{
+	SgsnInfoMap_t::iterator it = sSgsnInfoByHandle.find(si->mMsHandle);
+	if (it != sSgsnInfoByHandle.end() && it->second == si) { sSgsnInfoByHandle.erase(it); }
+#if NEW_TLLI_ASSIGN_PROCEDURE
+	it = sSgsnInfoByHandle.find(si->mAltTlli);
+	if (it != sSgsnInfoByHandle.end() && it->second == si) { sSgsnInfoByHandle.erase(it); }
+#endif
+}
+
 SgsnInfo::SgsnInfo(uint32_t wMsHandle) :
 	//mState(GmmState::GmmNotOurTlli),
 	mGmmp(0),
@@ -113,6 +146,11 @@ SgsnInfo::SgsnInfo(uint32_t wMsHandle) :
 	mLlcEngine = new LlcEngine(this);
 #endif
 	sSgsnInfoList.push_back(this);
+	sSgsnInfoByHandle[mMsHandle] = this;
+	// We can delete unused SgsnInfo as soon as the attach procedure is over,
+	// which is 15s, but let them hang around a bit longer so the user can see them.
+	mIdleCheck = mLastUseTime + gConfig.getNum("SGSN.Timer.MS.Idle") + 1;
+	sSgsnInfoIdle.insert(ExpiryQueue_t::value_type(mIdleCheck,mMsHandle));
 }
 
 SgsnInfo::~SgsnInfo()
@@ -126,6 +164,7 @@ void SgsnInfo::sirm()
 	sgsnInfoDump(this,ss);
 	SGSNLOG("Removing SgsnInfo:"<<ss);
 	sSgsnInfoList.remove(this);
+	sgsnUnindex(this);
 	delete this;
 }
 
@@ -186,7 +225,12 @@ static uint32_t allocatePTmsi()
 		time(&now);
 		gPTmsiNext = ((now&0xff)<<12) + 1;
 	}
-	if (gPTmsiNext == 0 || gPTmsiNext >= (1<<30)) { gPTmsiNext = 1; }
+	// Skip the ones still held by a Gmm context after a wrap around.
+	for (;;) {
+		if (gPTmsiNext == 0 || gPTmsiNext >= (1<<30)) { gPTmsiNext = 1; }
+		if (! sGmmByPTmsi.count(gPTmsiNext)) { break; }
+		gPTmsiNext++;
+	}
 	return gPTmsiNext++;
 	//return Tlli::makeLocalTlli(gPTmsiNext++);
 }
@@ -202,13 +246,17 @@ GmmInfo::GmmInfo(ByteVector &imsi):
 	mImsi(imsi), mState(GmmState::GmmDeregistered), msi(0)
 {
 	memset(mPdps,0,sizeof(mPdps));
-	mPTmsi = allocatePTmsi();
 	mGprsMultislotClass = -1;		// -1 means invalid.
 	mAttachTime = 0;
 	// Must set activityTime to prevent immediate removal from list by another phone simultaneously connection.
 	setActivity();
 	ScopedLock lock(sSgsnListMutex);
+	mPTmsi = allocatePTmsi();
 	sGmmInfoList.push_back(this);
+	sGmmByImsi[imsiKey(mImsi)] = this;
+	sGmmByPTmsi[mPTmsi] = this;
+	mDetachCheck = mActivityTime + gConfig.getNum("SGSN.Timer.ImplicitDetach") + 1;
+	sGmmDetach.insert(ExpiryQueue_t::value_type(mDetachCheck,mPTmsi));
 }
 
 GmmInfo::~GmmInfo()
@@ -241,6 +289,9 @@ static void GmmRemove(GmmInfo *gmm)
 	}
 #endif
 	sGmmInfoList.remove(gmm);
+	GmmInfoMap_t::iterator it = sGmmByImsi.find(imsiKey(gmm->mImsi));
+	if (it != sGmmByImsi.end() && it->second == gmm) { sGmmByImsi.erase(it); }
+	sGmmByPTmsi.erase(gmm->mPTmsi);
 	delete gmm;
 }
 
@@ -347,6 +398,43 @@ void SgsnInfo::sgsnSend2PdpLowSide(int nsapi, ByteVector &packet)
 }
 
 // The rbid is not used by GPRS, and is just 0.
+#if !RN_UMTS
+// Tell the MAC what kind of frame this is, so its flow control can drop user data
+// an N-PDU at a time and tell TCP from the rest.
+static void sgsnClassifyPdu(GprsSgsnDownlinkPdu *dlpdu)
+{
+	LlcFrame frame(dlpdu->mDlData);
+	switch (frame.getSapi()) {
+	case LlcSapi::UserData3: case LlcSapi::UserData5:
+	case LlcSapi::UserData9: case LlcSapi::UserData11:
+		break;
+	default:
+		return;
+	}
+	// We only send unacknowledged user data: a UI frame with the SNDCP pdu after its header.
+	if (frame.getFormat() != LLCFormat::UI || frame.size() < LlcFrame::UIHeaderLength + 3) { return; }
+	ByteVector payload(frame.tail(LlcFrame::UIHeaderLength));
+	SndcpFrame sframe(payload);
+	dlpdu->mUserData = true;
+	dlpdu->mFirstSeg = sframe.getF();
+	dlpdu->mMoreSegs = sframe.getM();
+	if (!dlpdu->mFirstSeg) { return; }
+	unsigned pcomp = sframe.getPcomp(), dcomp = sframe.getDcomp();
+	if (dcomp) { return; }	// Compressed data; we cannot tell.
+	if (pcomp) {
+		// Only RFC 1144 header compression is negotiated, and it only handles TCP.
+		dlpdu->mTcp = true;
+		return;
+	}
+	ByteVector ip(sframe.getPayload());
+	if (ip.size() >= 20 && (ip.getByte(0) >> 4) == 4) {
+		dlpdu->mTcp = ip.getByte(9) == IPPROTO_TCP;
+	} else if (ip.size() >= 40 && (ip.getByte(0) >> 4) == 6) {
+		dlpdu->mTcp = ip.getByte(6) == IPPROTO_TCP;
+	}
+}
+#endif
+
 void SgsnInfo::sgsnSend2MsHighSide(ByteVector &pdu,const char *descr, int rbid)
 {
 		MSUEAdapter *ms = getMS();
@@ -380,6 +468,7 @@ void SgsnInfo::sgsnSend2MsHighSide(ByteVector &pdu,const char *descr, int rbid)
 			return;
 		}
 		GprsSgsnDownlinkPdu *dlpdu = new GprsSgsnDownlinkPdu(pdu,tlli,aliasTlli,descr);
+		sgsnClassifyPdu(dlpdu);
 		//ms->msWriteHighSide(dlpdu);
 		// This is thread safe:
 		// Go ahead and enqueue it even if there is no MS
@@ -1195,6 +1284,60 @@ void handleL3Msg(SgsnInfo *si, ByteVector &bv)
 	}
 }
 
+// Remove the SgsnInfo idle for longer than SGSN.Timer.MS.Idle, except the primary one of a gmm.
+// Only the due entries at the head of the queue are looked at.
+// Assumes sSgsnListMutex is locked on entry.
+static void sgsnIdleExpiry(time_t now)
+{
+	int idletime = -1;
+	while (sSgsnInfoIdle.size() && sSgsnInfoIdle.begin()->first <= now) {
+		ExpiryQueue_t::iterator head = sSgsnInfoIdle.begin();
+		time_t due = head->first;
+		uint32_t handle = head->second;
+		sSgsnInfoIdle.erase(head);
+		SgsnInfoMap_t::iterator it = sSgsnInfoByHandle.find(handle);
+		if (it == sSgsnInfoByHandle.end()) { continue; }
+		SgsnInfo *si = it->second;
+		if (si->mIdleCheck != due) { continue; }	// Stale entry, the SgsnInfo is queued again under another time.
+		if (idletime < 0) { idletime = gConfig.getNum("SGSN.Timer.MS.Idle"); }
+		GmmInfo *gmm = si->getGmm();
+		if ((gmm==NULL || gmm->getSI() != si) && now - si->mLastUseTime > idletime) {
+			si->sirm();
+			continue;
+		}
+		// The primary SgsnInfo of a gmm stays; look again one idle period later.
+		si->mIdleCheck = si->mLastUseTime + idletime + 1;
+		if (si->mIdleCheck <= now) { si->mIdleCheck = now + idletime + 1; }
+		sSgsnInfoIdle.insert(ExpiryQueue_t::value_type(si->mIdleCheck,si->mMsHandle));
+	}
+}
+
+// 24.008 11.2.2: Implicit Detach timer default is 4 min greater
+// than T3323, which can be provided in AttachAccept, otherwise
+// defaults to T3312, which defaults to 54 minutes.
+// Assumes sSgsnListMutex is locked on entry.
+static void gmmDetachExpiry(time_t now)
+{
+	int attachlimit = -1;
+	while (sGmmDetach.size() && sGmmDetach.begin()->first <= now) {
+		ExpiryQueue_t::iterator head = sGmmDetach.begin();
+		time_t due = head->first;
+		uint32_t ptmsi = head->second;
+		sGmmDetach.erase(head);
+		GmmPTmsiMap_t::iterator it = sGmmByPTmsi.find(ptmsi);
+		if (it == sGmmByPTmsi.end()) { continue; }
+		GmmInfo *gmm = it->second;
+		if (gmm->mDetachCheck != due) { continue; }
+		if (attachlimit < 0) { attachlimit = gConfig.getNum("SGSN.Timer.ImplicitDetach"); }	// expiration time in seconds.
+		if (now - gmm->mActivityTime > attachlimit) {
+			GmmRemove(gmm);
+			continue;
+		}
+		gmm->mDetachCheck = std::max(gmm->mActivityTime + attachlimit + 1,now + 1);
+		sGmmDetach.insert(ExpiryQueue_t::value_type(gmm->mDetachCheck,ptmsi));
+	}
+}
+
 // Forces the SgsnInfo to exist.
 // For GPRS the handle is a TLLI.
 // From GSM03.03 sec 2.6 Structure of TLLI; and reproduced at class MSInfo comments.
@@ -1207,29 +1350,16 @@ SgsnInfo *findSgsnInfoByHandle(uint32_t handle, bool create)
 	// running in a separate thread.
 	ScopedLock lock(sSgsnListMutex); // I dont think this is necessary, but be safe.
 
-	SgsnInfo *si, *result = NULL;
-	// We can delete unused SgsnInfo as soon as the attach procedure is over,
-	// which is 15s, but let them hang around a bit longer so the user can see them.
-	int idletime = gConfig.getNum("SGSN.Timer.MS.Idle");
+	SgsnInfo *result = NULL;
 	time_t now; time(&now);
-	RN_FOR_ALL(SgsnInfoList_t,sSgsnInfoList,si) {
-		if (si->mMsHandle == handle) {result=si; continue;}
-#if RN_UMTS
-#else
-#if NEW_TLLI_ASSIGN_PROCEDURE
-		if (si->mAltTlli == handle) {result=si;continue;}
-#endif
-#endif
-		// Kill off old ones, except ones that are the primary one for a gmm.
-		GmmInfo *gmm = si->getGmm();
-		if (gmm==NULL || gmm->getSI() != si) {
-			if (now - si->mLastUseTime > idletime) { si->sirm(); }
-		}
-	}
-	if (result) {
-		time(&result->mLastUseTime);
-		return result;
+	SgsnInfoMap_t::iterator it = sSgsnInfoByHandle.find(handle);
+	if (it != sSgsnInfoByHandle.end()) {
+		result = it->second;
+		result->mLastUseTime = now;
 	}
+	// Kill off old ones, after the use time of the one found was refreshed.
+	sgsnIdleExpiry(now);
+	if (result) { return result; }
 	if (!create) { return NULL; }
 
 	// Make a new one.
@@ -1572,12 +1702,16 @@ SgsnInfo * SgsnInfo::changeTlli(bool now)
 	SgsnInfo *si = this;
 	if (si->mMsHandle != newTlli) {
 		killOtherTlli(si,newTlli);
+		ScopedLock lock(sSgsnListMutex);
+		sgsnUnindex(si);
 		if (now) {
 			si->mAltTlli = si->mMsHandle;
 			si->mMsHandle = newTlli;
 		} else {
 			si->mAltTlli = newTlli;
 		}
+		sSgsnInfoByHandle[si->mMsHandle] = si;
+		sSgsnInfoByHandle[si->mAltTlli] = si;
 	}
 	return si;
 #else
@@ -1597,18 +1731,11 @@ GmmInfo *findGmmByImsi(ByteVector &imsi, SgsnInfo *si)
 {
 	ScopedLock lock(sSgsnListMutex);
 	GmmInfo *gmm, *result = NULL;
-	// 24.008 11.2.2: Implicit Detach timer default is 4 min greater
-	// than T3323, which can be provided in AttachAccept, otherwise
-	// defaults to T3312, which defaults to 54 minutes.
-	int attachlimit = gConfig.getNum("SGSN.Timer.ImplicitDetach");	// expiration time in seconds.
 	time_t now; time(&now);
-	RN_FOR_ALL(GmmInfoList_t,sGmmInfoList,gmm) {
-		if (now - gmm->mActivityTime > attachlimit) {
-			GmmRemove(gmm);
-			continue;
-		}
-		if (gmm->mImsi == imsi) { result = gmm; }
-	}
+	// Expired contexts go first, so an MS coming back after the limit starts over.
+	gmmDetachExpiry(now);
+	GmmInfoMap_t::iterator it = sGmmByImsi.find(imsiKey(imsi));
+	if (it != sGmmByImsi.end()) { result = it->second; }
 	if (result) {
 		if (si) si->setGmm(result);
 		return result;
@@ -80,6 +80,7 @@ class GmmInfo
 	static const unsigned sNumPdps = 16;
 	time_t mAttachTime;
 	time_t mActivityTime;
+	time_t mDetachCheck;	// When the implicit detach queue looks at this context next.
 	int mGprsMultislotClass;		// -1 means invalid.
 	Bool_z mGprsGeranFeaturePackI;
 	AttachInfo mgAttachInfo;		// Copied from SgsnInfo.
@@ -227,6 +228,7 @@ class SgsnInfo
 
 	LlcEngine *mLlcEngine;
 	time_t mLastUseTime;
+	time_t mIdleCheck;	// When the idle queue looks at this SgsnInfo next.
 
 	//GmmMobileIdentityIE mAttachMobileId;
 
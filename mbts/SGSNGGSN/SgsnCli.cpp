@@ -16,6 +16,7 @@
 
 #include <list>
 #include "Sgsn.h"
+#include "SndcpComp.h"
 #include "Utils.h"
 #include "Globals.h"
 using namespace Utils;
@@ -113,6 +114,26 @@ static void sgsnCliFree(int argc, char **argv, int argi, ostream&os)
 	}
 }
 
+static void sgsnCliComp(int argc, char **argv, int argi, ostream&os)
+{
+	if (RN_CMD_OPTION("reset")) {
+		gSndcpCompStats.reset();
+		return;
+	}
+	if (argi < argc) throw CliErrorBadNumArgs();
+	gSndcpCompStats.text(os);
+}
+
+static void sgsnCliCopies(int argc, char **argv, int argi, ostream&os)
+{
+	if (RN_CMD_OPTION("reset")) {
+		gByteVectorStats.reset();
+		return;
+	}
+	if (argi < argc) throw CliErrorBadNumArgs();
+	gByteVectorStats.text(os);
+}
+
 static void sgsnCliHelp(int argc, char **argv, int argi, ostream&os);
 static struct SgsnSubCmds {
 	const char *name;
@@ -121,6 +142,8 @@ static struct SgsnSubCmds {
 } sgsnSubCmds[] = {
 	{ "list",sgsnCliList, "list  [(imsi|tlli) id]  # list all or specified MS" },
 	{ "free",sgsnCliFree, "free (imsi|tlli) id     # Delete something" },
+	{ "comp",sgsnCliComp, "comp [reset]          # SNDCP compression statistics" },
+	{ "copies",sgsnCliCopies, "copies [reset]        # downlink packet buffer allocations and copies" },
 	{ "help",sgsnCliHelp, "help                  # print this help" },
 	//{ "stat",gprsStats, "stat  # Show GPRS statistics" },
 	//{ "debug",gprsDebug,	"debug [level]  # Set debug level; 0 turns off" },
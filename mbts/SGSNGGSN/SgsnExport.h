@@ -66,10 +66,16 @@ struct GprsSgsnDownlinkPdu : public SingleLinkListNode, public SgsnDownlinkMsg
 						// (In gprs NSAPI is encoded in the LLC message in the data.)
 	uint32_t mAliasTlli;// Another TLLI that the SGSN knows refers to the same MS as the above.
 	Timeval mDlTime;
+	// For the downlink flow control of the MAC, from the LLC and SNDCP headers:
+	bool mUserData;		// An SNDCP segment; anything else is signalling and never dropped.
+	bool mFirstSeg;		// SNDCP F bit: it starts an N-PDU.
+	bool mMoreSegs;		// SNDCP M bit: more segments of the N-PDU follow.
+	bool mTcp;		// The N-PDU is TCP, so the MAC may drop it early to slow the sender.
 	bool isKeepAlive() { return false; }	// Is this is a dummy message?
 	unsigned size() { return mDlData.size(); }	// Decl must exactly match SingleLinkListNode
 	GprsSgsnDownlinkPdu(ByteVector a, uint32_t wTlli, uint32_t wAliasTlli, std::string descr) :
-		SgsnDownlinkMsg(a,descr), mTlli(wTlli), mAliasTlli(wAliasTlli)
+		SgsnDownlinkMsg(a,descr), mTlli(wTlli), mAliasTlli(wAliasTlli),
+		mUserData(false), mFirstSeg(false), mMoreSegs(false), mTcp(false)
 		{}
 };
 
@@ -0,0 +1,635 @@
+/**
+ * SndcpComp.cpp
+ * This file is part of the Yate-BTS Project http://www.yatebts.com
+ *
+ * SNDCP header and data compression, 3GPP 44.065
+ *
+ * Yet Another Telephony Engine - Base Transceiver Station
+ * Copyright (C) 2014 Null Team Impex SRL
+ * Copyright (C) 2014 Legba, Inc
+ *
+ * This software is distributed under multiple licenses;
+ * see the COPYING file in the main directory for licensing
+ * information for this specific distribution.
+ *
+ * This use of this software may be subject to additional restrictions.
+ * See the LEGAL file in the main directory for details.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#include <string.h>
+#include <stdio.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include "SgsnBase.h"
+#include "SndcpComp.h"
+#include <Globals.h>
+using namespace std;
+
+namespace SGSN {
+
+SndcpCompStats gSndcpCompStats;
+
+static inline unsigned get16(const unsigned char *p) { return (p[0] << 8) | p[1]; }
+static inline uint32_t get32(const unsigned char *p) { return ((uint32_t)get16(p) << 16) | get16(p+2); }
+static inline void put16(unsigned char *p, unsigned v) { p[0] = v >> 8; p[1] = v; }
+static inline void put32(unsigned char *p, uint32_t v) { put16(p,v >> 16); put16(p+2,v); }
+
+
+// RFC 1144 compressed header, section 3.2.
+enum {
+	NEW_C = 0x40,	// Connection number present
+	NEW_I = 0x20,	// IP id delta present
+	TCP_PUSH_BIT = 0x10,
+	NEW_S = 0x08,
+	NEW_A = 0x04,
+	NEW_W = 0x02,
+	NEW_U = 0x01,
+	SPECIAL_I = NEW_S|NEW_W|NEW_U,		// Echoed interactive traffic
+	SPECIAL_D = NEW_S|NEW_A|NEW_W|NEW_U,	// Unidirectional data
+	SPECIALS_MASK = NEW_S|NEW_A|NEW_W|NEW_U
+};
+
+// TCP flags
+enum { TH_FIN = 0x01, TH_SYN = 0x02, TH_RST = 0x04, TH_PUSH = 0x08, TH_ACK = 0x10, TH_URG = 0x20 };
+
+// Deltas are sent in one byte, or a zero byte followed by 16 bits.
+// A zero delta needs the long form.
+static void vjEncode(unsigned char *&cp, unsigned n)
+{
+	if (n >= 256 || n == 0) {
+		*cp++ = 0;
+		*cp++ = n >> 8;
+		*cp++ = n;
+	} else {
+		*cp++ = n;
+	}
+}
+
+static bool vjDecode(const unsigned char *cp, unsigned len, unsigned &rp, unsigned &n)
+{
+	if (rp >= len) { return false; }
+	if (cp[rp]) {
+		n = cp[rp++];
+		return true;
+	}
+	if (rp + 3 > len) { return false; }
+	n = get16(cp + rp + 1);
+	rp += 3;
+	return true;
+}
+
+VjComp::VjComp(unsigned slots)
+	: mNumSlots(slots), mAge(0), mLastSlot(slots), mToss(false)
+{
+	mSlots = new Slot[mNumSlots];
+	for (unsigned i = 0; i < mNumSlots; i++) {
+		mSlots[i].mHlen = 0;
+		mSlots[i].mAge = 0;
+	}
+}
+
+VjComp::~VjComp()
+{
+	delete[] mSlots;
+}
+
+VjComp::PacketType VjComp::compress(ByteVector &pkt)
+{
+	unsigned len = pkt.size();
+	unsigned char *ip = pkt.begin();
+	if (len < 40 || (ip[0] >> 4) != 4 || ip[9] != IPPROTO_TCP) { return TypeIp; }
+	unsigned ihl = (ip[0] & 0xf) * 4;
+	if (ihl < 20 || ihl + 20 > len || (get16(ip+6) & 0x3fff)) { return TypeIp; }	// Fragments stay as they are.
+	unsigned char *th = ip + ihl;
+	unsigned thl = (th[12] >> 4) * 4;
+	unsigned hlen = ihl + thl;
+	if (thl < 20 || hlen > len || hlen > sizeof(mSlots[0].mHdr) || get16(ip+2) != len) { return TypeIp; }
+	// Only established connections: SYN, FIN and RST segments are sent as they are.
+	if ((th[13] & (TH_SYN|TH_FIN|TH_RST|TH_ACK)) != TH_ACK) { return TypeIp; }
+
+	// Find the connection, or take the least recently used slot.
+	unsigned id = mNumSlots;
+	unsigned oldest = 0;
+	for (unsigned i = 0; i < mNumSlots; i++) {
+		Slot &s = mSlots[i];
+		if (s.mHlen) {
+			unsigned sihl = (s.mHdr[0] & 0xf) * 4;
+			if (0 == memcmp(s.mHdr+12,ip+12,8) && 0 == memcmp(s.mHdr+sihl,th,4)) { id = i; break; }
+		}
+		if (s.mAge < mSlots[oldest].mAge) { oldest = i; }
+	}
+	bool found = (id < mNumSlots);
+	if (!found) { id = oldest; }
+	Slot *cs = &mSlots[id];
+	cs->mAge = ++mAge;
+
+	unsigned char hdr[24];
+	unsigned clen = 0;
+	do {
+		if (!found) { break; }
+		unsigned char *oip = cs->mHdr;
+		unsigned char *oth = oip + ihl;
+		// Everything but the fields we can send as deltas must match the previous header.
+		if (cs->mHlen != hlen || ip[0] != oip[0] || ip[1] != oip[1] ||
+			get16(ip+6) != get16(oip+6) || ip[8] != oip[8] || ip[9] != oip[9] ||
+			(ihl > 20 && memcmp(ip+20,oip+20,ihl-20)) ||
+			(thl > 20 && memcmp(th+20,oth+20,thl-20))) {
+			break;
+		}
+
+		unsigned char deltas[16];
+		unsigned char *cp = deltas;
+		unsigned changes = 0;
+		if (th[13] & TH_URG) {
+			vjEncode(cp,get16(th+18));
+			changes |= NEW_U;
+		} else if (get16(th+18) != get16(oth+18) || (oth[13] & TH_URG)) {
+			// The special cases below do not say the URG flag went away.
+			break;
+		}
+		unsigned deltaW = (get16(th+14) - get16(oth+14)) & 0xffff;
+		if (deltaW) { vjEncode(cp,deltaW); changes |= NEW_W; }
+		uint32_t deltaA = get32(th+8) - get32(oth+8);
+		if (deltaA) {
+			if (deltaA > 0xffff) { break; }
+			vjEncode(cp,deltaA);
+			changes |= NEW_A;
+		}
+		uint32_t deltaS = get32(th+4) - get32(oth+4);
+		if (deltaS) {
+			if (deltaS > 0xffff) { break; }
+			vjEncode(cp,deltaS);
+			changes |= NEW_S;
+		}
+		unsigned olen = get16(oip+2);
+		bool special = false;
+		switch (changes) {
+		case 0:
+			// Only the length changed: data after a pure ack.
+			// Anything else is a retransmission and goes uncompressed.
+			if (len != olen && olen == hlen) { break; }
+			special = true;
+			break;
+		case SPECIAL_I:
+		case SPECIAL_D:
+			// The real changes look like a special case encoding.
+			special = true;
+			break;
+		case NEW_S|NEW_A:
+			if (deltaS == deltaA && deltaS == olen - hlen) {
+				changes = SPECIAL_I;
+				cp = deltas;
+			}
+			break;
+		case NEW_S:
+			if (deltaS == olen - hlen) {
+				changes = SPECIAL_D;
+				cp = deltas;
+			}
+			break;
+		}
+		if (special) { break; }
+		unsigned deltaI = (get16(ip+4) - get16(oip+4)) & 0xffff;
+		if (deltaI != 1) {
+			vjEncode(cp,deltaI);
+			changes |= NEW_I;
+		}
+		if (th[13] & TH_PUSH) { changes |= TCP_PUSH_BIT; }
+
+		// We always send the connection number, the link is not reliable.
+		hdr[clen++] = changes | NEW_C;
+		hdr[clen++] = id;
+		hdr[clen++] = th[16];	// TCP checksum, sent as is.
+		hdr[clen++] = th[17];
+		memcpy(hdr+clen,deltas,cp-deltas);
+		clen += cp - deltas;
+	} while (false);
+
+	memcpy(cs->mHdr,ip,hlen);
+	cs->mHlen = hlen;
+	mLastSlot = id;
+	if (!clen) {
+		ip[9] = id;
+		return TypeUncompressed;
+	}
+	pkt.trimLeft(hlen - clen);
+	memcpy(pkt.begin(),hdr,clen);
+	return TypeCompressed;
+}
+
+bool VjComp::uncompress(ByteVector &pkt, PacketType type)
+{
+	if (type == TypeIp) { return true; }
+	unsigned len = pkt.size();
+	unsigned char *cp = pkt.begin();
+	if (type == TypeUncompressed) {
+		unsigned ihl = (len >= 40) ? (cp[0] & 0xf) * 4 : 0;
+		unsigned hlen = (ihl >= 20 && ihl + 20 <= len) ? ihl + (cp[ihl+12] >> 4) * 4 : 0;
+		if (!hlen || (cp[0] >> 4) != 4 || hlen < ihl + 20 || hlen > len || hlen > sizeof(mSlots[0].mHdr) || cp[9] >= mNumSlots) {
+			mToss = true;
+			return false;
+		}
+		Slot &s = mSlots[cp[9]];
+		mLastSlot = cp[9];
+		mToss = false;
+		cp[9] = IPPROTO_TCP;
+		memcpy(s.mHdr,cp,hlen);
+		s.mHlen = hlen;
+		return true;
+	}
+
+	unsigned rp = 0;
+	if (len < 3) { mToss = true; return false; }
+	unsigned changes = cp[rp++];
+	if (changes & NEW_C) {
+		if (cp[rp] >= mNumSlots) { mToss = true; return false; }
+		mLastSlot = cp[rp++];
+		mToss = false;
+	} else if (mToss) {
+		// Lost a pdu, wait for the connection number to come back.
+		return false;
+	}
+	if (mLastSlot >= mNumSlots || !mSlots[mLastSlot].mHlen || rp + 2 > len) { mToss = true; return false; }
+	Slot &s = mSlots[mLastSlot];
+	unsigned char *ip = s.mHdr;
+	unsigned ihl = (ip[0] & 0xf) * 4;
+	unsigned char *th = ip + ihl;
+	unsigned hlen = s.mHlen;
+	th[16] = cp[rp++];
+	th[17] = cp[rp++];
+	if (changes & TCP_PUSH_BIT) { th[13] |= TH_PUSH; } else { th[13] &= ~TH_PUSH; }
+
+	unsigned n;
+	bool ok = true;
+	switch (changes & SPECIALS_MASK) {
+	case SPECIAL_I:
+		th[13] &= ~TH_URG;
+		n = get16(ip+2) - hlen;
+		put32(th+8,get32(th+8) + n);
+		put32(th+4,get32(th+4) + n);
+		break;
+	case SPECIAL_D:
+		th[13] &= ~TH_URG;
+		put32(th+4,get32(th+4) + get16(ip+2) - hlen);
+		break;
+	default:
+		if (changes & NEW_U) {
+			th[13] |= TH_URG;
+			if ((ok = vjDecode(cp,len,rp,n))) { put16(th+18,n); }
+		} else {
+			th[13] &= ~TH_URG;
+		}
+		if (ok && (changes & NEW_W) && (ok = vjDecode(cp,len,rp,n))) { put16(th+14,get16(th+14) + n); }
+		if (ok && (changes & NEW_A) && (ok = vjDecode(cp,len,rp,n))) { put32(th+8,get32(th+8) + n); }
+		if (ok && (changes & NEW_S) && (ok = vjDecode(cp,len,rp,n))) { put32(th+4,get32(th+4) + n); }
+		break;
+	}
+	if (ok && (changes & NEW_I)) {
+		if ((ok = vjDecode(cp,len,rp,n))) { put16(ip+4,get16(ip+4) + n); }
+	} else if (ok) {
+		put16(ip+4,get16(ip+4) + 1);
+	}
+	if (!ok) { mToss = true; return false; }
+
+	unsigned datalen = len - rp;
+	put16(ip+2,hlen + datalen);
+	ip[10] = ip[11] = 0;
+	uint16_t sum = ip_checksum(ip,ihl,NULL);
+	memcpy(ip+10,&sum,2);
+	ByteVector result(hlen + datalen);
+	memcpy(result.begin(),ip,hlen);
+	memcpy(result.begin()+hlen,cp+rp,datalen);
+	pkt = result;
+	return true;
+}
+
+
+SndcpCompEntity::SndcpCompEntity(unsigned entity, unsigned algorithm)
+	: mEntity(entity), mAlgorithm(algorithm), mNSapis(0), mS0(0),
+	  mVjDown(0), mVjUp(0)
+{
+	mComp[0] = mComp[1] = 0;
+}
+
+SndcpCompEntity::~SndcpCompEntity()
+{
+	delete mVjDown;
+	delete mVjUp;
+}
+
+SndcpCompression::SndcpCompression()
+{
+	memset(mProtocol,0,sizeof(mProtocol));
+}
+
+SndcpCompression::~SndcpCompression()
+{
+	for (unsigned i = 0; i < 32; i++) {
+		delete mProtocol[i];
+	}
+}
+
+// Number of PCOMP or DCOMP values of an algorithm, 44.065 6.5.2 and 6.6.2.
+static unsigned compValues(bool data, unsigned algorithm)
+{
+	if (data) {
+		switch (algorithm) {
+		case SndcpCompAlgorithm::V42bis: return 1;
+		case SndcpCompAlgorithm::V44: return 2;
+		}
+	} else {
+		switch (algorithm) {
+		case SndcpCompAlgorithm::RFC1144: return 2;
+		case SndcpCompAlgorithm::RFC2507: return 5;
+		case SndcpCompAlgorithm::ROHC: return 2;
+		}
+	}
+	return 0;
+}
+
+// 44.065 8: The entities of a data (type 1) or protocol control information (type 2) parameter.
+// Every entity we understand gets an answer, with no applicable NSAPIs if it is refused.
+// Data compression is always refused: V.42bis needs acknowledged mode, after a lost N-PDU
+// the dictionaries would no longer match and nothing short of a new XID resets both.
+bool SndcpCompression::xidEntities(bool data, ByteVector &req, ByteVector &rsp, unsigned allowed)
+{
+	SndcpCompEntity *none[32] = {0};
+	SndcpCompEntity **table = data ? none : mProtocol;
+	bool enabled = !data && gConfig.getBool("SGSN.Compression.Protocol");
+	size_t rp = 0;
+	while (rp + 2 <= req.size()) {
+		bool p = req.getBit2(rp,0);
+		unsigned entity = req.getByte(rp) & 0x1f;
+		size_t ep = rp + 2;
+		size_t end = ep + req.getByte(rp+1);
+		rp = end;
+		if (end > req.size()) {
+			LLCWARN("SNDCP XID compression entity overrun"<<LOGVAR(entity));
+			return false;
+		}
+		unsigned algorithm;
+		unsigned comp[5] = {0,0,0,0,0};
+		SndcpCompEntity *old = 0;
+		if (p) {
+			if (ep >= end) { continue; }
+			algorithm = req.getByte(ep++) & 0x1f;
+			unsigned ncomp = compValues(data,algorithm);
+			if (!ncomp) {
+				LLCWARN("SNDCP XID ignoring unknown"<<LOGVAR(data)<<LOGVAR(algorithm));
+				continue;
+			}
+			for (unsigned i = 0; i < ncomp && ep + i/2 < end; i++) {
+				comp[i] = req.getNibble(ep + i/2,!(i & 1));
+			}
+			ep += (ncomp + 1) / 2;
+		} else if (table[entity]) {
+			old = table[entity];
+			algorithm = old->mAlgorithm;
+		} else {
+			LLCWARN("SNDCP XID modifies unknown"<<LOGVAR(data)<<LOGVAR(entity));
+			continue;
+		}
+		if (ep + 2 > end) { continue; }
+		unsigned nsapis = req.getUInt16(ep) & 0xffe0;	// NSAPI 0-4 are reserved.
+		ep += 2;
+		unsigned accept = nsapis & allowed;
+		unsigned plen = end - ep;
+
+		bool ok = false;
+		unsigned s0 = 0;
+		if (old) {
+			// The entity keeps running, only its NSAPIs change: answer the parameters in use.
+			s0 = old->mS0;
+			ok = true;
+		} else if (!data && algorithm == SndcpCompAlgorithm::RFC1144) {
+			// S0 - 1, the highest slot number.
+			s0 = plen ? req.getByte(ep) : 15;
+			ok = true;
+		}
+		if (!ok || !enabled) { accept = 0; }
+
+		rsp.appendByte(entity);	// P bit is 0 in the response.
+		if (accept) {
+			rsp.appendByte(3);
+			rsp.appendUInt16(accept);
+			rsp.appendByte(s0);
+		} else {
+			rsp.appendByte(2 + plen);
+			rsp.appendUInt16(0);
+			rsp.append(req.segment(ep,plen));
+		}
+		LLCINFO("SNDCP XID"<<LOGVAR(data)<<LOGVAR(entity)<<LOGVAR(algorithm)
+			<<LOGHEX(nsapis)<<LOGHEX(accept));
+
+		if (p || !accept) {
+			delete table[entity];
+			table[entity] = 0;
+		}
+		if (!accept) { continue; }
+		// An NSAPI may only use one entity of each kind.
+		for (unsigned i = 0; i < 32; i++) {
+			if (i != entity && table[i]) {
+				table[i]->mNSapis &= ~accept;
+				if (!table[i]->mNSapis) { delete table[i]; table[i] = 0; }
+			}
+		}
+		SndcpCompEntity *ce = table[entity];
+		if (!ce) {
+			ce = table[entity] = new SndcpCompEntity(entity,algorithm);
+			ce->mComp[0] = comp[0];
+			ce->mComp[1] = comp[1];
+			ce->mS0 = s0;
+			ce->mVjDown = new VjComp(s0 + 1);
+			ce->mVjUp = new VjComp(s0 + 1);
+		}
+		ce->mNSapis = accept;
+	}
+	return true;
+}
+
+void SndcpCompression::xid(ByteVector &req, ByteVector &rsp, unsigned allowed)
+{
+	ScopedLock lock(mLock);
+	try {
+		size_t rp = 0;
+		while (rp + 2 <= req.size()) {
+			unsigned type = req.getByte(rp);
+			unsigned len = req.getByte(rp+1);
+			rp += 2;
+			if (rp + len > req.size()) {
+				LLCWARN("SNDCP XID parameter overrun"<<LOGVAR(type)<<LOGVAR(len));
+				break;
+			}
+			ByteVector value(req.segment(rp,len));
+			rp += len;
+			switch (type) {
+			case 0:	// Version, we only know 0.
+				rsp.appendByte(0);
+				rsp.appendByte(1);
+				rsp.appendByte(0);
+				break;
+			case 1:
+			case 2: {
+				rsp.appendByte(type);
+				size_t lenp = rsp.size();
+				rsp.appendByte(0);
+				xidEntities(type == 1,value,rsp,allowed);
+				rsp.setByte(lenp,rsp.size() - lenp - 1);
+				break;
+				}
+			default:
+				LLCWARN("SNDCP XID ignoring parameter"<<LOGVAR(type));
+				break;
+			}
+		}
+	} catch (ByteVectorError) {
+		LLCWARN("over-run error parsing SNDCP XID parameters");
+	}
+}
+
+SndcpCompEntity *SndcpCompression::findProtocol(unsigned nsapi)
+{
+	for (unsigned i = 0; i < 32; i++) {
+		if (mProtocol[i] && (mProtocol[i]->mNSapis & (1 << nsapi))) { return mProtocol[i]; }
+	}
+	return 0;
+}
+
+// 44.065 6.5: header compression only, DCOMP is always 0.
+void SndcpCompression::compress(unsigned nsapi, ByteVector &pdu, unsigned &pcomp, unsigned &dcomp)
+{
+	pcomp = dcomp = 0;
+	ScopedLock lock(mLock);
+	SndcpCompEntity *ce = findProtocol(nsapi);
+	if (ce && ce->mVjDown) {
+		unsigned long long start = SndcpCompStats::now();
+		unsigned in = pdu.size();
+		VjComp::PacketType type = ce->mVjDown->compress(pdu);
+		if (type == VjComp::TypeUncompressed) { pcomp = ce->mComp[0]; }
+		else if (type == VjComp::TypeCompressed) { pcomp = ce->mComp[1]; }
+		gSndcpCompStats.add(SndcpCompStats::HeaderDown,in,pdu.size(),SndcpCompStats::now() - start,true);
+	}
+}
+
+bool SndcpCompression::decompress(unsigned nsapi, ByteVector &pdu, unsigned pcomp, unsigned dcomp)
+{
+	if (!pcomp && !dcomp) { return true; }
+	if (dcomp) {
+		// We never accept a data compression entity.
+		LLCWARN("SNDCP no data compression entity"<<LOGVAR(nsapi)<<LOGVAR(dcomp));
+		return false;
+	}
+	ScopedLock lock(mLock);
+	if (pcomp) {
+		SndcpCompEntity *ce = findProtocol(nsapi);
+		if (!ce || !ce->mVjUp || (pcomp != ce->mComp[0] && pcomp != ce->mComp[1])) {
+			LLCWARN("SNDCP no header compression entity"<<LOGVAR(nsapi)<<LOGVAR(pcomp));
+			return false;
+		}
+		unsigned long long start = SndcpCompStats::now();
+		unsigned in = pdu.size();
+		bool ok = ce->mVjUp->uncompress(pdu,(pcomp == ce->mComp[0]) ? VjComp::TypeUncompressed : VjComp::TypeCompressed);
+		gSndcpCompStats.add(SndcpCompStats::HeaderUp,in,ok ? pdu.size() : 0,SndcpCompStats::now() - start,ok);
+		if (!ok) { return false; }
+	}
+	return true;
+}
+
+void SndcpCompression::lost(unsigned nsapi)
+{
+	ScopedLock lock(mLock);
+	// Only the header decompressor needs telling, there is no data compression.
+	SndcpCompEntity *ce = findProtocol(nsapi);
+	if (ce && ce->mVjUp) { ce->mVjUp->toss(); }
+}
+
+void SndcpCompression::detach(unsigned nsapi)
+{
+	ScopedLock lock(mLock);
+	for (unsigned i = 0; i < 32; i++) {
+		SndcpCompEntity *&ce = mProtocol[i];
+		if (!ce) { continue; }
+		ce->mNSapis &= ~(1 << nsapi);
+		if (!ce->mNSapis) { delete ce; ce = 0; }
+	}
+}
+
+bool SndcpCompression::active() const
+{
+	for (unsigned i = 0; i < 32; i++) {
+		if (mProtocol[i]) { return true; }
+	}
+	return false;
+}
+
+bool sndcpCompressionAllowed(const ByteVector &apn)
+{
+	if (!gConfig.getBool("SGSN.Compression.Protocol")) {
+		return false;
+	}
+	std::string list = gConfig.getStr("SGSN.Compression.APN");
+	if (list.find_first_not_of(" ") == std::string::npos) { return true; }
+	// 23.003 9.1: labels each preceded by their length.
+	std::string name;
+	for (size_t i = 0; i < apn.size(); ) {
+		unsigned len = apn.getByte(i++);
+		if (name.size()) { name += '.'; }
+		for (; len && i < apn.size(); len--) { name += (char)apn.getByte(i++); }
+	}
+	size_t pos = 0;
+	while (pos < list.size()) {
+		size_t start = list.find_first_not_of(" ",pos);
+		if (start == std::string::npos) { break; }
+		pos = list.find(' ',start);
+		if (pos == std::string::npos) { pos = list.size(); }
+		if (pos - start == name.size() && 0 == strncasecmp(list.c_str() + start,name.c_str(),name.size())) {
+			return true;
+		}
+	}
+	return false;
+}
+
+void SndcpCompStats::reset()
+{
+	memset(mFlow,0,sizeof(mFlow));
+}
+
+// Each flow has a single writer thread, readers only print.
+void SndcpCompStats::add(Flow flow, unsigned in, unsigned out, unsigned long long usec, bool ok)
+{
+	Counter &c = mFlow[flow];
+	c.mPdus++;
+	c.mBytesIn += in;
+	c.mBytesOut += out;
+	c.mUsec += usec;
+	if (!ok) { c.mSkipped++; }
+}
+
+void SndcpCompStats::text(std::ostream &os) const
+{
+	static const char *names[Flows] = { "header down", "header up" };
+	char buf[160];
+	os << "flow          pdus      in(B)     out(B)  ratio  usec/kbit skipped\n";
+	for (unsigned i = 0; i < Flows; i++) {
+		const Counter &c = mFlow[i];
+		double kbit = c.mBytesIn * 8 / 1000.0;
+		snprintf(buf,sizeof(buf),"%-11s %6llu %10llu %10llu %5.1f%% %10.2f %7llu\n",names[i],
+			c.mPdus,c.mBytesIn,c.mBytesOut,
+			c.mBytesIn ? 100.0 * c.mBytesOut / c.mBytesIn : 0.0,
+			kbit > 0 ? c.mUsec / kbit : 0.0,c.mSkipped);
+		os << buf;
+	}
+}
+
+unsigned long long SndcpCompStats::now()
+{
+	struct timeval tv;
+	gettimeofday(&tv,NULL);
+	return (unsigned long long)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+}; // namespace
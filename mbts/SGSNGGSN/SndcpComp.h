@@ -0,0 +1,141 @@
+/**
+ * SndcpComp.h
+ * This file is part of the Yate-BTS Project http://www.yatebts.com
+ *
+ * SNDCP header and data compression, 3GPP 44.065
+ *
+ * Yet Another Telephony Engine - Base Transceiver Station
+ * Copyright (C) 2014 Null Team Impex SRL
+ * Copyright (C) 2014 Legba, Inc
+ *
+ * This software is distributed under multiple licenses;
+ * see the COPYING file in the main directory for licensing
+ * information for this specific distribution.
+ *
+ * This use of this software may be subject to additional restrictions.
+ * See the LEGAL file in the main directory for details.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#ifndef SNDCPCOMP_H
+#define SNDCPCOMP_H
+#include <stdint.h>
+#include <ostream>
+#include <ByteVector.h>
+#include <Threads.h>
+
+namespace SGSN {
+
+// 44.065 6.5.1: The algorithms negotiated in the SNDCP XID parameters.
+struct SndcpCompAlgorithm {
+	enum {	// Protocol control information compression, XID parameter type 2
+		RFC1144 = 0,
+		RFC2507 = 1,
+		ROHC = 2
+	};
+	enum {	// Data compression, XID parameter type 1
+		V42bis = 0,
+		V44 = 1
+	};
+};
+
+// RFC 1144 "Compressing TCP/IP Headers for Low-Speed Serial Links" (Van Jacobson).
+// One of these for each direction of a compression entity.
+// The slots hold the last header seen on each TCP connection.
+class VjComp
+{
+	public:
+	enum PacketType {
+		TypeIp,			// Not TCP or not compressible, passed unchanged.
+		TypeUncompressed,	// PCOMP1: full header, the protocol field holds the slot number.
+		TypeCompressed		// PCOMP2: the compressed header.
+	};
+
+	VjComp(unsigned slots);
+	~VjComp();
+
+	// Compress the packet in place, return the type to signal in PCOMP.
+	PacketType compress(ByteVector &pkt);
+	// Rebuild the packet; returns false if the packet must be discarded.
+	bool uncompress(ByteVector &pkt, PacketType type);
+	// Discard compressed packets until the next one carrying a slot number, after a lost pdu.
+	void toss() { mToss = true; }
+
+	private:
+	struct Slot {
+		unsigned char mHdr[128];	// The last IP+TCP header, options included.
+		unsigned mHlen;			// Length of mHdr in use, 0 if the slot is free.
+		unsigned mAge;			// For the least recently used replacement.
+	};
+	Slot *mSlots;
+	unsigned mNumSlots;
+	unsigned mAge;
+	unsigned mLastSlot;	// Compressor: the slot of the last packet sent; decompressor: received.
+	bool mToss;
+};
+
+// A compression entity negotiated by SNDCP XID, 44.065 6.5.1.1.
+// Only protocol control information compression is accepted.
+struct SndcpCompEntity {
+	unsigned mEntity;	// Entity number 0..31
+	unsigned mAlgorithm;
+	unsigned mComp[2];	// PCOMP values assigned by the MS
+	unsigned mNSapis;	// Bit mask of applicable NSAPIs
+	unsigned mS0;		// S0 - 1 as answered
+	VjComp *mVjDown;
+	VjComp *mVjUp;
+	SndcpCompEntity(unsigned entity, unsigned algorithm);
+	~SndcpCompEntity();
+};
+
+// The compression entities of one user data LLC SAPI.
+class SndcpCompression
+{
+	Mutex mLock;	// XID arrives on the GPRS thread, downlink pdus on the GGSN one.
+	SndcpCompEntity *mProtocol[32];
+	bool xidEntities(bool data, ByteVector &req, ByteVector &rsp, unsigned allowed);
+	SndcpCompEntity *findProtocol(unsigned nsapi);
+	public:
+	SndcpCompression();
+	~SndcpCompression();
+	// Handle the SNDCP XID parameters of an LLC XID command, build the response ones.
+	// Only NSAPIs in allowed may be added to entities, data compression entities are refused.
+	void xid(ByteVector &req, ByteVector &rsp, unsigned allowed);
+	// Downlink: compress an N-PDU, return the PCOMP/DCOMP values to put in the header.
+	void compress(unsigned nsapi, ByteVector &pdu, unsigned &pcomp, unsigned &dcomp);
+	// Uplink: undo the compression; false if the N-PDU must be discarded.
+	bool decompress(unsigned nsapi, ByteVector &pdu, unsigned pcomp, unsigned dcomp);
+	// An uplink N-PDU was lost on this NSAPI.
+	void lost(unsigned nsapi);
+	// The NSAPI was deactivated, remove it from the entities.
+	void detach(unsigned nsapi);
+	bool active() const;
+};
+
+// Is compression allowed for a PDP context on this access point name (10.5.6.1 encoding)?
+bool sndcpCompressionAllowed(const ByteVector &apn);
+
+// Compression statistics, to estimate the processing cost per kbit before enabling it on an APN.
+struct SndcpCompStats {
+	enum Flow { HeaderDown, HeaderUp, Flows };
+	struct Counter {
+		unsigned long long mPdus;
+		unsigned long long mBytesIn;
+		unsigned long long mBytesOut;
+		unsigned long long mUsec;
+		unsigned long long mSkipped;	// Sent uncompressed downlink, discarded uplink
+	};
+	Counter mFlow[Flows];
+	SndcpCompStats() { reset(); }
+	void reset();
+	void add(Flow flow, unsigned in, unsigned out, unsigned long long usec, bool ok);
+	void text(std::ostream &os) const;
+	static unsigned long long now();
+};
+extern SndcpCompStats gSndcpCompStats;
+
+}; // namespace
+#endif
@@ -0,0 +1,204 @@
+/**
+ * SndcpCompTest.cpp
+ * This file is part of the Yate-BTS Project http://www.yatebts.com
+ *
+ * Round trip test of the SNDCP header compression
+ *
+ * Yet Another Telephony Engine - Base Transceiver Station
+ * Copyright (C) 2014 Null Team Impex SRL
+ * Copyright (C) 2014 Legba, Inc
+ *
+ * This software is distributed under multiple licenses;
+ * see the COPYING file in the main directory for licensing
+ * information for this specific distribution.
+ *
+ * This use of this software may be subject to additional restrictions.
+ * See the LEGAL file in the main directory for details.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+/*
+	Runs N-PDUs through a compressor and a separate decompressor, the
+	way the SGSN and the MS hold one each, and checks every N-PDU comes
+	out as it went in.
+	RFC 1144: several TCP connections, more than there are slots, send
+	bulk data, interactive echoes, window and urgent pointer changes,
+	IP options and retransmissions, mixed with UDP that must pass as is.
+	The report gives the compression ratio and the count of each outcome,
+	the return code is the number of N-PDUs that did not survive.
+*/
+
+#include "SndcpComp.h"
+#include "miniggsn.h"
+
+#include <Configuration.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <netinet/in.h>
+
+using namespace std;
+using namespace SGSN;
+
+ConfigurationTable gConfig;
+
+// Stand-ins for the SGSN, the codecs only use them for logging.
+namespace SGSN {
+FILE *mg_log_fp = NULL;
+bool sgsnDebug() { return false; }
+};
+
+static unsigned sPdus = 5000;	// N-PDUs for each test
+static unsigned sSlots = 4;	// RFC 1144 S0 + 1
+static unsigned sConnections = 6;
+static bool sVerbose = false;
+
+static unsigned rnd(unsigned n) { return (unsigned)random() % n; }
+
+static bool sameBytes(const ByteVector &a, const ByteVector &b)
+{
+	return a.size() == b.size() && 0 == memcmp(a.begin(),b.begin(),a.size());
+}
+
+// A TCP connection as seen by the compressor.
+struct TcpConn {
+	unsigned mPort;
+	uint32_t mSeq, mAck;
+	unsigned mWindow, mId;
+	bool mOptions;
+	unsigned mLastLen;
+};
+
+static void makeIp(ByteVector &pkt, unsigned proto, unsigned hlen, unsigned len, unsigned id, bool options)
+{
+	pkt = ByteVector(len);
+	unsigned char *ip = pkt.begin();
+	memset(ip,0,hlen);
+	unsigned ihl = options ? 24 : 20;
+	ip[0] = 0x40 | (ihl / 4);
+	ip[2] = len >> 8; ip[3] = len;
+	ip[4] = id >> 8; ip[5] = id;
+	ip[6] = 0x40;	// DF
+	ip[8] = 64;
+	ip[9] = proto;
+	ip[12] = 10; ip[13] = 0; ip[14] = 0; ip[15] = 1;
+	ip[16] = 192; ip[17] = 0; ip[18] = 2; ip[19] = 7;
+	if (options) { ip[20] = ip[21] = ip[22] = 1; ip[23] = 0; }	// NOPs and end of options
+	for (unsigned i = hlen; i < len; i++) { ip[i] = rnd(256); }
+	uint16_t sum = ip_checksum(ip,ihl,NULL);
+	memcpy(ip+10,&sum,2);
+}
+
+static void makeTcp(ByteVector &pkt, TcpConn &c)
+{
+	unsigned ihl = c.mOptions ? 24 : 20;
+	unsigned hlen = ihl + 20;
+	unsigned data = 0, flags = 0x10;	// ACK
+	uint32_t seq = c.mSeq;
+	switch (rnd(10)) {
+	case 0:	// Pure ack of data from the MS
+		c.mAck += 1 + rnd(1460);
+		break;
+	case 1:	// Interactive echo
+		data = 1 + rnd(20);
+		c.mAck += data;
+		break;
+	case 2:	// Window update
+		c.mWindow = 1000 + rnd(60000);
+		break;
+	case 3:	// Retransmission
+		if (c.mLastLen) { seq -= c.mLastLen; data = c.mLastLen; }
+		break;
+	default:	// Bulk data
+		data = 1 + rnd(1400);
+		break;
+	}
+	if (rnd(3) == 0) { flags |= 0x08; }	// PSH
+	makeIp(pkt,IPPROTO_TCP,hlen,hlen + data,c.mId++,c.mOptions);
+	unsigned char *th = pkt.begin() + ihl;
+	th[0] = c.mPort >> 8; th[1] = c.mPort;
+	th[2] = 0; th[3] = 80;
+	th[4] = seq >> 24; th[5] = seq >> 16; th[6] = seq >> 8; th[7] = seq;
+	th[8] = c.mAck >> 24; th[9] = c.mAck >> 16; th[10] = c.mAck >> 8; th[11] = c.mAck;
+	th[12] = 5 << 4;
+	th[13] = flags;
+	th[14] = c.mWindow >> 8; th[15] = c.mWindow;
+	th[16] = rnd(256); th[17] = rnd(256);	// Nobody checks the TCP checksum here
+	if (rnd(50) == 0) { th[13] |= 0x20; th[19] = 1 + rnd(data + 1); }	// URG
+	if (seq == c.mSeq) { c.mSeq += data; }
+	c.mLastLen = data;
+}
+
+static unsigned testVj()
+{
+	VjComp comp(sSlots), decomp(sSlots);
+	TcpConn *conns = new TcpConn[sConnections];
+	for (unsigned i = 0; i < sConnections; i++) {
+		TcpConn &c = conns[i];
+		c.mPort = 40000 + i;
+		c.mSeq = random();
+		c.mAck = random();
+		c.mWindow = 8192;
+		c.mId = rnd(65536);
+		c.mOptions = (i == 1);
+		c.mLastLen = 0;
+	}
+	unsigned errors = 0, counts[3] = {0,0,0};
+	unsigned long long in = 0, out = 0;
+	unsigned active = 0;
+	for (unsigned n = 0; n < sPdus; n++) {
+		ByteVector pkt;
+		if (rnd(20) == 0) {
+			makeIp(pkt,IPPROTO_UDP,28,28 + rnd(500),rnd(65536),false);
+		} else {
+			// Mostly keep to one connection so the slots are reused, sometimes switch.
+			if (rnd(8) == 0) { active = rnd(sConnections); }
+			makeTcp(pkt,conns[active]);
+		}
+		ByteVector sent(pkt.begin(),pkt.size());
+		in += pkt.size();
+		VjComp::PacketType type = comp.compress(sent);
+		counts[type]++;
+		out += sent.size();
+		if (!decomp.uncompress(sent,type) || !sameBytes(sent,pkt)) {
+			errors++;
+			if (sVerbose) { printf("RFC 1144 pdu %u type %u differs\n",n,type); }
+		}
+	}
+	delete[] conns;
+	printf("RFC 1144 slots %u connections %u ip %u uncompressed %u compressed %u ratio %.3f errors %u\n",
+		sSlots,sConnections,counts[VjComp::TypeIp],counts[VjComp::TypeUncompressed],
+		counts[VjComp::TypeCompressed],in ? (double)out / in : 0.0,errors);
+	return errors;
+}
+
+int main(int argc, char **argv)
+{
+	unsigned seed = 1;
+	int opt;
+	while ((opt = getopt(argc,argv,"n:s:c:r:vh")) != -1) {
+		switch (opt) {
+		case 'n': sPdus = atoi(optarg); break;
+		case 's': sSlots = atoi(optarg); break;
+		case 'c': sConnections = atoi(optarg); break;
+		case 'r': seed = atoi(optarg); break;
+		case 'v': sVerbose = true; break;
+		default:
+			printf("usage: %s [-n pdus] [-s slots] [-c connections] [-r seed] [-v]\n",argv[0]);
+			return 1;
+		}
+	}
+	if (!sSlots || sSlots > 256 || !sConnections) {
+		printf("slots must be 1 to 256, connections at least 1\n");
+		return 1;
+	}
+	srandom(seed);
+
+	unsigned errors = testVj();
+	printf("%s\n",errors ? "FAILED" : "passed");
+	return errors;
+}
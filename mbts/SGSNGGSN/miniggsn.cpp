@@ -123,11 +123,16 @@
 
 namespace SGSN {
 
-int pdpWriteHighSide(PdpContext *pdp, unsigned char *packet, unsigned len);
 int tun_fd = -1; // This is the tunnel we use to talk with the MSs.
 FILE *mg_log_fp = NULL;		// Extra log file for IP traffic.
 int mg_debug_level = 0;
 
+// Room reserved around each downlink packet: the SNDCP header (up to 4 bytes)
+// and LLC UI header (3 bytes) go in front, the LLC FCS (3 bytes) and the
+// terminating zero after it.
+#define MG_HEADROOM 8
+#define MG_TAILROOM 4
+
 
 // old:
 //static char const *mg_base_ip_str = "192.168.99.1";	// This did not raw bind.
@@ -267,15 +272,11 @@ static char *packettoa(char *result,unsigned char *packet, int len)
 }
 
 
-unsigned char *miniggsn_rcv_npdu(int *plen, uint32_t *dstaddr)
+// Read one packet from the tunnel into a buffer of its own, which then travels
+// down to the RLC without being copied: the room left before it takes the
+// SNDCP and LLC headers and the room after it the LLC FCS.
+bool miniggsn_rcv_npdu(ByteVector &packet, uint32_t *dstaddr)
 {
-	static unsigned char *recvbuf = NULL;
-
-	if (recvbuf == NULL) {
-		recvbuf = (unsigned char*)malloc(ggConfig.mgMaxPduSize+2);
-		if (!recvbuf) { /**error = -ENOMEM;*/ return NULL; }
-	}
-
 	// The O_NONBLOCK was set by default!  Is not happening any more.
 	{
 		int flags = fcntl(tun_fd,F_GETFL,0);
@@ -287,18 +288,24 @@ unsigned char *miniggsn_rcv_npdu(int *plen, uint32_t *dstaddr)
 		}
 	}
 
+	ByteVector buf(MG_HEADROOM + ggConfig.mgMaxPduSize + MG_TAILROOM);
+	buf.trimLeft(MG_HEADROOM);
+	unsigned char *recvbuf = buf.begin();
+
 	// We can just read from the tunnel.
 	int ret = read(tun_fd,recvbuf,ggConfig.mgMaxPduSize);
 	if (ret < 0) {
 		MGERROR("ggsn: error: reading from tunnel: %s", strerror(errno));
 		//*error = ret;
-		return NULL;
+		return false;
 	} else if (ret == 0) {
 		MGERROR("ggsn: error: zero bytes reading from tunnel: %s", strerror(errno));
 		//*error = ret;	// huh?
-		return NULL;
+		return false;
 	} else {
 		struct iphdr *iph = (struct iphdr*)recvbuf;
+		// Zero terminate for the convenience of the pinger.
+		recvbuf[ret] = 0;
 		{
 			char infobuf[200];
 			MGINFO("ggsn: received %s at %s",packettoa(infobuf,recvbuf,ret), timestr().c_str());
@@ -309,11 +316,10 @@ unsigned char *miniggsn_rcv_npdu(int *plen, uint32_t *dstaddr)
 		}
 
 		*dstaddr = iph->daddr;
-		// TODO: Do we have to allocate a new buffer?
-		*plen = ret;
-		// Zero terminate for the convenience of the pinger.
-		recvbuf[ret] = 0;
-		return recvbuf;
+		buf.setAppendP(ret);
+		gByteVectorStats.packet(ret);
+		packet = buf;	// Shares the memory.
+		return true;
 	}
 }
 
@@ -369,10 +375,9 @@ static int mg_toss_dup_packet(mg_con_t*mgp,unsigned char *packet, int packetlen)
 // see handle_nsip_read()
 void miniggsn_handle_read()
 {
-	int packetlen;
+	ByteVector packet;
 	uint32_t dstaddr;
-	unsigned char *packet = miniggsn_rcv_npdu(&packetlen, &dstaddr);
-	if (!packet) { return; }
+	if (!miniggsn_rcv_npdu(packet, &dstaddr)) { return; }
 
 	// We need to reassociate the packet with the PdpContext to which it belongs.
 	mg_con_t *mgp = mg_con_find_by_ip(dstaddr);
@@ -382,11 +387,11 @@ void miniggsn_handle_read()
 		return;	// -1;
 	}
 
-	if (mg_toss_dup_packet(mgp,packet,packetlen)) { return; }
+	if (mg_toss_dup_packet(mgp,packet.begin(),packet.size())) { return; }
 
 	PdpContext *pdp = mgp->mg_pdp;
 	//MGDEBUG(2,"miniggsn_handle_read pdp=%p",pdp);
-	pdp->pdpWriteHighSide(packet,packetlen);
+	pdp->pdpWriteHighSide(packet);
 }
 
 
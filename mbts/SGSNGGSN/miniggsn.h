@@ -19,6 +19,8 @@
 #include <time.h>
 #include "Logger.h"
 
+class ByteVector;
+
 namespace SGSN {
 
 struct PdpContext;
@@ -52,7 +54,7 @@ typedef struct mg_con_s {
 } mg_con_t;
 #define MG_CON_DEFINED
 
-unsigned char *miniggsn_rcv_npdu(int *error, int *plen, uint32_t *dstaddr);
+bool miniggsn_rcv_npdu(ByteVector &packet, uint32_t *dstaddr);
 int miniggsn_snd_npdu(PdpContext *pctx,unsigned char *npdu, unsigned len);
 int miniggsn_snd_npdu_by_mgc(mg_con_t *mgp,unsigned char *npdu, unsigned len);
 void miniggsn_handle_read();
@@ -264,6 +264,27 @@ void* ReceiveLoopAdapter(::ARFCNManager* manager){
 
 
 
+int ::ARFCNManager::readResponse(const char* command, char* response, unsigned timeout)
+{
+	// "CMD NAME ..." is answered by "RSP NAME ..."
+	const char* name = command + 4;
+	size_t nameLen = strcspn(name," ");
+	Timeval end(timeout);
+	while (true) {
+		long left = end.remaining();
+		int msgLen = mControlSocket.read(response,left>0 ? left : 0);
+		if (msgLen<=0) return msgLen;
+		response[msgLen] = '\0';
+		if ((msgLen>4) && (strncmp(response,"RSP ",4)==0) &&
+			(strncmp(response+4,name,nameLen)==0) &&
+			(response[4+nameLen]==' ' || response[4+nameLen]=='\0'))
+			return msgLen;
+		// A late answer to a command that timed out
+		LOG(NOTICE) << "discarding stale transceiver response " << response;
+	}
+}
+
+
 int ::ARFCNManager::sendCommandPacket(const char* command, char* response)
 {
 	int msgLen = 0;
@@ -275,11 +296,8 @@ int ::ARFCNManager::sendCommandPacket(const char* command, char* response)
 
 	for (int retry=0; retry<maxRetries; retry++) {
 		mControlSocket.write(command);
-		msgLen = mControlSocket.read(response,1000);
-		if (msgLen>0) {
-			response[msgLen] = '\0';
-			break;
-		}
+		msgLen = readResponse(command,response,1000);
+		if (msgLen>0) break;
 		LOG(WARNING) << "TRX link timeout on attempt " << retry+1;
 	}
 
@@ -434,6 +452,28 @@ bool ::ARFCNManager::powerOff()
 }
 
 
+bool ::ARFCNManager::ping(unsigned timeout)
+{
+	char response[MAX_UDP_LENGTH];
+	int msgLen = 0;
+	mControlLock.lock();
+	// Drop late answers to previous pings so they don't look like command responses
+	while (mControlSocket.read(response,0)>0) { }
+	mControlSocket.write("CMD POWEROFF");
+	msgLen = readResponse("CMD POWEROFF",response,timeout);
+	mControlLock.unlock();
+	return msgLen>0;
+}
+
+
+bool ::ARFCNManager::running()
+{
+	// Only answered with status 0 once the radio is on
+	int noiselevel;
+	return sendCommand("NOISELEV",0,&noiselevel)==0;
+}
+
+
 bool ::ARFCNManager::powerOn(bool warn)
 {
 	int status = sendCommand("POWERON");
@@ -583,6 +623,18 @@ signed ::ARFCNManager::getNoiseLevel(void)
         return noiselevel;
 }
 
+std::string ARFCNManager::getLatency(bool reset)
+{
+	static const char prefix[] = "RSP LATENCY 0 ";
+	char response[MAX_UDP_LENGTH];
+	int rspLen = sendCommandPacket(reset ? "CMD LATENCY RESET" : "CMD LATENCY",response);
+	if ((rspLen<=0) || strncmp(response,prefix,sizeof(prefix)-1)) {
+		LOG(ALERT) << "LATENCY failed";
+		return "";
+	}
+	return response + sizeof(prefix) - 1;
+}
+
 signed ::ARFCNManager::getFactoryCalibration(const char * param)
 {
 	signed value;
@@ -166,6 +166,19 @@ class ARFCNManager {
 	/** Turn off the transceiver. */
 	bool powerOff();
 
+	/**
+		Check if the transceiver answers, without retrying.
+		@param timeout Time to wait for the answer in ms.
+		@return true if the transceiver answered.
+	*/
+	bool ping(unsigned timeout);
+
+	/**
+		Check if the transceiver is already powered on,
+		e.g. left running by the mbts that was warm restarted.
+	*/
+	bool running();
+
 	/** Turn on the transceiver. */
 	
 	/**
@@ -215,6 +228,13 @@ class ARFCNManager {
 	*/
 	signed getFactoryCalibration(const char * param);
 
+	/**
+		Get the burst latency measured by the transceiver.
+		@param reset Start a new measurement interval after reporting.
+		@return the report text, empty if the transceiver did not answer.
+	*/
+	std::string getLatency(bool reset);
+
 	/**
 		Set power wrt full scale.
 		@param dB Power level wrt full power.
@@ -285,6 +305,16 @@ class ARFCNManager {
 	*/
 	int sendCommandPacket(const char* command, char* response);
 
+	/**
+		Read the response to a command, skipping the late responses
+		to earlier commands that timed out.
+		@param command The command sent, "CMD NAME ...".
+		@param response A buffer for the response packet.
+		@param timeout Time to wait for the response in ms.
+		@return Length of the response, 0 or less on timeout or error.
+	*/
+	int readResponse(const char* command, char* response, unsigned timeout);
+
 	/**
 		Send a command with a parameter.
 		@param command The command name.
@@ -0,0 +1,367 @@
+/**
+ * FileDevice.cpp
+ * This file is part of the Yate-BTS Project http://www.yatebts.com
+ *
+ * File backed IQ record / replay radio device
+ *
+ * Yet Another Telephony Engine - Base Transceiver Station
+ * Copyright (C) 2013-2014 Null Team Impex SRL
+ * Copyright (C) 2014 Legba, Inc
+ *
+ * This software is distributed under multiple licenses;
+ * see the COPYING file in the main directory for licensing
+ * information for this specific distribution.
+ *
+ * This use of this software may be subject to additional restrictions.
+ * See the LEGAL file in the main directory for details.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#include "FileDevice.h"
+
+#include <Logger.h>
+
+#include <string.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <math.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// Size of one complex 16 bit sample
+#define SAMPLE_SIZE (2 * sizeof(short))
+
+using namespace std;
+
+static bool argBool(const string &val)
+{
+  return (val == "yes") || (val == "true") || (val == "on") || (val == "1");
+}
+
+FileDevice::FileDevice(int sps, bool skipRx)
+  : sps(sps), speed(1.0), loop(true), started(false),
+    rxData(NULL), rxSamples(0), rxMap(NULL), rxMapLen(0), rxEnded(false),
+    txFd(-1), txHeader(NULL), txData(NULL), txCapacity(0), txMapLen(0),
+    txFirst(0), txFull(false), samplesRead(0), samplesWritten(0),
+    underrun(false), lastReadTime(0), rxGain(0.0), txGain(0.0)
+{
+  LOG(INFO) << "creating file device...";
+  rxRate = GSMRATE;
+  txRate = GSMRATE * sps;
+  startTime.tv_sec = 0;
+  startTime.tv_usec = 0;
+}
+
+FileDevice::~FileDevice()
+{
+  stop();
+  closeTx();
+  if (rxMap)
+    munmap(rxMap, rxMapLen);
+}
+
+bool FileDevice::parseArgs(const string &args)
+{
+  double txMax = 60.0;
+  size_t pos = 0;
+  while (pos < args.size()) {
+    size_t end = args.find(',', pos);
+    if (end == string::npos)
+      end = args.size();
+    string item = args.substr(pos, end - pos);
+    pos = end + 1;
+    if (item.empty())
+      continue;
+    size_t eq = item.find('=');
+    if (eq == string::npos) {
+      LOG(ALERT) << "Invalid file device argument '" << item << "'";
+      return false;
+    }
+    string name = item.substr(0, eq);
+    string val = item.substr(eq + 1);
+    if (name == "rx")
+      rxName = val;
+    else if (name == "tx")
+      txName = val;
+    else if (name == "loop")
+      loop = argBool(val);
+    else if (name == "speed")
+      speed = atof(val.c_str());
+    else if (name == "txmax")
+      txMax = atof(val.c_str());
+    else {
+      LOG(ALERT) << "Unknown file device argument '" << name << "'";
+      return false;
+    }
+  }
+  if (speed < 0.0)
+    speed = 0.0;
+  if (txMax <= 0.0)
+    txMax = 60.0;
+  txCapacity = (unsigned long long) (txMax * txRate);
+  return true;
+}
+
+bool FileDevice::openRx()
+{
+  int fd = ::open(rxName.c_str(), O_RDONLY);
+  if (fd < 0) {
+    LOG(ALERT) << "Could not open capture file " << rxName << ": " << strerror(errno);
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd, &st) || (st.st_size < (off_t) SAMPLE_SIZE)) {
+    LOG(ALERT) << "Capture file " << rxName << " is empty or unreadable";
+    ::close(fd);
+    return false;
+  }
+  rxMapLen = st.st_size;
+  rxMap = mmap(NULL, rxMapLen, PROT_READ, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (rxMap == MAP_FAILED) {
+    rxMap = NULL;
+    LOG(ALERT) << "Could not map capture file " << rxName << ": " << strerror(errno);
+    return false;
+  }
+  madvise(rxMap, rxMapLen, MADV_SEQUENTIAL);
+
+  size_t offs = 0;
+  const IQFileHeader *hdr = (const IQFileHeader *) rxMap;
+  if ((rxMapLen >= sizeof(IQFileHeader)) &&
+      !memcmp(hdr->magic, IQFILE_MAGIC, sizeof(hdr->magic))) {
+    if ((hdr->version != IQFILE_VERSION) || (hdr->headerLen < sizeof(IQFileHeader)) ||
+	(hdr->headerLen >= rxMapLen)) {
+      LOG(ALERT) << "Unsupported capture file " << rxName << " version " << hdr->version;
+      return false;
+    }
+    offs = hdr->headerLen;
+    if (fabs(hdr->rate - rxRate) > 1.0)
+      LOG(WARNING) << "Capture file " << rxName << " rate " << hdr->rate
+		   << " differs from receive rate " << rxRate << ", replaying unchanged";
+    LOG(INFO) << "Capture file " << rxName << " recorded at timestamp " << hdr->timestamp;
+  }
+  rxData = (const short *) ((const char *) rxMap + offs);
+  rxSamples = (rxMapLen - offs) / SAMPLE_SIZE;
+  // A recording that was not closed keeps its full sparse size, the tail is zeros
+  if (offs && (hdr->samples < rxSamples))
+    rxSamples = hdr->samples;
+  LOG(NOTICE) << "Replaying " << rxSamples << " samples ("
+	      << (rxSamples / rxRate) << " s) from " << rxName
+	      << (loop ? " in a loop" : "");
+  return true;
+}
+
+bool FileDevice::openTx()
+{
+  txFd = ::open(txName.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (txFd < 0) {
+    LOG(ALERT) << "Could not create record file " << txName << ": " << strerror(errno);
+    return false;
+  }
+  txMapLen = sizeof(IQFileHeader) + txCapacity * SAMPLE_SIZE;
+  // The file is sparse, blocks are allocated only when samples get written
+  if (ftruncate(txFd, txMapLen)) {
+    LOG(ALERT) << "Could not size record file " << txName << ": " << strerror(errno);
+    closeTx();
+    return false;
+  }
+  void *map = mmap(NULL, txMapLen, PROT_READ | PROT_WRITE, MAP_SHARED, txFd, 0);
+  if (map == MAP_FAILED) {
+    LOG(ALERT) << "Could not map record file " << txName << ": " << strerror(errno);
+    closeTx();
+    return false;
+  }
+  txHeader = (IQFileHeader *) map;
+  memcpy(txHeader->magic, IQFILE_MAGIC, sizeof(txHeader->magic));
+  txHeader->version = IQFILE_VERSION;
+  txHeader->headerLen = sizeof(IQFileHeader);
+  txHeader->rate = txRate;
+  txHeader->timestamp = 0;
+  txHeader->samples = 0;
+  txData = (short *) (txHeader + 1);
+  LOG(NOTICE) << "Recording up to " << txCapacity << " samples into " << txName;
+  return true;
+}
+
+void FileDevice::closeTx()
+{
+  size_t len = 0;
+  if (txHeader) {
+    len = txHeader->headerLen + txHeader->samples * SAMPLE_SIZE;
+    msync(txHeader, txMapLen, MS_SYNC);
+    munmap(txHeader, txMapLen);
+    txHeader = NULL;
+    txData = NULL;
+  }
+  if (txFd >= 0) {
+    if (len && ftruncate(txFd, len))
+      LOG(WARNING) << "Could not truncate record file " << txName;
+    ::close(txFd);
+    txFd = -1;
+  }
+}
+
+int FileDevice::open(const std::string &args, bool extref)
+{
+  LOG(INFO) << "opening file device " << args;
+  if (!parseArgs(args))
+    return -1;
+  if (!rxName.empty() && !openRx())
+    return -1;
+  if (!txName.empty() && !openTx())
+    return -1;
+  if (rxName.empty())
+    LOG(NOTICE) << "No capture file, receiving silence";
+  return NORMAL;
+}
+
+bool FileDevice::start()
+{
+  LOG(INFO) << "starting file device, speed " << speed;
+  samplesRead = 0;
+  samplesWritten = 0;
+  lastReadTime = 0;
+  underrun = false;
+  gettimeofday(&startTime, NULL);
+  started = true;
+  return true;
+}
+
+bool FileDevice::stop()
+{
+  if (!started)
+    return true;
+  started = false;
+  struct timeval now;
+  gettimeofday(&now, NULL);
+  double wall = (now.tv_sec - startTime.tv_sec) + (now.tv_usec - startTime.tv_usec) * 1.0e-6;
+  double air = samplesRead / rxRate;
+  LOG(NOTICE) << "File device processed " << air << " s of air time in " << wall
+	      << " s (" << ((wall > 0.0) ? (air / wall) : 0.0) << "x real time)";
+  if (txHeader)
+    msync(txHeader, txMapLen, MS_ASYNC);
+  return true;
+}
+
+void FileDevice::pace(TIMESTAMP timestamp)
+{
+  if (speed <= 0.0)
+    return;
+  struct timeval now;
+  gettimeofday(&now, NULL);
+  double elapsed = (now.tv_sec - startTime.tv_sec) * 1.0e6 + (now.tv_usec - startTime.tv_usec);
+  double due = timestamp * 1.0e6 / (rxRate * speed);
+  if (due > elapsed)
+    usleep((useconds_t) (due - elapsed));
+}
+
+double FileDevice::setRxGain(double dB)
+{
+  if (dB > maxRxGain())
+    dB = maxRxGain();
+  if (dB < minRxGain())
+    dB = minRxGain();
+  rxGain = dB;
+  return rxGain;
+}
+
+double FileDevice::setTxGain(double dB)
+{
+  if (dB > maxTxGain())
+    dB = maxTxGain();
+  if (dB < minTxGain())
+    dB = minTxGain();
+  txGain = dB;
+  return txGain;
+}
+
+// NOTE: Assumes sequential reads
+int FileDevice::readSamples(short *buf, int len, bool *overrun,
+			    TIMESTAMP timestamp,
+			    bool *wUnderrun,
+			    unsigned *RSSI)
+{
+  // Block until the end of the requested buffer would have been received
+  pace(timestamp + len);
+
+  if (overrun)
+    *overrun = false;
+  underrunLock.lock();
+  if (wUnderrun)
+    *wUnderrun = underrun;
+  underrun = false;
+  lastReadTime = timestamp + len;
+  underrunLock.unlock();
+
+  if (!rxSamples || (!loop && (timestamp + len > rxSamples))) {
+    memset(buf, 0, len * SAMPLE_SIZE);
+    if (rxSamples && (timestamp < rxSamples))
+      memcpy(buf, rxData + 2 * timestamp, (rxSamples - timestamp) * SAMPLE_SIZE);
+    if (rxSamples && !rxEnded) {
+      LOG(NOTICE) << "End of capture " << rxName << ", receiving silence";
+      rxEnded = true;
+    }
+  }
+  else {
+    unsigned long long pos = timestamp % rxSamples;
+    int done = 0;
+    while (done < len) {
+      unsigned long long chunk = rxSamples - pos;
+      if (chunk > (unsigned long long) (len - done))
+	chunk = len - done;
+      memcpy(buf + 2 * done, rxData + 2 * pos, chunk * SAMPLE_SIZE);
+      done += chunk;
+      pos = 0;
+    }
+  }
+  if (RSSI)
+    *RSSI = 0;
+  samplesRead += len;
+  return len;
+}
+
+int FileDevice::writeSamples(short *buf, int len, bool *wUnderrun,
+			     TIMESTAMP timestamp,
+			     bool isControl)
+{
+  underrunLock.lock();
+  // Transmit timestamps run at sps times the receive rate
+  if (timestamp / sps < lastReadTime)
+    underrun = true;
+  if (wUnderrun)
+    *wUnderrun = underrun;
+  underrunLock.unlock();
+
+  samplesWritten += len;
+  if (!txData || txFull)
+    return len;
+  if (!txHeader->samples) {
+    txFirst = timestamp;
+    txHeader->timestamp = timestamp;
+  }
+  if (timestamp < txFirst)
+    return len;
+  unsigned long long pos = timestamp - txFirst;
+  unsigned long long rec = len;
+  if (pos + rec > txCapacity) {
+    LOG(NOTICE) << "Record file " << txName << " is full, recording stopped";
+    txFull = true;
+    if (pos >= txCapacity)
+      return len;
+    rec = txCapacity - pos;
+  }
+  memcpy(txData + 2 * pos, buf, rec * SAMPLE_SIZE);
+  if (pos + rec > txHeader->samples)
+    txHeader->samples = pos + rec;
+  return len;
+}
+
+RadioDevice *RadioDevice::make(int sps, bool skipRx)
+{
+  return new FileDevice(sps, skipRx);
+}
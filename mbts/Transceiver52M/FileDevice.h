@@ -0,0 +1,219 @@
+/**
+ * FileDevice.h
+ * This file is part of the Yate-BTS Project http://www.yatebts.com
+ *
+ * Declaration for a file backed IQ record / replay radio device
+ *
+ * Yet Another Telephony Engine - Base Transceiver Station
+ * Copyright (C) 2013-2014 Null Team Impex SRL
+ * Copyright (C) 2014 Legba, Inc
+ *
+ * This software is distributed under multiple licenses;
+ * see the COPYING file in the main directory for licensing
+ * information for this specific distribution.
+ *
+ * This use of this software may be subject to additional restrictions.
+ * See the LEGAL file in the main directory for details.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#ifndef _FILE_DEVICE_H_
+#define _FILE_DEVICE_H_
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "radioDevice.h"
+#include "Threads.h"
+
+#include <stdint.h>
+#include <sys/time.h>
+#include <string>
+
+/** Magic string at the start of every IQ capture file */
+#define IQFILE_MAGIC "MBTSIQ\r\n"
+/** Current version of the IQ capture file format */
+#define IQFILE_VERSION 1
+
+/**
+	Header of an IQ capture file.
+	It is followed by interleaved native endian 16 bit I/Q sample pairs.
+	Files without this header are accepted for replay as raw I/Q data.
+*/
+struct IQFileHeader {
+  char magic[8];                ///< IQFILE_MAGIC
+  uint32_t version;             ///< IQFILE_VERSION
+  uint32_t headerLen;           ///< offset of the first sample in file
+  double rate;                  ///< sample rate in samples per second
+  uint64_t timestamp;           ///< device timestamp of the first sample
+  uint64_t samples;             ///< number of complex samples in file
+};
+
+/**
+	A radio device that replays received IQ samples from a memory mapped
+	capture file and records transmitted samples to another one.
+	Device arguments are a comma separated list of name=value pairs:
+	  rx=FILE     capture file to replay on the receive side, zeros if missing
+	  tx=FILE     file to record the transmitted samples into
+	  loop=BOOL   restart replay at end of capture (default yes)
+	  speed=NUM   pace relative to real time, 0 runs unpaced (default 1)
+	  txmax=SECS  maximum duration recorded in the tx file (default 60)
+*/
+class FileDevice: public RadioDevice {
+
+private:
+
+  int sps;                      ///< samples per symbol on the transmit side
+  double rxRate;                ///< receive sample rate
+  double txRate;                ///< transmit sample rate
+  double speed;                 ///< speed factor relative to real time
+  bool loop;                    ///< loop replay of the capture
+  bool started;                 ///< device is running
+
+  std::string rxName;           ///< name of the replayed capture file
+  const short *rxData;          ///< mapped samples of the replay file
+  unsigned long long rxSamples; ///< number of samples in replay file
+  void *rxMap;                  ///< start of the replay file mapping
+  size_t rxMapLen;              ///< length of the replay file mapping
+  bool rxEnded;                 ///< end of non looping replay was reported
+
+  std::string txName;           ///< name of the record file
+  int txFd;                     ///< descriptor of the record file
+  IQFileHeader *txHeader;       ///< mapped header of the record file
+  short *txData;                ///< mapped samples of the record file
+  unsigned long long txCapacity;///< number of samples the record file can hold
+  size_t txMapLen;              ///< length of the record file mapping
+  TIMESTAMP txFirst;            ///< timestamp of the first recorded sample
+  bool txFull;                  ///< record capacity exhausted was reported
+
+  unsigned long long samplesRead;	///< number of samples delivered to the radio interface
+  unsigned long long samplesWritten;	///< number of samples accepted from the radio interface
+
+  Mutex underrunLock;
+  bool underrun;                ///< a transmit buffer arrived late
+  TIMESTAMP lastReadTime;       ///< timestamp following the last read buffer
+
+  struct timeval startTime;     ///< wall clock time at start
+  double rxGain;
+  double txGain;
+
+  /** Parse the comma separated device arguments */
+  bool parseArgs(const std::string &args);
+
+  /** Map the capture file for replay */
+  bool openRx();
+
+  /** Create and map the file to record into */
+  bool openTx();
+
+  /** Write final header and unmap the record file */
+  void closeTx();
+
+  /** Sleep until a receive timestamp is due according to the speed */
+  void pace(TIMESTAMP timestamp);
+
+ public:
+
+  /** Object constructor */
+  FileDevice(int sps, bool skipRx);
+
+  /** Object destructor */
+  ~FileDevice();
+
+  /** Open the capture files */
+  int open(const std::string &args, bool extref);
+
+  /** Start replay and recording */
+  bool start();
+
+  /** Stop replay and recording */
+  bool stop();
+
+  /** Set priority not supported */
+  void setPriority() { return; }
+
+  enum TxWindowType getWindowType() { return TX_WINDOW_FIXED; }
+
+  /**
+	Read samples from the replay file.
+	@param buf preallocated buf to contain read result
+	@param len number of samples desired
+	@param overrun Set if read buffer has been overrun, e.g. data not being read fast enough
+	@param timestamp The timestamp of the first samples to be read
+	@param underrun Set if transmitted data arrived later than its time
+	@param RSSI The received signal strength of the read result
+	@return The number of samples actually read
+  */
+  int  readSamples(short *buf, int len, bool *overrun,
+		   TIMESTAMP timestamp = 0xffffffff,
+		   bool *underrun = NULL,
+		   unsigned *RSSI = NULL);
+  /**
+        Write samples to the record file.
+        @param buf Contains the data to be written.
+        @param len number of samples to write.
+        @param underrun Set if transmitted data arrived later than its time
+        @param timestamp The timestamp of the first sample of the data buffer.
+        @param isControl Set if data is a control packet, e.g. a ping command
+        @return The number of samples actually written
+  */
+  int  writeSamples(short *buf, int len, bool *underrun,
+		    TIMESTAMP timestamp = 0xffffffff,
+		    bool isControl = false);
+
+  /** Update the alignment between the read and write timestamps */
+  bool updateAlignment(TIMESTAMP timestamp) { return true; }
+
+  /** Set the transmitter frequency */
+  bool setTxFreq(double wFreq) { return true; }
+
+  /** Set the receiver frequency */
+  bool setRxFreq(double wFreq) { return true; }
+
+  /** Returns the starting write Timestamp*/
+  TIMESTAMP initialWriteTimestamp(void) { return 0; }
+
+  /** Returns the starting read Timestamp*/
+  TIMESTAMP initialReadTimestamp(void) { return 0; }
+
+  /** returns the full-scale transmit amplitude **/
+  double fullScaleInputValue() { return 32000 * 0.3; }
+
+  /** returns the full-scale receive amplitude **/
+  double fullScaleOutputValue() { return 32000; }
+
+  /** sets the receive chan gain, returns the gain setting **/
+  double setRxGain(double dB);
+
+  /** get the current receive gain */
+  double getRxGain(void) { return rxGain; }
+
+  /** return maximum Rx Gain **/
+  double maxRxGain(void) { return 60.0; }
+
+  /** return minimum Rx Gain **/
+  double minRxGain(void) { return 0.0; }
+
+  /** sets the transmit chan gain, returns the gain setting **/
+  double setTxGain(double dB);
+
+  /** return maximum Tx Gain **/
+  double maxTxGain(void) { return 30.0; }
+
+  /** return minimum Tx Gain **/
+  double minTxGain(void) { return 0.0; }
+
+  /** Return internal status values */
+  inline double getTxFreq() { return 0; }
+  inline double getRxFreq() { return 0; }
+  inline double getSampleRate() { return txRate; }
+  inline double numberRead() { return samplesRead; }
+  inline double numberWritten() { return samplesWritten; }
+
+};
+
+#endif // _FILE_DEVICE_H_
@@ -0,0 +1,175 @@
+/**
+ * Latency.cpp
+ * This file is part of the Yate-BTS Project http://www.yatebts.com
+ *
+ * Per stage burst latency histograms
+ *
+ * Yet Another Telephony Engine - Base Transceiver Station
+ * Copyright (C) 2014 Null Team Impex SRL
+ * Copyright (C) 2014 Legba, Inc
+ *
+ * This software is distributed under multiple licenses;
+ * see the COPYING file in the main directory for licensing
+ * information for this specific distribution.
+ *
+ * This use of this software may be subject to additional restrictions.
+ * See the LEGAL file in the main directory for details.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#include "Latency.h"
+
+#include <string.h>
+#include <stdio.h>
+#include <time.h>
+
+LatencyStats gLatency;
+
+static const char* sStageName[LatStages] = {
+	"tx.margin",
+	"tx.queue",
+	"tx.push",
+	"rx.wait",
+	"rx.demod"
+};
+
+
+LatencyHistogram::LatencyHistogram()
+	: mMax(0), mResetMax(false)
+{
+	for (unsigned i = 0; i < LATENCY_BUCKETS; i++)
+		mCount[i] = mBase[i] = 0;
+}
+
+unsigned LatencyHistogram::bucket(uint64_t us)
+{
+	if (us < 16)
+		return us;
+	unsigned o = 63 - __builtin_clzll(us);
+	unsigned index = 16 + (o - 4) * 4 + ((us >> (o - 2)) & 3);
+	return (index < LATENCY_BUCKETS) ? index : LATENCY_BUCKETS - 1;
+}
+
+uint64_t LatencyHistogram::bucketTop(unsigned index)
+{
+	if (index < 16)
+		return index;
+	unsigned o = (index - 16) / 4 + 4;
+	uint64_t low = (uint64_t)(4 + (index - 16) % 4) << (o - 2);
+	return low + ((uint64_t)1 << (o - 2)) - 1;
+}
+
+uint32_t LatencyHistogram::collect(uint32_t *counts) const
+{
+	uint32_t total = 0;
+	for (unsigned i = 0; i < LATENCY_BUCKETS; i++) {
+		uint32_t n = mCount[i] - mBase[i];
+		counts[i] += n;
+		total += n;
+	}
+	return total;
+}
+
+void LatencyHistogram::reset()
+{
+	for (unsigned i = 0; i < LATENCY_BUCKETS; i++)
+		mBase[i] = mCount[i];
+	// The writer restarts the maximum on its next sample
+	mResetMax = true;
+}
+
+uint64_t LatencyHistogram::percentile(const uint32_t *counts, uint32_t total, unsigned percent)
+{
+	if (!total)
+		return 0;
+	// Rank of the sample, rounded up
+	uint64_t rank = ((uint64_t)total * percent + 99) / 100;
+	if (!rank)
+		rank = 1;
+	uint64_t seen = 0;
+	for (unsigned i = 0; i < LATENCY_BUCKETS; i++) {
+		seen += counts[i];
+		if (seen >= rank)
+			return bucketTop(i);
+	}
+	return bucketTop(LATENCY_BUCKETS - 1);
+}
+
+
+LatencyStats::LatencyStats()
+	: mLate(0), mStale(0), mUnderrun(0),
+	  mLateBase(0), mStaleBase(0), mUnderrunBase(0)
+{
+}
+
+uint64_t LatencyStats::now()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC,&ts);
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+std::string LatencyStats::report() const
+{
+	std::string out;
+	char buf[128];
+	for (unsigned s = 0; s < LatStages; s++) {
+		uint32_t all[LATENCY_BUCKETS];
+		memset(all,0,sizeof(all));
+		uint32_t total = 0;
+		uint64_t max = 0;
+		std::string slots;
+		for (unsigned tn = 0; tn < 8; tn++) {
+			const LatencyHistogram &h = mHist[s][tn];
+			uint32_t counts[LATENCY_BUCKETS];
+			memset(counts,0,sizeof(counts));
+			uint32_t n = h.collect(counts);
+			for (unsigned i = 0; i < LATENCY_BUCKETS; i++)
+				all[i] += counts[i];
+			total += n;
+			uint64_t m = h.max();
+			if (m > max)
+				max = m;
+			if (!n)
+				continue;
+			// The maximum is exact, the percentiles are bucket bounds
+			uint64_t p50 = LatencyHistogram::percentile(counts,n,50);
+			uint64_t p99 = LatencyHistogram::percentile(counts,n,99);
+			snprintf(buf,sizeof(buf)," TN%u %llu/%llu/%llu",tn,
+				(unsigned long long)(p50 < m ? p50 : m),
+				(unsigned long long)(p99 < m ? p99 : m),
+				(unsigned long long)m);
+			slots += buf;
+		}
+		uint64_t p50 = LatencyHistogram::percentile(all,total,50);
+		uint64_t p99 = LatencyHistogram::percentile(all,total,99);
+		snprintf(buf,sizeof(buf),"%s n=%u p50=%llu p99=%llu max=%llu us\n",
+			sStageName[s],total,
+			(unsigned long long)(p50 < max ? p50 : max),
+			(unsigned long long)(p99 < max ? p99 : max),
+			(unsigned long long)max);
+		out += buf;
+		if (slots.size()) {
+			out += " ";
+			out += slots;
+			out += "\n";
+		}
+	}
+	snprintf(buf,sizeof(buf),"late=%u stale=%u underrun=%u\n",
+		mLate - mLateBase,mStale - mStaleBase,mUnderrun - mUnderrunBase);
+	out += buf;
+	return out;
+}
+
+void LatencyStats::reset()
+{
+	for (unsigned s = 0; s < LatStages; s++)
+		for (unsigned tn = 0; tn < 8; tn++)
+			mHist[s][tn].reset();
+	mLateBase = mLate;
+	mStaleBase = mStale;
+	mUnderrunBase = mUnderrun;
+}
@@ -0,0 +1,144 @@
+/**
+ * Latency.h
+ * This file is part of the Yate-BTS Project http://www.yatebts.com
+ *
+ * Declaration for the per stage burst latency histograms
+ *
+ * Yet Another Telephony Engine - Base Transceiver Station
+ * Copyright (C) 2014 Null Team Impex SRL
+ * Copyright (C) 2014 Legba, Inc
+ *
+ * This software is distributed under multiple licenses;
+ * see the COPYING file in the main directory for licensing
+ * information for this specific distribution.
+ *
+ * This use of this software may be subject to additional restrictions.
+ * See the LEGAL file in the main directory for details.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#ifndef _LATENCY_H_
+#define _LATENCY_H_
+
+#include <stdint.h>
+#include <string>
+
+/** Number of buckets, 4 per power of 2 above 16us */
+#define LATENCY_BUCKETS 128
+
+/**
+	Histogram of durations in microseconds.
+	Only one thread may add samples, any thread may read them.
+	Readers see slightly stale counters, they never block the writer.
+*/
+class LatencyHistogram {
+
+	public:
+
+	LatencyHistogram();
+
+	/** Add a sample, called by the single writer thread */
+	void add(uint64_t us)
+	{
+		mCount[bucket(us)]++;
+		if (mResetMax) {
+			mMax = us;
+			mResetMax = false;
+		}
+		else if (us > mMax)
+			mMax = us;
+	}
+
+	/**
+		Collect the counters added since the last reset.
+		@param counts Destination of LATENCY_BUCKETS counters, added to the existing values.
+		@return the number of collected samples.
+	*/
+	uint32_t collect(uint32_t *counts) const;
+
+	/** Maximum sample since the last reset */
+	uint64_t max() const { return mResetMax ? 0 : mMax; }
+
+	/** Start a new measurement interval, without touching the writer's counters */
+	void reset();
+
+	/** Bucket index of a duration */
+	static unsigned bucket(uint64_t us);
+
+	/** Highest duration counted in a bucket */
+	static uint64_t bucketTop(unsigned index);
+
+	/**
+		Find a percentile in collected counters.
+		@param counts The counters filled by collect().
+		@param total The number of samples in counters.
+		@param percent Percentile, 0 to 100.
+	*/
+	static uint64_t percentile(const uint32_t *counts, uint32_t total, unsigned percent);
+
+	private:
+
+	volatile uint32_t mCount[LATENCY_BUCKETS];	///< counters updated by the writer
+	uint32_t mBase[LATENCY_BUCKETS];		///< counter values at the last reset
+	volatile uint64_t mMax;				///< maximum since the last reset
+	volatile bool mResetMax;			///< set by reset() for the writer to restart mMax
+};
+
+
+/** The measured stages of the burst pipeline */
+enum LatencyStage {
+	LatTxMargin = 0,	///< how early a burst arrived from the core before its deadline
+	LatTxQueue,		///< time spent by a burst in the transmit priority queue
+	LatTxPush,		///< time to send a timeslot to the radio interface and device
+	LatRxWait,		///< time a received burst waited before demodulation
+	LatRxDemod,		///< time to detect and demodulate a received burst
+	LatStages
+};
+
+/** Histograms of all stages and timeslots, with the late burst counters */
+class LatencyStats {
+
+	public:
+
+	LatencyStats();
+
+	/** Record a stage duration on a timeslot */
+	void add(LatencyStage stage, unsigned tn, uint64_t us)
+		{ mHist[stage][tn & 7].add(us); }
+
+	/** Count a burst that arrived from the core after its deadline */
+	void late() { mLate++; }
+
+	/** Count a stale burst dropped from the transmit queue */
+	void stale() { mStale++; }
+
+	/** Count a transmit underrun reported by the device */
+	void underrun() { mUnderrun++; }
+
+	/** Build a text report, one line per stage followed by each timeslot */
+	std::string report() const;
+
+	/** Start a new measurement interval */
+	void reset();
+
+	/** Current time in microseconds on a monotonic clock */
+	static uint64_t now();
+
+	private:
+
+	LatencyHistogram mHist[LatStages][8];
+	volatile uint32_t mLate;
+	volatile uint32_t mStale;
+	volatile uint32_t mUnderrun;
+	uint32_t mLateBase;
+	uint32_t mStaleBase;
+	uint32_t mUnderrunBase;
+};
+
+/** Latency of the bursts going through this transceiver */
+extern LatencyStats gLatency;
+
+#endif /* _LATENCY_H_ */
@@ -0,0 +1,728 @@
+/**
+ * TRXLoadTest.cpp
+ * This file is part of the Yate-BTS Project http://www.yatebts.com
+ *
+ * Synthetic multi-MS air interface load generator for the transceiver
+ *
+ * Yet Another Telephony Engine - Base Transceiver Station
+ * Copyright (C) 2013-2014 Null Team Impex SRL
+ * Copyright (C) 2014 Legba, Inc
+ *
+ * This software is distributed under multiple licenses;
+ * see the COPYING file in the main directory for licensing
+ * information for this specific distribution.
+ *
+ * This use of this software may be subject to additional restrictions.
+ * See the LEGAL file in the main directory for details.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+/*
+	Simulates a population of MSs transmitting on a cell configured as
+	  TN0    combination V, uplink RACH
+	  TN1    combination VII, uplink SDCCH/8
+	  TN2-4  combination I, uplink TCH/F
+	  TN5-7  GPRS PDCH, uplink RLC blocks
+	Uplink bursts are synthesized with sigProcLib, delayed, scaled and
+	mixed with gaussian noise, then fed to a RadioInterface through a
+	virtual device.  Bursts coming out of the RadioInterface are detected
+	and demodulated the same way the Transceiver does and compared with
+	what was sent.  At the same time random downlink bursts are pushed
+	into the RadioInterface and demodulated back from the device side.
+	The uplink can also be saved as an IQ capture for transceiver-file.
+*/
+
+#include "radioInterface.h"
+#include "FileDevice.h"
+
+#include <Logger.h>
+#include <Configuration.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <map>
+#include <vector>
+
+using namespace std;
+
+ConfigurationTable gConfig;
+
+#define RX_OFFSET	3	// RadioInterface receive offset, in timeslots
+#define SPS_TX		4	// Samples per symbol on the downlink
+#define NOISE_AMPL	100.0	// Standard deviation of the uplink noise
+#define RACH_THRESH	6.0	// Same detection thresholds as Transceiver
+#define TSC_THRESH	5.0
+
+// Kinds of synthesized uplink bursts
+enum BurstKind {
+  KindRACH = 0,
+  KindSDCCH,
+  KindTCH,
+  KindPDCH,
+  KindCount
+};
+
+static const char *sKindName[KindCount] = { "RACH", "SDCCH", "TCH", "PDCH" };
+
+// A simulated mobile station
+struct SimMS {
+  BurstKind kind;		// channel used by the MS
+  int tn;			// timeslot of the dedicated or packet channel
+  int sub;			// SDCCH/8 subchannel
+  float delay;			// timing offset in symbols
+  float ampl;			// received amplitude
+};
+
+// A burst placed on the uplink, waiting to be checked
+struct SentBurst {
+  BurstKind kind;
+  int ms;
+  BitVector bits;
+  SentBurst() : kind(KindRACH), ms(-1) { }
+};
+
+// Per kind statistics
+struct KindStats {
+  unsigned long sent;
+  unsigned long detected;
+  unsigned long correct;
+  unsigned long bits;
+  unsigned long bitErrors;
+};
+
+// Test parameters
+static unsigned sFrames = 2040;
+static float sRachRate = 20.0;
+static unsigned sSdcch = 8;
+static unsigned sTch = 3;
+static unsigned sGprs = 6;
+static float sGprsLoad = 1.0;
+static unsigned sTSC = 0;
+static float sSnrMin = 10.0;
+static float sSnrMax = 30.0;
+static float sMaxDelay = 4.0;
+static float sGate = 1.5;
+static const char *sCapture = 0;
+
+static vector<SimMS> sMS;
+static map<unsigned long long,SentBurst> sSent;
+static KindStats sStats[KindCount];
+static unsigned long sFalse = 0;
+static unsigned long sChecked = 0;
+static unsigned long sGated = 0;
+static noiseVector sNoises(20);
+static double sRxTime = 0.0;
+
+static double now()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1.0e-9;
+}
+
+static float randf(float lo, float hi)
+{
+  return lo + (hi - lo) * (float) random() / (float) RAND_MAX;
+}
+
+static unsigned long long slotKey(const GSM::Time &t)
+{
+  return ((unsigned long long) t.FN() << 3) | t.TN();
+}
+
+// Count payload bit errors, the midamble and tail bits are not compared
+static unsigned bitErrors(const SoftVector &rx, const BitVector &sent, bool rach, unsigned &bits)
+{
+  static const unsigned normal[] = { 3, 61, 87, 145, 0 };
+  static const unsigned access[] = { 49, 85, 0 };
+  unsigned errors = 0;
+  bits = 0;
+  for (const unsigned *r = rach ? access : normal; *r; r += 2) {
+    for (unsigned i = r[0]; i < r[1]; i++)
+      if ((rx[i] > 0.5) != (sent[i] != 0))
+	errors++;
+    bits += r[1] - r[0];
+  }
+  return errors;
+}
+
+static void randomBits(BitVector &v, unsigned first, unsigned len)
+{
+  for (unsigned i = 0; i < len; i++)
+    v[first + i] = random() & 1;
+}
+
+// Build a normal burst with random payload and the given training sequence
+static BitVector normalBurst(unsigned tsc)
+{
+  BitVector burst(gSlotLen);
+  burst.zero();
+  randomBits(burst, 3, 58);
+  gTrainingSequence[tsc].copyToSegment(burst, 61);
+  randomBits(burst, 87, 58);
+  return burst;
+}
+
+// Build an access burst with random encoded payload
+static BitVector accessBurst()
+{
+  BitVector burst(gSlotLen);
+  burst.zero();
+  BitVector("00111010").copyToSegment(burst, 0);
+  gRACHSynchSequence.copyToSegment(burst, 8);
+  randomBits(burst, 49, 36);
+  return burst;
+}
+
+// Uplink frames of combination V carrying RACH
+static bool rachFrame(unsigned fn)
+{
+  unsigned mod51 = fn % 51;
+  return ((mod51 >= 14) && (mod51 <= 36)) || (mod51 == 4) || (mod51 == 5) ||
+    (mod51 == 45) || (mod51 == 46);
+}
+
+// Uplink SDCCH/8 subchannel transmitting in a frame, -1 if none
+static int sdcchSub(unsigned fn)
+{
+  int mod51 = fn % 51;
+  if ((mod51 < 15) || (mod51 > 46))
+    return -1;
+  return (mod51 - 15) / 4;
+}
+
+// Frame position inside a 52-multiframe PDCH block, -1 for idle/PTCCH
+static int pdchBlockPos(unsigned fn)
+{
+  int mod52 = fn % 52;
+  if ((mod52 % 13) == 12)
+    return -1;
+  return (mod52 - mod52 / 13) % 4;
+}
+
+// Chooses the MS transmitting in an uplink slot
+class Scheduler {
+public:
+  Scheduler()
+    : mRachProb(0.0)
+    { memset(mPdchOwner, -1, sizeof(mPdchOwner)); memset(mPdchNext, 0, sizeof(mPdchNext)); }
+  void init()
+  {
+    unsigned opportunities = 0;
+    for (unsigned fn = 0; fn < 51; fn++)
+      if (rachFrame(fn))
+        opportunities++;
+    // 51-multiframes per second is 1625000/6/1250/51
+    mRachProb = sRachRate / (opportunities * 216.6667 / 51.0);
+    if (mRachProb > 1.0)
+      mRachProb = 1.0;
+  }
+  int pick(const GSM::Time &t);
+private:
+  float mRachProb;
+  int mPdchOwner[8];
+  unsigned mPdchNext[8];
+};
+
+int Scheduler::pick(const GSM::Time &t)
+{
+  unsigned fn = t.FN();
+  int tn = t.TN();
+  if (tn == 0) {
+    if (!rachFrame(fn) || (randf(0.0, 1.0) >= mRachProb) || sMS.empty())
+      return -1;
+    return random() % sMS.size();
+  }
+  if (tn == 1) {
+    int sub = sdcchSub(fn);
+    for (unsigned i = 0; (sub >= 0) && (i < sMS.size()); i++)
+      if ((sMS[i].kind == KindSDCCH) && (sMS[i].sub == sub))
+        return i;
+    return -1;
+  }
+  if (tn <= 4) {
+    if ((fn % 26) == 25)
+      return -1;
+    for (unsigned i = 0; i < sMS.size(); i++)
+      if ((sMS[i].kind == KindTCH) && (sMS[i].tn == tn))
+        return i;
+    return -1;
+  }
+  // PDCH, allocate whole blocks round robin like USF scheduling
+  int pos = pdchBlockPos(fn);
+  if (pos < 0)
+    return -1;
+  if (pos == 0) {
+    mPdchOwner[tn] = -1;
+    if (randf(0.0, 1.0) < sGprsLoad) {
+      for (unsigned n = 0; n < sMS.size(); n++) {
+        unsigned i = (mPdchNext[tn] + n) % sMS.size();
+        if ((sMS[i].kind == KindPDCH) && (sMS[i].tn == tn)) {
+          mPdchOwner[tn] = i;
+          mPdchNext[tn] = i + 1;
+          break;
+        }
+      }
+    }
+  }
+  return mPdchOwner[tn];
+}
+
+static Scheduler sScheduler;
+
+/** Virtual radio device producing the synthetic uplink */
+class SynthDevice : public RadioDevice {
+public:
+  SynthDevice()
+    : mRxBase(0), mRxTime(0,0), mCapture(0), mCaptureSamples(0)
+    { mRxTime.decTN(RX_OFFSET); }
+  ~SynthDevice();
+
+  int open(const std::string &args, bool extref);
+  bool start() { return true; }
+  bool stop() { return true; }
+  enum TxWindowType getWindowType() { return TX_WINDOW_FIXED; }
+  void setPriority() { }
+  int readSamples(short *buf, int len, bool *overrun, TIMESTAMP timestamp = 0xffffffff,
+		  bool *underrun = 0, unsigned *RSSI = 0);
+  int writeSamples(short *buf, int len, bool *underrun, TIMESTAMP timestamp,
+		   bool isControl = false);
+  bool updateAlignment(TIMESTAMP timestamp) { return true; }
+  bool setTxFreq(double wFreq) { return true; }
+  bool setRxFreq(double wFreq) { return true; }
+  TIMESTAMP initialWriteTimestamp(void) { return 0; }
+  TIMESTAMP initialReadTimestamp(void) { return 0; }
+  double fullScaleInputValue() { return 32000 * 0.3; }
+  double fullScaleOutputValue() { return 32000; }
+  double setRxGain(double dB) { return dB; }
+  double getRxGain(void) { return 0; }
+  double maxRxGain(void) { return 0; }
+  double minRxGain(void) { return 0; }
+  double setTxGain(double dB) { return 0; }
+  double maxTxGain(void) { return 0; }
+  double minTxGain(void) { return 0; }
+  double getTxFreq() { return 0; }
+  double getRxFreq() { return 0; }
+  double getSampleRate() { return GSMRATE * SPS_TX; }
+  double numberRead() { return 0; }
+  double numberWritten() { return mTx.size() / 2; }
+
+  /** Transmitted samples not yet checked */
+  std::vector<short> mTx;
+
+private:
+  void synthSlot();
+
+  std::vector<short> mRx;	// synthesized samples not yet read
+  TIMESTAMP mRxBase;		// timestamp of first sample in mRx
+  GSM::Time mRxTime;		// time of next slot to synthesize
+  FILE *mCapture;
+  unsigned long long mCaptureSamples;
+};
+
+SynthDevice::~SynthDevice()
+{
+  if (!mCapture)
+    return;
+  IQFileHeader hdr;
+  memset(&hdr, 0, sizeof(hdr));
+  memcpy(hdr.magic, IQFILE_MAGIC, sizeof(hdr.magic));
+  hdr.version = IQFILE_VERSION;
+  hdr.headerLen = sizeof(hdr);
+  hdr.rate = GSMRATE;
+  hdr.samples = mCaptureSamples;
+  fseek(mCapture, 0, SEEK_SET);
+  fwrite(&hdr, sizeof(hdr), 1, mCapture);
+  fclose(mCapture);
+}
+
+int SynthDevice::open(const std::string &args, bool extref)
+{
+  if (args.empty())
+    return NORMAL;
+  mCapture = fopen(args.c_str(), "wb");
+  if (!mCapture) {
+    perror(args.c_str());
+    return -1;
+  }
+  // Header is rewritten with the final sample count at the end
+  IQFileHeader hdr;
+  memset(&hdr, 0, sizeof(hdr));
+  fwrite(&hdr, sizeof(hdr), 1, mCapture);
+  return NORMAL;
+}
+
+// Synthesize the uplink of one timeslot at 1 sample per symbol
+void SynthDevice::synthSlot()
+{
+  int tn = mRxTime.TN();
+  int guard = 8 + ((tn % 4) == 0);
+  int len = gSlotLen + guard;
+  int ms = sScheduler.pick(mRxTime);
+  signalVector *slot = gaussianNoise(len, NOISE_AMPL * NOISE_AMPL);
+  if (ms >= 0) {
+    SentBurst sent;
+    sent.ms = ms;
+    if (tn == 0) {
+      sent.kind = KindRACH;
+      sent.bits = accessBurst();
+    }
+    else {
+      sent.kind = sMS[ms].kind;
+      sent.bits = normalBurst(sTSC);
+    }
+    signalVector *burst = modulateBurst(sent.bits, guard, 1);
+    delayVector(*burst, sMS[ms].delay);
+    scaleVector(*burst, sMS[ms].ampl);
+    addVector(*slot, *burst);
+    delete burst;
+    sStats[sent.kind].sent++;
+    sSent[slotKey(mRxTime)] = sent;
+  }
+  size_t pos = mRx.size();
+  mRx.resize(pos + 2 * len);
+  signalVector::iterator itr = slot->begin();
+  for (int i = 0; i < len; i++, itr++) {
+    float re = itr->real();
+    float im = itr->imag();
+    mRx[pos + 2 * i] = (short) ((re > 32767.0) ? 32767 : ((re < -32767.0) ? -32767 : re));
+    mRx[pos + 2 * i + 1] = (short) ((im > 32767.0) ? 32767 : ((im < -32767.0) ? -32767 : im));
+  }
+  delete slot;
+  if (mCapture) {
+    fwrite(&mRx[pos], sizeof(short), 2 * len, mCapture);
+    mCaptureSamples += len;
+  }
+  mRxTime.incTN();
+}
+
+int SynthDevice::readSamples(short *buf, int len, bool *overrun,
+			     TIMESTAMP timestamp, bool *underrun, unsigned *RSSI)
+{
+  if (overrun)
+    *overrun = false;
+  if (underrun)
+    *underrun = false;
+  // Drop samples already consumed
+  if (timestamp > mRxBase) {
+    size_t drop = 2 * (timestamp - mRxBase);
+    if (drop > mRx.size())
+      drop = mRx.size();
+    mRx.erase(mRx.begin(), mRx.begin() + drop);
+    mRxBase = timestamp;
+  }
+  while (mRx.size() < (size_t) (2 * len))
+    synthSlot();
+  memcpy(buf, &mRx[0], 2 * len * sizeof(short));
+  return len;
+}
+
+int SynthDevice::writeSamples(short *buf, int len, bool *underrun,
+			      TIMESTAMP timestamp, bool isControl)
+{
+  mTx.insert(mTx.end(), buf, buf + 2 * len);
+  if (underrun)
+    *underrun = false;
+  return len;
+}
+
+// Receive side, same processing steps as Transceiver::pullRadioVector
+static void checkUplink(radioVector *rxBurst)
+{
+  GSM::Time t = rxBurst->getTime();
+  int tn = t.TN();
+  bool rach = (tn == 0);
+  if (rach && !rachFrame(t.FN())) {
+    delete rxBurst;
+    return;
+  }
+  if ((tn == 1) && ((t.FN() % 51) >= 12) && ((t.FN() % 51) <= 14)) {
+    // Idle SDCCH frames measure the noise floor like in Transceiver
+    float pwr;
+    energyGate(*rxBurst, 0, 0.0, 0.0, &pwr);
+    sNoises.insert(sqrt(pwr));
+    delete rxBurst;
+    return;
+  }
+
+  double start = now();
+  complex amplitude = 0.0;
+  float TOA = 0.0, avg = 0.0, pwr = 0.0;
+  energyDetect(*rxBurst, 20, 0.0, &avg);
+  int ok = 0;
+  unsigned gateLen = rach ? (88 + (unsigned) ceil(sMaxDelay)) : 0;
+  float gate = (sGate > 0.0) ? pow(10.0, sGate / 10.0) : 0.0;
+  sChecked++;
+  if (!energyGate(*rxBurst, gateLen, sNoises.min(), gate, &pwr)) {
+    sGated++;
+    sNoises.insert(sqrt(pwr));
+  }
+  else {
+    if (rach)
+      ok = detectRACHBurst(*rxBurst, RACH_THRESH, 1, &amplitude, &TOA);
+    else
+      ok = analyzeTrafficBurst(*rxBurst, sTSC, TSC_THRESH, 1, &amplitude, &TOA,
+			       (unsigned) ceil(sMaxDelay));
+    if (ok <= 0)
+      sNoises.insert(sqrt(pwr));
+  }
+  SoftVector *bits = 0;
+  if (ok > 0)
+    bits = demodulateBurst(*rxBurst, 1, amplitude, TOA);
+  sRxTime += now() - start;
+  delete rxBurst;
+
+  map<unsigned long long,SentBurst>::iterator it = sSent.find(slotKey(t));
+  if (it == sSent.end()) {
+    if (bits)
+      sFalse++;
+    delete bits;
+    return;
+  }
+  SentBurst &sent = it->second;
+  KindStats &st = sStats[sent.kind];
+  if (bits) {
+    st.detected++;
+    unsigned len;
+    unsigned errors = bitErrors(*bits, sent.bits, (sent.kind == KindRACH), len);
+    st.bits += len;
+    st.bitErrors += errors;
+    if (!errors)
+      st.correct++;
+    delete bits;
+  }
+  sSent.erase(it);
+}
+
+// Downlink bursts pushed into the RadioInterface, oldest first
+static vector<BitVector> sDlSent;
+static unsigned long sDlChecked = 0;
+static unsigned long sDlCorrect = 0;
+static unsigned long sDlBitErrors = 0;
+static unsigned long sDlBits = 0;
+static unsigned sDlTN = 0;
+static size_t sDlPos = 0;
+
+static void pushDownlink(RadioInterface &radio, double scale)
+{
+  BitVector bits = normalBurst(sTSC);
+  signalVector *burst = modulateBurst(bits, 8 + ((sDlTN % 4) == 0), SPS_TX);
+  scaleVector(*burst, scale);
+  radio.driveTransmitRadio(*burst, false);
+  delete burst;
+  sDlSent.push_back(bits);
+  sDlTN = (sDlTN + 1) % 8;
+}
+
+// Demodulate transmitted bursts back from the device samples
+static void checkDownlink(SynthDevice &dev, double scale)
+{
+  static unsigned tn = 0;
+  static float delay = -1.0;
+  static complex channel = 0.0;
+  while (!sDlSent.empty()) {
+    int samples = (gSlotLen + 8 + ((tn % 4) == 0)) * SPS_TX;
+    if ((dev.mTx.size() - sDlPos) < (size_t) (2 * samples))
+      break;
+    signalVector rx(samples);
+    signalVector::iterator itr = rx.begin();
+    for (int i = 0; i < samples; i++, itr++)
+      *itr = complex(dev.mTx[sDlPos + 2 * i], dev.mTx[sDlPos + 2 * i + 1]);
+    sDlPos += 2 * samples;
+    tn = (tn + 1) % 8;
+    unsigned len;
+    BitVector sent = sDlSent.front();
+    sDlSent.erase(sDlSent.begin());
+    if (delay < 0.0) {
+      // Find the modulator group delay and phase on the first burst
+      static const complex phases[4] = {
+	complex(1.0,0.0), complex(0.0,1.0), complex(-1.0,0.0), complex(0.0,-1.0)
+      };
+      unsigned best = gSlotLen;
+      for (unsigned p = 0; p < 4; p++) {
+	for (float d = 0.0; d <= 8.0; d += 0.25) {
+	  signalVector tmp(rx);
+	  SoftVector *bits = demodulateBurst(tmp, SPS_TX, phases[p] * scale, d * SPS_TX);
+	  unsigned errors = bitErrors(*bits, sent, false, len);
+	  delete bits;
+	  if (errors < best) {
+	    best = errors;
+	    delay = d;
+	    channel = phases[p] * scale;
+	  }
+	}
+      }
+    }
+    SoftVector *bits = demodulateBurst(rx, SPS_TX, channel, delay * SPS_TX);
+    unsigned errors = bitErrors(*bits, sent, false, len);
+    delete bits;
+    sDlChecked++;
+    sDlBits += len;
+    sDlBitErrors += errors;
+    if (!errors)
+      sDlCorrect++;
+  }
+  if (sDlPos > 1000000) {
+    dev.mTx.erase(dev.mTx.begin(), dev.mTx.begin() + sDlPos);
+    sDlPos = 0;
+  }
+}
+
+static void createPopulation()
+{
+  sMS.clear();
+  if (sSdcch > 8)
+    sSdcch = 8;
+  if (sTch > 3)
+    sTch = 3;
+  for (unsigned i = 0; i < sSdcch + sTch + sGprs; i++) {
+    SimMS ms;
+    if (i < sSdcch) {
+      ms.kind = KindSDCCH;
+      ms.tn = 1;
+      ms.sub = i;
+    }
+    else if (i < sSdcch + sTch) {
+      ms.kind = KindTCH;
+      ms.tn = 2 + i - sSdcch;
+      ms.sub = 0;
+    }
+    else {
+      ms.kind = KindPDCH;
+      ms.tn = 5 + (i - sSdcch - sTch) % 3;
+      ms.sub = 0;
+    }
+    ms.delay = randf(0.0, sMaxDelay);
+    ms.ampl = NOISE_AMPL * pow(10.0, randf(sSnrMin, sSnrMax) / 20.0);
+    sMS.push_back(ms);
+  }
+  // With no MS at all RACH bursts still need a sender
+  if (sMS.empty()) {
+    SimMS ms;
+    ms.kind = KindRACH;
+    ms.tn = 0;
+    ms.sub = 0;
+    ms.delay = randf(0.0, sMaxDelay);
+    ms.ampl = NOISE_AMPL * pow(10.0, randf(sSnrMin, sSnrMax) / 20.0);
+    sMS.push_back(ms);
+  }
+}
+
+static void usage(const char *name)
+{
+  fprintf(stderr,
+	  "Usage: %s [options]\n"
+	  "  -f FRAMES  number of TDMA frames to run (default %u)\n"
+	  "  -r RATE    RACH bursts per second (default %g)\n"
+	  "  -s NUM     MSs on SDCCH/8 on TN1, 0-8 (default %u)\n"
+	  "  -t NUM     MSs on TCH/F on TN2-4, 0-3 (default %u)\n"
+	  "  -g NUM     GPRS MSs sharing PDCHs on TN5-7 (default %u)\n"
+	  "  -u LOAD    fraction of PDCH uplink blocks used, 0-1 (default %g)\n"
+	  "  -c TSC     training sequence code (default %u)\n"
+	  "  -n DB      minimum SNR in dB (default %g)\n"
+	  "  -m DB      maximum SNR in dB (default %g)\n"
+	  "  -d SYM     maximum timing offset in symbols (default %g)\n"
+	  "  -G DB      receive energy gate above noise, 0 disables (default %g)\n"
+	  "  -o FILE    also save the uplink as IQ capture for transceiver-file\n"
+	  "  -x SEED    random seed for a repeatable run (default 1)\n",
+	  name, sFrames, sRachRate, sSdcch, sTch, sGprs, sGprsLoad, sTSC,
+	  sSnrMin, sSnrMax, sMaxDelay, sGate);
+}
+
+int main(int argc, char *argv[])
+{
+  unsigned seed = 1;
+  int opt;
+  while ((opt = getopt(argc, argv, "f:r:s:t:g:u:c:n:m:d:G:o:x:h")) != -1) {
+    switch (opt) {
+    case 'f': sFrames = atoi(optarg); break;
+    case 'r': sRachRate = atof(optarg); break;
+    case 's': sSdcch = atoi(optarg); break;
+    case 't': sTch = atoi(optarg); break;
+    case 'g': sGprs = atoi(optarg); break;
+    case 'u': sGprsLoad = atof(optarg); break;
+    case 'c': sTSC = atoi(optarg) & 7; break;
+    case 'n': sSnrMin = atof(optarg); break;
+    case 'm': sSnrMax = atof(optarg); break;
+    case 'd': sMaxDelay = atof(optarg); break;
+    case 'G': sGate = atof(optarg); break;
+    case 'o': sCapture = optarg; break;
+    case 'x': seed = atoi(optarg); break;
+    default:
+      usage(argv[0]);
+      return 1;
+    }
+  }
+  if (sSnrMax < sSnrMin)
+    sSnrMax = sSnrMin;
+
+  // There is no configuration file, define the keys used by the logger
+  gConfig.set("Log.File", "");
+  gLogInit("TRXLoadTest", "NOTICE");
+  srandom(seed);
+  srand(seed);
+  memset(sStats, 0, sizeof(sStats));
+
+  if (!sigProcLibSetup(SPS_TX) || !generateMidamble(1, sTSC)) {
+    fprintf(stderr, "Failed to initialize signal processing library\n");
+    return 1;
+  }
+  createPopulation();
+  sScheduler.init();
+
+  SynthDevice dev;
+  if (dev.open(sCapture ? sCapture : "", false) < 0)
+    return 1;
+  RadioInterface radio(&dev, RX_OFFSET, SPS_TX, GSM::Time(0));
+  if (!radio.init(RadioDevice::NORMAL)) {
+    fprintf(stderr, "Failed to initialize radio interface\n");
+    return 1;
+  }
+  radio.start();
+  double txScale = radio.fullScaleInputValue();
+
+  unsigned long slots = 0;
+  unsigned long total = 8UL * sFrames;
+  double start = now();
+  VectorFIFO *fifo = radio.receiveFIFO();
+  while (slots < total) {
+    radio.driveReceiveRadio();
+    while (radioVector *rx = fifo->get()) {
+      checkUplink(rx);
+      pushDownlink(radio, txScale);
+      slots++;
+    }
+    checkDownlink(dev, txScale);
+  }
+  double elapsed = now() - start;
+  double airTime = sFrames * 120.0e-3 / 26.0;
+
+  printf("Frames: %u (%.2f s of air time) in %.2f s\n", sFrames, airTime, elapsed);
+  printf("MSs: %u SDCCH, %u TCH, %u GPRS, TSC %u, SNR %g-%g dB, delay 0-%g symbols\n",
+	 sSdcch, sTch, sGprs, sTSC, sSnrMin, sSnrMax, sMaxDelay);
+  printf("%-6s %9s %9s %9s %9s %10s\n", "Uplink", "sent", "detected", "correct", "BER", "per second");
+  for (unsigned k = 0; k < KindCount; k++) {
+    KindStats &st = sStats[k];
+    printf("%-6s %9lu %9lu %9lu %9.2e %10.1f\n", sKindName[k], st.sent, st.detected,
+	   st.correct, st.bits ? (double) st.bitErrors / st.bits : 0.0,
+	   st.correct / airTime);
+  }
+  printf("False detections on empty slots: %lu\n", sFalse);
+  printf("Energy gate %g dB: %lu of %lu slots rejected before correlation\n",
+	 sGate, sGated, sChecked);
+  printf("PDCH blocks: %.1f per second\n", sStats[KindPDCH].correct / 4.0 / airTime);
+  printf("Downlink: %lu checked, %lu correct, BER %.2e\n", sDlChecked, sDlCorrect,
+	 sDlBits ? (double) sDlBitErrors / sDlBits : 0.0);
+  printf("Receive processing: %.2f s, %.1f us per slot, %.1fx real time\n",
+	 sRxTime, sRxTime * 1.0e6 / total, (sRxTime > 0.0) ? airTime / sRxTime : 0.0);
+
+  radio.close();
+  sigProcLibDestroy();
+  return 0;
+}
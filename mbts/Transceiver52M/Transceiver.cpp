@@ -30,6 +30,7 @@
 
 #include <stdio.h>
 #include "Transceiver.h"
+#include "Latency.h"
 #include <Logger.h>
 
 #ifdef HAVE_CONFIG_H
@@ -80,10 +81,23 @@ Transceiver::Transceiver(int wBasePort,
   mRxFreq = 0.0;
   mPower = -10;
   mNoiseLev = 0.0;
+
+  for (int i = 0; i < MODULATED_CACHE_SIZE; i++)
+    mModulatedCache[i].burst = NULL;
+
+  mRxGate = 0.0;
+  mRxWorkers = 0;
+  for (int i = 0; i < 8; i++) {
+    mRxBursts[i] = 0;
+    mRxGated[i] = 0;
+    mRxDetected[i] = 0;
+  }
 }
 
 Transceiver::~Transceiver()
 {
+  for (int i = 0; i < MODULATED_CACHE_SIZE; i++)
+    delete mModulatedCache[i].burst;
   sigProcLibDestroy();
   mTransmitPriorityQueue.clear();
 }
@@ -110,6 +124,7 @@ bool Transceiver::init()
     fillerModulus[i]=26;
     for (int j = 0; j < 102; j++) {
       fillerTable[j][i] = new signalVector(*modBurst);
+      fillerBurst[j][i] = NULL;
     }
 
     delete modBurst;
@@ -122,22 +137,87 @@ bool Transceiver::init()
 
   return true;
 }
+
+void Transceiver::setRxGate(float dB)
+{
+  mRxGate = (dB > 0.0) ? pow(10.0,dB/10.0) : 0.0;
+  LOG(INFO) << "receive energy gate " << dB << " dB above noise";
+}
+
+void Transceiver::reportRxStats()
+{
+  std::ostringstream os;
+  for (int i = 0; i < 8; i++) {
+    if (!mRxBursts[i])
+      continue;
+    os << " TN" << i << "=" << mRxBursts[i] << "/" << mRxGated[i] << "/" << mRxDetected[i];
+    mRxBursts[i] = 0;
+    mRxGated[i] = 0;
+    mRxDetected[i] = 0;
+  }
+  if (os.str().size())
+    LOG(INFO) << "receive bursts/gated/detected:" << os.str();
+}
+
+void Transceiver::addNoise(int timeslot, float noise, bool gated)
+{
+  ScopedLock lock(mRxStateLock);
+  mNoises.insert(noise);
+  if (gated)
+    mRxGated[timeslot]++;
+}
+
+void Transceiver::setRxWorkers(unsigned count)
+{
+  if (count > MAX_RX_WORKERS)
+    count = MAX_RX_WORKERS;
+  mRxWorkers = count;
+  if (count)
+    LOG(INFO) << "demodulating received bursts in " << count << " worker threads";
+}
  
 radioVector *Transceiver::fixRadioVector(BitVector &burst,
 				 int RSSI,
 				 GSM::Time &wTime)
 {
+  int guard = 8 + (wTime.TN() % 4 == 0);
+
+  // FCCH, BCCH, idle paging and dummy bursts repeat, reuse their waveform
+  ModulatedBurst *cached = NULL;
+  ModulatedKey key;
+  if (burst.size() == gSlotLen) {
+    memcpy(key.bits,burst.begin(),gSlotLen);
+    key.guard = guard;
+    key.RSSI = RSSI;
+    // The key has no padding, hash it a word at a time
+    uint32_t hash = 2166136261U;
+    const char *p = (const char *) &key;
+    for (unsigned i = 0; i < sizeof(key); i += sizeof(uint32_t)) {
+      uint32_t word;
+      memcpy(&word,p + i,sizeof(word));
+      hash = (hash ^ word) * 16777619U;
+    }
+    cached = &mModulatedCache[(hash ^ (hash >> 16)) % MODULATED_CACHE_SIZE];
+    if (cached->burst && !memcmp(&cached->key,&key,sizeof(key)))
+      return new radioVector(*cached->burst,wTime);
+  }
 
   // modulate and stick into queue 
   signalVector* modBurst = modulateBurst(burst,
-					 8 + (wTime.TN() % 4 == 0),
+					 guard,
 					 mSPSTx);
   scaleVector(*modBurst,txFullScale * pow(10,-RSSI/10));
 
   radioVector *newVec = new radioVector(*modBurst,wTime);
   //fillerActive[ARFCN][wTime.TN()] = (ARFCN==0) || (RSSI != 255);
 
-  delete modBurst;
+  if (!cached) {
+    delete modBurst;
+    return newVec;
+  }
+  delete cached->burst;
+  cached->burst = modBurst;
+  cached->key = key;
   return newVec;
 }
 
@@ -174,6 +254,8 @@ void Transceiver::setFiller(radioVector *rv, bool allocate, bool force)
 	LOG(DEBUG) << "setFiller"<<LOGVAR(TN);
 	int modFN = rv->getTime().FN() % fillerModulus[TN];
 	delete fillerTable[modFN][TN];
+	mRadioInterface->releaseBurst(fillerBurst[modFN][TN]);
+	fillerBurst[modFN][TN] = NULL;
 	if (allocate) {
 		fillerTable[modFN][TN] = new signalVector(*rv);
 	} else {
@@ -189,11 +271,20 @@ void Transceiver::pushRadioVector(GSM::Time &nowTime)
     // Even if the burst is stale, put it in the fillter table.
     // (It might be an idle pattern.)
     LOG(NOTICE) << "dumping STALE burst in TRX->USRP interface";
+    gLatency.stale();
     setFiller(staleBurst,false,false);
   }
 
   // Everything from this point down operates in one TN period,
   int TN = nowTime.TN();
+  uint64_t start = LatencyStats::now();
+  pushRadioVectorTN(nowTime,start);
+  gLatency.add(LatTxPush,TN,LatencyStats::now() - start);
+}
+
+void Transceiver::pushRadioVectorTN(GSM::Time &nowTime, uint64_t start)
+{
+  int TN = nowTime.TN();
 
   radioVector *sendVec = NULL;
   // if queue contains data at the desired timestamp, stick it into FIFO
@@ -201,6 +292,8 @@ void Transceiver::pushRadioVector(GSM::Time &nowTime)
   while (radioVector *next = (radioVector*) mTransmitPriorityQueue.getCurrentBurst(nowTime)) {
     //LOG(DEBUG) << "transmitFIFO: wrote burst " << next << " at time: " << nowTime;
     LOG(DEBUG) << (sendVec?"adding":"sending")<<" burst " << next << " at time: " << nowTime;
+    if (next->getStamp() && (start > next->getStamp()))
+      gLatency.add(LatTxQueue,TN,start - next->getStamp());
     setFiller(next,true,false);
     addFiller = false;
     if (!sendVec) {
@@ -214,6 +307,17 @@ void Transceiver::pushRadioVector(GSM::Time &nowTime)
   // pull filler data, and set it up to be transmitted
   if (addFiller){
     int modFN = nowTime.FN() % fillerModulus[TN];
+    // Unchanged filler bursts are sent as already converted device samples
+    DeviceBurst *&filler = fillerBurst[modFN][TN];
+    if (!filler)
+      filler = mRadioInterface->acquireBurst(*fillerTable[modFN][TN]);
+    if (filler && !sendVec) {
+      if (IGPRS == mChanType[TN]) {
+        LOG(DEBUG) << "setting GPRS filler burst on T" << TN << " FN " << nowTime.FN();
+      }
+      mRadioInterface->driveTransmitRadio(*filler);
+      return;
+    }
     radioVector *tmpVec = new radioVector(*fillerTable[modFN][TN],nowTime);
     if (IGPRS == mChanType[TN]) {
       LOG(DEBUG) << (sendVec?"adding":"setting")<<" GPRS filler burst on T" << TN << " FN " << nowTime.FN();
@@ -326,21 +430,55 @@ Transceiver::CorrType Transceiver::expectedCorrType(GSM::Time currTime)
 SoftVector *Transceiver::pullRadioVector(GSM::Time &wTime,
 				      int &RSSI,
 				      int &timingOffset)
+{
+  radioVector *rxBurst = (radioVector *) mReceiveFIFO->get();
+
+  if (!rxBurst) return NULL;
+
+  return measureRadioVector(rxBurst,wTime,RSSI,timingOffset);
+}
+
+SoftVector *Transceiver::measureRadioVector(radioVector *rxBurst,
+					    GSM::Time &wTime,
+					    int &RSSI,
+					    int &timingOffset)
+{
+  int TN = rxBurst->getTime().TN();
+  uint64_t start = LatencyStats::now();
+  if (rxBurst->getStamp() && (start > rxBurst->getStamp()))
+    gLatency.add(LatRxWait,TN,start - rxBurst->getStamp());
+  SoftVector *burst = processRadioVector(rxBurst,wTime,RSSI,timingOffset);
+  gLatency.add(LatRxDemod,TN,LatencyStats::now() - start);
+  return burst;
+}
+
+SoftVector *Transceiver::processRadioVector(radioVector *rxBurst,
+					    GSM::Time &wTime,
+					    int &RSSI,
+					    int &timingOffset)
 {
   bool needDFE = false;
   bool success = false;
   complex amplitude = 0.0;
   float TOA = 0.0, avg = 0.0;
 
-  radioVector *rxBurst = (radioVector *) mReceiveFIFO->get();
-
-  if (!rxBurst) return NULL;
-
   int timeslot = rxBurst->getTime().TN();
 
+  // Report once every superframe
+  if (!timeslot && !(rxBurst->getTime().FN() % (51 * 26))) {
+    ScopedLock lock(mRxStateLock);
+    reportRxStats();
+  }
+
   CorrType corrType = expectedCorrType(rxBurst->getTime());
 
   if ((corrType==OFF) || (corrType==IDLE)) {
+    // Nothing is sent on idle slots, they measure the noise floor
+    if (corrType==IDLE) {
+      float idlePwr;
+      energyGate(*rxBurst, 0, 0.0, 0.0, &idlePwr);
+      addNoise(timeslot,sqrt(idlePwr),false);
+    }
     delete rxBurst;
     return NULL;
   }
@@ -350,9 +488,26 @@ SoftVector *Transceiver::pullRadioVector(GSM::Time &wTime,
   energyDetect(*vectorBurst, 20 * mSPSRx, 0.0, &avg);
 
   // Update noise level
-  mNoiseLev = mNoises.avg();
+  float noiseLev, noiseFloor;
+  mRxStateLock.lock();
+  mNoiseLev = noiseLev = mNoises.avg();
+  noiseFloor = mNoises.min();
+  mRxBursts[timeslot]++;
+  mRxStateLock.unlock();
   avg = sqrt(avg);
 
+  // Correlate only slots rising above the noise floor, RACH bursts are
+  // 88 symbols long and may arrive up to the maximum expected delay late.
+  // The floor is the lowest recent measurement so that undetected bursts
+  // counted as noise can't raise it and lock out weak signals.
+  float gatePwr;
+  unsigned gateLen = (corrType == RACH) ? (88 + mMaxExpectedDelay) * mSPSRx : 0;
+  if (!energyGate(*vectorBurst, gateLen, noiseFloor, mRxGate, &gatePwr)) {
+    addNoise(timeslot,sqrt(gatePwr),true);
+    delete rxBurst;
+    return NULL;
+  }
+
   // run the proper correlator
   if (corrType==TSC) {
     LOG(DEBUG) << "looking for TSC at time: " << rxBurst->getTime();
@@ -381,7 +536,7 @@ SoftVector *Transceiver::pullRadioVector(GSM::Time &wTime,
 				  &channelResp,
 				  &chanOffset);
     if (success) {
-      SNRestimate[timeslot] = amplitude.norm2()/(mNoiseLev*mNoiseLev+1.0); // this is not highly accurate
+      SNRestimate[timeslot] = amplitude.norm2()/(noiseLev*noiseLev+1.0); // this is not highly accurate
       if (estimateChannel) {
          LOG(DEBUG) << "estimating channel...";
          channelResponse[timeslot] = channelResp;
@@ -395,7 +550,7 @@ SoftVector *Transceiver::pullRadioVector(GSM::Time &wTime,
     }
     else {
       channelResponse[timeslot] = NULL;
-      mNoises.insert(avg);
+      addNoise(timeslot,sqrt(gatePwr),false);
     }
   }
   else {
@@ -403,12 +558,15 @@ SoftVector *Transceiver::pullRadioVector(GSM::Time &wTime,
     if (success = detectRACHBurst(*vectorBurst, 6.0, mSPSRx, &amplitude, &TOA))
       channelResponse[timeslot] = NULL;
     else
-      mNoises.insert(avg);
+      addNoise(timeslot,sqrt(gatePwr),false);
   }
 
   // demodulate burst
   SoftVector *burst = NULL;
   if ((rxBurst) && (success)) {
+    mRxStateLock.lock();
+    mRxDetected[timeslot]++;
+    mRxStateLock.unlock();
     if ((corrType==RACH) || (!needDFE)) {
       burst = demodulateBurst(*vectorBurst, mSPSRx, amplitude, TOA);
     } else {
@@ -493,6 +651,11 @@ void Transceiver::driveControl()
         // Start radio interface threads.
         mTxServiceLoopThread->start((void * (*)(void*))TxServiceLoopAdapter,(void*) this);
         mRxServiceLoopThread->start((void * (*)(void*))RxServiceLoopAdapter,(void*) this);
+        for (unsigned i = 0; i < mRxWorkers; i++) {
+          mRxWorker[i].trx = this;
+          mRxWorker[i].thread = new Thread(32768);
+          mRxWorker[i].thread->start((void * (*)(void*))RxWorkerLoopAdapter,(void*) &mRxWorker[i]);
+        }
         mTransmitPriorityQueueServiceLoopThread->start((void * (*)(void*))TransmitPriorityQueueServiceLoopAdapter,(void*) this);
         writeClockInterface();
 
@@ -629,6 +792,23 @@ void Transceiver::driveControl()
     sprintf(response,"RSP SETSLOT 0 %d %d",timeslot,corrCode);
 
   }
+  else if (strcmp(command,"LATENCY")==0) {
+    // The report does not fit the short response buffer
+    char param[MAX_PACKET_LENGTH];
+    param[0] = '\0';
+    sscanf(buffer,"%3s %s %15s",cmdcheck,command,param);
+    std::string report = "RSP LATENCY 0 " + gLatency.report();
+    char tmp[64];
+    sprintf(tmp,"transmit latency %d timeslots\n",
+            (int) mTransmitLatency.FN() * 8 + (int) mTransmitLatency.TN());
+    report += tmp;
+    if (strcmp(param,"RESET")==0)
+      gLatency.reset();
+    if (report.size() >= MAX_UDP_LENGTH)
+      report.resize(MAX_UDP_LENGTH - 1);
+    mControlSocket.write(report.c_str(),report.size());
+    return;
+  }
   else if (strcmp(command,"READFACTORY")==0) {
     // TODO: Actually support reading data from various USRPs
     int ret = 0; //fail everything -kurtis
@@ -698,7 +878,17 @@ bool Transceiver::driveTransmitPriorityQueue()
   
   GSM::Time currTime = GSM::Time(frameNum,timeSlot);
 
+  // How early the burst came before the transmit deadline, a timeslot lasts 7500/13 us
+  uint64_t arrival = LatencyStats::now();
+  GSM::Time deadline = mTransmitDeadlineClock;
+  int margin = (currTime - deadline) * 8 + (int) currTime.TN() - (int) deadline.TN();
+  if (margin < 0)
+    gLatency.late();
+  else
+    gLatency.add(LatTxMargin,timeSlot,(uint64_t) margin * 7500 / 13);
+
   radioVector *newVec = fixRadioVector(newBurst,RSSI,currTime);
+  newVec->setStamp(arrival);
 
   if (false && fillerFlag) {
 	setFiller(newVec,false,true);
@@ -723,34 +913,73 @@ void Transceiver::driveReceiveFIFO()
 
   mRadioInterface->driveReceiveRadio();
 
+  if (mRxWorkers) {
+    // Timeslots are independent, each one always goes to the same worker
+    // so its channel estimate is only used from a single thread
+    while (radioVector *vec = (radioVector *) mReceiveFIFO->get()) {
+      RxJob *job = new RxJob;
+      job->rxBurst = vec;
+      job->burst = NULL;
+      job->done = false;
+      mRxPendingLock.lock();
+      mRxPending.push_back(job);
+      mRxPendingLock.unlock();
+      mRxWorker[vec->getTime().TN() % mRxWorkers].queue.write(job);
+    }
+    return;
+  }
+
   rxBurst = pullRadioVector(burstTime,RSSI,TOA);
 
-  if (rxBurst) { 
-
-    LOG(DEBUG) << "burst parameters: "
-	  << " time: " << burstTime
-	  << " RSSI: " << RSSI
-	  << " TOA: "  << TOA
-	  << " bits: " << *rxBurst;
-    
-    char burstString[gSlotLen+10];
-    burstString[0] = burstTime.TN();
-    for (int i = 0; i < 4; i++)
-      burstString[1+i] = (burstTime.FN() >> ((3-i)*8)) & 0x0ff;
-    burstString[5] = RSSI;
-    burstString[6] = (TOA >> 8) & 0x0ff;
-    burstString[7] = TOA & 0x0ff;
-    SoftVector::iterator burstItr = rxBurst->begin();
-
-    for (unsigned int i = 0; i < gSlotLen; i++) {
-      burstString[8+i] =(char) round((*burstItr++)*255.0);
-    }
-    burstString[gSlotLen+9] = '\0';
-    delete rxBurst;
+  if (rxBurst)
+    writeBurst(rxBurst,burstTime,RSSI,TOA);
+}
+
+void Transceiver::driveRxWorker(RxWorker *worker)
+{
+  RxJob *job = worker->queue.read();
+  if (!job)
+    return;
 
-    mDataSocket.write(burstString,gSlotLen+10);
+  job->burst = measureRadioVector(job->rxBurst,job->time,job->RSSI,job->TOA);
+  job->rxBurst = NULL;
+
+  // Deliver to the core in the order the bursts were received
+  ScopedLock lock(mRxPendingLock);
+  job->done = true;
+  while (mRxPending.size() && mRxPending.front()->done) {
+    RxJob *next = mRxPending.front();
+    mRxPending.pop_front();
+    if (next->burst)
+      writeBurst(next->burst,next->time,next->RSSI,next->TOA);
+    delete next;
   }
+}
 
+void Transceiver::writeBurst(SoftVector *rxBurst, GSM::Time &burstTime, int RSSI, int TOA)
+{
+  LOG(DEBUG) << "burst parameters: "
+	<< " time: " << burstTime
+	<< " RSSI: " << RSSI
+	<< " TOA: "  << TOA
+	<< " bits: " << *rxBurst;
+
+  char burstString[gSlotLen+10];
+  burstString[0] = burstTime.TN();
+  for (int i = 0; i < 4; i++)
+    burstString[1+i] = (burstTime.FN() >> ((3-i)*8)) & 0x0ff;
+  burstString[5] = RSSI;
+  burstString[6] = (TOA >> 8) & 0x0ff;
+  burstString[7] = TOA & 0x0ff;
+  SoftVector::iterator burstItr = rxBurst->begin();
+
+  for (unsigned int i = 0; i < gSlotLen; i++) {
+    burstString[8+i] =(char) round((*burstItr++)*255.0);
+  }
+  burstString[gSlotLen+9] = '\0';
+  delete rxBurst;
+
+  mDataSocket.write(burstString,gSlotLen+10);
 }
 
 void Transceiver::driveTransmitFIFO() 
@@ -832,6 +1061,17 @@ void *RxServiceLoopAdapter(Transceiver *transceiver)
   return NULL;
 }
 
+void *RxWorkerLoopAdapter(RxWorker *worker)
+{
+  worker->trx->setPriority();
+
+  while (1) {
+    worker->trx->driveRxWorker(worker);
+    pthread_testcancel();
+  }
+  return NULL;
+}
+
 void *TxServiceLoopAdapter(Transceiver *transceiver)
 {
   while (1) {
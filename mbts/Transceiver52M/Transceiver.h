@@ -36,10 +36,37 @@
 
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <string>
+#include <deque>
 
 /** Define this to be the slot number to be logged. */
 //#define TRANSMIT_LOGGING 1
 
+/** Number of entries in the cache of modulated bursts */
+#define MODULATED_CACHE_SIZE 256
+
+/** Maximum number of receive worker threads, one per timeslot */
+#define MAX_RX_WORKERS 8
+
+class Transceiver;
+
+/** A received burst going through a receive worker */
+struct RxJob {
+  radioVector *rxBurst;         ///< received burst, consumed by the worker
+  SoftVector *burst;            ///< demodulated bits, NULL if nothing was detected
+  GSM::Time time;               ///< time of the demodulated burst
+  int RSSI;                     ///< received signal strength
+  int TOA;                      ///< timing offset in 1/256 symbol
+  bool done;                    ///< the worker finished processing
+};
+
+/** A receive worker thread and the bursts waiting for it */
+struct RxWorker {
+  Transceiver *trx;
+  InterthreadQueue<RxJob> queue;
+  Thread *thread;
+};
+
 /** The Transceiver class, responsible for physical layer of basestation */
 class Transceiver {
   
@@ -94,6 +121,40 @@ private:
 
   float mNoiseLev;      ///< Average noise level
   noiseVector mNoises;  ///< Vector holding running noise measurements
+  float mRxGate;        ///< Power ratio above noise needed to correlate a burst, 0 to correlate all
+
+  unsigned mRxBursts[8];    ///< bursts expected on each timeslot since the last report
+  unsigned mRxGated[8];     ///< bursts rejected by the energy gate
+  unsigned mRxDetected[8];  ///< bursts detected by the correlators
+
+  /** log and reset the receive statistics of all timeslots */
+  void reportRxStats();
+
+  /** add a noise measurement, counting a gated burst if requested */
+  void addNoise(int timeslot, float noise, bool gated);
+
+  Mutex mRxStateLock;   ///< protects the noise measurements and receive statistics
+
+  unsigned mRxWorkers;                 ///< number of receive workers, 0 to demodulate in the receive thread
+  RxWorker mRxWorker[MAX_RX_WORKERS];  ///< receive workers, bursts are assigned by timeslot
+  std::deque<RxJob*> mRxPending;       ///< jobs in reception order waiting for delivery to the core
+  Mutex mRxPendingLock;                ///< protects the pending jobs and the data socket writes
+
+  /** What a modulated waveform depends on, compared as raw bytes */
+  struct ModulatedKey {
+    char bits[gSlotLen];  ///< burst bits, one per byte
+    int guard;            ///< guard period in symbols
+    int RSSI;             ///< attenuation
+  };
+
+  /** A modulated burst kept for when the same bits are sent again */
+  struct ModulatedBurst {
+    ModulatedKey key;
+    signalVector *burst;  ///< scaled modulated waveform
+  };
+
+  /** Direct mapped cache of recently modulated bursts, by hash of the key */
+  ModulatedBurst mModulatedCache[MODULATED_CACHE_SIZE];
 
   /** unmodulate a modulated burst */
 #ifdef TRANSMIT_LOGGING
@@ -108,10 +169,28 @@ private:
   /** Push modulated burst into transmit FIFO corresponding to a particular timestamp */
   void pushRadioVector(GSM::Time &nowTime);
 
+  /** Send the bursts of one timeslot, called by pushRadioVector() which measures it */
+  void pushRadioVectorTN(GSM::Time &nowTime, uint64_t start);
+
   /** Pull and demodulate a burst from the receive FIFO */ 
   SoftVector *pullRadioVector(GSM::Time &wTime,
 			   int &RSSI,
 			   int &timingOffset);
+
+  /** Detect and demodulate a received burst, consumes the burst */
+  SoftVector *processRadioVector(radioVector *rxBurst,
+				 GSM::Time &wTime,
+				 int &RSSI,
+				 int &timingOffset);
+
+  /** Process a received burst, recording its wait and demodulation time */
+  SoftVector *measureRadioVector(radioVector *rxBurst,
+				 GSM::Time &wTime,
+				 int &RSSI,
+				 int &timingOffset);
+
+  /** send a demodulated burst to the GSM core, consumes the burst */
+  void writeBurst(SoftVector *rxBurst, GSM::Time &burstTime, int RSSI, int TOA);
    
   /** Set modulus for specific timeslot */
   void setModulus(int timeslot);
@@ -133,6 +212,7 @@ private:
   unsigned mTSC;                       ///< the midamble sequence code
   int fillerModulus[8];                ///< modulus values of all timeslots, in frames
   signalVector *fillerTable[102][8];   ///< table of modulated filler waveforms for all timeslots
+  DeviceBurst *fillerBurst[102][8];    ///< device format copies of the filler table, NULL until sent
   unsigned mMaxExpectedDelay;            ///< maximum expected time-of-arrival offset in GSM symbols
 
   GSM::Time    channelEstimateTime[8]; ///< last timestamp of each timeslot's channel estimate
@@ -165,6 +245,12 @@ public:
   void start();
   bool init();
 
+  /** set the receive energy gate in dB above the noise floor, 0 to disable */
+  void setRxGate(float dB);
+
+  /** set the number of receive worker threads, 0 to demodulate in the receive thread */
+  void setRxWorkers(unsigned count);
+
   /** attach the radioInterface receive FIFO */
   void receiveFIFO(VectorFIFO *wFIFO) { mReceiveFIFO = wFIFO;}
 
@@ -197,6 +283,11 @@ protected:
 
   friend void *RxServiceLoopAdapter(Transceiver *);
 
+  /** process one burst in a receive worker */
+  void driveRxWorker(RxWorker *worker);
+
+  friend void *RxWorkerLoopAdapter(RxWorker *);
+
   friend void *TxServiceLoopAdapter(Transceiver *);
 
   friend void *ControlServiceLoopAdapter(Transceiver *);
@@ -214,6 +305,9 @@ protected:
 void *RxServiceLoopAdapter(Transceiver *);
 void *TxServiceLoopAdapter(Transceiver *);
 
+/** receive worker thread loop */
+void *RxWorkerLoopAdapter(RxWorker *);
+
 /** control message handler thread loop */
 void *ControlServiceLoopAdapter(Transceiver *);
 
@@ -38,6 +38,8 @@ class RadioDevice {
 
   static RadioDevice *make(int sps, bool skipRx = false);
 
+  virtual ~RadioDevice() {}
+
   /** Initialize the USRP */
   virtual int open(const std::string &args = "", bool extref = false)=0;
 
@@ -24,6 +24,7 @@
 
 #include "radioInterface.h"
 #include "Resampler.h"
+#include "Latency.h"
 #include <Logger.h>
 
 extern "C" {
@@ -49,6 +50,9 @@ RadioInterface::RadioInterface(RadioDevice *wRadio,
 RadioInterface::~RadioInterface(void)
 {
   close();
+  for (DeviceBurstMap::iterator it = mDeviceBursts.begin();
+       it != mDeviceBursts.end(); ++it)
+    delete it->second;
 }
 
 bool RadioInterface::init(int type)
@@ -120,6 +124,63 @@ int RadioInterface::radioifyVector(signalVector &wVector,
   return wVector.size();
 }
 
+// FNV-1a over the 32 bit words of the samples
+static uint64_t burstHash(signalVector &wVector)
+{
+  const uint32_t *words = (const uint32_t *) wVector.begin();
+  unsigned len = wVector.size() * 2;
+  uint64_t hash = 14695981039346656037ULL;
+  for (unsigned i = 0; i < len; i++) {
+    hash ^= words[i];
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+void RadioInterface::stageBurst(signalVector &radioBurst, bool zeroBurst)
+{
+  short *out = convertSendBuffer + 2 * sendCursor;
+
+  if (zeroBurst)
+    memset(out, 0, radioBurst.size() * 2 * sizeof(short));
+  else
+    convert_float_short(out, (float *) radioBurst.begin(),
+                        powerScaling, 2 * radioBurst.size());
+}
+
+DeviceBurst *RadioInterface::acquireBurst(signalVector &radioBurst)
+{
+  uint64_t hash = burstHash(radioBurst);
+  DeviceBurst *burst;
+
+  DeviceBurstMap::iterator it = mDeviceBursts.find(hash);
+  if (it == mDeviceBursts.end()) {
+    burst = new DeviceBurst(hash, radioBurst);
+    mDeviceBursts[hash] = burst;
+    LOG(DEBUG) << "new device burst " << hash << ", " << mDeviceBursts.size() << " cached";
+  }
+  else {
+    burst = it->second;
+    // Hash collision, leave this waveform on the conversion path
+    if ((burst->size != radioBurst.size()) ||
+        memcmp(burst->waveform.begin(), radioBurst.begin(),
+               burst->size * 2 * sizeof(float)))
+      return NULL;
+  }
+
+  burst->refs++;
+  return burst;
+}
+
+void RadioInterface::releaseBurst(DeviceBurst *burst)
+{
+  if (!burst || --burst->refs)
+    return;
+
+  mDeviceBursts.erase(burst->hash);
+  delete burst;
+}
+
 int RadioInterface::unRadioifyVector(float *floatVector,
 				     signalVector& newVector)
 {
@@ -188,14 +249,33 @@ void RadioInterface::driveTransmitRadio(signalVector &radioBurst, bool zeroBurst
   if (!mOn)
     return;
 
-  radioifyVector(radioBurst,
-                 (float *) (sendBuffer->begin() + sendCursor), zeroBurst);
+  stageBurst(radioBurst, zeroBurst);
 
   sendCursor += radioBurst.size();
 
   pushBuffer();
 }
 
+void RadioInterface::driveTransmitRadio(DeviceBurst &burst)
+{
+  if (!mOn)
+    return;
+
+  // Converted only when first sent or after a power change
+  if (burst.scaling != powerScaling) {
+    convert_float_short(burst.samples, (float *) burst.waveform.begin(),
+                        powerScaling, 2 * burst.size);
+    burst.scaling = powerScaling;
+  }
+
+  memcpy(convertSendBuffer + 2 * sendCursor, burst.samples,
+         burst.size * 2 * sizeof(short));
+
+  sendCursor += burst.size;
+
+  pushBuffer();
+}
+
 void RadioInterface::driveReceiveRadio() {
 
   if (!mOn) return;
@@ -229,6 +309,7 @@ void RadioInterface::driveReceiveRadio() {
         else
           rxBurst = new radioVector(*finalVec,tmpTime); 
       }
+      rxBurst->setStamp(gLatency.now());
       mReceiveFIFO.put(rxBurst); 
     }
     mClock.incTN(); 
@@ -314,10 +395,7 @@ void RadioInterface::pushBuffer()
   if (sendCursor > sendBuffer->size())
     LOG(ALERT) << "Send buffer overflow";
 
-  convert_float_short(convertSendBuffer,
-                      (float *) sendBuffer->begin(),
-                      powerScaling, 2 * sendCursor);
-
+  /* Bursts were converted to device format when staged */
   /* Send the all samples in the send buffer */ 
   num_sent = mRadio->writeSamples(convertSendBuffer,
                                   sendCursor,
@@ -326,6 +404,8 @@ void RadioInterface::pushBuffer()
   if (num_sent != sendCursor) {
           LOG(ALERT) << "Transmit error " << num_sent;
   }
+  if (underrun)
+    gLatency.underrun();
 
   writeTimestamp += num_sent;
   sendCursor = 0;
@@ -21,6 +21,31 @@
 #include "radioVector.h"
 #include "radioClock.h"
 
+#include <map>
+#include <stdint.h>
+
+/**
+  A burst waveform converted to device sample format.
+  Identical waveforms, like the dummy bursts filling idle timeslots, share
+  one copy so they can be transmitted without converting them again.
+*/
+class DeviceBurst {
+public:
+  uint64_t hash;		      ///< content hash of the source waveform
+  signalVector waveform;	      ///< source waveform, converted again on scaling change
+  unsigned size;		      ///< number of complex samples
+  double scaling;		      ///< power scaling used for the conversion
+  short *samples;		      ///< interleaved I/Q device samples
+  unsigned refs;		      ///< number of holders of this burst
+
+  DeviceBurst(uint64_t wHash, const signalVector &wWaveform)
+    : hash(wHash), waveform(wWaveform), size(wWaveform.size()), scaling(0.0),
+      samples(new short[2 * wWaveform.size()]), refs(0)
+  { }
+
+  ~DeviceBurst() { delete[] samples; }
+};
+
 /** class to interface the transceiver with the USRP */
 class RadioInterface {
 
@@ -59,13 +84,19 @@ protected:
   int mNumARFCNs;
   signalVector *finalVec, *finalVec9;
 
-private:
+  typedef std::map<uint64_t,DeviceBurst*> DeviceBurstMap;
+  DeviceBurstMap mDeviceBursts;		      ///< shared device format bursts by content hash
 
   /** format samples to USRP */ 
   int radioifyVector(signalVector &wVector,
                      float *floatVector,
                      bool zero);
 
+  /** place a burst at the send cursor */
+  virtual void stageBurst(signalVector &radioBurst, bool zeroBurst);
+
+private:
+
   /** format samples from USRP */
   int unRadioifyVector(float *floatVector, signalVector &wVector);
 
@@ -120,6 +151,19 @@ public:
   /** drive transmission of GSM bursts */
   void driveTransmitRadio(signalVector &radioBurst, bool zeroBurst);
 
+  /**
+    Get a shared device format copy of a burst, to be released when unused.
+    @param radioBurst the burst waveform
+    @return the device burst, NULL if bursts can't be sent in device format
+  */
+  virtual DeviceBurst *acquireBurst(signalVector &radioBurst);
+
+  /** release a burst obtained from acquireBurst() */
+  void releaseBurst(DeviceBurst *burst);
+
+  /** drive transmission of a burst already in device format */
+  void driveTransmitRadio(DeviceBurst &burst);
+
   /** drive reception of GSM bursts */
   void driveReceiveRadio();
 
@@ -162,6 +206,7 @@ private:
 
   void pushBuffer();
   void pullBuffer();
+  void stageBurst(signalVector &radioBurst, bool zeroBurst);
 
 public:
 
@@ -174,4 +219,7 @@ public:
 
   bool init(int type);
   void close();
+
+  /** bursts are resampled, they can't be sent in device format */
+  DeviceBurst *acquireBurst(signalVector &radioBurst) { return NULL; }
 };
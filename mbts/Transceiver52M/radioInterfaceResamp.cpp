@@ -23,6 +23,7 @@
 #include <Logger.h>
 
 #include "Resampler.h"
+#include "Latency.h"
 
 extern "C" {
 #include "convert.h"
@@ -203,6 +204,13 @@ void RadioInterfaceResamp::pullBuffer()
 	recvCursor += resamp_inchunk;
 }
 
+/* Resampling works on floats, stage the burst unconverted */
+void RadioInterfaceResamp::stageBurst(signalVector &radioBurst, bool zeroBurst)
+{
+	radioifyVector(radioBurst,
+		       (float *) (sendBuffer->begin() + sendCursor), zeroBurst);
+}
+
 /* Send a timestamped chunk to the device */
 void RadioInterfaceResamp::pushBuffer()
 {
@@ -238,6 +246,8 @@ void RadioInterfaceResamp::pushBuffer()
 	if (num_sent != outer_len) {
 		LOG(ALERT) << "Transmit error " << num_sent;
 	}
+	if (underrun)
+		gLatency.underrun();
 
 	/* Shift remaining samples to beginning of buffer */
 	memmove(innerSendBuffer->begin(),
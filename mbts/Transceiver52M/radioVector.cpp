@@ -22,7 +22,7 @@
 #include "radioVector.h"
 
 radioVector::radioVector(const signalVector& wVector, GSM::Time& wTime)
-	: signalVector(wVector), mTime(wTime)
+	: signalVector(wVector), mTime(wTime), mStamp(0)
 {
 }
 
@@ -57,6 +57,18 @@ float noiseVector::avg()
 	return val / (float) size();
 }
 
+float noiseVector::min()
+{
+	float val = size() ? (*this)[0] : 0.0;
+
+	for (size_t i = 1; i < size(); i++) {
+		if ((*this)[i] < val)
+			val = (*this)[i];
+	}
+
+	return val;
+}
+
 bool noiseVector::insert(float val)
 {
 	if (!size())
@@ -31,9 +31,13 @@ public:
 	GSM::Time getTime() const;
 	void setTime(const GSM::Time& wTime);
 	bool operator>(const radioVector& other) const;
+	/** Time in microseconds when the burst entered the transceiver */
+	uint64_t getStamp() const { return mStamp; }
+	void setStamp(uint64_t us) { mStamp = us; }
 
 private:
 	GSM::Time mTime;
+	uint64_t mStamp;
 };
 
 class noiseVector : std::vector<float> {
@@ -41,6 +45,7 @@ public:
 	noiseVector(size_t len = 0);
 	bool insert(float val);
 	float avg();
+	float min();
 
 private:
 	std::vector<float>::iterator it;
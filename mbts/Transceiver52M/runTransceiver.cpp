@@ -58,7 +58,7 @@ static const char *cOpenBTSConfigEnv = "MBTSConfigFile";
 ConfigurationTable gConfig(getenv(cOpenBTSConfigEnv)?getenv(cOpenBTSConfigEnv):CONFIGDB,"transceiver", getConfigurationKeys());
 
 /** Connection to YBTS */
-Connection::LogConnection gLogConn(STDERR_FILENO + 1);
+Connection::LogConnection gLogConn(STDERR_FILENO + 1,Connection::LogSourceTrx);
 
 volatile bool gbShutdown = false;
 
@@ -104,7 +104,7 @@ int main(int argc, char *argv[])
     std::cout << "Using internal clock reference" << std::endl;
 
   gLogInit("transceiver", logLevel.c_str(), LOG_LOCAL7);
-  if (gLogConn.valid())
+  if (gLogConn.valid() && gLogConn.startWriter())
     Log::gHook = Connection::LogConnection::hook;
 
   srandom(time(NULL));
@@ -141,6 +141,8 @@ int main(int argc, char *argv[])
     fail = 1;
     goto shutdown;
   }
+  trx->setRxGate(gConfig.getFloat("TRX.RxGate"));
+  trx->setRxWorkers(gConfig.getNum("TRX.RxWorkers"));
   trx->receiveFIFO(radio->receiveFIFO());
   gLogConn.write("Starting transceiver");
   trx->start();
@@ -215,5 +217,30 @@ ConfigurationKeyMap getConfigurationKeys()
 	map[tmp->getName()] = *tmp;
 	delete tmp;
 
+	tmp = new ConfigurationKey("TRX.RxGate","1.5",
+		"dB",
+		ConfigurationKey::CUSTOMERTUNE,
+		ConfigurationKey::VALRANGE,
+		"0.0:6.0",
+		true,
+		"Received slots whose power is not this much above the noise floor are rejected before running the burst correlators.  "
+			"Lower values detect weaker bursts at the expense of more receive processing.  "
+			"Set to 0 to correlate every expected burst."
+	);
+	map[tmp->getName()] = *tmp;
+	delete tmp;
+
+	tmp = new ConfigurationKey("TRX.RxWorkers","0",
+		"threads",
+		ConfigurationKey::CUSTOMERTUNE,
+		ConfigurationKey::VALRANGE,
+		"0:8",
+		true,
+		"Number of threads demodulating received bursts in parallel, each timeslot is always handled by the same thread.  "
+			"Set to 0 to demodulate in the receive thread."
+	);
+	map[tmp->getName()] = *tmp;
+	delete tmp;
+
 	return map;
 }
@@ -1225,6 +1225,37 @@ bool energyDetect(signalVector &rxBurst,
   return (energy/windowLength > detectThreshold*detectThreshold);
 }
 
+bool energyGate(signalVector &rxBurst,
+                unsigned len,
+                float noiseLev,
+                float gate,
+                float *avgPwr)
+{
+  if (!len || (len > rxBurst.size()))
+    len = rxBurst.size();
+
+  /* Independent partial sums over the interleaved I/Q floats vectorize */
+  const float *data = (const float *) rxBurst.begin();
+  float acc0 = 0.0f, acc1 = 0.0f, acc2 = 0.0f, acc3 = 0.0f;
+  unsigned n = 2 * len, i = 0;
+  for (; i + 4 <= n; i += 4) {
+    acc0 += data[i + 0] * data[i + 0];
+    acc1 += data[i + 1] * data[i + 1];
+    acc2 += data[i + 2] * data[i + 2];
+    acc3 += data[i + 3] * data[i + 3];
+  }
+  for (; i < n; i++)
+    acc0 += data[i] * data[i];
+
+  float pwr = len ? (acc0 + acc1 + acc2 + acc3) / len : 0.0f;
+  if (avgPwr)
+    *avgPwr = pwr;
+
+  if ((gate <= 0.0f) || (noiseLev <= 0.0f))
+    return true;
+  return (pwr >= gate * noiseLev * noiseLev);
+}
+
 /*
  * Detect a burst based on correlation and peak-to-average ratio
  *
@@ -266,6 +266,21 @@ bool energyDetect(signalVector &rxBurst,
                   float detectThreshold,
                   float *avgPwr = NULL);
 
+/**
+        Energy gate run ahead of the correlators, rejects slots holding only noise.
+        @param rxBurst The received GSM burst of interest.
+        @param len The number of samples at the start of the burst to measure.
+        @param noiseLev The noise floor amplitude, zero if not yet known.
+        @param gate The power ratio above the noise floor required to pass, zero to pass all.
+        @param avgPwr The average power of the measured samples.
+        @return True if the burst may hold a signal and should be correlated.
+*/
+bool energyGate(signalVector &rxBurst,
+                unsigned len,
+                float noiseLev,
+                float gate,
+                float *avgPwr = NULL);
+
 /**
         RACH correlator/detector.
         @param rxBurst The received GSM burst of interest.
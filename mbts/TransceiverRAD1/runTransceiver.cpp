@@ -42,7 +42,7 @@ ConfigurationTable gConfig(getenv(cOpenBTSConfigEnv)?getenv(cOpenBTSConfigEnv):"
 FactoryCalibration gFactoryCalibration;
 
 /** Connection to YBTS */
-Connection::LogConnection gLogConn(STDERR_FILENO + 1);
+Connection::LogConnection gLogConn(STDERR_FILENO + 1,Connection::LogSourceTrx);
 
 volatile bool gbShutdown = false;
 static void ctrlCHandler(int signo)
@@ -67,7 +67,7 @@ int main(int argc, char *argv[])
   }
   // Configure logger.
   gLogInit("transceiver",gConfig.getStr("Log.Level").c_str(),LOG_LOCAL7);
-  if (gLogConn.valid())
+  if (gLogConn.valid() && gLogConn.startWriter())
     Log::gHook = Connection::LogConnection::hook;
 
   int numARFCN=1;
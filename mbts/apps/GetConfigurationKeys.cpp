@@ -60,6 +60,30 @@ ConfigurationKeyMap getConfigurationKeys()
 	ConfigurationKeyMap map;
 	ConfigurationKey *tmp;
 
+	tmp = new ConfigurationKey("Control.GSMTAP.File","",
+		"",
+		ConfigurationKey::CUSTOMERWARN,
+		ConfigurationKey::FILEPATH_OPT,
+		"",
+		false,
+		"Path of a pcapng file to write the GSMTAP packets to, in addition to sending them to Control.GSMTAP.TargetIP; empty to write no file.  "
+			"The file is rewritten when the path changes."
+	);
+	map[tmp->getName()] = *tmp;
+	delete tmp;
+
+	tmp = new ConfigurationKey("Control.GSMTAP.Filter","",
+		"",
+		ConfigurationKey::CUSTOMERWARN,
+		ConfigurationKey::STRING_OPT,
+		"",
+		false,
+		"Channels to capture, a space separated list of BCCH, CCCH, SDCCH, TCH, CBCH, PDCH, PTCCH, SACCH and timeslots TN0 to TN7.  "
+			"An empty list, or no channel or no timeslot in it, captures all of them."
+	);
+	map[tmp->getName()] = *tmp;
+	delete tmp;
+
 	tmp = new ConfigurationKey("Control.GSMTAP.GPRS","no",
 		"",
 		ConfigurationKey::CUSTOMERWARN,
@@ -82,6 +106,17 @@ ConfigurationKeyMap getConfigurationKeys()
 	map[tmp->getName()] = *tmp;
 	delete tmp;
 
+	tmp = new ConfigurationKey("Control.GSMTAP.MaxRate","5000",
+		"packets per second",
+		ConfigurationKey::CUSTOMERWARN,
+		ConfigurationKey::VALRANGE,
+		"0:100000(100)",
+		false,
+		"Maximum number of GSMTAP packets captured per second, the others are counted and discarded; 0 for no limit."
+	);
+	map[tmp->getName()] = *tmp;
+	delete tmp;
+
 	tmp = new ConfigurationKey("Control.GSMTAP.TargetIP","127.0.0.1",
 		"",
 		ConfigurationKey::CUSTOMERWARN,
@@ -389,6 +424,30 @@ ConfigurationKeyMap getConfigurationKeys()
 	map[tmp->getName()] = *tmp;
 	delete tmp;
 
+	tmp = new ConfigurationKey("GPRS.Channels.Forecast","30",
+		"seconds",
+		ConfigurationKey::DEVELOPER,
+		ConfigurationKey::VALRANGE,
+		"0:300(10)",
+		false,
+		"How far ahead the GPRS and voice loads are forecast when deciding how many channels GPRS holds.  "
+			"0 uses the smoothed loads without their trend."
+	);
+	map[tmp->getName()] = *tmp;
+	delete tmp;
+
+	tmp = new ConfigurationKey("GPRS.Channels.Hold","60",
+		"seconds",
+		ConfigurationKey::DEVELOPER,
+		ConfigurationKey::VALRANGE,
+		"10:600(10)",
+		false,
+		"How long in seconds the forecast must want fewer GPRS channels before one is returned to GSM RR use.  "
+			"Channels are returned at once when voice is forecast to need them."
+	);
+	map[tmp->getName()] = *tmp;
+	delete tmp;
+
 	tmp = new ConfigurationKey("GPRS.Channels.Min.C0","2",
 		"channels",
 		ConfigurationKey::CUSTOMERTUNE,
@@ -411,18 +470,39 @@ ConfigurationKeyMap getConfigurationKeys()
 	map[tmp->getName()] = *tmp;
 	delete tmp;
 
-#if GPRS_CHANNELS_MAX_SUPPORTED
 	tmp = new ConfigurationKey("GPRS.Channels.Max","4",
 		"channels",
 		ConfigurationKey::CUSTOMERTUNE,
 		ConfigurationKey::VALRANGE,
 		"0:10",// educated guess
 		false,
-		"Maximum number of channels allocated for GPRS service."
+		"Maximum number of channels allocated for GPRS service.  "
+			"Above GPRS.Channels.Min.C0 plus GPRS.Channels.Min.CN, channels are added in multislot groups as the forecast GPRS load needs them."
+	);
+	map[tmp->getName()] = *tmp;
+	delete tmp;
+
+	tmp = new ConfigurationKey("GPRS.Channels.Smoothing","60",
+		"seconds",
+		ConfigurationKey::DEVELOPER,
+		ConfigurationKey::VALRANGE,
+		"5:600(5)",
+		false,
+		"Time constant in seconds of the smoothing of the GPRS and voice loads used to forecast them."
+	);
+	map[tmp->getName()] = *tmp;
+	delete tmp;
+
+	tmp = new ConfigurationKey("GPRS.Channels.Voice.Reserve","1",
+		"channels",
+		ConfigurationKey::DEVELOPER,
+		ConfigurationKey::VALRANGE,
+		"0:8",
+		false,
+		"Number of TCHs kept free for voice calls beyond the voice load forecast; GPRS channels are returned to GSM RR use to keep them free."
 	);
 	map[tmp->getName()] = *tmp;
 	delete tmp;
-#endif
 
 	tmp = new ConfigurationKey("GPRS.Codecs.Downlink","14",
 		"",
@@ -527,6 +607,18 @@ ConfigurationKeyMap getConfigurationKeys()
 	map[tmp->getName()] = *tmp;
 	delete tmp;
 
+	tmp = new ConfigurationKey("GPRS.Downlink.Cell.Bytes","200000",
+		"bytes",
+		ConfigurationKey::DEVELOPER,
+		ConfigurationKey::VALRANGE,
+		"10000:2000000(10000)",
+		false,
+		"Maximum bytes of user data queued for the downlink of all the MS in the cell.  "
+			"It is also the size of the cell leaky bucket; user data beyond it is discarded."
+	);
+	map[tmp->getName()] = *tmp;
+	delete tmp;
+
 	tmp = new ConfigurationKey("GPRS.Downlink.KeepAlive","300",
 		"milliseconds",
 		ConfigurationKey::DEVELOPER,
@@ -539,6 +631,18 @@ ConfigurationKeyMap getConfigurationKeys()
 	map[tmp->getName()] = *tmp;
 	delete tmp;
 
+	tmp = new ConfigurationKey("GPRS.Downlink.MS.Bytes","30000",
+		"bytes",
+		ConfigurationKey::DEVELOPER,
+		ConfigurationKey::VALRANGE,
+		"2000:500000(1000)",
+		false,
+		"Maximum bytes of user data queued for the downlink of one MS.  "
+			"It is also the size of the MS leaky bucket, which leaks at the rate of the MS channels; user data beyond it is discarded."
+	);
+	map[tmp->getName()] = *tmp;
+	delete tmp;
+
 	tmp = new ConfigurationKey("GPRS.Downlink.Persist","0",
 		"milliseconds",
 		ConfigurationKey::DEVELOPER,
@@ -551,6 +655,18 @@ ConfigurationKeyMap getConfigurationKeys()
 	map[tmp->getName()] = *tmp;
 	delete tmp;
 
+	tmp = new ConfigurationKey("GPRS.Downlink.TargetDelay","3000",
+		"milliseconds",
+		ConfigurationKey::DEVELOPER,
+		ConfigurationKey::VALRANGE,
+		"0:10000(100)",
+		false,
+		"TCP pdus are discarded early when the oldest pdu queued for the MS has waited longer than this, so the sender slows down before the queue fills.  "
+			"0 disables it."
+	);
+	map[tmp->getName()] = *tmp;
+	delete tmp;
+
 	tmp = new ConfigurationKey("GPRS.Enable","yes",
 
 		"",
@@ -575,6 +691,19 @@ ConfigurationKeyMap getConfigurationKeys()
 	map[tmp->getName()] = *tmp;
 	delete tmp;
 
+	tmp = new ConfigurationKey("GPRS.MAC.Workers","0",
+		"threads",
+		ConfigurationKey::CUSTOMERTUNE,
+		ConfigurationKey::VALRANGE,
+		"0:8",
+		false,
+		"Number of extra threads that channel code the downlink GPRS blocks of the PDCHs in parallel at the end of each block period.  "
+			"0 codes them in the MAC service thread.  Useful with several carriers.  "
+			"Threads are added when increased, but only stop on restart."
+	);
+	map[tmp->getName()] = *tmp;
+	delete tmp;
+
 	tmp = new ConfigurationKey("GPRS.MS.KeepExpiredCount","20",
 		"structs",
 		ConfigurationKey::DEVELOPER,
@@ -761,6 +890,44 @@ ConfigurationKeyMap getConfigurationKeys()
 	map[tmp->getName()] = *tmp;
 	delete tmp;
 
+	tmp = new ConfigurationKey("GPRS.Scheduler","round-robin",
+		"",
+		ConfigurationKey::CUSTOMERTUNE,
+		ConfigurationKey::CHOICE,
+		"round-robin|Round Robin,"
+			"proportional-fair|Proportional Fair",
+		false,
+		"How the MAC shares the downlink blocks and uplink USFs of a channel between TBFs.  "
+			"round-robin serves the TBF waiting the longest.  "
+			"proportional-fair favors the TBFs that can use a faster coding scheme than their recent throughput, "
+			"so MS in good radio conditions are not held back by the ones on CS-1."
+	);
+	map[tmp->getName()] = *tmp;
+	delete tmp;
+
+	tmp = new ConfigurationKey("GPRS.Scheduler.MaxAge","1000",
+		"milliseconds",
+		ConfigurationKey::CUSTOMERTUNE,
+		ConfigurationKey::VALRANGE,
+		"0:5000(20)",
+		false,
+		"With the proportional-fair GPRS.Scheduler, a TBF not served for this long goes ahead of the others.  "
+			"0 disables this starvation limit."
+	);
+	map[tmp->getName()] = *tmp;
+	delete tmp;
+
+	tmp = new ConfigurationKey("GPRS.Scheduler.Window","2000",
+		"milliseconds",
+		ConfigurationKey::CUSTOMERTUNE,
+		ConfigurationKey::VALRANGE,
+		"100:10000(100)",
+		false,
+		"Time over which the GPRS.Scheduler averages the throughput of each TBF."
+	);
+	map[tmp->getName()] = *tmp;
+	delete tmp;
+
 	tmp = new ConfigurationKey("GPRS.SendIdleFrames","no",
 		"",
 		ConfigurationKey::FACTORY,
@@ -1680,6 +1847,30 @@ ConfigurationKeyMap getConfigurationKeys()
 	map[tmp->getName()] = *tmp;
 	delete tmp;
 
+	tmp = new ConfigurationKey("SGSN.Compression.APN","",
+		"",
+		ConfigurationKey::CUSTOMERTUNE,
+		ConfigurationKey::STRING_OPT,
+		"",
+		false,
+		"Space separated list of the access point names on which SNDCP compression may be negotiated.  "
+			"Leave empty to allow it on all of them.  "
+			"The cost of each algorithm is shown by the \"sgsn comp\" command."
+	);
+	map[tmp->getName()] = *tmp;
+	delete tmp;
+
+	tmp = new ConfigurationKey("SGSN.Compression.Protocol","no",
+		"",
+		ConfigurationKey::CUSTOMERTUNE,
+		ConfigurationKey::BOOLEAN,
+		"",
+		false,
+		"Accept RFC 1144 TCP/IP header compression when the MS requests it in SNDCP XID, 3GPP 44.065 6.5."
+	);
+	map[tmp->getName()] = *tmp;
+	delete tmp;
+
 	tmp = new ConfigurationKey("SGSN.Debug","no",
 		"",
 		ConfigurationKey::DEVELOPER,
@@ -1766,6 +1957,31 @@ ConfigurationKeyMap getConfigurationKeys()
 	map[tmp->getName()] = *tmp;
 	delete tmp;
 
+	tmp = new ConfigurationKey("TRX.RxGate","1.5",
+		"dB",
+		ConfigurationKey::CUSTOMERTUNE,
+		ConfigurationKey::VALRANGE,
+		"0.0:6.0",
+		true,
+		"Received slots whose power is not this much above the noise floor are rejected before running the burst correlators.  "
+			"Lower values detect weaker bursts at the expense of more receive processing.  "
+			"Set to 0 to correlate every expected burst."
+	);
+	map[tmp->getName()] = *tmp;
+	delete tmp;
+
+	tmp = new ConfigurationKey("TRX.RxWorkers","0",
+		"threads",
+		ConfigurationKey::CUSTOMERTUNE,
+		ConfigurationKey::VALRANGE,
+		"0:8",
+		true,
+		"Number of threads demodulating received bursts in parallel, each timeslot is always handled by the same thread.  "
+			"Set to 0 to demodulate in the receive thread."
+	);
+	map[tmp->getName()] = *tmp;
+	delete tmp;
+
 	tmp = new ConfigurationKey("TRX.Port","5700",
 		"",
 		ConfigurationKey::FACTORY,
@@ -1861,6 +2077,17 @@ ConfigurationKeyMap getConfigurationKeys()
 	map[tmp->getName()] = *tmp;
 	delete tmp;
 
+	tmp = new ConfigurationKey("TRX.FastStart","yes",
+		"",
+		ConfigurationKey::DEVELOPER,
+		ConfigurationKey::BOOLEAN,
+		"",
+		false,
+		"Poll the transceiver at startup and continue as soon as it answers instead of waiting a fixed time."
+	);
+	map[tmp->getName()] = *tmp;
+	delete tmp;
+
 	tmp = new ConfigurationKey("TRX.IgnoreDeath","no",
 		"",
 		ConfigurationKey::DEVELOPER,
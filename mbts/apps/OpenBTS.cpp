@@ -43,6 +43,7 @@ ReportingTable gReports(gConfig.getStr("Control.Reporting.StatsTable").c_str());
 #include <GSMSAPMux.h>
 #include <GSML3RRMessages.h>
 #include <GSMLogicalChannel.h>
+#include <GSMTAPDump.h>
 
 #include <ControlCommon.h>
 //#include <TransactionTable.h>
@@ -118,8 +119,36 @@ Connection::ConnectionMap gConnMap;
 
 const char* transceiverPath = "./transceiver";
 
+// Frame number put in log records
+static unsigned int logFrameNumber()
+{
+	return gBTS.time().FN();
+}
+
 pid_t gTransceiverPid = 0;
 
+// Startup timing, the first phase includes the global constructors
+static Timeval gStartupTime;
+static Timeval gStartupPhase;
+
+static void startupPhase(const char* name)
+{
+	LOG(NOTICE) << "startup phase " << name << " took " << gStartupPhase.elapsed() << " ms";
+	gStartupPhase.now();
+}
+
+// Wait for the transceiver to answer on its control port
+// Return as soon as it does instead of waiting the whole interval
+static bool waitTransceiver(unsigned ms)
+{
+	Timeval end(ms);
+	while (!end.passed()) {
+		if (gTRX.ARFCN(0)->ping(250))
+			return true;
+	}
+	return false;
+}
+
 void startTransceiver()
 {
 	//if local kill the process currently listening on this port
@@ -264,8 +293,11 @@ int main(int argc, char *argv[])
 	}
 
 	if (gLogConn.valid() && gCmdConn.valid() && gSigConn.valid() &&
-			gMediaConn.valid() && gLogConn.write("MBTS connected to YBTS"))
+			gMediaConn.valid() && gLogConn.write("MBTS connected to YBTS")) {
+		Connection::LogConnection::gFrameNumber = logFrameNumber;
+		gLogConn.startWriter();
 		Log::gHook = Connection::LogConnection::hook;
+	}
 	else {
 		COUT("\nNot started by YBTS\n");
 		exit(1);
@@ -289,6 +321,7 @@ int main(int argc, char *argv[])
 	gBTS.init();
 	//gSubscriberRegistry.init();
 	gParser.addCommands();
+	startupPhase("init");
 
 	if (gCmdConn.valid()) {
 		gSigConn.start();
@@ -303,17 +336,26 @@ int main(int argc, char *argv[])
 	//gTRX.ARFCN(0)->powerOn();
 	//sleep(gConfig.getNum("TRX.Timeout.Start"));
 	//bool haveTRX = gTRX.ARFCN(0)->powerOn(false); // (pat) Dont power on the radio before initing it, particularly SETTSC below; radio can crash.
-	bool haveTRX = gTRX.ARFCN(0)->powerOff();
+	// Fast start probes the transceiver once instead of retrying the command
+	bool fastStart = gConfig.getBool("TRX.FastStart");
+	bool haveTRX = fastStart ? gTRX.ARFCN(0)->ping(250) : gTRX.ARFCN(0)->powerOff();
 
 	Thread transceiverThread;
 	if (!haveTRX) {
 		transceiverThread.start((void*(*)(void*)) startTransceiver, NULL);
-		// sleep to let the FPGA code load
-		// TODO: we should be "pinging" the radio instead of sleeping
-		sleep(5);
+		// let the FPGA code load
+		if (!fastStart)
+			sleep(5);
+		else if (!waitTransceiver(5000))
+			LOG(WARNING) << "transceiver not answering after 5 seconds";
 	} else {
 		LOG(NOTICE) << "transceiver already running";
 	}
+	// A transceiver kept by a warm restart of mbts is still tuned and transmitting.
+	// Its TSC is locked while on, the rest is sent again to rebuild our side.
+	bool radioOn = haveTRX && gTRX.ARFCN(0)->running();
+	if (radioOn) LOG(NOTICE) << "reusing running radio";
+	startupPhase("transceiver");
 
 	// Start the peer interface
 //	gPeerInterface.start();
@@ -369,7 +411,9 @@ int main(int argc, char *argv[])
 	}
 
 	// Send either TSC or full BSIC depending on radio need
-	if (gConfig.getBool("GSM.Radio.NeedBSIC")) {
+	if (radioOn) {
+		// Already set, the radio refuses it while on
+	} else if (gConfig.getBool("GSM.Radio.NeedBSIC")) {
 		// Send BSIC to 
 		C0radio->setBSIC(gBTS.BSIC());
 	} else {
@@ -386,6 +430,7 @@ int main(int argc, char *argv[])
 	// Turn on and power up.
 	C0radio->powerOn(true);
 	C0radio->setPower(gConfig.getNum("GSM.Radio.PowerManager.MinAttenDB"));
+	startupPhase("radio");
 
 	//
 	// Create a C-V channel set on C0T0.
@@ -527,8 +572,15 @@ int main(int argc, char *argv[])
 	}
 
 
+	startupPhase("channels");
+
+	// Tapping only copies into a ring, the capture thread does the rest.
+	gGSMTAP.start();
+
 	// OK, now it is safe to start the BTS.
 	gBTS.start();
+	startupPhase("start");
+	LOG(NOTICE) << "startup took " << gStartupTime.elapsed() << " ms";
 
 	if (gCmdConn.valid()) {
 		gMediaConn.start();
@@ -49,7 +49,10 @@ typedef unsigned char Byte;
 #include <stdio.h>
 #include <ctype.h>
 
+/* Define COMP128_LIBRARY to build only the algorithm without main() */
+#ifndef COMP128_LIBRARY
 #define TEST
+#endif
  
 /*
  * rand[0..15]: the challenge from the base station
@@ -27,6 +27,12 @@ while read REPLY; do
 	    op="${params#*:op=}"; op="${op%%:*}"
 	    proto="${params#*:protocol=}"; proto="${proto%%:*}"
 	    resp=""
+	    gen=""
+	    # pick a random challenge if the caller did not provide one
+	    if [ -z "$rand" ]; then
+		rand=`od -An -tx1 -N16 /dev/urandom | tr -d ' \n'`
+		gen=":rand=$rand"
+	    fi
 	    case "X$proto" in
 		Xcomp128)
 		    case "X$op" in
@@ -64,7 +70,7 @@ while read REPLY; do
 		    ;;
 	    esac
 	    if [ -n "$resp" ]; then
-		echo "%%<message:$id:true:::$resp"
+		echo "%%<message:$id:true:::$resp$gen"
 	    else
 		echo "%%<message:$id:false::"
 	    fi
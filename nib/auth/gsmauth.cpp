@@ -0,0 +1,715 @@
+/**
+ * gsmauth.cpp
+ * This file is part of the Yate-BTS Project http://www.yatebts.com
+ *
+ * In-process GSM/UMTS authentication vector engine
+ *
+ * Yet Another Telephony Engine - Base Transceiver Station
+ * Copyright (C) 2014 Null Team Impex SRL
+ *
+ * This software is distributed under multiple licenses;
+ * see the COPYING file in the main directory for licensing
+ * information for this specific distribution.
+ *
+ * This use of this software may be subject to additional restrictions.
+ * See the LEGAL file in the main directory for details.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#include <yatephone.h>
+
+#ifdef _WINDOWS
+#error This module is not for Windows
+#endif
+
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+extern "C" {
+#include "milenage/milenage.h"
+
+void A3A8(unsigned char rand[16], unsigned char key[16],
+	unsigned char simoutput[12]);
+}
+
+using namespace TelEngine;
+namespace { // anonymous
+
+// Default message handler priority, ahead of gsm_auth.sh
+#define AUTH_PRIORITY_DEF 90
+// Default number of vectors kept ready for each subscriber
+#define AUTH_POOL_DEPTH_DEF 2
+#define AUTH_POOL_DEPTH_MAX 32
+// Default maximum number of subscribers with precomputed vectors
+#define AUTH_POOL_MAX_DEF 10000
+// Default number of threads computing vectors in advance
+#define AUTH_WORKERS_DEF 2
+#define AUTH_WORKERS_MAX 16
+// SQN increment between two authentications, nib.js uses 0x20
+#define AUTH_SQN_STEP_DEF 32
+// Mask of a 48 bit SQN
+#define AUTH_SQN_MASK 0xffffffffffffULL
+
+class AuthVector;
+class AuthPool;
+class AuthWorker;
+class AuthHandler;
+class AuthModule;
+
+// One precomputed authentication vector, results kept in text form
+class AuthVector : public GenObject
+{
+public:
+    inline AuthVector(uint64_t sqn = 0)
+	: m_sqn(sqn)
+	{}
+    // Copy the results into a gsm.auth message
+    void fill(NamedList& msg, bool comp128) const;
+    uint64_t m_sqn;
+    String m_rand;
+    String m_sres;
+    String m_kc;
+    String m_xres;
+    String m_ck;
+    String m_ik;
+    String m_autn;
+};
+
+// Precomputed vectors of a subscriber, the name is the IMSI
+class AuthPool : public String
+{
+public:
+    inline AuthPool(const String& imsi)
+	: String(imsi), m_comp128(true), m_nextSqn(0), m_count(0), m_queued(false)
+	{}
+    // Check if the pool was built for some key material
+    inline bool sameKey(bool comp128, const String& ki, const String& op) const
+	{ return m_comp128 == comp128 && m_ki == ki && m_op == op; }
+    // Discard all vectors and remember new key material
+    void reset(bool comp128, const String& ki, const String& op, uint64_t sqn);
+    // Retrieve the vector for a SQN (ignored for COMP128), caller owns it
+    AuthVector* take(uint64_t sqn);
+    bool m_comp128;
+    String m_ki;
+    String m_op;
+    uint64_t m_nextSqn;
+    ObjList m_vectors;
+    unsigned int m_count;
+    bool m_queued;
+};
+
+// Thread refilling subscriber pools in background
+class AuthWorker : public Thread, public GenObject
+{
+public:
+    AuthWorker();
+    virtual void run();
+    virtual void cleanup();
+};
+
+// gsm.auth handler
+class AuthHandler : public MessageHandler
+{
+public:
+    inline AuthHandler(unsigned int priority)
+	: MessageHandler("gsm.auth",priority,"gsmauth")
+	{}
+    virtual bool received(Message& msg);
+};
+
+class AuthModule : public Module
+{
+public:
+    AuthModule();
+    ~AuthModule();
+    virtual void initialize();
+    // Handle one gsm.auth request
+    bool authenticate(Message& msg);
+    // Pop one subscriber waiting to be refilled and refill it
+    bool refill();
+    // Worker thread notifications
+    void workerStarted(AuthWorker* worker);
+    void workerStopped(AuthWorker* worker);
+    // Stop all worker threads
+    void stopWorkers();
+protected:
+    virtual void statusParams(String& str);
+    virtual bool received(Message& msg, int id);
+private:
+    bool comp128(Message& msg, const String& ki, const String& imsi, bool prime);
+    bool milenage(Message& msg, const String& ki, const String& op,
+	const String& imsi, bool prime);
+    // Find or create the pool of a subscriber, must be called locked
+    AuthPool* findPool(const String& imsi, bool create);
+    // Queue a pool for refill if not full, must be called locked
+    void queueRefill(AuthPool* pool);
+    // Fill a random 128 bit challenge
+    void random(unsigned char* buf);
+    AuthHandler* m_handler;
+    Mutex m_poolMutex;
+    HashList m_pools;
+    ObjList m_refill;
+    Semaphore m_refillSem;
+    ObjList m_workers;
+    unsigned int m_workersRunning;
+    int m_random;
+    // Configuration
+    unsigned int m_depth;
+    unsigned int m_poolMax;
+    uint64_t m_sqnStep;
+    // Statistics
+    unsigned int m_requests;
+    unsigned int m_failed;
+    unsigned int m_hits;
+    unsigned int m_misses;
+    unsigned int m_computed;
+};
+
+INIT_PLUGIN(AuthModule);
+
+UNLOAD_PLUGIN(unloadNow)
+{
+    if (unloadNow)
+	__plugin.stopWorkers();
+    return true;
+}
+
+
+static inline int hexDigit(char c)
+{
+    if (c >= '0' && c <= '9')
+	return c - '0';
+    if (c >= 'a' && c <= 'f')
+	return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+	return c - 'A' + 10;
+    return -1;
+}
+
+// Decode an exact length hex string, optionally prefixed by 0x
+static bool unHex(const String& str, unsigned char* buf, unsigned int len)
+{
+    const char* s = str.c_str();
+    unsigned int l = str.length();
+    if (l > 2 && s[0] == '0' && (s[1] == 'x' || s[1] == 'X')) {
+	s += 2;
+	l -= 2;
+    }
+    if (l != 2 * len)
+	return false;
+    for (unsigned int i = 0; i < len; i++) {
+	int hi = hexDigit(s[2 * i]);
+	int lo = hexDigit(s[2 * i + 1]);
+	if (hi < 0 || lo < 0)
+	    return false;
+	buf[i] = (unsigned char)((hi << 4) | lo);
+    }
+    return true;
+}
+
+// Encode a buffer as upper case hex, the format of do_comp128 and do_milenage
+static String& toHex(String& str, const unsigned char* buf, unsigned int len)
+{
+    static const char s_digits[] = "0123456789ABCDEF";
+    char tmp[65];
+    if (len > 32)
+	len = 32;
+    for (unsigned int i = 0; i < len; i++) {
+	tmp[2 * i] = s_digits[buf[i] >> 4];
+	tmp[2 * i + 1] = s_digits[buf[i] & 0x0f];
+    }
+    tmp[2 * len] = '\0';
+    return (str = tmp);
+}
+
+static inline void sqnToBytes(uint64_t sqn, unsigned char* buf)
+{
+    for (int i = 5; i >= 0; i--) {
+	buf[i] = (unsigned char)sqn;
+	sqn >>= 8;
+    }
+}
+
+static inline uint64_t sqnFromBytes(const unsigned char* buf)
+{
+    uint64_t sqn = 0;
+    for (int i = 0; i < 6; i++)
+	sqn = (sqn << 8) | buf[i];
+    return sqn;
+}
+
+// Compute one COMP128 vector
+static void comp128Vector(AuthVector& v, unsigned char* ki, unsigned char* rand)
+{
+    unsigned char out[12];
+    A3A8(rand,ki,out);
+    toHex(v.m_rand,rand,16);
+    toHex(v.m_sres,out,4);
+    toHex(v.m_kc,out + 4,8);
+}
+
+// Compute one MILENAGE vector with AMF 0
+static void milenageVector(AuthVector& v, const MilenageCtx& ctx, const unsigned char* rand)
+{
+    unsigned char sqn[6], amf[2] = { 0, 0 };
+    unsigned char xres[8], ck[16], ik[16], ak[6], autn[16];
+    sqnToBytes(v.m_sqn,sqn);
+    MilenageF1(&ctx,rand,sqn,amf,autn + 8,0);
+    MilenageF2345(&ctx,rand,xres,ck,ik,ak);
+    for (int i = 0; i < 6; i++)
+	autn[i] = sqn[i] ^ ak[i];
+    autn[6] = amf[0];
+    autn[7] = amf[1];
+    toHex(v.m_rand,rand,16);
+    toHex(v.m_xres,xres,8);
+    toHex(v.m_ck,ck,16);
+    toHex(v.m_ik,ik,16);
+    toHex(v.m_autn,autn,16);
+}
+
+
+void AuthVector::fill(NamedList& msg, bool comp128) const
+{
+    msg.setParam("rand",m_rand);
+    if (comp128) {
+	msg.setParam("sres",m_sres);
+	msg.setParam("kc",m_kc);
+    }
+    else {
+	msg.setParam("xres",m_xres);
+	msg.setParam("ck",m_ck);
+	msg.setParam("ik",m_ik);
+	msg.setParam("autn",m_autn);
+    }
+}
+
+
+void AuthPool::reset(bool comp128, const String& ki, const String& op, uint64_t sqn)
+{
+    m_vectors.clear();
+    m_count = 0;
+    m_comp128 = comp128;
+    m_ki = ki;
+    m_op = op;
+    m_nextSqn = sqn;
+}
+
+AuthVector* AuthPool::take(uint64_t sqn)
+{
+    while (AuthVector* v = static_cast<AuthVector*>(m_vectors.remove(false))) {
+	m_count--;
+	if (m_comp128 || v->m_sqn == sqn)
+	    return v;
+	// Vector for a SQN the subscriber moved past
+	TelEngine::destruct(v);
+    }
+    return 0;
+}
+
+
+AuthWorker::AuthWorker()
+    : Thread("GSM Auth Worker")
+{
+    __plugin.workerStarted(this);
+}
+
+void AuthWorker::run()
+{
+    while (!Engine::exiting() && !Thread::check(false))
+	__plugin.refill();
+}
+
+void AuthWorker::cleanup()
+{
+    __plugin.workerStopped(this);
+}
+
+
+bool AuthHandler::received(Message& msg)
+{
+    return __plugin.authenticate(msg);
+}
+
+
+AuthModule::AuthModule()
+    : Module("gsmauth","misc"),
+      m_handler(0), m_poolMutex(false,"GSMAuthPool"), m_pools(257),
+      m_refillSem(0x7fffffff,"GSMAuthRefill",0), m_workersRunning(0),
+      m_random(-1), m_depth(AUTH_POOL_DEPTH_DEF), m_poolMax(AUTH_POOL_MAX_DEF),
+      m_sqnStep(AUTH_SQN_STEP_DEF),
+      m_requests(0), m_failed(0), m_hits(0), m_misses(0), m_computed(0)
+{
+    Output("Loaded module GSM Authentication");
+}
+
+AuthModule::~AuthModule()
+{
+    Output("Unloading module GSM Authentication");
+    if (m_random >= 0)
+	::close(m_random);
+}
+
+void AuthModule::initialize()
+{
+    Output("Initializing module GSM Authentication");
+    Configuration cfg(Engine::configFile("gsmauth"));
+    cfg.load();
+    NamedList dummy("");
+    NamedList* gen = cfg.getSection("general");
+    if (!gen)
+	gen = &dummy;
+    unsigned int workers = gen->getIntValue("workers",AUTH_WORKERS_DEF,0,AUTH_WORKERS_MAX);
+    {
+	Lock lck(m_poolMutex);
+	m_depth = gen->getIntValue("pool_depth",AUTH_POOL_DEPTH_DEF,0,AUTH_POOL_DEPTH_MAX);
+	m_poolMax = gen->getIntValue("pool_max",AUTH_POOL_MAX_DEF,0);
+	m_sqnStep = gen->getIntValue("sqn_step",AUTH_SQN_STEP_DEF,1);
+	if (!m_depth) {
+	    m_pools.clear();
+	    m_refill.clear();
+	}
+    }
+    if (m_handler)
+	return;
+    setup();
+    installRelay(Halt);
+    if (m_random < 0)
+	m_random = ::open("/dev/urandom",O_RDONLY);
+    if (m_random < 0)
+	Debug(this,DebugWarn,"Could not open /dev/urandom, using a weaker generator");
+    Debug(this,DebugInfo,"Using %s MILENAGE, %u workers, %u vectors per subscriber",
+	RijndaelHaveAesNi() ? "AES-NI" : "table driven",workers,m_depth);
+    for (unsigned int i = 0; i < workers; i++) {
+	AuthWorker* w = new AuthWorker;
+	if (!w->startup()) {
+	    Debug(this,DebugWarn,"Failed to start worker thread %u",i);
+	    // The constructor registered it, cleanup() will never run
+	    workerStopped(w);
+	    delete w;
+	}
+    }
+    m_handler = new AuthHandler(gen->getIntValue("priority",AUTH_PRIORITY_DEF,1));
+    Engine::install(m_handler);
+}
+
+void AuthModule::statusParams(String& str)
+{
+    Lock lck(m_poolMutex);
+    str.append("workers=",",") << m_workersRunning;
+    str << ",subscribers=" << m_pools.count();
+    str << ",requests=" << m_requests;
+    str << ",failed=" << m_failed;
+    str << ",pool_hits=" << m_hits;
+    str << ",pool_misses=" << m_misses;
+    str << ",precomputed=" << m_computed;
+    str << ",aesni=" << String::boolText(RijndaelHaveAesNi());
+}
+
+bool AuthModule::received(Message& msg, int id)
+{
+    if (id == Halt)
+	stopWorkers();
+    return Module::received(msg,id);
+}
+
+void AuthModule::workerStarted(AuthWorker* worker)
+{
+    Lock lck(m_poolMutex);
+    m_workers.append(worker)->setDelete(false);
+    m_workersRunning++;
+}
+
+void AuthModule::workerStopped(AuthWorker* worker)
+{
+    Lock lck(m_poolMutex);
+    m_workers.remove(worker,false);
+    if (m_workersRunning)
+	m_workersRunning--;
+}
+
+void AuthModule::stopWorkers()
+{
+    Lock lck(m_poolMutex);
+    for (ObjList* o = m_workers.skipNull(); o; o = o->skipNext())
+	static_cast<AuthWorker*>(o->get())->cancel();
+    unsigned int n = m_workersRunning;
+    lck.drop();
+    // Wake up every waiting worker so it notices the cancel request
+    for (unsigned int i = 0; i < n; i++)
+	m_refillSem.unlock();
+    for (unsigned int i = 0; i < 100; i++) {
+	lck.acquire(m_poolMutex);
+	n = m_workersRunning;
+	lck.drop();
+	if (!n)
+	    break;
+	Thread::idle();
+    }
+    if (n)
+	Debug(this,DebugWarn,"%u worker threads did not stop",n);
+}
+
+void AuthModule::random(unsigned char* buf)
+{
+    if (m_random >= 0 && ::read(m_random,buf,16) == 16)
+	return;
+    for (int i = 0; i < 16; i += 4) {
+	uint32_t r = Random::random();
+	buf[i] = (unsigned char)r;
+	buf[i + 1] = (unsigned char)(r >> 8);
+	buf[i + 2] = (unsigned char)(r >> 16);
+	buf[i + 3] = (unsigned char)(r >> 24);
+    }
+}
+
+AuthPool* AuthModule::findPool(const String& imsi, bool create)
+{
+    if (!m_depth || imsi.null())
+	return 0;
+    AuthPool* pool = static_cast<AuthPool*>(m_pools[imsi]);
+    if (pool || !create)
+	return pool;
+    if (m_pools.count() >= m_poolMax) {
+	DDebug(this,DebugMild,"Not keeping vectors for %s, %u subscribers pooled",
+	    imsi.c_str(),m_pools.count());
+	return 0;
+    }
+    pool = new AuthPool(imsi);
+    m_pools.append(pool);
+    return pool;
+}
+
+void AuthModule::queueRefill(AuthPool* pool)
+{
+    if (!pool || pool->m_queued || pool->m_count >= m_depth || !m_workersRunning)
+	return;
+    pool->m_queued = true;
+    m_refill.append(new String(*pool));
+    m_refillSem.unlock();
+}
+
+bool AuthModule::refill()
+{
+    if (!m_refillSem.lock(Thread::idleUsec()))
+	return false;
+    Lock lck(m_poolMutex);
+    String* imsi = static_cast<String*>(m_refill.remove(false));
+    if (!imsi)
+	return false;
+    AuthPool* pool = findPool(*imsi,false);
+    TelEngine::destruct(imsi);
+    if (!pool)
+	return false;
+    pool->m_queued = false;
+    if (pool->m_count >= m_depth)
+	return true;
+    // Copy what is needed and compute without holding the lock
+    String id = *pool;
+    bool comp = pool->m_comp128;
+    String ki = pool->m_ki;
+    String op = pool->m_op;
+    uint64_t sqn = pool->m_nextSqn;
+    unsigned int n = m_depth - pool->m_count;
+    uint64_t step = m_sqnStep;
+    lck.drop();
+
+    unsigned char k[16], o[16], rand[16];
+    if (!unHex(ki,k,16) || (!comp && !unHex(op,o,16)))
+	return false;
+    MilenageCtx ctx;
+    if (!comp)
+	MilenageSetup(&ctx,k,o);
+    ObjList vectors;
+    ObjList* add = &vectors;
+    for (unsigned int i = 0; i < n; i++) {
+	AuthVector* v = new AuthVector((sqn + i * step) & AUTH_SQN_MASK);
+	random(rand);
+	if (comp)
+	    comp128Vector(*v,k,rand);
+	else
+	    milenageVector(*v,ctx,rand);
+	add = add->append(v);
+    }
+
+    lck.acquire(m_poolMutex);
+    pool = findPool(id,false);
+    // Drop the results if the subscriber changed while computing
+    if (!pool || !pool->sameKey(comp,ki,op) || pool->m_nextSqn != sqn)
+	return true;
+    add = &pool->m_vectors;
+    while (add->next())
+	add = add->next();
+    while (GenObject* v = vectors.remove(false)) {
+	add = add->append(v);
+	pool->m_count++;
+    }
+    pool->m_nextSqn = (sqn + n * step) & AUTH_SQN_MASK;
+    m_computed += n;
+    XDebug(this,DebugAll,"Precomputed %u vectors for %s",n,id.c_str());
+    return true;
+}
+
+bool AuthModule::authenticate(Message& msg)
+{
+    const String& proto = msg[YSTRING("protocol")];
+    const String& ki = msg[YSTRING("ki")];
+    const String& imsi = msg[YSTRING("imsi")];
+    bool prime = msg.getBoolValue(YSTRING("prime"));
+    bool ok = false;
+    if (proto == YSTRING("comp128"))
+	ok = comp128(msg,ki,imsi,prime);
+    else if (proto == YSTRING("milenage"))
+	ok = milenage(msg,ki,msg[YSTRING("op")],imsi,prime);
+    else
+	return false;
+    Lock lck(m_poolMutex);
+    if (!prime)
+	m_requests++;
+    if (!ok)
+	m_failed++;
+    return ok;
+}
+
+bool AuthModule::comp128(Message& msg, const String& ki, const String& imsi, bool prime)
+{
+    const String& op = msg[YSTRING("op")];
+    // Only COMP128 version 1 is implemented
+    if (op == YSTRING("2") || op == YSTRING("3"))
+	return false;
+    unsigned char k[16], rand[16];
+    if (!unHex(ki,k,16))
+	return false;
+    const String& r = msg[YSTRING("rand")];
+    if (r) {
+	if (!unHex(r,rand,16))
+	    return false;
+	AuthVector v;
+	comp128Vector(v,k,rand);
+	v.fill(msg,true);
+	return true;
+    }
+    // No challenge provided, use or refill the subscriber pool
+    Lock lck(m_poolMutex);
+    AuthPool* pool = findPool(imsi,true);
+    if (pool && !pool->sameKey(true,ki,String::empty()))
+	pool->reset(true,ki,String::empty(),0);
+    AuthVector* v = (pool && !prime) ? pool->take(0) : 0;
+    if (!prime) {
+	if (v)
+	    m_hits++;
+	else if (pool)
+	    m_misses++;
+    }
+    queueRefill(pool);
+    lck.drop();
+    if (prime)
+	return true;
+    if (!v) {
+	v = new AuthVector;
+	random(rand);
+	comp128Vector(*v,k,rand);
+    }
+    v->fill(msg,true);
+    TelEngine::destruct(v);
+    return true;
+}
+
+bool AuthModule::milenage(Message& msg, const String& ki, const String& op,
+    const String& imsi, bool prime)
+{
+    unsigned char k[16], o[16], rand[16], sqn[6], amf[2] = { 0, 0 };
+    if (!(unHex(ki,k,16) && unHex(op,o,16)))
+	return false;
+    const String& r = msg[YSTRING("rand")];
+    if (r && !unHex(r,rand,16))
+	return false;
+    const String& s = msg[YSTRING("sqn")];
+    if (s.null()) {
+	if (r.null())
+	    return false;
+	unsigned char mac[8], ak[6], autn[16];
+	MilenageCtx ctx;
+	MilenageSetup(&ctx,k,o);
+	const String& auts = msg[YSTRING("auts")];
+	if (auts) {
+	    // Resynchronization, recover the SQN of the MS
+	    unsigned char a[14];
+	    if (!unHex(auts,a,14))
+		return false;
+	    MilenageF5star(&ctx,rand,ak);
+	    for (int i = 0; i < 6; i++)
+		sqn[i] = ak[i] ^ a[i];
+	    MilenageF1(&ctx,rand,sqn,amf,0,mac);
+	    if (::memcmp(mac,a + 6,8))
+		return false;
+	    String tmp;
+	    msg.setParam("sqn",toHex(tmp,sqn,6));
+	    return true;
+	}
+	// Network authentication as seen by the MS
+	if (!unHex(msg[YSTRING("autn")],autn,16))
+	    return false;
+	unsigned char xres[8], ck[16], ik[16];
+	MilenageF2345(&ctx,rand,xres,ck,ik,ak);
+	for (int i = 0; i < 6; i++)
+	    sqn[i] = ak[i] ^ autn[i];
+	MilenageF1(&ctx,rand,sqn,autn + 6,mac,0);
+	if (::memcmp(mac,autn + 8,8))
+	    return false;
+	String tmp;
+	msg.setParam("xres",toHex(tmp,xres,8));
+	msg.setParam("ck",toHex(tmp,ck,16));
+	msg.setParam("ik",toHex(tmp,ik,16));
+	return true;
+    }
+    if (!unHex(s,sqn,6))
+	return false;
+    uint64_t seq = sqnFromBytes(sqn);
+    AuthVector* v = 0;
+    if (r.null()) {
+	// No challenge provided, use or refill the subscriber pool
+	Lock lck(m_poolMutex);
+	AuthPool* pool = findPool(imsi,true);
+	if (pool && !pool->sameKey(false,ki,op))
+	    pool->reset(false,ki,op,seq);
+	else if (pool && prime) {
+	    // Realign the pool to the SQN the subscriber will use next
+	    AuthVector* f = static_cast<AuthVector*>(pool->m_vectors.get());
+	    if (f ? (f->m_sqn != seq) : (pool->m_nextSqn != seq))
+		pool->reset(false,ki,op,seq);
+	}
+	if (pool && !prime) {
+	    v = pool->take(seq);
+	    if (v)
+		m_hits++;
+	    else {
+		m_misses++;
+		// Vectors are no longer in sequence, restart after this one
+		pool->reset(false,ki,op,(seq + m_sqnStep) & AUTH_SQN_MASK);
+	    }
+	}
+	queueRefill(pool);
+	lck.drop();
+	if (prime)
+	    return true;
+	if (!v)
+	    random(rand);
+    }
+    if (!v) {
+	MilenageCtx ctx;
+	MilenageSetup(&ctx,k,o);
+	v = new AuthVector(seq);
+	milenageVector(*v,ctx,rand);
+    }
+    v->fill(msg,false);
+    TelEngine::destruct(v);
+    return true;
+}
+
+}; // anonymous namespace
+
+/* vi: set ts=8 sw=4 sts=4 noet: */
@@ -43,6 +43,7 @@ int main(int argc, char **argv)
 	u8 rand[16], key[16], op[16], sqn[6], amf[2];
 	u8 xres[8], ck[16], ik[16], autn[16], auts[14];
 	u8 mac_a[8], ak[6];
+	MilenageCtx ctx;
 	int i;
 	int ms = 0;
 	int sync = 0;
@@ -81,10 +82,11 @@ int main(int argc, char **argv)
 		rand[i] = (hextoint(argv[4][2*i+2])<<4)
 			 | hextoint(argv[4][2*i+3]);
 	amf[1] = amf[0] = 0;
+	MilenageSetup(&ctx, key, op);
 
 	if (ms) {
 		/* compute xres, ck, ik, ak */
-		f2345(key, rand, xres, ck, ik, ak, op);
+		MilenageF2345(&ctx, rand, xres, ck, ik, ak);
 		/* unobscure sqn of the AuC */
 		for (i=0; i<6; i++)
 			sqn[i] = ak[i] ^ autn[i];
@@ -92,7 +94,7 @@ int main(int argc, char **argv)
 		amf[0] = autn[6];
 		amf[1] = autn[7];
 		/* compute mac_a */
-		f1(key, rand, sqn, amf, mac_a, op);
+		MilenageF1(&ctx, rand, sqn, amf, mac_a, NULL);
 		for (i=0; i<8; i++)
 			if (mac_a[i] != autn[i+8])
 				return 0;
@@ -111,12 +113,12 @@ int main(int argc, char **argv)
 
 	if (sync) {
 		/* compute ak */
-		f5star(key, rand, ak, op);
+		MilenageF5star(&ctx, rand, ak);
 		/* unobscure sqn of the MS */
 		for (i=0; i<6; i++)
 			sqn[i] = ak[i] ^ auts[i];
 		/* compute mac_s using the recovered sqn */
-		f1star(key, rand, sqn, amf, mac_a, op);
+		MilenageF1(&ctx, rand, sqn, amf, NULL, mac_a);
 		for (i=0; i<8; i++)
 			if (mac_a[i] != auts[i+6])
 				return 0;
@@ -128,9 +130,9 @@ int main(int argc, char **argv)
 	}
 
 	/* compute mac_a */
-	f1(key, rand, sqn, amf, mac_a, op);
+	MilenageF1(&ctx, rand, sqn, amf, mac_a, NULL);
 	/* compute xres, ck, ik, ak */
-	f2345(key, rand, xres, ck, ik, ak, op);
+	MilenageF2345(&ctx, rand, xres, ck, ik, ak);
 	for (i=0; i<6; i++)
 		autn[i] = sqn[i] ^ ak[i];
 	autn[6] = amf[0];
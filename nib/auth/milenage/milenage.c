@@ -283,3 +283,120 @@ void ComputeOPc( u8 op_c[16], u8 op[16] )
 
   return;
 } /* end of function ComputeOPc */
+
+
+/*-------------------------------------------------------------------
+ *  Reentrant versions of the algorithms. They compute exactly what
+ *  the functions above do but keep the key schedule and OPc in a
+ *  caller held context so they can run concurrently and do not
+ *  repeat the key setup for every function.
+ *-----------------------------------------------------------------*/
+
+void MilenageSetup( MilenageCtx *ctx, const u8 k[16], const u8 op[16] )
+{
+  u8 i;
+
+  RijndaelCtxSchedule( &ctx->cipher, k );
+  RijndaelCtxEncrypt( &ctx->cipher, op, ctx->op_c );
+  for (i=0; i<16; i++)
+    ctx->op_c[i] ^= op[i];
+}
+
+/* Encrypt RAND xor OPc, the TEMP value shared by all functions */
+static void MilenageTemp( const MilenageCtx *ctx, const u8 rand[16],
+                          u8 temp[16] )
+{
+  u8 rijndaelInput[16];
+  u8 i;
+
+  for (i=0; i<16; i++)
+    rijndaelInput[i] = rand[i] ^ ctx->op_c[i];
+  RijndaelCtxEncrypt( &ctx->cipher, rijndaelInput, temp );
+}
+
+/* Compute one OUT block: TEMP xor OPc rotated by r bytes, xor c */
+static void MilenageOut( const MilenageCtx *ctx, const u8 temp[16],
+                         u8 r, u8 c, u8 out[16] )
+{
+  u8 rijndaelInput[16];
+  u8 i;
+
+  for (i=0; i<16; i++)
+    rijndaelInput[(i+r) % 16] = temp[i] ^ ctx->op_c[i];
+  rijndaelInput[15] ^= c;
+  RijndaelCtxEncrypt( &ctx->cipher, rijndaelInput, out );
+  for (i=0; i<16; i++)
+    out[i] ^= ctx->op_c[i];
+}
+
+void MilenageF1( const MilenageCtx *ctx, const u8 rand[16],
+                 const u8 sqn[6], const u8 amf[2],
+                 u8 mac_a[8], u8 mac_s[8] )
+{
+  u8 temp[16];
+  u8 in1[16];
+  u8 out1[16];
+  u8 rijndaelInput[16];
+  u8 i;
+
+  MilenageTemp( ctx, rand, temp );
+
+  for (i=0; i<6; i++)
+  {
+    in1[i]    = sqn[i];
+    in1[i+8]  = sqn[i];
+  }
+  for (i=0; i<2; i++)
+  {
+    in1[i+6]  = amf[i];
+    in1[i+14] = amf[i];
+  }
+
+  for (i=0; i<16; i++)
+    rijndaelInput[(i+8) % 16] = in1[i] ^ ctx->op_c[i];
+  for (i=0; i<16; i++)
+    rijndaelInput[i] ^= temp[i];
+
+  RijndaelCtxEncrypt( &ctx->cipher, rijndaelInput, out1 );
+  for (i=0; i<16; i++)
+    out1[i] ^= ctx->op_c[i];
+
+  if (mac_a)
+    for (i=0; i<8; i++)
+      mac_a[i] = out1[i];
+  if (mac_s)
+    for (i=0; i<8; i++)
+      mac_s[i] = out1[i+8];
+}
+
+void MilenageF2345( const MilenageCtx *ctx, const u8 rand[16],
+                    u8 res[8], u8 ck[16], u8 ik[16], u8 ak[6] )
+{
+  u8 temp[16];
+  u8 out[16];
+  u8 i;
+
+  MilenageTemp( ctx, rand, temp );
+
+  MilenageOut( ctx, temp, 0, 1, out );
+  for (i=0; i<8; i++)
+    res[i] = out[i+8];
+  for (i=0; i<6; i++)
+    ak[i]  = out[i];
+
+  MilenageOut( ctx, temp, 12, 2, ck );
+  MilenageOut( ctx, temp, 8, 4, ik );
+}
+
+void MilenageF5star( const MilenageCtx *ctx, const u8 rand[16],
+                     u8 ak[6] )
+{
+  u8 temp[16];
+  u8 out[16];
+  u8 i;
+
+  MilenageTemp( ctx, rand, temp );
+  MilenageOut( ctx, temp, 4, 8, out );
+  for (i=0; i<6; i++)
+    ak[i] = out[i];
+}
@@ -19,7 +19,7 @@
 #ifndef MILENAGE_H
 #define MILENAGE_H
 
-typedef unsigned char u8;
+#include "rijndael.h"
 
 
 void f1    ( u8 k[16], u8 rand[16], u8 sqn[6], u8 amf[2],
@@ -32,5 +32,24 @@ void f5star( u8 k[16], u8 rand[16],
              u8 ak[6], u8 op[16] );
 void ComputeOPc( u8 op_c[16], u8 op[16] );
 
+/*-------------------------------------------------------------------
+ *  Reentrant interface. The key schedule and OPc are computed once
+ *  in the context and reused for every function of a subscriber.
+ *-----------------------------------------------------------------*/
+
+typedef struct {
+  RijndaelCtx cipher;
+  u8 op_c[16];
+} MilenageCtx;
+
+void MilenageSetup ( MilenageCtx *ctx, const u8 k[16], const u8 op[16] );
+void MilenageF1    ( const MilenageCtx *ctx, const u8 rand[16],
+                     const u8 sqn[6], const u8 amf[2],
+                     u8 mac_a[8], u8 mac_s[8] );
+void MilenageF2345 ( const MilenageCtx *ctx, const u8 rand[16],
+                     u8 res[8], u8 ck[16], u8 ik[16], u8 ak[6] );
+void MilenageF5star( const MilenageCtx *ctx, const u8 rand[16],
+                     u8 ak[6] );
+
 
 #endif
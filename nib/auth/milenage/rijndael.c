@@ -21,8 +21,22 @@
 
 /* #define LITTLE_ENDIAN For INTEL architecture */
 
-typedef unsigned char   u8;
-typedef unsigned int	 u32;
+#include "rijndael.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && \
+    ((__GNUC__ > 4) || ((__GNUC__ == 4) && (__GNUC_MINOR__ >= 9)))
+#define RIJNDAEL_AESNI
+#include <wmmintrin.h>
+#include <cpuid.h>
+#endif
+
+/* Don't rely on LITTLE_ENDIAN, system headers define it on every host */
+#undef LITTLE_ENDIAN
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+#define LITTLE_ENDIAN
+#elif defined(__i386__) || defined(__x86_64__)
+#define LITTLE_ENDIAN
+#endif
 
 /* Circular byte rotates of 32 bit values */
 
@@ -50,15 +64,15 @@ typedef unsigned int	 u32;
 
 /* Invert byte order in a 32 bit variable */
 
-__inline u32 byte_swap(const u32 x)
+static __inline u32 byte_swap(const u32 x)
 {
     return rot1(x) & 0x00ff00ff | rot3(x) & 0xff00ff00;
 }
-__inline u32 u32_in(const u8 x[])
+static __inline u32 u32_in(const u8 x[])
 {
   return byte_swap(*(u32*)x);
 };
-__inline void u32_out(u8 x[], const u32 v) 
+static __inline void u32_out(u8 x[], const u32 v) 
 {
   *(u32*)x = byte_swap(v);
 };
@@ -389,7 +403,7 @@ static u32 Ekey[44];	/* The expanded key */
  * RijndaelKeySchedule
  *   Initialise the key schedule from a supplied key
  */
-void RijndaelKeySchedule(u8 key[16])
+static void KeySchedule(u32 *Ekey, const u8 key[16])
 {
     u32  t;
     u32  *ek=Ekey,	    /* pointer to the expanded key   */
@@ -411,13 +425,9 @@ void RijndaelKeySchedule(u8 key[16])
     }
 }
 
-/*-----------------------------------------------------------
- * RijndaelEncrypt
- *   Encrypt an input block
- */
-void RijndaelEncrypt(u8 in[16], u8 out[16])
+static void Encrypt(const u32 *kp, const u8 in[16], u8 out[16])
 {
-    u32    b0[4], b1[4], *kp = Ekey;
+    u32    b0[4], b1[4];
 
     b0[0] = u32_in(in     ) ^ *kp++;
     b0[1] = u32_in(in +  4) ^ *kp++;
@@ -439,3 +449,124 @@ void RijndaelEncrypt(u8 in[16], u8 out[16])
     u32_out(out +  8, lf_rnd(b1, 2) ^ kp[2]); 
     u32_out(out + 12, lf_rnd(b1, 3) ^ kp[3]);
 }
+
+/*-----------------------------------------------------------
+ * RijndaelKeySchedule
+ *   Initialise the key schedule from a supplied key
+ */
+void RijndaelKeySchedule(u8 key[16])
+{
+    KeySchedule(Ekey, key);
+}
+
+/*-----------------------------------------------------------
+ * RijndaelEncrypt
+ *   Encrypt an input block
+ */
+void RijndaelEncrypt(u8 in[16], u8 out[16])
+{
+    Encrypt(Ekey, in, out);
+}
+
+/*------------------ AES-NI implementation ---------------------*/
+
+#ifdef RIJNDAEL_AESNI
+
+__attribute__((target("aes,sse2")))
+static __m128i aesni_expand(__m128i key, __m128i gen)
+{
+    gen = _mm_shuffle_epi32(gen, 0xff);
+    key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+    key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+    key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+    return _mm_xor_si128(key, gen);
+}
+
+#define aesni_round_key(rk, n, rcon) \
+    rk[n] = aesni_expand(rk[n - 1], _mm_aeskeygenassist_si128(rk[n - 1], rcon))
+
+__attribute__((target("aes,sse2")))
+static void aesni_schedule(u8 rkey[176], const u8 key[16])
+{
+    __m128i rk[11];
+    int i;
+
+    rk[0] = _mm_loadu_si128((const __m128i *)key);
+    aesni_round_key(rk, 1, 0x01);
+    aesni_round_key(rk, 2, 0x02);
+    aesni_round_key(rk, 3, 0x04);
+    aesni_round_key(rk, 4, 0x08);
+    aesni_round_key(rk, 5, 0x10);
+    aesni_round_key(rk, 6, 0x20);
+    aesni_round_key(rk, 7, 0x40);
+    aesni_round_key(rk, 8, 0x80);
+    aesni_round_key(rk, 9, 0x1b);
+    aesni_round_key(rk, 10, 0x36);
+    for (i = 0; i < 11; i++)
+        _mm_storeu_si128((__m128i *)(rkey + 16 * i), rk[i]);
+}
+
+__attribute__((target("aes,sse2")))
+static void aesni_encrypt(const u8 rkey[176], const u8 in[16], u8 out[16])
+{
+    const __m128i *rk = (const __m128i *)rkey;
+    __m128i b = _mm_xor_si128(_mm_loadu_si128((const __m128i *)in),
+                              _mm_loadu_si128(rk));
+    int i;
+
+    for (i = 1; i < 10; i++)
+        b = _mm_aesenc_si128(b, _mm_loadu_si128(rk + i));
+    b = _mm_aesenclast_si128(b, _mm_loadu_si128(rk + 10));
+    _mm_storeu_si128((__m128i *)out, b);
+}
+
+#endif /* RIJNDAEL_AESNI */
+
+/*-----------------------------------------------------------
+ * RijndaelHaveAesNi
+ *   Check if the processor supports the AES instructions
+ */
+int RijndaelHaveAesNi(void)
+{
+#ifdef RIJNDAEL_AESNI
+    static int aesni = -1;
+    unsigned int a, b, c, d;
+
+    if (aesni < 0)
+        aesni = (__get_cpuid(1, &a, &b, &c, &d) && (c & bit_AES)) ? 1 : 0;
+    return aesni;
+#else
+    return 0;
+#endif
+}
+
+/*-----------------------------------------------------------
+ * RijndaelCtxSchedule
+ *   Initialise a caller held key schedule
+ */
+void RijndaelCtxSchedule(RijndaelCtx *ctx, const u8 key[16])
+{
+    ctx->aesni = RijndaelHaveAesNi();
+#ifdef RIJNDAEL_AESNI
+    if (ctx->aesni) {
+        aesni_schedule(ctx->rkey, key);
+        return;
+    }
+#endif
+    KeySchedule(ctx->ekey, key);
+}
+
+/*-----------------------------------------------------------
+ * RijndaelCtxEncrypt
+ *   Encrypt an input block with a caller held key schedule
+ */
+void RijndaelCtxEncrypt(const RijndaelCtx *ctx, const u8 in[16], u8 out[16])
+{
+#ifdef RIJNDAEL_AESNI
+    if (ctx->aesni) {
+        aesni_encrypt(ctx->rkey, in, out);
+        return;
+    }
+#endif
+    Encrypt(ctx->ekey, in, out);
+}
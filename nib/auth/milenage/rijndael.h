@@ -19,9 +19,32 @@
 #ifndef RIJNDAEL_H
 #define RIJNDAEL_H
 
+#ifndef RIJNDAEL_TYPES
+#define RIJNDAEL_TYPES
+typedef unsigned char u8;
+typedef unsigned int  u32;
+#endif
+
 
 void RijndaelKeySchedule( u8 key[16] );
 void RijndaelEncrypt( u8 input[16], u8 output[16] );
 
+/*-------------------------------------------------------------------
+ *  Reentrant interface. The expanded key is held by the caller so
+ *  several keys can be used at once from different threads. On x86
+ *  processors that support it the AES-NI instructions are used.
+ *-----------------------------------------------------------------*/
+
+typedef struct {
+  u32 ekey[44];     /* table driven expanded key */
+  u8  rkey[176];    /* round keys for AES-NI */
+  int aesni;        /* set if rkey is valid and AES-NI is used */
+} RijndaelCtx;
+
+int  RijndaelHaveAesNi( void );
+void RijndaelCtxSchedule( RijndaelCtx *ctx, const u8 key[16] );
+void RijndaelCtxEncrypt( const RijndaelCtx *ctx, const u8 input[16],
+                         u8 output[16] );
+
 
 #endif
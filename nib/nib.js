@@ -75,8 +75,45 @@ function rand128()
     return rand32() + rand32() + rand32() + rand32();
 }
  
+// Query the nibcache module, return the handled message or null
+function cacheQuery(oper,params)
+{
+    if (!nib_cache)
+	return null;
+    var m = new Message("nib.cache");
+    m.operation = oper;
+    if (params) {
+	for (var p in params)
+	    m[p] = params[p];
+    }
+    if (m.dispatch())
+	return m;
+    return null;
+}
+
+// Check if nibcache is loaded and give it the configured subscribers
+function loadCache()
+{
+    var m = new Message("nib.cache");
+    m.operation = "status";
+    nib_cache = m.dispatch();
+    if (!nib_cache) {
+	Engine.debug(Engine.DebugNote,"Module nibcache is not loaded, lookups will scan all subscribers");
+	return;
+    }
+    cacheQuery("clear");
+    if (subscribers == undefined)
+	return;
+    for (var imsi in subscribers) {
+	var sub = subscribers[imsi];
+	cacheQuery("subscriber",{"imsi":imsi, "msisdn":sub.msisdn, "short_number":sub.short_number, "active":(sub.active==1)});
+    }
+}
+
 function numberAvailable(val)
 {
+    if (nib_cache)
+	return cacheQuery("registered",{"msisdn":val}) == null;
     if (regUsers["+"+val]==undefined)
 	return true;
     return false;
@@ -144,6 +181,13 @@ function getRegUserMsisdn(imsi)
 {
     var msisdn_key;
 
+    if (nib_cache) {
+	var m = cacheQuery("registered",{"imsi":imsi});
+	if (m)
+	    return m.msisdn;
+	return false;
+    }
+
     for (msisdn_key in regUsers)
 	if (regUsers[msisdn_key] == imsi)
 	    return msisdn_key;
@@ -173,6 +217,13 @@ function getSubscriberIMSI(msisdn)
 
 //    Engine.debug(Engine.DebugInfo,"getSubscriberIMSI, msisdn="+msisdn);
 
+    if (nib_cache) {
+	var m = cacheQuery("find",{"number":msisdn});
+	if (m)
+	    return m.imsi;
+	return false;
+    }
+
     for (imsi_key in subscribers) {
 	nr = subscribers[imsi_key].msisdn;
 	//Engine.debug("nr="+nr);
@@ -248,6 +299,13 @@ function isShortNumber(called)
 	// subscribers is not defined so we don't have short numbers
 	return called;
 
+    if (nib_cache) {
+	var m = cacheQuery("find",{"short_number":called});
+	if (m)
+	    return m.msisdn;
+	return called;
+    }
+
     for (imsi_key in subscribers) {
 	if (subscribers[imsi_key].short_number==called)
 	    return subscribers[imsi_key].msisdn;
@@ -269,6 +327,14 @@ function routeOutside(msg,called)
 
 function routeToRegUser(msg,called)
 {
+    if (nib_cache) {
+	var m = cacheQuery("registered",{"number":called});
+	if (!m)
+	    return false;
+	msg.retValue(getRouteToIMSI(m.imsi));
+	return true;
+    }
+
     for (number in regUsers) {
 	imsi = regUsers[number];
 	if (number.substr(0,1)=="+")
@@ -297,33 +363,60 @@ function onInterval()
     }
 }
 
+// Queue a SMS for delivery after a number of seconds
+function queueSMS(sms,delay)
+{
+    if (nib_cache) {
+	sms.delay = delay;
+	if (cacheQuery("sms_add",sms))
+	    return;
+    }
+    sms.next_try = (Date.now() / 1000) + delay;
+    pendingSMSs.push(sms);
+}
+
+// Try to deliver a SMS, queue it again if it failed
+function deliverSMS(sms)
+{
+    if (moLocalDelivery(sms)==false) {
+	sms.tries = sms.tries - 1;
+	if (sms.tries>=0) {
+	    // if number of attempts to deliver wasn't excedeed retry after 5 seconds
+	    queueSMS(sms,5);
+	    Engine.debug(Engine.DebugInfo,"Could not deliver sms from imsi "+sms.imsi+" to number "+sms.dest+".");
+	} else
+	    Engine.debug(Engine.DebugInfo,"Droped sms from imsi "+sms.imsi+" to number "+sms.dest+". Exceeded attempts.");
+    } else
+	Engine.debug(Engine.DebugInfo,"Delivered sms from imsi "+sms.imsi+" to number "+sms.dest);
+}
+
 // Execute idle loop actions
 function onIdleAction()
 {
-    // check if we have any SMSs to send
-    if (pendingSMSs.length>0) {
-	// check if sms from first position is ready to be delivered
-	if (pendingSMSs[0].next_try<=Date.now()) {
-	    // retrieve sms from first position and remove it
-	    var sms = pendingSMSs.shift();
-	    res = moLocalDelivery(sms);
-	    if (res==false) {
-		sms.tries = sms.tries - 1;
-		if (sms.tries>=0) {
-		    // if number of attempts to deliver wasn't excedeed push it on last position
-		    // add sms at the end of pending SMSs
-		    sms.next_try = (Date.now() / 1000) + 5; // current time + 5 seconds 
-		    pendingSMSs.push(sms);
-		    Engine.debug(Engine.DebugInfo,"Could not deliver sms from imsi "+sms.imsi+" to number "+sms.dest+".");
-		} else
-		    Engine.debug(Engine.DebugInfo,"Droped sms from imsi "+sms.imsi+" to number "+sms.dest+". Exceeded attempts.");
-	    } else
-		Engine.debug(Engine.DebugInfo,"Delivered sms from imsi "+sms.imsi+" to number "+sms.dest);
+    var delay = 5;
+    if (nib_cache) {
+	// deliver the SMSs that are due, nibcache keeps them ordered by time
+	// each delivery may wait for paging, so only a few are sent per pass
+	var m;
+	for (var n = 0; n < sms_idle_max; n++) {
+	    m = cacheQuery("sms_due");
+	    if (!m)
+		break;
+	    var sms = {"imsi":m.imsi, "msisdn":m.msisdn, "smsc":m.smsc, "dest":m.dest, "dest_imsi":m.dest_imsi, "tries":m.tries, "msg":m.msg};
+	    deliverSMS(sms);
 	}
+	// more may be due, come back sooner
+	if (m)
+	    delay = 1;
+    }
+    else if (pendingSMSs.length>0) {
+	// check if sms from first position is ready to be delivered
+	if (pendingSMSs[0].next_try<=(Date.now() / 1000))
+	    deliverSMS(pendingSMSs.shift());
     }
 
-    // Reschedule after 5s
-    onInterval.nextIdle = (Date.now() / 1000) + 5;
+    // Reschedule after 5s, or 1s if the pass was cut short
+    onInterval.nextIdle = (Date.now() / 1000) + delay;
 }
 
 // Deliver SMS to registered MS in MT format
@@ -359,8 +452,8 @@ function onElizaSMS(msg, imsi_orig, dest, msisdn)
     //Engine.debug(Engine.DebugInfo,"Calling eliza with text='"+msg.text+"' from imsi "+imsi_orig);
     var answer = chatWithBot(msg.text,imsi_orig);
 
-    var sms = {"imsi":"nib_smsc", "msisdn":eliza_number,"smsc":nib_smsc_number, "dest":msisdn, "dest_imsi":imsi_orig, "next_try":try_time, "tries": sms_attempts, "msg":answer};
-    pendingSMSs.push(sms);
+    var sms = {"imsi":"nib_smsc", "msisdn":eliza_number,"smsc":nib_smsc_number, "dest":msisdn, "dest_imsi":imsi_orig, "tries": sms_attempts, "msg":answer};
+    queueSMS(sms,5);
 
     return true;
 }
@@ -395,17 +488,16 @@ function onSMS(msg)
 	return true;
     }
     
-    var sms = {"imsi":imsi_orig, "msisdn":msisdn,"smsc": msg.called, "dest":dest, "dest_imsi":dest_imsi, "next_try":Date.now(), "tries": sms_attempts, "msg":msg.text};
-    pendingSMSs.push(sms);
+    var sms = {"imsi":imsi_orig, "msisdn":msisdn,"smsc": msg.called, "dest":dest, "dest_imsi":dest_imsi, "tries": sms_attempts, "msg":msg.text};
+    queueSMS(sms,0);
 
     return true;
 }
 
 function message(msg, dest_imsi, dest_msisdn)
 {
-    var try_time = (Date.now()/1000) + 5;
-    var sms = {"imsi":"nib_smsc", "msisdn":nib_smsc_number,"smsc":nib_smsc_number, "dest":dest_msisdn, "dest_imsi":dest_imsi, "next_try":try_time, "tries": sms_attempts, "msg":msg};
-    pendingSMSs.push(sms);
+    var sms = {"imsi":"nib_smsc", "msisdn":nib_smsc_number,"smsc":nib_smsc_number, "dest":dest_msisdn, "dest_imsi":dest_imsi, "tries": sms_attempts, "msg":msg};
+    queueSMS(sms,5);
 }
 
 function sendGreetingMessage(imsi, msisdn)
@@ -539,17 +631,18 @@ function startAuth(msg,imsi)
     }
 
     if (imsi_type=="3G") {
-	rand = rand128();
+	// Let the authentication engine pick the challenge, it may be precomputed
 	var m = new Message("gsm.auth");
 	m.protocol = "milenage";
+	m.imsi = imsi;
 	m.ki = ki;
 	m.op = op;
-	m.rand = rand;
 	m.sqn = sqn;
 	if (!m.dispatch(true)) {
 	    msg.error = "failure";
 	    return false;
 	}
+	var rand = m.rand;
 	// Increment the sequence without changing index
 	sqn = 0xffffffffffff & (0x20 + parseInt(sqn,16));
 	sqn = strFix(sqn.toString(16),-12,'0');
@@ -570,16 +663,16 @@ function startAuth(msg,imsi)
 	return false;
     } 
     else {
-	rand = rand128();
 	var m = new Message("gsm.auth");
 	m.protocol = "comp128";
+	m.imsi = imsi;
 	m.ki = ki;
 	m.op = op;
-	m.rand = rand;
 	if (!m.dispatch(true)) {
 	    msg.error = "failure";
 	    return false;
 	}
+	var rand = m.rand;
 	// remember sres
 	subscribers[imsi]["sres"] = m.sres;
 	// Populate message with auth params
@@ -589,6 +682,30 @@ function startAuth(msg,imsi)
     }
 }
 
+// Ask the authentication engine to prepare vectors for known subscribers
+function primeAuth()
+{
+    if (subscribers == undefined)
+	return;
+    for (var imsi in subscribers) {
+	var sub = subscribers[imsi];
+	if (sub.ki=="" || sub.ki==null)
+	    continue;
+	var m = new Message("gsm.auth");
+	m.prime = true;
+	m.imsi = imsi;
+	m.ki = sub.ki;
+	m.op = sub.op;
+	if (sub.imsi_type=="3G") {
+	    m.protocol = "milenage";
+	    m.sqn = (sub.sqn == "") ? "000000000000" : sub.sqn;
+	}
+	else
+	    m.protocol = "comp128";
+	m.enqueue();
+    }
+}
+
 function checkAuth(msg,imsi)
 {
     var res;
@@ -688,7 +805,10 @@ function onRegister(msg)
     // if we do this, in the future it will be copied in call.route messages(after this is implemented in ybts.cpp)
     msg.msisdn = msisdn;
 
-    regUsers[msisdn] = imsi;
+    if (nib_cache)
+	cacheQuery("register",{"imsi":imsi, "msisdn":msisdn});
+    else
+	regUsers[msisdn] = imsi;
     Engine.debug(Engine.DebugInfo,"Registered imsi "+imsi+" with number "+msisdn);
     return true;
 }
@@ -708,7 +828,10 @@ function onUnregister(msg)
     }
     if (msisdn.substr(0,1)!="+")
 	msisdn = "+"+msisdn;   
-    delete regUsers[msisdn];
+    if (nib_cache)
+	cacheQuery("unregister",{"imsi":imsi, "msisdn":msisdn});
+    else
+	delete regUsers[msisdn];
 
     Engine.debug(Engine.DebugInfo,"Unregistered imsi "+imsi+" with msisdn "+msisdn);
     return true;
@@ -739,6 +862,16 @@ function onComplete(msg, line, part)
     }
 }
 
+// Put a table kept by nibcache in a command result
+function listCache(msg,table)
+{
+    var m = cacheQuery("list",{"table":table});
+    if (!m)
+	return false;
+    msg.retValue(m.retValue());
+    return true;
+}
+
 function onCommand(msg)
 {
     if (!msg.line) {
@@ -747,6 +880,8 @@ function onCommand(msg)
     }
     switch (msg.line) {
 	case "nib list registered":
+	    if (listCache(msg,"registered"))
+		return true;
 	    var tmp = "IMSI            MSISDN \r\n";
 	    tmp += "--------------- ---------------\r\n";
 	    for (var msisdn_key in regUsers)
@@ -755,6 +890,8 @@ function onCommand(msg)
 	    return true;
 
 	case "nib list sms":
+	    if (listCache(msg,"sms"))
+		return true;
 	    var tmp = "FROM_IMSI        FROM_MSISDN        TO_IMSI        TO_MSISDN\r\n";
 	    tmp += "--------------- --------------- --------------- ---------------\r\n";
 	    for (var i=0; i<pendingSMSs.length; i++)
@@ -778,7 +915,9 @@ var eliza_number = "35492";
 var david_number = "32843";
 var nib_smsc_number = "12345";
 var sms_attempts = 3;
+var sms_idle_max = 2;   // SMS delivered per idle pass when nibcache is loaded
 var regUsers = {};
+var nib_cache = false;
 var pendingSMSs = [];
 var seenIMSIs = {};  // imsi:count_rejected
 var ussd_sessions = {};
@@ -792,3 +931,5 @@ Message.install(onSMS,"msg.execute",80,"callto","nib_smsc");
 Message.install(onCommand,"engine.command",120);
 
 Engine.setInterval(onInterval,1000);
+loadCache();
+primeAuth();
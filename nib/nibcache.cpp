@@ -0,0 +1,524 @@
+/**
+ * nibcache.cpp
+ * This file is part of the Yate-BTS Project http://www.yatebts.com
+ *
+ * Subscriber and registration store for the Network In a Box script
+ *
+ * Yet Another Telephony Engine - Base Transceiver Station
+ * Copyright (C) 2014 Null Team Impex SRL
+ *
+ * This software is distributed under multiple licenses;
+ * see the COPYING file in the main directory for licensing
+ * information for this specific distribution.
+ *
+ * This use of this software may be subject to additional restrictions.
+ * See the LEGAL file in the main directory for details.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#include <yatephone.h>
+
+using namespace TelEngine;
+namespace { // anonymous
+
+// Default message handler priority
+#define NIB_PRIORITY_DEF 80
+// Default size of hash tables
+#define NIB_HASH_SIZE_DEF 1021
+// Default interval, in seconds, between two saves of the data file
+#define NIB_SAVE_INTERVAL_DEF 5
+
+class NibSubscriber;
+class NibSms;
+class NibHandler;
+class NibModule;
+
+// A subscriber configured in subscribers.js, the name is the IMSI
+class NibSubscriber : public String
+{
+public:
+    inline NibSubscriber(const String& imsi, const String& msisdn,
+	const String& shortNumber, bool active)
+	: String(imsi), m_msisdn(msisdn), m_shortNumber(shortNumber), m_active(active)
+	{}
+    String m_msisdn;
+    String m_shortNumber;
+    bool m_active;
+};
+
+// A pending MT SMS
+class NibSms : public NamedList
+{
+public:
+    inline NibSms(uint64_t nextTry)
+	: NamedList(""), m_nextTry(nextTry)
+	{}
+    uint64_t m_nextTry;                  // Next delivery attempt, in seconds
+};
+
+// nib.cache handler
+class NibHandler : public MessageHandler
+{
+public:
+    inline NibHandler(unsigned int priority)
+	: MessageHandler("nib.cache",priority,"nibcache")
+	{}
+    virtual bool received(Message& msg);
+};
+
+class NibModule : public Module
+{
+public:
+    NibModule();
+    ~NibModule();
+    virtual void initialize();
+    // Handle one nib.cache request
+    bool handle(Message& msg);
+protected:
+    virtual void statusParams(String& str);
+    virtual bool received(Message& msg, int id);
+private:
+    // Subscribers
+    void setSubscriber(const NamedList& params);
+    void removeSubscriber(const String& imsi);
+    NibSubscriber* findNumber(const String& number);
+    // Registrations
+    void setRegistered(const String& imsi, const String& msisdn);
+    bool removeRegistered(const String& imsi, const String& msisdn);
+    NamedString* findRegistered(const String& number);
+    // Pending SMS
+    void addSms(NibSms* sms);
+    void listRegistered(String& buf);
+    void listSms(String& buf);
+    // Data file
+    void load();
+    void save();
+    NibHandler* m_handler;
+    Mutex m_mutex;
+    HashList m_subscribers;              // Subscribers by IMSI
+    HashList m_byMsisdn;                 // Subscribers by MSISDN without leading +
+    HashList m_byShort;                  // Subscribers by short number
+    HashList m_regImsi;                  // Registered MSISDN (with leading +) by IMSI
+    HashList m_regNumber;                // Registered IMSI by MSISDN without leading +
+    ObjList m_sms;                       // Pending SMS ordered by next attempt
+    ObjList* m_smsLast;                  // Last item of the pending SMS list
+    String m_file;
+    bool m_changed;
+    uint64_t m_saveTime;
+    // Configuration
+    unsigned int m_saveInterval;
+    // Statistics
+    unsigned int m_requests;
+    unsigned int m_hits;
+};
+
+INIT_PLUGIN(NibModule);
+
+UNLOAD_PLUGIN(unloadNow)
+{
+    return true;
+}
+
+
+static inline const char* noPlus(const String& number)
+{
+    return number.c_str() + ((number.at(0) == '+') ? 1 : 0);
+}
+
+// Remove an index entry pointing to an IMSI
+static void removeIndex(HashList& index, const String& key, const String& imsi)
+{
+    if (key.null())
+	return;
+    ObjList* o = index.getHashList(key);
+    for (o = o ? o->skipNull() : 0; o; o = o->skipNext()) {
+	NamedString* ns = static_cast<NamedString*>(o->get());
+	if (ns->name() == key && *ns == imsi) {
+	    o->remove();
+	    return;
+	}
+    }
+}
+
+
+bool NibHandler::received(Message& msg)
+{
+    return __plugin.handle(msg);
+}
+
+
+NibModule::NibModule()
+    : Module("nibcache","misc"),
+      m_handler(0), m_mutex(false,"NibCache"),
+      m_subscribers(NIB_HASH_SIZE_DEF), m_byMsisdn(NIB_HASH_SIZE_DEF),
+      m_byShort(NIB_HASH_SIZE_DEF), m_regImsi(NIB_HASH_SIZE_DEF),
+      m_regNumber(NIB_HASH_SIZE_DEF), m_smsLast(&m_sms),
+      m_changed(false), m_saveTime(0),
+      m_saveInterval(NIB_SAVE_INTERVAL_DEF),
+      m_requests(0), m_hits(0)
+{
+    Output("Loaded module NIB Cache");
+}
+
+NibModule::~NibModule()
+{
+    Output("Unloading module NIB Cache");
+}
+
+void NibModule::initialize()
+{
+    Output("Initializing module NIB Cache");
+    Configuration cfg(Engine::configFile("nibcache"));
+    cfg.load();
+    NamedList dummy("");
+    NamedList* gen = cfg.getSection("general");
+    if (!gen)
+	gen = &dummy;
+    Lock lck(m_mutex);
+    m_saveInterval = gen->getIntValue("save_interval",NIB_SAVE_INTERVAL_DEF,0,3600);
+    if (m_handler)
+	return;
+    m_file = gen->getValue("datafile",Engine::configFile("nibdata"));
+    Engine::runParams().replaceParams(m_file);
+    load();
+    lck.drop();
+    setup();
+    installRelay(Halt);
+    installRelay(Timer);
+    m_handler = new NibHandler(gen->getIntValue("priority",NIB_PRIORITY_DEF,1));
+    Engine::install(m_handler);
+}
+
+void NibModule::statusParams(String& str)
+{
+    Lock lck(m_mutex);
+    str.append("subscribers=",",") << m_subscribers.count();
+    str << ",registered=" << m_regImsi.count();
+    str << ",sms=" << m_sms.count();
+    str << ",requests=" << m_requests;
+    str << ",hits=" << m_hits;
+}
+
+bool NibModule::received(Message& msg, int id)
+{
+    if (id == Timer) {
+	Lock lck(m_mutex);
+	if (m_changed && m_saveTime <= Time::secNow())
+	    save();
+    }
+    else if (id == Halt) {
+	Lock lck(m_mutex);
+	if (m_changed)
+	    save();
+    }
+    return Module::received(msg,id);
+}
+
+// Operations:
+// subscriber: add or replace subscriber 'imsi' (msisdn, short_number, active)
+// unsubscribe: remove subscriber 'imsi'
+// clear: remove all subscribers
+// find: subscriber by 'imsi', by 'number' (MSISDN suffix or short number)
+//  or by 'short_number'. Set imsi, msisdn, short_number, active
+// register: register 'imsi' with 'msisdn'
+// unregister: unregister 'imsi', optionally with a known 'msisdn'
+// registered: registration by 'imsi', by 'msisdn' or by 'number' (MSISDN suffix).
+//  Set imsi, msisdn
+// sms_add: queue a pending SMS, all parameters are kept.
+//  'delay' is the number of seconds until the delivery attempt
+// sms_due: retrieve and remove the first pending SMS due for delivery
+// list: return the 'registered' or 'sms' table
+bool NibModule::handle(Message& msg)
+{
+    const String& oper = msg[YSTRING("operation")];
+    Lock lck(m_mutex);
+    m_requests++;
+    bool ok = true;
+    if (oper == YSTRING("find")) {
+	NibSubscriber* sub = 0;
+	const String& imsi = msg[YSTRING("imsi")];
+	const String& shortNumber = msg[YSTRING("short_number")];
+	if (imsi)
+	    sub = static_cast<NibSubscriber*>(m_subscribers[imsi]);
+	else if (shortNumber) {
+	    NamedString* ns = static_cast<NamedString*>(m_byShort[shortNumber]);
+	    if (ns)
+		sub = static_cast<NibSubscriber*>(m_subscribers[*ns]);
+	}
+	else
+	    sub = findNumber(msg[YSTRING("number")]);
+	if (sub) {
+	    msg.setParam("imsi",*sub);
+	    msg.setParam("msisdn",sub->m_msisdn);
+	    msg.setParam("short_number",sub->m_shortNumber);
+	    msg.setParam("active",String::boolText(sub->m_active));
+	}
+	ok = (sub != 0);
+    }
+    else if (oper == YSTRING("registered")) {
+	NamedString* reg = 0;
+	const String& imsi = msg[YSTRING("imsi")];
+	const String& msisdn = msg[YSTRING("msisdn")];
+	if (imsi) {
+	    NamedString* ns = static_cast<NamedString*>(m_regImsi[imsi]);
+	    if (ns)
+		reg = static_cast<NamedString*>(m_regNumber[noPlus(*ns)]);
+	}
+	else if (msisdn)
+	    reg = static_cast<NamedString*>(m_regNumber[noPlus(msisdn)]);
+	else
+	    reg = findRegistered(msg[YSTRING("number")]);
+	if (reg) {
+	    msg.setParam("imsi",*reg);
+	    msg.setParam("msisdn","+" + reg->name());
+	}
+	ok = (reg != 0);
+    }
+    else if (oper == YSTRING("sms_due")) {
+	ObjList* o = m_sms.skipNull();
+	NibSms* sms = o ? static_cast<NibSms*>(o->get()) : 0;
+	ok = sms && sms->m_nextTry <= Time::secNow();
+	if (ok) {
+	    msg.copyParams(*sms);
+	    // Removing the head may free the node cached as last
+	    m_sms.remove(sms);
+	    m_smsLast = 0;
+	    m_changed = true;
+	}
+    }
+    else if (oper == YSTRING("sms_add")) {
+	NibSms* sms = new NibSms(Time::secNow() + msg.getIntValue(YSTRING("delay"),0,0));
+	sms->copyParams(msg);
+	sms->clearParam(YSTRING("operation"));
+	sms->clearParam(YSTRING("delay"));
+	addSms(sms);
+    }
+    else if (oper == YSTRING("register"))
+	setRegistered(msg[YSTRING("imsi")],msg[YSTRING("msisdn")]);
+    else if (oper == YSTRING("unregister"))
+	ok = removeRegistered(msg[YSTRING("imsi")],msg[YSTRING("msisdn")]);
+    else if (oper == YSTRING("subscriber"))
+	setSubscriber(msg);
+    else if (oper == YSTRING("unsubscribe"))
+	removeSubscriber(msg[YSTRING("imsi")]);
+    else if (oper == YSTRING("clear")) {
+	m_subscribers.clear();
+	m_byMsisdn.clear();
+	m_byShort.clear();
+    }
+    else if (oper == YSTRING("list")) {
+	const String& what = msg[YSTRING("table")];
+	if (what == YSTRING("registered"))
+	    listRegistered(msg.retValue());
+	else if (what == YSTRING("sms"))
+	    listSms(msg.retValue());
+	else
+	    ok = false;
+    }
+    else if (oper != YSTRING("status"))
+	ok = false;
+    if (ok)
+	m_hits++;
+    return ok;
+}
+
+void NibModule::setSubscriber(const NamedList& params)
+{
+    const String& imsi = params[YSTRING("imsi")];
+    if (imsi.null())
+	return;
+    removeSubscriber(imsi);
+    NibSubscriber* sub = new NibSubscriber(imsi,noPlus(params[YSTRING("msisdn")]),
+	params[YSTRING("short_number")],params.getBoolValue(YSTRING("active"),true));
+    m_subscribers.append(sub);
+    if (sub->m_msisdn)
+	m_byMsisdn.append(new NamedString(sub->m_msisdn,imsi));
+    if (sub->m_shortNumber)
+	m_byShort.append(new NamedString(sub->m_shortNumber,imsi));
+}
+
+void NibModule::removeSubscriber(const String& imsi)
+{
+    NibSubscriber* sub = static_cast<NibSubscriber*>(m_subscribers[imsi]);
+    if (!sub)
+	return;
+    removeIndex(m_byMsisdn,sub->m_msisdn,imsi);
+    removeIndex(m_byShort,sub->m_shortNumber,imsi);
+    m_subscribers.remove(sub);
+}
+
+// Find the subscriber whose MSISDN is the longest suffix of a number
+// Fall back to short number if no MSISDN matches
+NibSubscriber* NibModule::findNumber(const String& number)
+{
+    if (number.null())
+	return 0;
+    for (unsigned int i = 0; i < number.length(); i++) {
+	if (number.at(i) == '+')
+	    continue;
+	NamedString* ns = static_cast<NamedString*>(m_byMsisdn[number.substr(i)]);
+	if (ns)
+	    return static_cast<NibSubscriber*>(m_subscribers[*ns]);
+    }
+    NamedString* ns = static_cast<NamedString*>(m_byShort[number]);
+    return ns ? static_cast<NibSubscriber*>(m_subscribers[*ns]) : 0;
+}
+
+void NibModule::setRegistered(const String& imsi, const String& msisdn)
+{
+    if (imsi.null() || msisdn.null())
+	return;
+    removeRegistered(imsi,String::empty());
+    String number = noPlus(msisdn);
+    // A number belongs to only one IMSI
+    NamedString* old = static_cast<NamedString*>(m_regNumber[number]);
+    if (old)
+	removeRegistered(*old,number);
+    m_regImsi.append(new NamedString(imsi,"+" + number));
+    m_regNumber.append(new NamedString(number,imsi));
+    m_changed = true;
+}
+
+bool NibModule::removeRegistered(const String& imsi, const String& msisdn)
+{
+    NamedString* ns = static_cast<NamedString*>(m_regImsi[imsi]);
+    if (!ns)
+	return false;
+    if (msisdn && *ns != msisdn && noPlus(*ns) != noPlus(msisdn))
+	return false;
+    removeIndex(m_regNumber,noPlus(*ns),imsi);
+    m_regImsi.remove(ns);
+    m_changed = true;
+    return true;
+}
+
+// Find the registration whose MSISDN is the longest suffix of a number
+NamedString* NibModule::findRegistered(const String& number)
+{
+    for (unsigned int i = 0; i < number.length(); i++) {
+	if (number.at(i) == '+')
+	    continue;
+	NamedString* ns = static_cast<NamedString*>(m_regNumber[number.substr(i)]);
+	if (ns)
+	    return ns;
+    }
+    return 0;
+}
+
+// Insert in delivery time order
+// Most SMS are added with the same delay so they usually go at the end
+void NibModule::addSms(NibSms* sms)
+{
+    m_changed = true;
+    if (!m_smsLast)
+	m_smsLast = m_sms.last();
+    NibSms* last = static_cast<NibSms*>(m_smsLast->get());
+    if (!last || last->m_nextTry <= sms->m_nextTry) {
+	m_smsLast = m_smsLast->append(sms);
+	return;
+    }
+    ObjList* o = m_sms.skipNull();
+    for (; o; o = o->skipNext())
+	if (static_cast<NibSms*>(o->get())->m_nextTry > sms->m_nextTry)
+	    break;
+    // Inserting moves the current item to a new node
+    o->insert(sms);
+    m_smsLast = 0;
+}
+
+void NibModule::listRegistered(String& buf)
+{
+    buf << "IMSI            MSISDN \r\n";
+    buf << "--------------- ---------------\r\n";
+    for (unsigned int i = 0; i < m_regImsi.length(); i++) {
+	ObjList* o = m_regImsi.getList(i);
+	for (o = o ? o->skipNull() : 0; o; o = o->skipNext()) {
+	    NamedString* ns = static_cast<NamedString*>(o->get());
+	    buf << ns->name() << "   " << *ns << "\r\n";
+	}
+    }
+}
+
+void NibModule::listSms(String& buf)
+{
+    buf << "FROM_IMSI        FROM_MSISDN        TO_IMSI        TO_MSISDN\r\n";
+    buf << "--------------- --------------- --------------- ---------------\r\n";
+    for (ObjList* o = m_sms.skipNull(); o; o = o->skipNext()) {
+	NibSms* sms = static_cast<NibSms*>(o->get());
+	buf << (*sms)[YSTRING("imsi")] << "   " << (*sms)[YSTRING("msisdn")];
+	buf << "   " << (*sms)[YSTRING("dest_imsi")] << "   " << (*sms)[YSTRING("dest")];
+	buf << "\r\n";
+    }
+}
+
+// Load registrations and pending SMS
+void NibModule::load()
+{
+    if (!m_file)
+	return;
+    Configuration cfg(m_file);
+    if (!cfg.load(false))
+	return;
+    unsigned int n = cfg.sections();
+    for (unsigned int i = 0; i < n; i++) {
+	NamedList* sect = cfg.getSection(i);
+	if (!sect)
+	    continue;
+	if (*sect == YSTRING("registered")) {
+	    for (ObjList* o = sect->paramList()->skipNull(); o; o = o->skipNext()) {
+		NamedString* ns = static_cast<NamedString*>(o->get());
+		setRegistered(ns->name(),*ns);
+	    }
+	}
+	else if (sect->startsWith("sms ")) {
+	    NibSms* sms = new NibSms(sect->getIntValue(YSTRING("next_try"),0,0));
+	    for (ObjList* o = sect->paramList()->skipNull(); o; o = o->skipNext()) {
+		NamedString* ns = static_cast<NamedString*>(o->get());
+		if (ns->name() != YSTRING("next_try"))
+		    sms->addParam(ns->name(),String::uriUnescape(*ns));
+	    }
+	    addSms(sms);
+	}
+    }
+    m_changed = false;
+    Debug(this,DebugInfo,"Loaded %u registrations, %u pending SMS from '%s'",
+	m_regImsi.count(),m_sms.count(),m_file.c_str());
+}
+
+// Save registrations and pending SMS, must be called locked
+void NibModule::save()
+{
+    m_changed = false;
+    m_saveTime = Time::secNow() + m_saveInterval;
+    if (!m_file)
+	return;
+    Configuration cfg(m_file);
+    NamedList* reg = cfg.createSection("registered");
+    for (unsigned int i = 0; i < m_regImsi.length(); i++) {
+	ObjList* o = m_regImsi.getList(i);
+	for (o = o ? o->skipNull() : 0; o; o = o->skipNext()) {
+	    NamedString* ns = static_cast<NamedString*>(o->get());
+	    reg->addParam(ns->name(),*ns);
+	}
+    }
+    unsigned int n = 0;
+    for (ObjList* o = m_sms.skipNull(); o; o = o->skipNext()) {
+	NibSms* sms = static_cast<NibSms*>(o->get());
+	NamedList* sect = cfg.createSection("sms " + String(++n));
+	// Text may span several lines
+	for (ObjList* p = sms->paramList()->skipNull(); p; p = p->skipNext()) {
+	    NamedString* ns = static_cast<NamedString*>(p->get());
+	    sect->addParam(ns->name(),String::uriEscape(*ns));
+	}
+	sect->setParam("next_try",String((unsigned int)sms->m_nextTry));
+    }
+    if (!cfg.save())
+	Debug(this,DebugWarn,"Failed to save data file '%s'",m_file.c_str());
+}
+
+}; // anonymous namespace
+
+/* vi: set ts=8 sw=4 sts=4 noet: */
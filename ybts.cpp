@@ -34,6 +34,11 @@
 #include <signal.h>
 #include <stdio.h>
 #include <syslog.h>
+#include <errno.h>
+#ifdef __linux__
+#include <sys/socket.h>
+#define YBTS_RECV_MMSG
+#endif
 
 using namespace TelEngine;
 namespace { // anonymous
@@ -75,6 +80,19 @@ namespace { // anonymous
 #define YBTS_PAGING_TIMEOUT_MIN 5000
 #define YBTS_PAGING_TIMEOUT_MAX 150000
 
+// Datagrams read from a socket by one system call
+#define YBTS_READ_BATCH_MAX 32
+#define YBTS_READ_BATCH_SIGN 16
+#define YBTS_READ_BATCH_MEDIA 16
+#define YBTS_READ_BATCH_LOG 8
+
+#define YBTS_JOB_WORKERS_DEF 8
+#define YBTS_JOB_WORKERS_MAX 64
+
+#define YBTS_JOB_MAX_DEF 1000
+#define YBTS_JOB_MAX_MIN 10
+#define YBTS_JOB_MAX_MAX 100000
+
 #define YBTS_SET_REASON_BREAK(s) { reason = s; break; }
 
 // Constant strings
@@ -139,7 +157,9 @@ class YBTSThreadOwner;
 class YBTSMessage;                       // YBTS <-> BTS PDU
 class YBTSTransport;
 class YBTSGlobalThread;                  // GenObject and Thread descendent
-class YBTSConnAuthThread;                // Authenticator for MT services
+class YBTSJob;                           // A procedure run by the worker pool
+class YBTSJobPool;                       // Worker threads running procedures
+class YBTSConnAuthJob;                   // Authenticator for MT services
 class YBTSLAI;                           // Holds local area id
 class YBTSTid;                           // Transaction identifier holder
 class YBTSConn;                          // A logical connection
@@ -149,7 +169,7 @@ class YBTSSignalling;                    // Signalling interface
 class YBTSMedia;                         // Media interface
 class YBTSUE;                            // A registered equipment
 class YBTSLocationUpd;                   // Running location update from UE
-class YBTSSubmit;                        // MO SMS/SS submit thread
+class YBTSSubmit;                        // MO SMS/SS submit procedure
 class YBTSSmsInfo;                       // Holds data describing a pending SMS
 class YBTSMtSms;                         // Holds data describing a pending MT SMS
 class YBTSMtSmsList;                     // A list of MT SMS for the same UE target
@@ -220,13 +240,41 @@ protected:
     void* m_ptr;
 };
 
+// A procedure (state machine) run by the worker pool
+// Each run advances it until it finishes or has to wait for a MS response
+class YBTSJob : public GenObject
+{
+    friend class YBTSJobPool;
+public:
+    enum Result {
+	Done = 0,                        // Finished, the job is released
+	Again,                           // Run again as soon as possible
+	Retry,                           // Run again after a thread idle interval
+	Wait                             // Run again when notified
+    };
+    inline YBTSJob(const char* name)
+	: m_jobName(name), m_jobState(0), m_jobWakeup(false), m_jobTime(0)
+	{}
+    inline const char* jobName() const
+	{ return m_jobName; }
+protected:
+    // Run the procedure. Return a Result value
+    virtual int process() = 0;
+private:
+    const char* m_jobName;
+    int m_jobState;                      // Pool state
+    bool m_jobWakeup;                    // Notified while running
+    uint64_t m_jobTime;                  // Retry time
+};
+
 class YBTSConnAuth
 {
     friend class YBTSSignalling;
 public:
     inline YBTSConnAuth(uint16_t connid, int origin)
 	: m_authSent(false), m_authOk(false), m_authNeedResync(false),
-	m_origin(origin), m_originUsed(false)
+	m_origin(origin), m_originUsed(false), m_authStarted(false),
+	m_authWait(1,"YBTSConnAuth",0)
 	{ authSetConn(connid); }
     ~YBTSConnAuth();
     // Set connection
@@ -234,9 +282,15 @@ public:
     // Send auth request. Wait for completion.
     // Return true if sent (a response was receveid of request was dropped)
     bool authSend(NamedList& params, String& reason, unsigned int* intervals = 0);
+    // Send auth request or check if it completed, don't wait
+    // Return a YBTSJob::Result, set 'ok' as authSend() would when Done
+    int authStep(NamedList& params, String& reason, bool& ok);
     // End authentication
     virtual void authEnd(bool ok, const char* error = 0, const String* rsp = 0,
 	const String* rspExt = 0);
+    // Auth ended, notify the waiting procedure
+    virtual void authNotify()
+	{ m_authWait.unlock(); }
     void authHandleRsp(bool ok, const XmlElement& xml);
     // Send auth reject
     void authReject();
@@ -253,8 +307,12 @@ protected:
     String m_authError;                  // Received error
     int m_origin;                        // Auth origin
     bool m_originUsed;                   // Origin used, auth sent at least once
+    // Stop auth, wait for a running authEnd() to complete
+    void authDetach();
 private:
     YBTSConnAuth() {}
+    bool m_authStarted;                  // Auth request sent by authStep()
+    Semaphore m_authWait;                // Signaled when auth ends
 };
 
 class YBTSConnAuthMt : public YBTSConnAuth
@@ -262,9 +320,16 @@ class YBTSConnAuthMt : public YBTSConnAuth
 public:
     YBTSConnAuthMt(uint16_t connid, YBTSUE* ue, int origin);
     const char* authMt(unsigned int* intervals = 0);
+    // Run MT authentication, don't wait for MS responses
+    // Return a YBTSJob::Result, set 'result' as authMt() would when Done
+    int authMtStep(const char*& result);
 protected:
+    const char* authMtResult(const String& reason);
     Message m_msg;
     RefPointer<YBTSUE> m_ue;
+    int m_mtIndex;                       // Current 'auth' dispatch index
+    bool m_mtAuth;                       // Waiting for MS auth response
+    String m_mtReason;
 };
 
 class YBTSThread : public Thread
@@ -286,6 +351,8 @@ public:
 	{}
     void threadTerminated(YBTSThread* th);
     virtual void processLoop() = 0;
+    inline bool threadRunning() const
+	{ return m_thread != 0; }
 
 protected:
     bool startThread(const char* name, Thread::Priority prio = Thread::Normal);
@@ -298,6 +365,42 @@ protected:
     Mutex* m_mutex;
 };
 
+// L3 message decoded directly from its octets without building XML
+// Used for frequent messages with a simple layout
+class YBTSL3Fast
+{
+public:
+    enum Proto {
+	None = 0,
+	RR = 0x06,                       // Radio resources management
+	SMS = 0x09                       // Short message service, CP layer
+    };
+    enum SmsType {
+	CPData = 0x01,
+	CPAck = 0x04,
+	CPError = 0x10
+    };
+    enum RRType {
+	RRStatus = 0x12
+    };
+    inline YBTSL3Fast()
+	: m_proto(None), m_type(0), m_tiFlag(false), m_cause(0)
+	{}
+    // Decode a SMS CP message. Return false to decode it as XML
+    bool decode(const uint8_t* data, unsigned int len);
+    // Encode the first octet of a message with transaction identifier
+    static bool encodeTI(uint8_t& octet, uint8_t proto, const String& callRef, bool tiFlag);
+    static const TokenDict s_smsType[];
+    static const TokenDict s_cpCause[];
+
+    uint8_t m_proto;                     // Protocol discriminator, None if not decoded
+    uint8_t m_type;                      // Message type
+    bool m_tiFlag;                       // Transaction identifier flag
+    uint8_t m_cause;                     // CP-ERROR cause
+    String m_callRef;                    // Transaction identifier value
+    String m_rpdu;                       // CP-DATA RPDU as hex string
+};
+
 class YBTSMessage : public GenObject, public YBTSConnIdHolder
 {
 public:
@@ -320,6 +423,16 @@ public:
 	{ return m_xml; }
     inline XmlElement* takeXml()
 	{ XmlElement* x = m_xml; m_xml = 0; return x; }
+    // Binary data sent instead of XML
+    inline DataBlock& payload()
+	{ return m_payload; }
+    inline const DataBlock& payload() const
+	{ return m_payload; }
+    // Received L3 message decoded without XML
+    inline const YBTSL3Fast& l3() const
+	{ return m_l3; }
+    // Set the identity of a Start/Stop Paging
+    void setPagingIdentity(const String& ident);
     inline bool error() const
 	{ return m_error; }
     // Parse message. Return 0 on failure
@@ -335,6 +448,8 @@ protected:
     uint8_t m_primitive;
     uint8_t m_info;
     XmlElement* m_xml;
+    DataBlock m_payload;
+    YBTSL3Fast m_l3;
     bool m_error;                        // Encode/decode error flag
 };
 
@@ -369,14 +484,23 @@ class YBTSTransport : public GenObject, public YBTSDebug
     friend class YBTSMedia;
 public:
     inline YBTSTransport()
-	: m_maxRead(0)
+	: m_maxRead(0), m_slotLen(0), m_slots(0), m_readCount(0), m_readIndex(0)
 	{}
     ~YBTSTransport()
 	{ resetTransport(); }
-    inline const DataBlock& readBuf() const
-	{ return m_readBuf; }
+    // Data of the datagram returned by the last recv()
+    inline uint8_t* readData() const
+	{ return (uint8_t*)m_readBuf.data() + m_readIndex * m_slotLen; }
     inline HANDLE detachRemote()
 	{ return m_remoteSocket.detach(); }
+    // Duplicate the remote handle, keep the pair open if the peer exits
+    inline HANDLE dupRemote()
+	{ return m_remoteSocket.valid() ? ::dup(m_remoteSocket.handle()) : Socket::invalidHandle(); }
+    inline bool remoteValid() const
+	{ return m_remoteSocket.valid(); }
+    // Discard data left in the pair and the read batch by a terminated peer
+    // Return the number of discarded packets
+    unsigned int drain(bool local);
     inline bool canSelect() const
 	{ return m_socket.canSelect(); }
 
@@ -385,17 +509,29 @@ protected:
     inline bool send(const DataBlock& data)
 	{ return send(data.data(),data.length()); }
     // Read socket data. Return 0: nothing read, >1: read data, negative: fatal error
+    // Pending datagrams are read in batches and returned one by one
     int recv();
-    bool initTransport(bool stream, unsigned int buflen, bool reserveNull);
+    bool initTransport(bool stream, unsigned int buflen, bool reserveNull,
+	unsigned int batch = 1);
     void resetTransport();
-    void alarmError(Socket& sock, const char* oper);
+    inline void alarmError(Socket& sock, const char* oper)
+	{ alarmError(sock.error(),oper); }
+    void alarmError(int error, const char* oper);
 
     Socket m_socket;
     Socket m_readSocket;
     Socket m_writeSocket;
     Socket m_remoteSocket;
-    DataBlock m_readBuf;
+    DataBlock m_readBuf;                 // Ring of read buffers, one per datagram
     unsigned int m_maxRead;
+    unsigned int m_slotLen;              // Length of one read buffer
+    unsigned int m_slots;                // Number of read buffers
+    unsigned int m_readCount;            // Datagrams read by the last system call
+    unsigned int m_readIndex;            // Datagram returned to the reader
+    unsigned int m_readLen[YBTS_READ_BATCH_MAX];
+
+private:
+    int readDone(unsigned int index);
 };
 
 class YBTSGlobalThread : public Thread, public GenObject
@@ -423,21 +559,81 @@ public:
     static Mutex s_threadsMutex;
 };
 
-class YBTSConnAuthThread : public YBTSGlobalThread, public YBTSConnAuthMt
+class YBTSJobPool : public Mutex
 {
 public:
-    inline YBTSConnAuthThread(uint16_t connid, YBTSUE* ue, int origin)
-	: YBTSGlobalThread("YBTSConnAuth"), YBTSConnAuthMt(connid,ue,origin)
+    enum JobState {
+	JobIdle = 0,
+	JobReady,
+	JobRunning,
+	JobWaiting,
+	JobRetry
+    };
+    YBTSJobPool();
+    inline void setLimits(unsigned int workers, unsigned int maxJobs) {
+	    Lock lck(this);
+	    m_maxWorkers = workers;
+	    m_maxJobs = maxJobs;
+	}
+    // Add a job. Start a worker if none is idle
+    // Return false if the job was refused, the caller still owns it
+    bool add(YBTSJob* job);
+    // Notify a job waiting for an event
+    void wakeup(YBTSJob* job);
+    // Refuse new jobs, re-schedule waiting ones to let them terminate
+    void cancel();
+    // Release all jobs
+    void clear();
+    // Worker thread loop
+    void run();
+    void status(String& buf);
+private:
+    inline void setReady(YBTSJob* job) {
+	    job->m_jobState = JobReady;
+	    m_ready.append(job);
+	    if (++m_queued > m_maxQueued)
+		m_maxQueued = m_queued;
+	}
+    ObjList m_ready;                     // Jobs to run
+    ObjList m_waiting;                   // Jobs waiting for a notification or retry
+    Semaphore m_semaphore;               // Wake up idle workers
+    unsigned int m_maxWorkers;
+    unsigned int m_maxJobs;
+    unsigned int m_workers;
+    unsigned int m_idle;
+    unsigned int m_jobs;
+    unsigned int m_queued;
+    unsigned int m_running;
+    unsigned int m_retry;
+    unsigned int m_maxQueued;
+    uint64_t m_total;
+    uint64_t m_rejected;
+    bool m_cancelled;
+};
+
+class YBTSJobWorker : public YBTSGlobalThread
+{
+public:
+    inline YBTSJobWorker()
+	: YBTSGlobalThread("YBTSWorker")
 	{}
-    ~YBTSConnAuthThread()
-	{ notify(true); }
-    virtual void cleanup()
-	{ notify(true); }
 protected:
-    virtual void run() {
-	    set(this,true);
-	    notify(false,authMt() == 0);
+    virtual void run();
+};
+
+class YBTSConnAuthJob : public YBTSJob, public YBTSConnAuthMt
+{
+public:
+    inline YBTSConnAuthJob(uint16_t connid, YBTSUE* ue, int origin)
+	: YBTSJob("YBTSConnAuth"), YBTSConnAuthMt(connid,ue,origin)
+	{}
+    ~YBTSConnAuthJob() {
+	    authDetach();
+	    notify(true);
 	}
+    virtual void authNotify();
+protected:
+    virtual int process();
     void notify(bool final, bool ok = false);
 };
 
@@ -813,6 +1009,9 @@ public:
     void authReject(YBTSConn* conn);
     bool start();
     void stop();
+    // Drop all connections and wait for a new handshake, keep the socket and thread
+    // Return false if the interface is not usable anymore
+    bool resetPeer();
     // Drop a connection
     void dropConn(uint16_t connId, bool notifyPeer);
     inline void dropConn(YBTSConn* conn, bool notifyPeer) {
@@ -1044,12 +1243,13 @@ public:
     bool startPaging(BtsPagingChanType type);
     void stopPaging();
     void stopPagingNow();
+    void resumePaging();
 
 protected:
     inline YBTSUE(const char* imsi, const char* tmsi)
 	: Mutex(false,"YBTSUE"),
 	  m_registered(false), m_imsiDetached(false), m_removed(false),
-	  m_expires(0), m_pageCnt(0),
+	  m_expires(0), m_pageCnt(0), m_pagingType(ChanTypeSMS),
 	  m_imsi(imsi), m_tmsi(tmsi)
 	{ }
 
@@ -1058,6 +1258,7 @@ protected:
     bool m_removed;                      // Removed from MM list
     uint32_t m_expires;
     uint32_t m_pageCnt;
+    BtsPagingChanType m_pagingType;
     String m_imsi;
     String m_tmsi;
     String m_imei;
@@ -1065,40 +1266,48 @@ protected:
     String m_paging;
 };
 
-class YBTSLocationUpd : public YBTSGlobalThread, public YBTSConnIdHolder,
+class YBTSLocationUpd : public YBTSJob, public YBTSConnIdHolder,
     public YBTSConnAuth
 {
 public:
     YBTSLocationUpd(YBTSUE& ue, uint16_t connid);
-    ~YBTSLocationUpd()
-	{ notify(); }
+    ~YBTSLocationUpd() {
+	    authDetach();
+	    notify();
+	}
     inline uint64_t startTime() const
 	{ return m_startTime; }
-    virtual void cleanup()
-	{ notify(); }
+    virtual void authNotify();
 protected:
-    virtual void run();
+    virtual int process();
     void notify(bool final = true, bool ok = false);
 
     String m_imsi;                       // UE imsi, empty if already notified termination
     Message m_msg;                       // The message to dispatch
     uint64_t m_startTime;
+    int m_step;                          // Procedure step
+    bool m_rej;                          // Reject authentication when terminated
+    String m_reason;                     // Authentication failure reason
 };
 
-class YBTSSubmit : public YBTSGlobalThread, public YBTSConnIdHolder, public YBTSConnAuth
+class YBTSSubmit : public YBTSJob, public YBTSConnIdHolder, public YBTSConnAuth
 {
 public:
     YBTSSubmit(YBTSTid::Type t, uint16_t connid, YBTSUE* ue, const char* callRef);
-    ~YBTSSubmit()
-	{ notify(); }
+    ~YBTSSubmit() {
+	    authDetach();
+	    notify();
+	}
     inline Message& msg()
 	{ return m_msg; }
-    virtual void cleanup()
-	{ notify(); }
+    // Don't notify termination when destroyed
+    inline void discard()
+	{ m_imsi.clear(); }
+    virtual void authNotify();
 protected:
-    virtual void run();
+    virtual int process();
     void notify(bool final = true);
-    bool dispatch(bool route);
+    int dispatch(bool route, bool& ok);
 
     YBTSTid::Type m_type;
     String m_imsi;                       // UE imsi, empty if already notified termination
@@ -1107,6 +1316,10 @@ protected:
     bool m_ok;
     uint8_t m_cause;
     String m_data;
+    int m_step;                          // Procedure step
+    int m_dispStep;                      // dispatch() step
+    bool m_dispRej;                      // Reject authentication in dispatch()
+    String m_reason;                     // Authentication failure reason
 };
 
 class YBTSSmsInfo : public YBTSTid
@@ -1170,7 +1383,7 @@ class YBTSMtSmsList : public RefObject, public Mutex
 public:
     inline YBTSMtSmsList(YBTSUE* ue)
 	: Mutex(false,"YBTSMtSmsList"), m_tid(0), m_check(false),
-	m_auth(0), m_paging(false),
+	m_auth(0), m_paging(false), m_pagingSlot(false), m_pagingWait(false),
 	m_ue(ue)
 	{}
     inline YBTSUE* ue()
@@ -1179,16 +1392,26 @@ public:
 	{ return m_conn; }
     inline bool paging() const
 	{ return m_paging; }
+    inline bool pagingWait() const
+	{ return m_pagingWait; }
     inline bool startPaging() {
-	    if (!m_paging && m_ue)
+	    if (!m_paging && m_ue && pagingSlot(true)) {
 		m_paging = m_ue->startPaging(ChanTypeSMS);
+		if (!m_paging)
+		    pagingSlot(false);
+	    }
 	    return m_paging;
 	}
     inline void stopPaging() {
 	    if (m_paging && m_ue)
 		m_ue->stopPaging();
 	    m_paging = false;
+	    pagingSlot(false);
 	}
+    // Retrieve the next free TID
+    uint8_t nextTid();
+    // Retrieve the number of MT SMS paging UEs and waiting to page
+    static void pagingStatus(unsigned int& paging, unsigned int& waiting);
 
     ObjList m_sms;                       // MT SMS list
     RefPointer<YBTSConn> m_conn;         // Used connection
@@ -1199,8 +1422,13 @@ public:
 protected:
     // Release memory. Decrease connection usage. Stop UE paging
     virtual void destroyed();
+    // Request or release a paging slot
+    // Queue the list if no slot is available
+    bool pagingSlot(bool get);
 
     bool m_paging;                       // Paging the UE
+    bool m_pagingSlot;                   // Holding a paging slot
+    bool m_pagingWait;                   // Waiting for a paging slot
     RefPointer<YBTSUE> m_ue;
 };
 
@@ -1264,6 +1492,8 @@ protected:
 	bool* dropConn = 0);
     void updateExpire(YBTSUE* ue);
     void checkTimers(const Time& time = Time());
+    // Resume paging after the peer was restarted
+    void resumePaging();
     void loadUElist();
     void saveUElist();
     Message* buildUnregister(const String& imsi, YBTSUE* ue = 0);
@@ -1597,7 +1827,9 @@ public:
     const char* startMtSs(YBTSConn* conn, YBTSTid*& ss);
     // Radio ready notification. Return false if state is invalid
     bool radioReady();
-    void restart(unsigned int restartMs = 1, unsigned int stopIntervalMs = 0);
+    // Restart. A peer failure may restart only the peer if warm restart is enabled
+    void restart(unsigned int restartMs = 1, unsigned int stopIntervalMs = 0,
+	bool peerFailure = false);
     void stopNoRestart();
     inline bool haveChan(const String& chanId) {
 	    Lock lck(this);
@@ -1655,9 +1887,9 @@ public:
 
 protected:
     void handleSmsCPData(YBTSMessage& m, YBTSConn* conn,
-	const String& callRef, bool tiFlag, const XmlElement& cpData);
+	const String& callRef, bool tiFlag, const String* rpdu);
     void handleSmsCPRsp(YBTSMessage& m, YBTSConn* conn,
-	const String& callRef, bool tiFlag, const XmlElement& rsp, bool ok);
+	const String& callRef, bool tiFlag, bool ok);
     // Check for MT SMS in list. Return false if the list is empty
     bool checkMtSms(YBTSMtSmsList& list, unsigned int* toutAuth = 0);
     // Handle pending MP SMS final response
@@ -1700,8 +1932,16 @@ protected:
 	    start();
 	}
     void stop();
+    // Stop the peer only, keep interfaces, UEs and pending operations
+    void stopWarm();
+    // Start a new peer on the interfaces kept by stopWarm()
+    void startWarm();
+    void stopChannels();
+    bool checkRestartIndex();
     bool startPeer();
     void stopPeer();
+    // Terminate the peer process group, with the transceiver kept by warm restarts
+    void stopPeerGroup();
     bool handleMsgExecute(Message& msg, const String& dest);
     bool handleEngineStop(Message& msg);
     YBTSChan* findChanConnId(uint16_t connId);
@@ -1737,6 +1977,7 @@ protected:
     int m_state;
     Mutex m_stateMutex;
     pid_t m_peerPid;                     // Peer PID
+    pid_t m_peerGroup;                   // Process group of the peers and their transceiver
     bool m_peerAlive;
     uint64_t m_peerCheckTime;
     unsigned int m_peerCheckIntervalMs;
@@ -1747,6 +1988,8 @@ protected:
     bool m_restart;                      // Restart flag
     uint64_t m_restartTime;              // Restart time
     unsigned int m_restartIndex;         // Current restart index
+    bool m_warm;                         // Pending restart is a warm one
+    bool m_warmResync;                   // Peer was warm restarted, resync on radio up
     YBTSLog* m_logTrans;                 // Log transceiver
     YBTSLog* m_logBts;                   // Log OpenBTS
     YBTSCommand* m_command;              // Command interface
@@ -1804,8 +2047,15 @@ static String s_peerArg;                 // Peer program argument
 static String s_peerDir;                 // Peer program working directory
 static String s_ueFile;                  // File to save UE information
 static bool s_askIMEI = true;            // Ask the IMEI identity
+static bool s_binaryCodec = true;        // Use binary encoding for frequent messages
+static bool s_warmRestart = false;       // Restart only the peer when it fails
 static unsigned int s_pagingTout = YBTS_PAGING_TIMEOUT_DEF;// Paging timeout to be used on MT services
 static unsigned int s_mtSmsTimeout = YBTS_MT_SMS_TIMEOUT_DEF; // MT SMS timeout interval
+static unsigned int s_mtSmsWindow = 1;   // MT SMS sent on a connection without waiting for response
+static unsigned int s_mtSmsPagingMax = 0; // Maximum number of UEs paged for MT SMS, 0: no limit
+static unsigned int s_mtSmsPaging = 0;   // Number of paging slots in use
+static ObjList s_mtSmsPagingWait;        // MT SMS lists waiting for a paging slot
+static Mutex s_mtSmsPagingMutex(false,"YBTSSmsPaging");
 static unsigned int s_ussdTimeout = YBTS_USSD_TIMEOUT_DEF;    // USSD session timeout interval
 static unsigned int s_bufLenLog = 16384; // Read buffer length for log interface
 static unsigned int s_bufLenSign = 1024; // Read buffer length for signalling interface
@@ -1841,6 +2091,7 @@ static const String s_statusUeMsisdn = "msisdn";
 
 ObjList YBTSGlobalThread::s_threads;
 Mutex YBTSGlobalThread::s_threadsMutex(false,"YBTSGlobal");
+static YBTSJobPool s_jobs;                // Procedures run by worker threads
 
 #define YBTS_MAKENAME(x) {#x, x}
 #define YBTS_XML_GETCHILD_PTR_CONTINUE(x,tag,ptr) \
@@ -1880,6 +2131,27 @@ const TokenDict YBTSMessage::s_priName[] =
     {0,0}
 };
 
+const TokenDict YBTSL3Fast::s_smsType[] = {
+    {"CP-Data", CPData},
+    {"CP-Ack", CPAck},
+    {"CP-Error", CPError},
+    {0,0}
+};
+
+// ETSI TS 124.011 Section 8.1.4.2
+const TokenDict YBTSL3Fast::s_cpCause[] = {
+    {"network-failure", 17},
+    {"congestion", 22},
+    {"invalid-TID", 81},
+    {"semantically-incorrect-message", 95},
+    {"invalid-mandatory-info", 96},
+    {"message-type-non-existent-or-not-implemented", 97},
+    {"message-not-compatible-with-SM-protocol-state", 98},
+    {"IE-non-existent-or-not-implemented", 99},
+    {"protocol-error", 111},
+    {0,0}
+};
+
 const TokenDict YBTSTid::s_typeName[] = {
     YBTS_MAKENAME(Sms),
     YBTS_MAKENAME(Ussd),
@@ -2480,6 +2752,14 @@ YBTSConnAuth::~YBTSConnAuth()
 	m_conn->owner()->authCancel(m_conn,this);
 }
 
+// Stop auth. Wait for authEnd() called by the signalling to return
+void YBTSConnAuth::authDetach()
+{
+    if (m_conn)
+	m_conn->owner()->authCancel(m_conn,this);
+    m_authStarted = false;
+}
+
 // Set connection
 bool YBTSConnAuth::authSetConn(uint16_t connid)
 {
@@ -2503,47 +2783,65 @@ static inline bool decIntervals(unsigned int* intervals, String& reason)
 // Send auth request. Wait for completion
 bool YBTSConnAuth::authSend(NamedList& params, String& reason, unsigned int* intervals)
 {
-    const String& rand = params[YSTRING("auth.rand")];
-    if (!rand) {
-	reason = "missing rand parameter";
-	return false;
-    }
-    const String& autn = params[YSTRING("auth.autn")];
-    const char* keySeq = params.getValue(YSTRING("auth.keysequence"),"0");
-    if (m_authSent || !m_conn) {
-	reason << "invalid state";
-	return false;
-    }
+    bool ok = false;
     while (true) {
+	int res = authStep(params,reason,ok);
+	if (res == YBTSJob::Done)
+	    return ok;
+	if (res == YBTSJob::Wait) {
+	    if (m_authWait.lock(Thread::idleUsec()))
+		continue;
+	}
+	else
+	    Thread::idle();
+	if (threadExiting(reason) || !decIntervals(intervals,reason)) {
+	    ok = m_authStarted;
+	    authDetach();
+	    return ok;
+	}
+    }
+}
+
+// Send auth request or check if it completed
+int YBTSConnAuth::authStep(NamedList& params, String& reason, bool& ok)
+{
+    ok = false;
+    if (!m_authStarted) {
+	const String& rand = params[YSTRING("auth.rand")];
+	if (!rand) {
+	    reason = "missing rand parameter";
+	    return YBTSJob::Done;
+	}
+	const String& autn = params[YSTRING("auth.autn")];
+	const char* keySeq = params.getValue(YSTRING("auth.keysequence"),"0");
+	if (m_authSent || !m_conn) {
+	    reason << "invalid state";
+	    return YBTSJob::Done;
+	}
 	int res = -1;
 	if (__plugin.signalling())
 	    res = m_conn->owner()->authStart(m_conn,this,rand,autn,keySeq);
 	if (threadExiting(reason)) {
 	    if (!res)
 		m_conn->owner()->authCancel(m_conn,this);
-	    return false;
+	    return YBTSJob::Done;
 	}
-	if (!res)
-	    break;
 	if (res < 0) {
 	    reason << "net-out-of-order";
-	    return false;
-	}
-	Thread::idle();
-	if (threadExiting(reason) || !decIntervals(intervals,reason)) {
-	    m_conn->owner()->authCancel(m_conn,this);
-	    return false;
+	    return YBTSJob::Done;
 	}
+	if (res)
+	    return YBTSJob::Retry;
+	m_authStarted = true;
     }
-    // Wait for completion
-    while (m_authSent) {
-	Thread::idle();
-	if (threadExiting(reason) || !decIntervals(intervals,reason)) {
-	    m_conn->owner()->authCancel(m_conn,this);
-	    return true;
-	}
+    if (m_authSent) {
+	if (!threadExiting(reason))
+	    return YBTSJob::Wait;
+	m_conn->owner()->authCancel(m_conn,this);
     }
-    return true;
+    m_authStarted = false;
+    ok = true;
+    return YBTSJob::Done;
 }
 
 // End authentication
@@ -2582,6 +2880,7 @@ void YBTSConnAuth::authEnd(bool ok, const char* error, const String* rsp,
 	}
     }
     m_authSent = false;
+    authNotify();
 }
 
 void YBTSConnAuth::authHandleRsp(bool ok, const XmlElement& xml)
@@ -2622,7 +2921,9 @@ void YBTSConnAuth::authClearParams(NamedList& list)
 //
 YBTSConnAuthMt::YBTSConnAuthMt(uint16_t connid, YBTSUE* ue, int origin)
     : YBTSConnAuth(connid,origin),
-    m_msg("auth")
+    m_msg("auth"),
+    m_mtIndex(0),
+    m_mtAuth(false)
 {
     if (m_conn)
 	m_ue = m_conn->ue();
@@ -2707,6 +3008,61 @@ const char* YBTSConnAuthMt::authMt(unsigned int* intervals)
 	    break;
 	authSetParams(m_msg);
     }
+    return authMtResult(reason);
+}
+
+// Same flow as authMt(), return to caller instead of waiting for AUTH REQ response
+int YBTSConnAuthMt::authMtStep(const char*& result)
+{
+    if (!m_conn) {
+	result = "net-out-of-order";
+	return YBTSJob::Done;
+    }
+    while (true) {
+	if (m_mtAuth) {
+	    bool ok = false;
+	    int res = authStep(m_msg,m_mtReason,ok);
+	    if (res != YBTSJob::Done)
+		return res;
+	    m_mtAuth = false;
+	    if (!ok || m_mtReason || threadExiting(m_mtReason))
+		break;
+	    // Last cycle: ignore resync error
+	    if (m_mtIndex == 2)
+		m_authNeedResync = false;
+	    if (!(m_authOk || m_authNeedResync))
+		break;
+	    authSetParams(m_msg);
+	}
+	m_mtIndex++;
+	bool ok = Engine::dispatch(m_msg);
+	if (threadExiting(m_mtReason))
+	    break;
+	if (m_conn->removed()) {
+	    m_mtReason = "net-out-of-order";
+	    break;
+	}
+	if (!ok) {
+	    m_mtReason = "auth message not handled";
+	    break;
+	}
+	const String& err = m_msg[s_error];
+	if (!err) {
+	    m_conn->setAuthenticated();
+	    result = 0;
+	    return YBTSJob::Done;
+	}
+	if (m_mtIndex > 2 || err != s_noAuth)
+	    break;
+	m_mtAuth = true;
+    }
+    result = authMtResult(m_mtReason);
+    return YBTSJob::Done;
+}
+
+// Authentication failed: reject it if needed, build the result
+const char* YBTSConnAuthMt::authMtResult(const String& reason)
+{
     if (reason)
 	Debug(&__plugin,DebugNote,"Failed to complete MT authentication on conn %u: %s",
 	    m_conn->connId(),reason.c_str());
@@ -2799,9 +3155,81 @@ void YBTSThreadOwner::threadTerminated(YBTSThread* th)
 }
 
 
+//
+// YBTSL3Fast
+//
+// Decode SMS CP-DATA, CP-ACK and CP-ERROR
+// ETSI TS 124.011 Section 7.2 and 8.1
+bool YBTSL3Fast::decode(const uint8_t* data, unsigned int len)
+{
+    if (len < 2 || (data[0] & 0x0f) != SMS)
+	return false;
+    // TI value 7 is reserved for extension
+    uint8_t tid = (data[0] >> 4) & 0x07;
+    if (tid == 7)
+	return false;
+    switch (data[1]) {
+	case CPData:
+	    if (len < 3 || !data[2] || (unsigned int)data[2] + 3 > len)
+		return false;
+	    m_rpdu.hexify((void*)(data + 3),data[2]);
+	    break;
+	case CPError:
+	    if (len < 3)
+		return false;
+	    m_cause = data[2];
+	    break;
+	case CPAck:
+	    break;
+	default:
+	    return false;
+    }
+    m_proto = SMS;
+    m_type = data[1];
+    m_tiFlag = (data[0] & 0x80) != 0;
+    m_callRef = String((int)tid);
+    return true;
+}
+
+// Encode TI flag, TI value and protocol discriminator
+// ETSI TS 124.007 Section 11.2.3.1
+bool YBTSL3Fast::encodeTI(uint8_t& octet, uint8_t proto, const String& callRef, bool tiFlag)
+{
+    int tid = callRef.toInteger(-1);
+    if (tid < 0 || tid > 6)
+	return false;
+    octet = (tiFlag ? 0x80 : 0) | (tid << 4) | proto;
+    return true;
+}
+
+
 //
 // YBTSMessage
 //
+// Set paging identity, binary for IMSI and TMSI, text for others
+void YBTSMessage::setPagingIdentity(const String& ident)
+{
+    if (s_binaryCodec) {
+	if (ident.startsWith("TMSI")) {
+	    int64_t tmsi = ident.substr(4).toInt64(-1,16);
+	    if (tmsi >= 0 && tmsi <= 0xffffffff) {
+		uint8_t b[5] = {PagingIdTMSI,(uint8_t)(tmsi >> 24),(uint8_t)(tmsi >> 16),
+		    (uint8_t)(tmsi >> 8),(uint8_t)tmsi};
+		m_payload.assign(b,5);
+		return;
+	    }
+	}
+	else if (ident.startsWith("IMSI") && ident.length() > 4 && ident.length() <= 19) {
+	    uint8_t b = PagingIdIMSI;
+	    m_payload.assign(&b,1);
+	    m_payload.append((void*)(ident.c_str() + 4),ident.length() - 4);
+	    return;
+	}
+    }
+    TelEngine::destruct(m_xml);
+    m_xml = new XmlElement("identity",ident);
+}
+
 // Utility used in YBTSMessage::parse()
 static inline void decodeMsg(GSML3Codec& codec, uint8_t* data, unsigned int len,
     XmlElement*& xml, String& reason)
@@ -2848,7 +3276,8 @@ YBTSMessage* YBTSMessage::parse(YBTSSignalling* recv, uint8_t* data, unsigned in
 		Debug(recv,DebugAll,"Recv L3 message: %s",tmp.c_str());
 	    }
 #endif
-	    decodeMsg(recv->codec(),data,len,m->m_xml,reason);
+	    if (!(s_binaryCodec && m->m_l3.decode(data,len)))
+		decodeMsg(recv->codec(),data,len,m->m_xml,reason);
 	    break;
 	case SigEstablishSAPI:
 	case SigHandshake:
@@ -2898,6 +3327,10 @@ bool YBTSMessage::build(YBTSSignalling* sender, DataBlock& buf, const YBTSMessag
     String reason;
     switch (msg.primitive()) {
 	case SigL3Message:
+	    if (msg.payload().length()) {
+		buf.append(msg.payload());
+		return true;
+	    }
 	    if (encodeMsg(sender->codec(),msg,buf,reason)) {
 #ifdef DEBUG
 		void* data = buf.data(4);
@@ -2912,6 +3345,10 @@ bool YBTSMessage::build(YBTSSignalling* sender, DataBlock& buf, const YBTSMessag
 	    break;
 	case SigStartPaging:
 	case SigStopPaging:
+	    if (msg.payload().length()) {
+		buf.append(msg.payload());
+		return true;
+	    }
 	    if (!msg.xml()) {
 		reason = "Missing XML";
 		break;
@@ -2980,6 +3417,10 @@ int YBTSTransport::recv()
 {
     if (!m_readSocket.valid())
 	return 0;
+    // Return datagrams already read
+    if (m_readIndex + 1 < m_readCount)
+	return readDone(m_readIndex + 1);
+    m_readCount = 0;
     if (canSelect()) {
 	bool ok = false;
 	if (!m_readSocket.select(&ok,0,0,Thread::idleUsec())) {
@@ -2991,20 +3432,36 @@ int YBTSTransport::recv()
 	if (!ok)
 	    return 0;
     }
-    uint8_t* buf = (uint8_t*)m_readBuf.data();
-    int rd = m_readSocket.recv(buf,m_maxRead);
-    if (rd >= 0) {
-	if (rd) {
-	    __plugin.setPeerAlive();
-	    if (m_maxRead < m_readBuf.length())
-		buf[rd] = 0;
-#ifdef XDEBUG
-	    String tmp;
-	    tmp.hexify(buf,rd,' ');
-	    Debug(m_enabler,DebugAll,"Read %d bytes: %s [%p]",rd,tmp.c_str(),m_ptr);
+#ifdef YBTS_RECV_MMSG
+    if (m_slots > 1) {
+	struct mmsghdr msgs[YBTS_READ_BATCH_MAX];
+	struct iovec iov[YBTS_READ_BATCH_MAX];
+	::memset(msgs,0,m_slots * sizeof(struct mmsghdr));
+	uint8_t* buf = (uint8_t*)m_readBuf.data();
+	for (unsigned int i = 0; i < m_slots; i++) {
+	    iov[i].iov_base = buf + i * m_slotLen;
+	    iov[i].iov_len = m_maxRead;
+	    msgs[i].msg_hdr.msg_iov = &iov[i];
+	    msgs[i].msg_hdr.msg_iovlen = 1;
+	}
+	int n = ::recvmmsg(m_readSocket.handle(),msgs,m_slots,MSG_DONTWAIT,0);
+	if (n > 0) {
+	    for (int i = 0; i < n; i++)
+		m_readLen[i] = msgs[i].msg_len;
+	    m_readCount = n;
+	    return readDone(0);
+	}
+	if (!n || errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+	    return 0;
+	alarmError(errno,"read");
+	return -1;
+    }
 #endif
-	}
-	return rd;
+    int rd = m_readSocket.recv(m_readBuf.data(),m_maxRead);
+    if (rd >= 0) {
+	m_readLen[0] = rd;
+	m_readCount = 1;
+	return readDone(0);
     }
     if (m_readSocket.canRetry())
 	return 0;
@@ -3012,7 +3469,27 @@ int YBTSTransport::recv()
     return -1;
 }
 
-bool YBTSTransport::initTransport(bool stream, unsigned int buflen, bool reserveNull)
+// Make a datagram of the last batch current, return its length
+int YBTSTransport::readDone(unsigned int index)
+{
+    m_readIndex = index;
+    unsigned int rd = m_readLen[index];
+    if (rd) {
+	__plugin.setPeerAlive();
+	uint8_t* buf = readData();
+	if (m_maxRead < m_slotLen)
+	    buf[rd] = 0;
+#ifdef XDEBUG
+	String tmp;
+	tmp.hexify(buf,rd,' ');
+	Debug(m_enabler,DebugAll,"Read %u bytes: %s [%p]",rd,tmp.c_str(),m_ptr);
+#endif
+    }
+    return rd;
+}
+
+bool YBTSTransport::initTransport(bool stream, unsigned int buflen, bool reserveNull,
+    unsigned int batch)
 {
     resetTransport();
     String error;
@@ -3024,8 +3501,17 @@ bool YBTSTransport::initTransport(bool stream, unsigned int buflen, bool reserve
 	if (m_socket.setBlocking(false)) {
 	    m_readSocket.attach(m_socket.handle());
 	    m_writeSocket.attach(m_socket.handle());
-	    m_readBuf.assign(0,reserveNull ? buflen + 1 : buflen);
-	    m_maxRead = reserveNull ? m_readBuf.length() - 1 : m_readBuf.length();
+	    // Keep read buffers aligned, received data is accessed by words
+	    m_slotLen = ((reserveNull ? buflen + 1 : buflen) + 7) & ~7;
+	    m_maxRead = buflen;
+	    // Stream sockets don't keep message boundaries
+	    m_slots = stream ? 1 : batch;
+	    if (m_slots < 1)
+		m_slots = 1;
+	    else if (m_slots > YBTS_READ_BATCH_MAX)
+		m_slots = YBTS_READ_BATCH_MAX;
+	    m_readBuf.assign(0,m_slots * m_slotLen);
+	    m_readCount = m_readIndex = 0;
 	    return true;
 	}
 	error << "Failed to set non blocking mode";
@@ -3050,10 +3536,30 @@ void YBTSTransport::resetTransport()
     m_remoteSocket.terminate();
 }
 
-void YBTSTransport::alarmError(Socket& sock, const char* oper)
+unsigned int YBTSTransport::drain(bool local)
+{
+    unsigned int n = 0;
+    if (local) {
+	// Datagrams of the last batch not yet returned by recv()
+	if (m_readCount > m_readIndex + 1)
+	    n = m_readCount - m_readIndex - 1;
+	m_readCount = m_readIndex = 0;
+    }
+    char buf[256];
+    for (int i = local ? 0 : 1; i < 2; i++) {
+	Socket& s = i ? m_remoteSocket : m_socket;
+	if (!s.valid())
+	    continue;
+	while (::recv(s.handle(),buf,sizeof(buf),MSG_DONTWAIT) > 0)
+	    n++;
+    }
+    return n;
+}
+
+void YBTSTransport::alarmError(int error, const char* oper)
 {
     String tmp;
-    addLastError(tmp,sock.error());
+    addLastError(tmp,error);
     Alarm(m_enabler,"socket",DebugWarn,"Socket %s error%s [%p]",
 	oper,tmp.c_str(),m_ptr);
 }
@@ -3066,6 +3572,8 @@ void YBTSTransport::alarmError(Socket& sock, const char* oper)
 // Return true if there are no running threads
 bool YBTSGlobalThread::cancelAll(bool hard, unsigned int waitMs)
 {
+    // Let workers terminate waiting jobs
+    s_jobs.cancel();
     Lock lck(s_threadsMutex);
     ObjList* o = s_threads.skipNull();
     if (!o)
@@ -3093,15 +3601,217 @@ bool YBTSGlobalThread::cancelAll(bool hard, unsigned int waitMs)
 
 
 //
-// YBTSConnAuthThread
+// YBTSJobPool
+//
+YBTSJobPool::YBTSJobPool()
+    : Mutex(false,"YBTSJobs"),
+    m_semaphore(YBTS_JOB_WORKERS_MAX,"YBTSJobs",0),
+    m_maxWorkers(YBTS_JOB_WORKERS_DEF), m_maxJobs(YBTS_JOB_MAX_DEF),
+    m_workers(0), m_idle(0), m_jobs(0), m_queued(0), m_running(0), m_retry(0),
+    m_maxQueued(0), m_total(0), m_rejected(0), m_cancelled(false)
+{
+}
+
+// Add a job. Start a worker if none is idle
+bool YBTSJobPool::add(YBTSJob* job)
+{
+    if (!job)
+	return false;
+    Lock lck(this);
+    if (m_cancelled || m_jobs >= m_maxJobs) {
+	m_rejected++;
+	Debug(&__plugin,m_cancelled ? DebugAll : DebugNote,
+	    "Refusing job %s: %s (%u jobs)",job->jobName(),
+	    m_cancelled ? "exiting" : "too many jobs",m_jobs);
+	return false;
+    }
+    if (!m_idle && m_workers < m_maxWorkers) {
+	YBTSJobWorker* th = new YBTSJobWorker;
+	if (th->startup())
+	    m_workers++;
+	else {
+	    delete th;
+	    if (!m_workers) {
+		m_rejected++;
+		Debug(&__plugin,DebugWarn,"Refusing job %s: failed to start worker",
+		    job->jobName());
+		return false;
+	    }
+	}
+    }
+    m_jobs++;
+    m_total++;
+    setReady(job);
+    if (m_idle)
+	m_semaphore.unlock();
+    return true;
+}
+
+// Notify a job waiting for an event
+void YBTSJobPool::wakeup(YBTSJob* job)
+{
+    if (!job)
+	return;
+    Lock lck(this);
+    switch (job->m_jobState) {
+	case JobRunning:
+	    job->m_jobWakeup = true;
+	    break;
+	case JobWaiting:
+	    m_waiting.remove(job,false);
+	    setReady(job);
+	    if (m_idle)
+		m_semaphore.unlock();
+	    break;
+	default: ;
+    }
+}
+
+// Refuse new jobs, re-schedule waiting ones to let them terminate
+void YBTSJobPool::cancel()
+{
+    Lock lck(this);
+    m_cancelled = true;
+    for (ObjList* o = m_waiting.skipNull(); o; o = o->skipNull())
+	setReady(static_cast<YBTSJob*>(o->remove(false)));
+    m_retry = 0;
+    for (unsigned int n = m_idle; n; n--)
+	m_semaphore.unlock();
+}
+
+// Release all jobs
+void YBTSJobPool::clear()
+{
+    ObjList tmp;
+    Lock lck(this,1000000);
+    if (!lck.locked()) {
+	Debug(&__plugin,DebugWarn,"Failed to lock jobs pool, not releasing %u jobs",m_jobs);
+	return;
+    }
+    m_cancelled = true;
+    moveList(tmp,m_ready);
+    moveList(tmp,m_waiting);
+    m_jobs = m_running;
+    m_queued = m_retry = 0;
+    lck.drop();
+    tmp.clear();
+}
+
+// Worker thread loop
+void YBTSJobPool::run()
+{
+    Lock lck(this);
+    while (true) {
+	if (m_retry) {
+	    uint64_t now = Time::now();
+	    for (ObjList* o = m_waiting.skipNull(); o;) {
+		YBTSJob* job = static_cast<YBTSJob*>(o->get());
+		if (job->m_jobState != JobRetry || job->m_jobTime > now) {
+		    o = o->skipNext();
+		    continue;
+		}
+		o->remove(false);
+		m_retry--;
+		setReady(job);
+		o = o->skipNull();
+	    }
+	}
+	ObjList* o = m_ready.skipNull();
+	if (!o) {
+	    if (Thread::check(false))
+		break;
+	    // Check retry and cancel often, no need to poll otherwise
+	    long wait = m_retry ? Thread::idleUsec() : 100000;
+	    m_idle++;
+	    lck.drop();
+	    m_semaphore.lock(wait);
+	    lck.acquire(this);
+	    m_idle--;
+	    continue;
+	}
+	YBTSJob* job = static_cast<YBTSJob*>(o->remove(false));
+	m_queued--;
+	m_running++;
+	job->m_jobState = JobRunning;
+	job->m_jobWakeup = false;
+	lck.drop();
+	int res = job->process();
+	lck.acquire(this);
+	m_running--;
+	switch (res) {
+	    case YBTSJob::Again:
+		setReady(job);
+		break;
+	    case YBTSJob::Retry:
+		job->m_jobState = JobRetry;
+		job->m_jobTime = Time::now() + Thread::idleUsec();
+		m_waiting.append(job);
+		m_retry++;
+		break;
+	    case YBTSJob::Wait:
+		if (job->m_jobWakeup)
+		    setReady(job);
+		else {
+		    job->m_jobState = JobWaiting;
+		    m_waiting.append(job);
+		}
+		break;
+	    default:
+		job->m_jobState = JobIdle;
+		m_jobs--;
+		lck.drop();
+		TelEngine::destruct(job);
+		lck.acquire(this);
+	}
+    }
+    m_workers--;
+}
+
+void YBTSJobPool::status(String& buf)
+{
+    Lock lck(this);
+    buf << ",workers=" << m_workers << ",jobs=" << m_jobs;
+    buf << ",jobs_queued=" << m_queued << ",jobs_running=" << m_running;
+    buf << ",jobs_waiting=" << (m_jobs - m_queued - m_running);
+    buf << ",jobs_maxqueued=" << m_maxQueued << ",jobs_max=" << m_maxJobs;
+    buf << ",jobs_total=" << m_total << ",jobs_rejected=" << m_rejected;
+}
+
+
+//
+// YBTSJobWorker
 //
-void YBTSConnAuthThread::notify(bool final, bool ok)
+void YBTSJobWorker::run()
+{
+    set(this,true);
+    s_jobs.run();
+}
+
+
+//
+// YBTSConnAuthJob
+//
+int YBTSConnAuthJob::process()
+{
+    const char* result = 0;
+    int res = authMtStep(result);
+    if (res == Done)
+	notify(false,result == 0);
+    return res;
+}
+
+void YBTSConnAuthJob::authNotify()
+{
+    s_jobs.wakeup(this);
+}
+
+void YBTSConnAuthJob::notify(bool final, bool ok)
 {
     if (!m_ue)
 	return;
     if (final && !Engine::exiting())
 	Alarm(&__plugin,"system",DebugWarn,
-	    "MT auth thread conn=%u abnormally terminated [%p]",
+	    "MT auth job conn=%u abnormally terminated [%p]",
 	    (m_conn ? m_conn->connId() : 0),this);
     if (__plugin.mm() && isValidStartTime(m_msg.msgTime()))
 	__plugin.mm()->mtAuthTerminated(m_ue,m_conn,ok);
@@ -3293,7 +4003,7 @@ bool YBTSLog::start()
     stop();
     while (true) {
 	Lock lck(this);
-	if (!m_transport.initTransport(false,s_bufLenLog,true))
+	if (!m_transport.initTransport(false,s_bufLenLog,true,YBTS_READ_BATCH_LOG))
 	    break;
 	if (!startThread("YBTSLog"))
 	    break;
@@ -3314,47 +4024,82 @@ void YBTSLog::stop()
     Debug(this,DebugInfo,"Stopped [%p]",this);
 }
 
+// Convert LF to CR LF, return text itself if there is no LF
+static const char* fixLineEnd(const char* text, String& buf)
+{
+    const char* lf = ::strchr(text,'\n');
+    if (!lf)
+	return text;
+    const char* s = text;
+    while (lf) {
+	if (lf > text && lf[-1] == '\r')
+	    buf.append(s,lf - s + 1);
+	else {
+	    buf.append(s,lf - s);
+	    buf << "\r\n";
+	}
+	s = lf + 1;
+	lf = ::strchr(s,'\n');
+    }
+    buf << s;
+    return buf.c_str();
+}
+
 // Read socket
 void YBTSLog::processLoop()
 {
     while (!Thread::check(false)) {
 	int rd = m_transport.recv();
 	if (rd > 2) {
-	    int level = -1;
-	    switch (m_transport.readBuf().at(0)) {
-		case LOG_EMERG:
-		    level = DebugGoOn;
-		    break;
-		case LOG_ALERT:
-		case LOG_CRIT:
-		    level = DebugWarn;
-		    break;
-		case LOG_ERR:
-		case LOG_WARNING:
-		    level = DebugMild;
-		    break;
-		case LOG_NOTICE:
-		    level = DebugNote;
-		    break;
-		case LOG_INFO:
-		    level = DebugInfo;
-		    break;
-		case LOG_DEBUG:
-		    level = DebugAll;
-		    break;
+	    const uint8_t* buf = m_transport.readData();
+	    const char* text = (const char*)buf + 1;
+	    uint32_t fn = 0xffffffff;
+	    if ((buf[0] & 0xc0) == BTS_LOG_RECORD) {
+		if (rd <= BTS_LOG_HEADER)
+		    continue;
+		fn = ((uint32_t)buf[2] << 24) | ((uint32_t)buf[3] << 16) |
+		    ((uint32_t)buf[4] << 8) | buf[5];
+		unsigned int dropped = ((unsigned int)buf[6] << 8) | buf[7];
+		if (dropped)
+		    Debug(this,DebugMild,"Peer dropped %u log records [%p]",dropped,this);
+		text = (const char*)buf + BTS_LOG_HEADER;
 	    }
-	    String tmp((const char*)m_transport.readBuf().data(1));
-	    // LF -> CR LF
-	    for (int i = 0; (i = tmp.find('\n',i + 1)) >= 0; ) {
-		if (tmp.at(i - 1) != '\r') {
-		    tmp = tmp.substr(0,i) + "\r" + tmp.substr(i);
-		    i++;
+	    int level = -1;
+	    if (buf[0] != 0xff) {
+		switch (buf[0] & 0x07) {
+		    case LOG_EMERG:
+			level = DebugGoOn;
+			break;
+		    case LOG_ALERT:
+		    case LOG_CRIT:
+			level = DebugWarn;
+			break;
+		    case LOG_ERR:
+		    case LOG_WARNING:
+			level = DebugMild;
+			break;
+		    case LOG_NOTICE:
+			level = DebugNote;
+			break;
+		    case LOG_INFO:
+			level = DebugInfo;
+			break;
+		    case LOG_DEBUG:
+			level = DebugAll;
+			break;
 		}
+		// Don't format records that won't be shown
+		if (!debugAt(level))
+		    continue;
 	    }
-	    if (level >= 0)
-		Debug(this,level,"%s",tmp.c_str());
+	    String tmp;
+	    text = fixLineEnd(text,tmp);
+	    if (level < 0)
+		Output("%s",text);
+	    else if (fn != 0xffffffff)
+		Debug(this,level,"FN %u: %s",fn,text);
 	    else
-		Output("%s",tmp.c_str());
+		Debug(this,level,"%s",text);
 	    continue;
 	}
 	if (!rd) {
@@ -3414,7 +4159,7 @@ bool YBTSCommand::recv(String& str)
     while (!Thread::check(false)) {
 	int rd = m_transport.recv();
 	if (rd > 0) {
-	    str = (const char*)m_transport.readBuf().data();
+	    str = (const char*)m_transport.readData();
 	    return true;
 	}
 	if (!rd) {
@@ -3551,6 +4296,13 @@ int YBTSSignalling::checkTimers(const Time& time)
 
 bool YBTSSignalling::sendRRMStatus(uint16_t connId, uint8_t code)
 {
+    if (s_binaryCodec) {
+	// ETSI TS 144.018 Section 9.1.29
+	uint8_t b[3] = {YBTSL3Fast::RR,YBTSL3Fast::RRStatus,code};
+	YBTSMessage m(SigL3Message,0,connId);
+	m.payload().assign(b,3);
+	return send(m);
+    }
     XmlElement* rrm = new XmlElement("RRM");
     XmlElement* ch =  new XmlElement(s_message);
     ch->setAttribute(s_type,"RRStatus");
@@ -3565,6 +4317,17 @@ bool YBTSSignalling::sendSmsCPData(YBTSConn* conn, const String& callRef, bool t
 {
     if (!conn)
 	return false;
+    uint8_t b[3] = {0,YBTSL3Fast::CPData,0};
+    if (s_binaryCodec && YBTSL3Fast::encodeTI(b[0],YBTSL3Fast::SMS,callRef,tiFlag)) {
+	YBTSMessage m(SigL3Message,sapi,conn->connId());
+	m.payload().assign(b,3);
+	DataBlock rp;
+	if (rp.unHexify(rpdu) && rp.length() && rp.length() <= 255) {
+	    *(uint8_t*)m.payload().data(2) = (uint8_t)rp.length();
+	    m.payload().append(rp);
+	    return send(m);
+	}
+    }
     XmlElement* sms = new XmlElement("SMS");
     sms->addChildSafe(buildTID(callRef,tiFlag));
     XmlElement* what = new XmlElement(s_message);
@@ -3580,6 +4343,20 @@ bool YBTSSignalling::sendSmsCPRsp(YBTSConn* conn, const String& callRef, bool ti
 {
     if (!conn)
 	return false;
+    uint8_t b[3] = {0,YBTSL3Fast::CPAck,0};
+    if (s_binaryCodec && YBTSL3Fast::encodeTI(b[0],YBTSL3Fast::SMS,callRef,tiFlag)) {
+	unsigned int len = 2;
+	if (cause) {
+	    b[1] = YBTSL3Fast::CPError;
+	    b[2] = lookup(cause,YBTSL3Fast::s_cpCause);
+	    len = b[2] ? 3 : 0;
+	}
+	if (len) {
+	    YBTSMessage m(SigL3Message,sapi,conn->connId());
+	    m.payload().assign(b,len);
+	    return send(m);
+	}
+    }
     XmlElement* sms = new XmlElement("SMS");
     sms->addChildSafe(buildTID(callRef,tiFlag));
     XmlElement* what = new XmlElement(s_message);
@@ -3666,7 +4443,7 @@ bool YBTSSignalling::start()
 	    break;
 	}
 	Lock lck(this);
-	if (!m_transport.initTransport(false,s_bufLenSign,true))
+	if (!m_transport.initTransport(false,s_bufLenSign,true,YBTS_READ_BATCH_SIGN))
 	    break;
 	if (!startThread("YBTSSignalling"))
 	    break;
@@ -3695,6 +4472,25 @@ void YBTSSignalling::stop()
     Debug(this,DebugInfo,"Stopped [%p]",this);
 }
 
+bool YBTSSignalling::resetPeer()
+{
+    Lock lck(this);
+    if (!(threadRunning() && m_transport.remoteValid()))
+	return false;
+    changeState(Closing);
+    lck.drop();
+    dropAllSS();
+    ObjList ids;
+    m_connsMutex.lock();
+    for (ObjList* o = m_conns.skipNull(); o; o = o->skipNext())
+	ids.append(new String(static_cast<YBTSConn*>(o->get())->connId()));
+    m_connsMutex.unlock();
+    for (ObjList* o = ids.skipNull(); o; o = o->skipNext())
+	dropConn(static_cast<String*>(o->get())->toInteger(),false);
+    Debug(this,DebugInfo,"Dropped %u connections on peer restart [%p]",ids.count(),this);
+    return true;
+}
+
 // Drop a connection
 void YBTSSignalling::dropConn(uint16_t connId, bool notifyPeer)
 {
@@ -3835,7 +4631,7 @@ void YBTSSignalling::processLoop()
     while (!Thread::check(false)) {
 	int rd = m_transport.recv();
 	if (rd > 0) {
-	    uint8_t* buf = (uint8_t*)m_transport.readBuf().data();
+	    uint8_t* buf = m_transport.readData();
 	    YBTSMessage* m = YBTSMessage::parse(this,buf,rd);
 	    if (m) {
 		lock();
@@ -4077,7 +4873,12 @@ int YBTSSignalling::handlePDU(YBTSMessage& msg)
 		    msg.name(),this);
 		return Ok;
 	    }
-	    if (msg.xml()) {
+	    if (msg.l3().m_proto == YBTSL3Fast::SMS) {
+		RefPointer<YBTSConn> conn;
+		if (findConnDrop(msg,conn,msg.connId()))
+		    __plugin.handleSmsPDU(msg,conn);
+	    }
+	    else if (msg.xml()) {
 		const String& proto = msg.xml()->getTag();
 		RefPointer<YBTSConn> conn;
 		if (proto == YSTRING("MM")) {
@@ -4220,6 +5021,17 @@ void YBTSSignalling::printMsg(YBTSMessage& msg, bool recv)
 	    }
 	    msg.xml()->toString(data,false,indent,origindent);
 	}
+	else if (msg.l3().m_proto == YBTSL3Fast::SMS) {
+	    const YBTSL3Fast& l3 = msg.l3();
+	    data << "SMS " << lookup(l3.m_type,YBTSL3Fast::s_smsType) << " TID=" << l3.m_callRef;
+	    data << " TIFlag=" << String::boolText(l3.m_tiFlag);
+	    if (l3.m_type == YBTSL3Fast::CPError)
+		data << " CP-Cause=" << (unsigned int)l3.m_cause;
+	    else if (l3.m_rpdu)
+		data << " RPDU=" << l3.m_rpdu;
+	}
+	else if (msg.payload().length())
+	    data.hexify((void*)msg.payload().data(),msg.payload().length(),' ');
 	s.append(data,"\r\n");
     }
     s << "\r\n-----";
@@ -4314,7 +5126,7 @@ bool YBTSMedia::start()
     stop();
     while (true) {
 	Lock lck(this);
-	if (!m_transport.initTransport(false,s_bufLenMedia,false))
+	if (!m_transport.initTransport(false,s_bufLenMedia,false,YBTS_READ_BATCH_MEDIA))
 	    break;
 	if (!startThread("YBTSMedia"))
 	    break;
@@ -4344,7 +5156,7 @@ void YBTSMedia::processLoop()
     while (!Thread::check(false)) {
 	int rd = m_transport.recv();
 	if (rd > 0) {
-	    uint16_t* d = (uint16_t*)m_transport.m_readBuf.data();
+	    uint16_t* d = (uint16_t*)m_transport.readData();
 	    YBTSDataSource* src = rd >= 2 ? find(ntohs(*d)) : 0;
 	    if (!src)
 		continue;
@@ -4401,6 +5213,7 @@ bool YBTSUE::startPaging(BtsPagingChanType type)
     m_pageCnt++;
     if (m_paging)
 	return true;
+    m_pagingType = type;
     YBTSSignalling* sig = __plugin.signalling();
     if (!sig)
 	return false;
@@ -4414,7 +5227,8 @@ bool YBTSUE::startPaging(BtsPagingChanType type)
     else
 	return false;
     lck.drop();
-    YBTSMessage m(SigStartPaging,(uint8_t)type,0,new XmlElement("identity",tmp));
+    YBTSMessage m(SigStartPaging,(uint8_t)type);
+    m.setPagingIdentity(tmp);
     if (sig->send(m)) {
 	Debug(&__plugin,DebugAll,"Started paging %s",tmp.c_str());
 	lck.acquire(this);
@@ -4446,7 +5260,8 @@ void YBTSUE::stopPagingNow()
     unlock();
     if (!tmp)
 	return;
-    YBTSMessage m(SigStopPaging,0,0,new XmlElement("identity",tmp));
+    YBTSMessage m(SigStopPaging);
+    m.setPagingIdentity(tmp);
     if (sig->send(m)) {
 	Debug(&__plugin,DebugAll,"Stopped paging %s",tmp.c_str());
 	lock();
@@ -4456,16 +5271,36 @@ void YBTSUE::stopPagingNow()
     }
 }
 
+// Send paging again after a peer restart, the new peer knows nothing about it
+void YBTSUE::resumePaging()
+{
+    YBTSSignalling* sig = __plugin.signalling();
+    if (!sig)
+	return;
+    lock();
+    String tmp = m_paging;
+    uint8_t type = m_pagingType;
+    unlock();
+    if (!tmp)
+	return;
+    YBTSMessage m(SigStartPaging,type);
+    m.setPagingIdentity(tmp);
+    if (sig->send(m))
+	Debug(&__plugin,DebugAll,"Resumed paging %s",tmp.c_str());
+}
+
 
 //
 // YBTSLocationUpd
 //
 YBTSLocationUpd::YBTSLocationUpd(YBTSUE& ue, uint16_t connid)
-    : YBTSGlobalThread("YBTSLocUpd"),
+    : YBTSJob("YBTSLocUpd"),
     YBTSConnIdHolder(connid),
     YBTSConnAuth(connid,YBTSConn::FLocUpd),
     m_msg("user.register"),
-    m_startTime(Time::now())
+    m_startTime(Time::now()),
+    m_step(0),
+    m_rej(false)
 {
     m_imsi = ue.imsi();
     m_msg.addParam("driver",__plugin.name());
@@ -4480,62 +5315,87 @@ YBTSLocationUpd::YBTSLocationUpd(YBTSUE& ue, uint16_t connid)
     if (!valid || Thread::check(false) || Engine::exiting()) { \
 	if (!valid) \
 	    m_imsi.clear(); \
-	if (rej) \
+	if (m_rej) \
 	    authReject(); \
 	notify(false,false); \
-	return; \
+	return Done; \
     } \
 }
 
-void YBTSLocationUpd::run()
-{
-    set(this,true);
-    if (!m_imsi)
-	return;
-    Debug(&__plugin,DebugAll,"Started location updating thread for IMSI=%s [%p]",
-	m_imsi.c_str(),this);
-    bool ok = Engine::dispatch(m_msg);
-    bool rej = !ok && (m_msg[s_error] == s_noAuth);
-    YBTS_LOCUPD_CHECK_STOP;
-    if (ok || !rej) {
-	notify(false,ok);
-	return;
-    }
-    String reason;
-    ok = authSend(m_msg,reason);
-    YBTS_LOCUPD_CHECK_STOP;
-    while (ok && (m_authOk || m_authNeedResync)) {
-	authSetParams(m_msg);
-	ok = Engine::dispatch(m_msg);
-	rej = !ok && (m_msg[s_error] == s_noAuth);
-	YBTS_LOCUPD_CHECK_STOP;
-	if (ok || !rej)
-	    break;
-	ok = authSend(m_msg,reason);
-	YBTS_LOCUPD_CHECK_STOP;
-	if (!ok)
-	    break;
-	if (!m_authOk) {
-	    ok = false;
-	    break;
+// Steps:
+// 0: Dispatch user.register. Send AUTH REQ if 'noauth' is returned
+// 1: Dispatch with auth response. Send AUTH REQ again if 'noauth' is returned
+// 2: Dispatch with auth response
+int YBTSLocationUpd::process()
+{
+    bool ok = false;
+    switch (m_step) {
+	case 0:
+	    if (!m_imsi)
+		return Done;
+	    Debug(&__plugin,DebugAll,"Started location updating for IMSI=%s [%p]",
+		m_imsi.c_str(),this);
+	    ok = Engine::dispatch(m_msg);
+	    m_rej = !ok && (m_msg[s_error] == s_noAuth);
+	    YBTS_LOCUPD_CHECK_STOP;
+	    if (ok || !m_rej) {
+		notify(false,ok);
+		return Done;
+	    }
+	    m_step = 1;
+	    // fall through
+	case 1:
+	{
+	    int res = authStep(m_msg,m_reason,ok);
+	    if (res != Done)
+		return res;
+	    YBTS_LOCUPD_CHECK_STOP;
+	    if (!(ok && (m_authOk || m_authNeedResync)))
+		break;
+	    authSetParams(m_msg);
+	    ok = Engine::dispatch(m_msg);
+	    m_rej = !ok && (m_msg[s_error] == s_noAuth);
+	    YBTS_LOCUPD_CHECK_STOP;
+	    if (ok || !m_rej)
+		break;
+	    m_step = 2;
+	}
+	    // fall through
+	case 2:
+	{
+	    int res = authStep(m_msg,m_reason,ok);
+	    if (res != Done)
+		return res;
+	    YBTS_LOCUPD_CHECK_STOP;
+	    if (!ok)
+		break;
+	    if (!m_authOk) {
+		ok = false;
+		break;
+	    }
+	    authSetParams(m_msg);
+	    ok = Engine::dispatch(m_msg);
+	    m_rej = !ok && (m_msg[s_error] == s_noAuth);
+	    YBTS_LOCUPD_CHECK_STOP;
 	}
-	authSetParams(m_msg);
-	ok = Engine::dispatch(m_msg);
-	rej = !ok && (m_msg[s_error] == s_noAuth);
-	YBTS_LOCUPD_CHECK_STOP;
-	break;
     }
-    if (reason)
+    if (m_reason)
 	Debug(&__plugin,DebugNote,
 	    "Failed to complete location updating authentication IMSI=%s: %s [%p]",
-	    m_imsi.c_str(),reason.c_str(),this);
-    if (rej) {
+	    m_imsi.c_str(),m_reason.c_str(),this);
+    if (m_rej) {
 	Debug(&__plugin,DebugNote,
 	    "Location updating IMSI=%s: rejecting authentication [%p]",
 	    m_imsi.c_str(),this);
 	authReject();
     }
     notify(false,ok);
+    return Done;
+}
+
+void YBTSLocationUpd::authNotify()
+{
+    s_jobs.wakeup(this);
 }
 
 void YBTSLocationUpd::notify(bool final, bool ok)
@@ -4545,14 +5405,14 @@ void YBTSLocationUpd::notify(bool final, bool ok)
     String imsi = m_imsi;
     m_imsi.clear();
     if (!final)
-	Debug(&__plugin,DebugAll,"Location updating thread for IMSI=%s terminated [%p]",
+	Debug(&__plugin,DebugAll,"Location updating for IMSI=%s terminated [%p]",
 	    imsi.c_str(),this);
     else {
 	ok = false;
 	m_msg.setParam(s_error,String(CauseProtoError));
 	if (!Engine::exiting())
 	    Alarm(&__plugin,"system",DebugWarn,
-		"Location updating thread for IMSI=%s abnormally terminated [%p]",
+		"Location updating for IMSI=%s abnormally terminated [%p]",
 		imsi.c_str(),this);
     }
     if (__plugin.mm())
@@ -4565,14 +5425,17 @@ void YBTSLocationUpd::notify(bool final, bool ok)
 //
 YBTSSubmit::YBTSSubmit(YBTSTid::Type t, uint16_t connid, YBTSUE* ue,
     const char* callRef)
-    : YBTSGlobalThread("YBTSSubmit"),
+    : YBTSJob("YBTSSubmit"),
     YBTSConnIdHolder(connid),
     YBTSConnAuth(connid,0),
     m_type(t),
     m_callRef(callRef),
     m_msg("call.route"),
     m_ok(false),
-    m_cause(111)
+    m_cause(111),
+    m_step(0),
+    m_dispStep(0),
+    m_dispRej(false)
 {
     m_msg.addParam("module",__plugin.name());
     switch (t) {
@@ -4595,35 +5458,57 @@ YBTSSubmit::YBTSSubmit(YBTSTid::Type t, uint16_t connid, YBTSUE* ue,
     m_msg.addParam("username",m_imsi,false);
 }
 
-void YBTSSubmit::run()
+// Steps:
+// 0: Start
+// 1: Route
+// 2: Execute
+int YBTSSubmit::process()
 {
-    set(this,true);
-    Debug(&__plugin,DebugAll,
-	"Started MO submit thread type=%s IMSI=%s callRef=%s [%p]",
-	YBTSTid::typeName(m_type),m_imsi.c_str(),m_callRef.c_str(),this);
-    while (m_imsi) {
-	if (!dispatch(true))
-	    break;
-	switch (m_type) {
-	    case YBTSTid::Sms:
-		m_msg = "msg.execute";
-	        break;
-	    case YBTSTid::Ussd:
-		m_msg = "ussd.execute";
-	        break;
-	    default:
-		m_msg = "";
+    bool ok = false;
+    switch (m_step) {
+	case 0:
+	    Debug(&__plugin,DebugAll,
+		"Started MO submit type=%s IMSI=%s callRef=%s [%p]",
+		YBTSTid::typeName(m_type),m_imsi.c_str(),m_callRef.c_str(),this);
+	    if (!m_imsi)
+		break;
+	    m_step = 1;
+	    // fall through
+	case 1:
+	{
+	    int res = dispatch(true,ok);
+	    if (res != Done)
+		return res;
+	    if (!ok)
+		break;
+	    switch (m_type) {
+		case YBTSTid::Sms:
+		    m_msg = "msg.execute";
+		    break;
+		case YBTSTid::Ussd:
+		    m_msg = "ussd.execute";
+		    break;
+		default:
+		    m_msg = "";
+	    }
+	    if (!m_msg)
+		break;
+	    m_msg.setParam("callto",m_msg.retValue());
+	    clearListParams(m_msg,s_error,YSTRING("reason"));
+	    m_msg.retValue().clear();
+	    authClearParams(m_msg);
+	    m_step = 2;
+	}
+	    // fall through
+	case 2:
+	{
+	    int res = dispatch(false,ok);
+	    if (res != Done)
+		return res;
+	    m_ok = ok;
+	    if (m_ok)
+		m_cause = 0;
 	}
-	if (!m_msg)
-	    break;
-	m_msg.setParam("callto",m_msg.retValue());
-	clearListParams(m_msg,s_error,YSTRING("reason"));
-	m_msg.retValue().clear();
-	authClearParams(m_msg);
-	m_ok = dispatch(false);
-	if (m_ok)
-	    m_cause = 0;
-	break;
     }
     if (m_ok && m_originUsed && isValidStartTime(m_msg.msgTime()) &&
 	__plugin.signalling()) {
@@ -4633,7 +5518,7 @@ void YBTSSubmit::run()
     }
     if (Thread::check(false) || Engine::exiting()) {
 	m_imsi.clear();
-	return;
+	return Done;
     }
     // TODO: Try to build a cause from other param?
     if (m_type == YBTSTid::Sms) {
@@ -4642,6 +5527,12 @@ void YBTSSubmit::run()
 	m_data = m_msg[YSTRING("irpdu")];
     }
     notify(false);
+    return Done;
+}
+
+void YBTSSubmit::authNotify()
+{
+    s_jobs.wakeup(this);
 }
 
 void YBTSSubmit::notify(bool final)
@@ -4655,12 +5546,12 @@ void YBTSSubmit::notify(bool final)
 	return;
     if (!final)
 	Debug(&__plugin,DebugAll,
-	    "MO submit thread type=%s IMSI=%s callRef=%s terminated ok=%s data='%s' cause=%u [%p]",
+	    "MO submit type=%s IMSI=%s callRef=%s terminated ok=%s data='%s' cause=%u [%p]",
 	    YBTSTid::typeName(m_type),imsi.c_str(),m_callRef.c_str(),
 	    String::boolText(m_ok),TelEngine::c_safe(m_data),m_cause,this);
     else if (!Engine::exiting())
 	Alarm(&__plugin,"system",DebugWarn,
-	    "MO submit thread type=%s IMSI=%s callRef=%s abnormally terminated [%p]",
+	    "MO submit type=%s IMSI=%s callRef=%s abnormally terminated [%p]",
 	    YBTSTid::typeName(m_type),imsi.c_str(),m_callRef.c_str(),this);
     if (!__plugin.signalling())
 	return;
@@ -4687,60 +5578,86 @@ static inline bool routeOk(Message& msg)
     return true;
 }
 
-bool YBTSSubmit::dispatch(bool route)
-{
-    bool ok = Engine::dispatch(m_msg);
-    if (Thread::check(false) || Engine::exiting())
-	return false;
-    if (!ok && route)
-	return false;
-    if (route) {
-	if (routeOk(m_msg))
-	    return true;
-	if (m_msg[s_error] != s_noAuth)
-	    return false;
-    }
-    else if (ok || m_msg[s_error] != s_noAuth)
-	return ok;
-    String reason;
-    ok = authSend(m_msg,reason);
-    bool rej = true;
-    while (ok && !reason && (m_authOk || m_authNeedResync)) {
-	if (threadExiting(reason))
-	    break;
-	authSetParams(m_msg);
-	ok = Engine::dispatch(m_msg);
-	if (route)
-	    ok = ok && routeOk(m_msg);
-	rej = !ok && (m_msg[s_error] == s_noAuth);
-	if (threadExiting(reason))
-	    break;
-	if (ok || !rej)
-	    break;
-	ok = authSend(m_msg,reason);
-	if (!ok || reason || threadExiting(reason) || !m_authOk)
-	    break;
-	authSetParams(m_msg);
-	ok = Engine::dispatch(m_msg);
-	if (route)
-	    ok = ok && routeOk(m_msg);
-	rej = !ok && (m_msg[s_error] == s_noAuth);
-	threadExiting(reason);
-	break;
-    }
-    if (!(reason || rej))
-	return ok;
-    if (reason)
+// Dispatch the message, authenticate the MS if 'noauth' is returned
+// Steps:
+// 0: Dispatch. Send AUTH REQ if 'noauth' is returned
+// 1: Dispatch with auth response. Send AUTH REQ again if 'noauth' is returned
+// 2: Dispatch with auth response
+// Return a YBTSJob::Result, set 'ok' to dispatch result when Done
+int YBTSSubmit::dispatch(bool route, bool& ok)
+{
+    ok = false;
+    switch (m_dispStep) {
+	case 0:
+	    ok = Engine::dispatch(m_msg);
+	    if (Thread::check(false) || Engine::exiting()) {
+		ok = false;
+		return Done;
+	    }
+	    if (!ok && route)
+		return Done;
+	    if (route) {
+		ok = routeOk(m_msg);
+		if (ok || m_msg[s_error] != s_noAuth)
+		    return Done;
+	    }
+	    else if (ok || m_msg[s_error] != s_noAuth)
+		return Done;
+	    m_reason.clear();
+	    m_dispRej = true;
+	    m_dispStep = 1;
+	    // fall through
+	case 1:
+	{
+	    int res = authStep(m_msg,m_reason,ok);
+	    if (res != Done)
+		return res;
+	    if (!(ok && !m_reason && (m_authOk || m_authNeedResync)))
+		break;
+	    if (threadExiting(m_reason))
+		break;
+	    authSetParams(m_msg);
+	    ok = Engine::dispatch(m_msg);
+	    if (route)
+		ok = ok && routeOk(m_msg);
+	    m_dispRej = !ok && (m_msg[s_error] == s_noAuth);
+	    if (threadExiting(m_reason))
+		break;
+	    if (ok || !m_dispRej)
+		break;
+	    m_dispStep = 2;
+	}
+	    // fall through
+	case 2:
+	{
+	    int res = authStep(m_msg,m_reason,ok);
+	    if (res != Done)
+		return res;
+	    if (!ok || m_reason || threadExiting(m_reason) || !m_authOk)
+		break;
+	    authSetParams(m_msg);
+	    ok = Engine::dispatch(m_msg);
+	    if (route)
+		ok = ok && routeOk(m_msg);
+	    m_dispRej = !ok && (m_msg[s_error] == s_noAuth);
+	    threadExiting(m_reason);
+	}
+    }
+    m_dispStep = 0;
+    if (!(m_reason || m_dispRej))
+	return Done;
+    if (m_reason)
 	Debug(&__plugin,DebugNote,
 	    "Failed to complete authentication for MO submit type=%s IMSI=%s callRef=%s: %s [%p]",
-	    YBTSTid::typeName(m_type),m_imsi.c_str(),m_callRef.c_str(),reason.c_str(),this);
-    if (rej) {
+	    YBTSTid::typeName(m_type),m_imsi.c_str(),m_callRef.c_str(),m_reason.c_str(),this);
+    if (m_dispRej) {
 	Debug(&__plugin,DebugNote,
 	    "Rejecting authentication for MO submit type=%s IMSI=%s callRef=%s [%p]",
 	    YBTSTid::typeName(m_type),m_imsi.c_str(),m_callRef.c_str(),this);
 	authReject();
     }
-    return false;
+    ok = false;
+    return Done;
 }
 
 
@@ -4795,6 +5712,71 @@ void YBTSMtSmsList::destroyed()
 	__plugin.signalling()->setConnUsage(m_conn,false,YBTSConn::FMtSms);
 }
 
+// Retrieve the next TID not used by a sent SMS
+uint8_t YBTSMtSmsList::nextTid()
+{
+    for (unsigned int n = 0; n < 7; n++) {
+	uint8_t tid = m_tid++;
+	if (m_tid >= 7)
+	    m_tid = 0;
+	String ref((int)tid);
+	ObjList* o = m_sms.skipNull();
+	for (; o; o = o->skipNext()) {
+	    YBTSMtSms* sms = static_cast<YBTSMtSms*>(o->get());
+	    if (sms->sent() && sms->callRef() == ref)
+		break;
+	}
+	if (!o)
+	    return tid;
+    }
+    return m_tid;
+}
+
+// Request or release a paging slot
+// A released slot is given to the first waiting list
+bool YBTSMtSmsList::pagingSlot(bool get)
+{
+    Lock lck(s_mtSmsPagingMutex);
+    if (get) {
+	if (m_pagingSlot)
+	    return true;
+	if (s_mtSmsPagingMax && s_mtSmsPaging >= s_mtSmsPagingMax) {
+	    if (!m_pagingWait) {
+		m_pagingWait = true;
+		s_mtSmsPagingWait.append(this)->setDelete(false);
+	    }
+	    return false;
+	}
+	s_mtSmsPaging++;
+	m_pagingSlot = true;
+	return true;
+    }
+    if (m_pagingWait) {
+	m_pagingWait = false;
+	s_mtSmsPagingWait.remove(this,false);
+    }
+    if (!m_pagingSlot)
+	return true;
+    m_pagingSlot = false;
+    ObjList* o = s_mtSmsPagingWait.skipNull();
+    if (!o) {
+	s_mtSmsPaging--;
+	return true;
+    }
+    YBTSMtSmsList* list = static_cast<YBTSMtSmsList*>(o->remove(false));
+    list->m_pagingWait = false;
+    list->m_pagingSlot = true;
+    list->m_check = true;
+    return true;
+}
+
+void YBTSMtSmsList::pagingStatus(unsigned int& paging, unsigned int& waiting)
+{
+    Lock lck(s_mtSmsPagingMutex);
+    paging = s_mtSmsPaging;
+    waiting = s_mtSmsPagingWait.count();
+}
+
 
 //
 // YBTSMM
@@ -4923,6 +5905,26 @@ void YBTSMM::locUpdTerminated(uint64_t startTime, const String& imsi, uint16_t c
     TelEngine::destruct(mm);
 }
 
+void YBTSMM::resumePaging()
+{
+    ObjList paging;
+    m_ueMutex.lock();
+    for (unsigned int i = 0; i < m_ueHashLen; i++) {
+	for (ObjList* o = m_ueIMSI[i].skipNull(); o; o = o->skipNext()) {
+	    YBTSUE* ue = static_cast<YBTSUE*>(o->get());
+	    if (ue->paging() && ue->ref())
+		paging.append(ue);
+	}
+    }
+    m_ueMutex.unlock();
+    unsigned int n = paging.count();
+    if (!n)
+	return;
+    Debug(this,DebugInfo,"Resuming paging for %u UEs [%p]",n,this);
+    for (ObjList* o = paging.skipNull(); o; o = o->skipNext())
+	static_cast<YBTSUE*>(o->get())->resumePaging();
+}
+
 void YBTSMM::completeUe(String& buf, const String& partWord,
     bool imsi, bool tmsi, bool imei)
 {
@@ -5140,11 +6142,11 @@ bool YBTSMM::handlePagingResponse(YBTSMessage& m, YBTSConn* conn, XmlElement& rs
     if (conn)
 	auth = __plugin.havePagingMtService(ue,s_authMtCall,s_authMtSms,s_authMtUssd);
     if (auth) {
-	YBTSConnAuthThread* th = new YBTSConnAuthThread(conn->connId(),ue,auth);
-	if (th->startup())
+	YBTSConnAuthJob* job = new YBTSConnAuthJob(conn->connId(),ue,auth);
+	if (s_jobs.add(job))
 	    return true;
-	delete th;
-	Debug(this,DebugNote,"Failed to start MT auth thread for conn=%u [%p]",
+	delete job;
+	Debug(this,DebugNote,"Failed to start MT auth for conn=%u [%p]",
 	    m.connId(),this);
 	conn = 0;
     }
@@ -5283,12 +6285,12 @@ void YBTSMM::handleLocationUpdate(YBTSMessage& m, const XmlElement& xml, YBTSCon
 	}
     }
     ue->m_imsiDetached = false;
-    YBTSLocationUpd* th = new YBTSLocationUpd(*ue,conn->connId());
+    YBTSLocationUpd* job = new YBTSLocationUpd(*ue,conn->connId());
     lckUE.drop();
-    if (!th->startup()) {
-	delete th;
+    if (!s_jobs.add(job)) {
+	delete job;
 	ue->lock();
-	Debug(this,DebugNote,"Location updating for IMSI=%s: failed to start thread [%p]",
+	Debug(this,DebugNote,"Location updating for IMSI=%s: failed to start job [%p]",
 	    ue->imsi().c_str(),this);
 	ue->unlock();
 	sendLocationUpdateReject(m,conn,CauseProtoError);
@@ -6548,6 +7550,7 @@ YBTSDriver::YBTSDriver()
     m_state(Idle),
     m_stateMutex(false,"YBTSState"),
     m_peerPid(0),
+    m_peerGroup(0),
     m_peerAlive(false),
     m_peerCheckTime(0),
     m_peerCheckIntervalMs(YBTS_PEERCHECK_DEF),
@@ -6558,6 +7561,8 @@ YBTSDriver::YBTSDriver()
     m_restart(false),
     m_restartTime(0),
     m_restartIndex(0),
+    m_warm(false),
+    m_warmResync(false),
     m_logTrans(0),
     m_logBts(0),
     m_command(0),
@@ -6724,6 +7729,14 @@ void YBTSDriver::handleCC(YBTSMessage& m, YBTSConn* conn)
 // Handle SMS PDUs
 void YBTSDriver::handleSmsPDU(YBTSMessage& m, YBTSConn* conn)
 {
+    const YBTSL3Fast& l3 = m.l3();
+    if (l3.m_proto == YBTSL3Fast::SMS) {
+	if (l3.m_type == YBTSL3Fast::CPData)
+	    handleSmsCPData(m,conn,l3.m_callRef,l3.m_tiFlag,&l3.m_rpdu);
+	else
+	    handleSmsCPRsp(m,conn,l3.m_callRef,l3.m_tiFlag,l3.m_type == YBTSL3Fast::CPAck);
+	return;
+    }
     XmlElement* xml = m.xml() ? m.xml()->findFirstChild(&s_message) : 0;
     if (!xml) {
 	Debug(this,DebugNote,"Empty xml in %s [%p]",m.name(),this);
@@ -6742,11 +7755,11 @@ void YBTSDriver::handleSmsPDU(YBTSMessage& m, YBTSConn* conn)
 	return;
     }
     if (*type == YSTRING("CP-Data"))
-	handleSmsCPData(m,conn,*callRef,tiFlag,*xml);
+	handleSmsCPData(m,conn,*callRef,tiFlag,xml->childText(YSTRING("RPDU")));
     else if (*type == YSTRING("CP-Ack"))
-	handleSmsCPRsp(m,conn,*callRef,tiFlag,*xml,true);
+	handleSmsCPRsp(m,conn,*callRef,tiFlag,true);
     else if (*type == YSTRING("CP-Error"))
-	handleSmsCPRsp(m,conn,*callRef,tiFlag,*xml,false);
+	handleSmsCPRsp(m,conn,*callRef,tiFlag,false);
     else
 	Debug(this,DebugNote,"Unhandled SMS %s conn=(%p,%u)",
 	    type->c_str(),conn,conn ? conn->connId() : 0);
@@ -7258,14 +8271,28 @@ bool YBTSDriver::radioReady()
     }
     m_restartIndex = 0;
     changeState(RadioUp);
+    bool resync = m_warmResync;
+    m_warmResync = false;
+    lck.drop();
+    if (resync && m_mm) {
+	Debug(this,DebugInfo,"Peer warm restart complete");
+	m_mm->resumePaging();
+    }
     return true;
 }
 
-void YBTSDriver::restart(unsigned int restartMs, unsigned int stopIntervalMs)
+void YBTSDriver::restart(unsigned int restartMs, unsigned int stopIntervalMs,
+    bool peerFailure)
 {
     Lock lck(m_stateMutex);
     if (m_error)
 	return;
+    // Any other restart reason overrides a pending warm restart
+    // Warm restart a peer only if it completed the handshake
+    if (!(peerFailure && s_warmRestart))
+	m_warm = false;
+    else if (!(m_restart || m_stop))
+	m_warm = (state() >= Running);
     if (m_restartTime && !restartMs)
 	m_restart = true;
     else
@@ -7281,6 +8308,7 @@ void YBTSDriver::stopNoRestart()
     m_restart = false;
     m_restartTime = 0;
     m_error = true;
+    m_warm = false;
 }
 
 // Enqueue an SS related message. Decode facility
@@ -7385,7 +8413,7 @@ bool YBTSDriver::mapEncode(XmlElement*& xml, String& buf, String* error, bool en
 }
 
 void YBTSDriver::handleSmsCPData(YBTSMessage& m, YBTSConn* conn,
-    const String& callRef, bool tiFlag, const XmlElement& cpData)
+    const String& callRef, bool tiFlag, const String* rpdu)
 {
     if (!conn) {
 	Debug(this,DebugMild,"Ignoring SMS CP-DATA conn=%u: no connection",m.connId());
@@ -7409,7 +8437,6 @@ void YBTSDriver::handleSmsCPData(YBTSMessage& m, YBTSConn* conn,
 	if (!conn->ue()->registered())
 	    SMS_CPDATA_DONE("UE not registered");
 	cause = "invalid-mandatory-info";
-	const String* rpdu = cpData.childText(YSTRING("RPDU"));
 	if (TelEngine::null(rpdu))
 	    SMS_CPDATA_DONE("empty RPDU");
 	uint8_t rpMsgType = 0;
@@ -7455,26 +8482,28 @@ void YBTSDriver::handleSmsCPData(YBTSMessage& m, YBTSConn* conn,
 	    Debug(this,DebugNote,
 		"SMS CP-DATA conn=%u: unable to retrieve SMSC number, %s",
 		m.connId(),res ? "empty destination address" : "invalid RP-DATA");
-	YBTSSubmit* th = new YBTSSubmit(YBTSTid::Sms,conn->connId(),conn->ue(),callRef);
+	YBTSSubmit* job = new YBTSSubmit(YBTSTid::Sms,conn->connId(),conn->ue(),callRef);
 	if (called) {
-	    th->msg().addParam("called",called);
-	    th->msg().addParam("callednumplan",plan,false);
-	    th->msg().addParam("callednumtype",type,false);
+	    job->msg().addParam("called",called);
+	    job->msg().addParam("callednumplan",plan,false);
+	    job->msg().addParam("callednumtype",type,false);
 	}
 	if (smsCalled) {
-	    th->msg().addParam("sms.called",smsCalled);
-	    th->msg().addParam("sms.called.plan",smsCalledPlan,false);
-	    th->msg().addParam("sms.called.nature",smsCalledType,false);
+	    job->msg().addParam("sms.called",smsCalled);
+	    job->msg().addParam("sms.called.plan",smsCalledPlan,false);
+	    job->msg().addParam("sms.called.nature",smsCalledType,false);
 	}
 	if (smsText) {
-	    th->msg().addParam("text",smsText);
-	    th->msg().addParam("text.encoding",smsTextEnc);
+	    job->msg().addParam("text",smsText);
+	    job->msg().addParam("text.encoding",smsTextEnc);
 	}
-	th->msg().addParam("rpdu",*rpdu);
-	if (th->startup())
+	job->msg().addParam("rpdu",*rpdu);
+	if (s_jobs.add(job))
 	    return;
+	job->discard();
+	delete job;
 	causeRp = 41; // Temporary failure
-	SMS_CPDATA_DONE_MILD("failed to start thread");
+	SMS_CPDATA_DONE_MILD("failed to start job");
 #undef SMS_CPDATA_DONE
 #undef SMS_CPDATA_DONE_MILD
     }
@@ -7492,7 +8521,7 @@ void YBTSDriver::handleSmsCPData(YBTSMessage& m, YBTSConn* conn,
 }
 
 void YBTSDriver::handleSmsCPRsp(YBTSMessage& m, YBTSConn* conn,
-    const String& callRef, bool tiFlag, const XmlElement& rsp, bool ok)
+    const String& callRef, bool tiFlag, bool ok)
 {
     Debug(this,ok ? DebugAll : DebugNote,"SMS %s conn=%u callRef=%s tiFlag=%s",
 	(ok ? "CP-ACK" : "CP-ERROR"),m.connId(),callRef.c_str(),
@@ -7512,95 +8541,101 @@ void YBTSDriver::handleSmsCPRsp(YBTSMessage& m, YBTSConn* conn,
 bool YBTSDriver::checkMtSms(YBTSMtSmsList& list, unsigned int* toutAuth)
 {
     Lock lck(list);
-    ObjList* o = list.m_sms.skipNull();
-    XDebug(this,DebugAll,"checkMtSms(%p)%s",&list,(o ? "" : " empty"));
-    if (!o)
-	return false;
-    YBTSMtSms* sms = static_cast<YBTSMtSms*>(o->get());
-    if (!sms->active()) {
-	XDebug(this,DebugAll,"checkMtSms(%p) removing inactive '%s'",
-	    &list,sms->id().c_str());
-	o->remove();
-	lck.drop();
-	return checkMtSms(list);
-    }
-    DDebug(this,DebugAll,
-	"checkMtSms(%p) '%s' sent=%u paging=%u conn=%p waitTraffic=%u",
-	&list,sms->id().c_str(),sms->sent(),!list.ue()->paging().null(),
-	(YBTSConn*)(list.m_conn),(list.m_conn ? list.m_conn->waitForTraffic() : false));
-    // Do nothing if radio is not up
-    if (m_state != RadioUp)
-	return true;
-    if (sms->sent())
-	return true;
-    if (list.paging()) {
-	if (list.ue() && list.ue()->paging())
-	    return true;
-	list.stopPaging();
-    }
-    if (!list.m_conn) {
-	// No connection: start paging
-	if (!m_signalling->findConn(list.m_conn,list.ue())) {
-	    list.startPaging();
-	    return true;
+    while (true) {
+	// Remove terminated SMS, count the ones waiting for response
+	YBTSMtSms* sms = 0;
+	unsigned int sent = 0;
+	for (ObjList* o = list.m_sms.skipNull(); o;) {
+	    YBTSMtSms* tmp = static_cast<YBTSMtSms*>(o->get());
+	    if (!tmp->active()) {
+		XDebug(this,DebugAll,"checkMtSms(%p) removing inactive '%s'",
+		    &list,tmp->id().c_str());
+		o->remove();
+		o = o->skipNull();
+		continue;
+	    }
+	    if (tmp->sent())
+		sent++;
+	    else if (!sms)
+		sms = tmp;
+	    o = o->skipNext();
 	}
-	list.stopPaging();
-	if (list.m_conn->flag(YBTSConn::FLocUpd)) {
-	    list.m_conn = 0;
+	XDebug(this,DebugAll,"checkMtSms(%p)%s",&list,
+	    (list.m_sms.skipNull() ? "" : " empty"));
+	if (!list.m_sms.skipNull())
+	    return false;
+	// Do nothing if radio is not up, all SMS were sent or window is full
+	if (m_state != RadioUp || !sms || sent >= s_mtSmsWindow)
 	    return true;
+	DDebug(this,DebugAll,
+	    "checkMtSms(%p) '%s' sent=%u paging=%u conn=%p waitTraffic=%u",
+	    &list,sms->id().c_str(),sent,!list.ue()->paging().null(),
+	    (YBTSConn*)(list.m_conn),(list.m_conn ? list.m_conn->waitForTraffic() : false));
+	if (list.paging()) {
+	    if (list.ue() && list.ue()->paging())
+		return true;
+	    list.stopPaging();
 	}
-	if (list.m_auth == 1)
-	    return true;
-	if (!list.m_auth && s_authMtSms && !list.m_conn->authenticated()) {
-	    const char* error = "failure";
-	    if (toutAuth) {
-		list.m_auth = 1;
-		lck.drop();
-		error = authConnMt(list.m_conn,true,*toutAuth);
-		lck.acquire(list);
-		list.m_auth = 2;
-		if (!error) {
+	if (!list.m_conn) {
+	    // No connection: start paging
+	    if (!m_signalling->findConn(list.m_conn,list.ue())) {
+		list.startPaging();
+		return true;
+	    }
+	    list.stopPaging();
+	    if (list.m_conn->flag(YBTSConn::FLocUpd)) {
+		list.m_conn = 0;
+		return true;
+	    }
+	    if (list.m_auth == 1)
+		return true;
+	    if (!list.m_auth && s_authMtSms && !list.m_conn->authenticated()) {
+		const char* error = "failure";
+		if (toutAuth) {
+		    list.m_auth = 1;
 		    lck.drop();
-		    return checkMtSms(list);
+		    error = authConnMt(list.m_conn,true,*toutAuth);
+		    lck.acquire(list);
+		    list.m_auth = 2;
+		    if (!error)
+			continue;
+		}
+		list.m_conn = 0;
+		String imsi;
+		list.ue()->imsiSafe(imsi);
+		for (ObjList* o = list.m_sms.skipNull(); o; o = o->skipNext()) {
+		    YBTSMtSms* sms = static_cast<YBTSMtSms*>(o->get());
+		    Debug(this,DebugNote,"Dropping MT SMS '%s' to IMSI=%s: %s",
+			sms->id().c_str(),imsi.c_str(),
+			(toutAuth ? error : "connection not authenticated"));
+		    sms->terminate(false,error);
 		}
+		return true;
 	    }
-	    list.m_conn = 0;
+	    signalling()->setConnUsage(list.m_conn,true,YBTSConn::FMtSms);
+	}
+	if (list.m_conn->waitForTraffic())
+	    return true;
+	// Check for SAPI 3 availability
+	uint8_t sapi = list.m_conn->startSapi(3);
+	if (sapi == 255)
+	    return true;
+	list.m_auth = 0;
+	sms->m_callRef = list.nextTid();
+	if (signalling()->sendSmsCPData(list.m_conn,sms->callRef(),false,sapi,sms->rpdu())) {
 	    String imsi;
 	    list.ue()->imsiSafe(imsi);
-	    for (ObjList* o = list.m_sms.skipNull(); o; o = o->skipNext()) {
-		YBTSMtSms* sms = static_cast<YBTSMtSms*>(o->get());
-		Debug(this,DebugNote,"Dropping MT SMS '%s' to IMSI=%s: %s",
-		    sms->id().c_str(),imsi.c_str(),
-		    (toutAuth ? error : "connection not authenticated"));
-		sms->terminate(false,error);
-	    }
-	    return true;
+	    Debug(this,DebugAll,"MT SMS '%s' to IMSI=%s sent on conn %u tid=%s",
+		sms->id().c_str(),imsi.c_str(),list.m_conn->connId(),
+		sms->callRef().c_str());
+	    sms->m_sent = true;
+	    continue;
 	}
-	signalling()->setConnUsage(list.m_conn,true,YBTSConn::FMtSms);
-    }
-    if (list.m_conn->waitForTraffic())
-	return true;
-    // Check for SAPI 3 availability
-    uint8_t sapi = list.m_conn->startSapi(3);
-    if (sapi == 255)
-	return true;
-    list.m_auth = 0;
-    sms->m_callRef = list.m_tid++;
-    if (list.m_tid >= 7)
-	list.m_tid = 0;
-    if (signalling()->sendSmsCPData(list.m_conn,sms->callRef(),false,sapi,sms->rpdu())) {
-	String imsi;
-	list.ue()->imsiSafe(imsi);
-	Debug(this,DebugAll,"MT SMS '%s' to IMSI=%s sent on conn %u",
-	    sms->id().c_str(),imsi.c_str(),list.m_conn->connId());
-	sms->m_sent = true;
-	return true;
+	// Failed to send: terminate now
+	sms->terminate(false);
+	list.m_sms.remove(sms);
     }
-    // Failed to send: terminate now
-    sms->terminate(false);
-    o->remove();
-    lck.drop();
-    return checkMtSms(list);
+    return true;
 }
 
 void YBTSDriver::checkMtSs(YBTSConn* conn)
@@ -7661,24 +8696,25 @@ bool YBTSDriver::handleMtSmsRsp(YBTSUE* ue, bool ok, const String& callRef,
     if (!findMtSmsList(list,ue))
 	return false;
     Lock lck(list);
-    ObjList* first = list->m_sms.skipNull();
-    if (!first) {
-	lck.drop();
-	removeMtSms(list);
-	return false;
+    YBTSMtSms* sms = 0;
+    for (ObjList* o = list->m_sms.skipNull(); o; o = o->skipNext()) {
+	YBTSMtSms* tmp = static_cast<YBTSMtSms*>(o->get());
+	if (tmp->active() && tmp->sent() && tmp->callRef() == callRef) {
+	    sms = tmp;
+	    break;
+	}
     }
-    YBTSMtSms* sms = static_cast<YBTSMtSms*>(first->get());
-    if (!sms->active()) {
-	first->remove();
+    if (!sms) {
+	bool empty = !list->m_sms.skipNull();
 	lck.drop();
-	return handleMtSmsRsp(ue,ok,callRef,reason,rpdu);
-    }
-    if (sms->callRef() != callRef)
+	if (empty)
+	    removeMtSms(list);
 	return false;
+    }
     Debug(this,DebugAll,"MT SMS '%s' to IMSI=%s responded",
 	sms->id().c_str(),ue->imsi().c_str());
     sms->terminate(ok,reason,rpdu);
-    first->remove();
+    list->m_sms.remove(sms);
     lck.drop();
     if (respondSapi != 255)
 	signalling()->sendSmsCPRsp(list->m_conn,callRef,false,respondSapi);
@@ -7860,17 +8896,17 @@ bool YBTSDriver::submitUssd(YBTSConn* conn, const String& callRef, const String&
 	    reason = "empty USSD string";
 	    break;
 	}
-	YBTSSubmit* th = new YBTSSubmit(YBTSTid::Ussd,conn->connId(),conn->ue(),callRef);
-	th->msg().addParam("called",text);
-	th->msg().addParam("id",ssId);
-	th->msg().addParam("operation_type",ussdOperName(Pssr));
-	th->msg().addParam("text",text);
-	textXml->copyAttributes(th->msg(),"text.");
-	exportXml(th->msg(),facilityXml);
-	if (th->startup())
+	YBTSSubmit* job = new YBTSSubmit(YBTSTid::Ussd,conn->connId(),conn->ue(),callRef);
+	job->msg().addParam("called",text);
+	job->msg().addParam("id",ssId);
+	job->msg().addParam("operation_type",ussdOperName(Pssr));
+	job->msg().addParam("text",text);
+	textXml->copyAttributes(job->msg(),"text.");
+	exportXml(job->msg(),facilityXml);
+	if (s_jobs.add(job))
 	    return true;
-	delete th;
-	reason = "failed to start routing thread";
+	delete job;
+	reason = "failed to start routing job";
 	break;
     }
     Debug(this,DebugNote,"Rejecting MO USSD on conn=%u: %s",conn->connId(),reason);
@@ -7922,21 +8958,30 @@ const char* YBTSDriver::authConnMt(YBTSConn* conn, bool sms, unsigned int& toutM
     return fail;
 }
 
-void YBTSDriver::start()
+// Check and increase the restart index. Halt the engine if the maximum was reached
+// Must be called with state mutex locked
+bool YBTSDriver::checkRestartIndex()
 {
-    stop();
-    Lock lck(m_stateMutex);
-    if (m_stopped)
-	return;
     unsigned int n = s_restartMax;
     if (m_restartIndex >= n) {
 	m_stopped = true;
 	Alarm(this,"system",DebugGoOn,
 	    "Restart index reached maximum value %u. Exiting ...",n);
 	Engine::halt(ECANCELED);
-	return;
+	return false;
     }
     m_restartIndex++;
+    return true;
+}
+
+void YBTSDriver::start()
+{
+    stop();
+    Lock lck(m_stateMutex);
+    if (m_stopped)
+	return;
+    if (!checkRestartIndex())
+	return;
     changeState(Starting);
     while (true) {
 	// Log interface
@@ -7967,9 +9012,8 @@ void YBTSDriver::start()
     stop();
 }
 
-void YBTSDriver::stop()
+void YBTSDriver::stopChannels()
 {
-    dropAllSS();
     lock();
     ListIterator iter(channels());
     while (true) {
@@ -7987,6 +9031,12 @@ void YBTSDriver::stop()
     m_terminatedCalls.clear();
     m_haveCalls = false;
     unlock();
+}
+
+void YBTSDriver::stop()
+{
+    dropAllSS();
+    stopChannels();
     Lock lck(m_stateMutex);
     bool stopped = (state() != Idle);
     if (stopped)
@@ -7994,9 +9044,12 @@ void YBTSDriver::stop()
     m_stop = false;
     m_stopTime = 0;
     m_error = false;
+    m_warm = false;
+    m_warmResync = false;
     m_signalling->stop();
     m_media->stop();
     stopPeer();
+    stopPeerGroup();
     m_command->stop();
     m_logTrans->stop();
     m_logBts->stop();
@@ -8015,6 +9068,65 @@ void YBTSDriver::stop()
     }
 }
 
+// Calls and connections are lost with the peer
+// The socket pairs, UEs, queued MT SMS and paging requests are kept for the next one
+void YBTSDriver::stopWarm()
+{
+    Debug(this,DebugNote,"Stopping peer for warm restart ...");
+    dropAllSS();
+    stopChannels();
+    bool ok = m_signalling->resetPeer() && m_logTrans->threadRunning() &&
+	m_logBts->threadRunning() && m_media->threadRunning() &&
+	m_command->transport().remoteValid();
+    m_media->cleanup(false);
+    Lock lck(m_stateMutex);
+    m_stop = false;
+    m_stopTime = 0;
+    if (!(ok && m_warm)) {
+	Debug(this,DebugNote,"Interfaces not usable, doing a full restart");
+	m_warm = false;
+	lck.drop();
+	stop();
+	return;
+    }
+    stopPeer();
+    // Leftovers from the old peer must not reach the new one
+    unsigned int n = m_command->transport().drain(true) +
+	m_signalling->transport().drain(true) + m_media->transport().drain(true) +
+	m_logTrans->transport().drain(false) + m_logBts->transport().drain(false);
+    if (n)
+	Debug(this,DebugInfo,"Discarded %u packets left by the old peer",n);
+    m_peerAlive = false;
+    m_peerCheckTime = 0;
+    changeState(Starting);
+}
+
+void YBTSDriver::startWarm()
+{
+    Lock lck(m_stateMutex);
+    if (m_stopped)
+	return;
+    if (!m_warm || state() != Starting) {
+	lck.drop();
+	start();
+	return;
+    }
+    m_warm = false;
+    if (!checkRestartIndex())
+	return;
+    if (startPeer()) {
+	changeState(WaitHandshake);
+	m_warmResync = true;
+	m_signalling->waitHandshake();
+	setRestart(0);
+	return;
+    }
+    Alarm(this,"system",DebugWarn,"Failed to restart the peer, doing a full restart");
+    setRestart(1,true);
+    lck.drop();
+    stop();
+}
+
 bool YBTSDriver::startPeer()
 {
     String cmd,arg,dir;
@@ -8027,11 +9139,22 @@ bool YBTSDriver::startPeer()
     }
     Debug(this,DebugAll,"Starting peer '%s' '%s'",cmd.c_str(),arg.c_str());
     Socket s[FDCount];
-    s[FDLogTransceiver].attach(m_logTrans->transport().detachRemote());
-    s[FDLogBts].attach(m_logBts->transport().detachRemote());
-    s[FDCommand].attach(m_command->transport().detachRemote());
-    s[FDSignalling].attach(m_signalling->transport().detachRemote());
-    s[FDMedia].attach(m_media->transport().detachRemote());
+    if (s_warmRestart) {
+	// Keep our copy of the remote ends so a new peer can take them over
+	s[FDLogTransceiver].attach(m_logTrans->transport().dupRemote());
+	s[FDLogBts].attach(m_logBts->transport().dupRemote());
+	s[FDCommand].attach(m_command->transport().dupRemote());
+	s[FDSignalling].attach(m_signalling->transport().dupRemote());
+	s[FDMedia].attach(m_media->transport().dupRemote());
+    }
+    else {
+	s[FDLogTransceiver].attach(m_logTrans->transport().detachRemote());
+	s[FDLogBts].attach(m_logBts->transport().detachRemote());
+	s[FDCommand].attach(m_command->transport().detachRemote());
+	s[FDSignalling].attach(m_signalling->transport().detachRemote());
+	s[FDMedia].attach(m_media->transport().detachRemote());
+    }
+    pid_t group = m_peerGroup;
     int pid = ::fork();
     if (pid < 0) {
 	String s;
@@ -8039,12 +9162,24 @@ bool YBTSDriver::startPeer()
 	return false;
     }
     if (pid) {
-	Debug(this,DebugInfo,"Started peer pid=%d",pid);
+	// Set the group here too, the child may not have run yet
+	if (!(group && ::setpgid(pid,group) == 0))
+	    ::setpgid(pid,pid);
+	// The child may have set it already, and exec'd
+	group = ::getpgid(pid);
+	if (m_peerGroup && m_peerGroup != group)
+	    Debug(this,DebugNote,"Peer process group %d is gone",m_peerGroup);
+	m_peerGroup = (group > 0) ? group : pid;
+	Debug(this,DebugInfo,"Started peer pid=%d group=%d",pid,m_peerGroup);
 	m_peerPid = pid;
 	return true;
     }
     // In child - terminate all other threads if needed
     Thread::preExec();
+    // Join the group of the previous peer so a transceiver it left running
+    //  is terminated with us on a full restart
+    if (!(group && ::setpgid(0,group) == 0))
+	::setpgid(0,0);
     // Try to immunize child from ^C and ^backslash
     ::signal(SIGINT,SIG_IGN);
     ::signal(SIGQUIT,SIG_IGN);
@@ -8128,6 +9263,23 @@ void YBTSDriver::stopPeer()
     m_peerPid = 0;
 }
 
+// The transceiver started by a peer is not our child, it is terminated through
+//  the process group all the peers share
+void YBTSDriver::stopPeerGroup()
+{
+    if (!m_peerGroup)
+	return;
+    if (::kill(-m_peerGroup,SIGTERM) == 0) {
+	Debug(this,DebugInfo,"Terminating peer process group %d",m_peerGroup);
+	unsigned int i = threadIdleIntervals(3000);
+	while (i-- && ::kill(-m_peerGroup,0) == 0)
+	    Thread::idle();
+	if (::kill(-m_peerGroup,SIGKILL) == 0)
+	    Debug(this,DebugWarn,"Killed peer process group %d",m_peerGroup);
+    }
+    m_peerGroup = 0;
+}
+
 static inline void setHalfByteDigits(uint8_t*& buf, uint8_t value)
 {
     if (value < 100) {
@@ -8319,7 +9471,8 @@ bool YBTSDriver::handleMsgExecute(Message& msg, const String& dest)
 	    if (!intervals)
 		YBTS_SMSOUT_DONE("timeout");
 	}
-	if (maxPdd && !sms->sent()) {
+	// Post dial delay starts when the list gets a paging slot
+	if (maxPdd && !sms->sent() && !list->pagingWait()) {
 	    maxPdd--;
 	    if (!maxPdd)
 		YBTS_SMSOUT_DONE("postdialdelay");
@@ -8446,8 +9599,12 @@ void YBTSDriver::checkStop(const Time& time)
     Lock lck(m_stateMutex);
     if (m_stop && m_stopTime) {
 	if (m_stopTime <= time) {
+	    bool warm = m_warm;
 	    lck.drop();
-	    stop();
+	    if (warm)
+		stopWarm();
+	    else
+		stop();
 	}
     }
     else
@@ -8460,8 +9617,12 @@ void YBTSDriver::checkRestart(const Time& time)
     Lock lck(m_stateMutex);
     if (m_restart && m_restartTime) {
 	if (m_restartTime <= time) {
+	    bool warm = m_warm;
 	    lck.drop();
-	    start();
+	    if (warm)
+		startWarm();
+	    else
+		start();
 	}
     }
     else
@@ -8484,7 +9645,18 @@ void YBTSDriver::ybtsStatus(String& line, String& retVal)
     }
     lck.drop();
     retVal << ",state_time=" << (val ? ((Time::now() - val) / 1000000)  : 0);
+    s_jobs.status(retVal);
+    unsigned int paging = 0;
+    unsigned int pagingWait = 0;
+    YBTSMtSmsList::pagingStatus(paging,pagingWait);
+    retVal << ",sms_paging=" << paging << ",sms_paging_wait=" << pagingWait;
     retVal << "\r\n";
+    // Burst latency per stage and timeslot, measured by the transceiver
+    if (line == YSTRING("latency") && state() >= Running) {
+	String tmp;
+	if (commandExecute(tmp,BTS_CMD " latency"))
+	    retVal << tmp;
+    }
 }
 
 static inline void addTout(String& dest, uint64_t toutUs, bool msec)
@@ -8645,8 +9817,17 @@ void YBTSDriver::initialize()
     s_tmsiSave = ybts.getBoolValue(YSTRING("tmsi_save"));
     s_mtSmsTimeout = ybts.getIntValue(YSTRING("sms.timeout"),
 	YBTS_MT_SMS_TIMEOUT_DEF,YBTS_MT_SMS_TIMEOUT_MIN,YBTS_MT_SMS_TIMEOUT_MAX);
+    s_mtSmsWindow = ybts.getIntValue(YSTRING("sms.window"),1,1,7);
+    s_mtSmsPagingMutex.lock();
+    s_mtSmsPagingMax = ybts.getIntValue(YSTRING("sms.paging_max"),0,0);
+    s_mtSmsPagingMutex.unlock();
     s_ussdTimeout = ybts.getIntValue(YSTRING("ussd.session_timeout"),
 	YBTS_USSD_TIMEOUT_DEF,YBTS_USSD_TIMEOUT_MIN);
+    unsigned int workers = ybts.getIntValue(YSTRING("worker_threads"),
+	YBTS_JOB_WORKERS_DEF,1,YBTS_JOB_WORKERS_MAX);
+    unsigned int maxJobs = ybts.getIntValue(YSTRING("max_procedures"),
+	YBTS_JOB_MAX_DEF,YBTS_JOB_MAX_MIN,YBTS_JOB_MAX_MAX);
+    s_jobs.setLimits(workers,maxJobs);
     const String& expXml = ybts[YSTRING("export_xml_as")];
     if (expXml == YSTRING("string"))
 	m_exportXml = -1;
@@ -8672,6 +9853,8 @@ void YBTSDriver::initialize()
 	s_lai.reset();
     }
     s_askIMEI = ybts.getBoolValue("imei_request",true);
+    s_binaryCodec = ybts.getBoolValue("binary_codec",true);
+    s_warmRestart = ybts.getBoolValue("warm_restart");
     s_ueFile = ybts.getValue("datafile",Engine::configFile("ybtsdata"));
     Engine::runParams().replaceParams(s_ueFile);
     s_peerCmd = ybts.getValue("peer_cmd","${modulepath}/" BTS_DIR "/" BTS_CMD);
@@ -8684,6 +9867,8 @@ void YBTSDriver::initialize()
     String s;
     s << "\r\nLAI=" << s_lai.lai();
     s << "\r\nimei_request=" << String::boolText(s_askIMEI);
+    s << "\r\nbinary_codec=" << String::boolText(s_binaryCodec);
+    s << "\r\nwarm_restart=" << String::boolText(s_warmRestart);
     s << "\r\ntmsi_expire=" << s_tmsiExpire << "s";
     s << "\r\ndatafile=" << s_ueFile;
     s << "\r\nmax_restart=" << s_restartMax;
@@ -8691,7 +9876,11 @@ void YBTSDriver::initialize()
     s << "\r\nt308=" << s_t308;
     s << "\r\nt313=" << s_t313;
     s << "\r\nsms.timeout=" << s_mtSmsTimeout;
+    s << "\r\nsms.window=" << s_mtSmsWindow;
+    s << "\r\nsms.paging_max=" << s_mtSmsPagingMax;
     s << "\r\nussd.session_timeout=" << s_ussdTimeout;
+    s << "\r\nworker_threads=" << workers;
+    s << "\r\nmax_procedures=" << maxJobs;
     s << "\r\npeer_cmd=" << s_peerCmd;
     s << "\r\npeer_arg=" << s_peerArg;
     s << "\r\npeer_dir=" << s_peerDir;
@@ -8793,6 +9982,7 @@ bool YBTSDriver::received(Message& msg, int id)
 	    dropAll(msg);
 	    stop();
 	    YBTSGlobalThread::cancelAll(true);
+	    s_jobs.clear();
 	    YBTSMsgHandler::uninstall();
 	    break;
 	case Timer:
@@ -8808,7 +9998,7 @@ bool YBTSDriver::received(Message& msg, int id)
 		    if (res == YBTSSignalling::FatalError)
 			stopNoRestart();
 		    else
-			restart();
+			restart(1,0,true);
 		}
 	    }
 	    if (m_haveCalls)
@@ -8836,7 +10026,7 @@ bool YBTSDriver::received(Message& msg, int id)
 			Debug(this,DebugNote,"Peer pid %d vanished",m_peerPid);
 			m_restartTime = 0;
 			lck.drop();
-			restart();
+			restart(1,0,true);
 		    }
 		}
 	    }
@@ -8917,6 +10107,8 @@ bool YBTSDriver::commandComplete(Message& msg, const String& partLine, const Str
 	itemComplete(msg.retValue(),s_stopCmd,partWord);
 	itemComplete(msg.retValue(),s_restartCmd,partWord);
     }
+    else if (partLine == (name() + " " + s_statusCmd))
+	itemComplete(msg.retValue(),YSTRING("latency"),partWord);
     else if (partLine == m_statusCmd || partLine == m_statusOverCmd) {
 	itemComplete(msg.retValue(),YSTRING("ue"),partWord);
 	itemComplete(msg.retValue(),YSTRING("conn"),partWord);
@@ -34,6 +34,21 @@ enum BtsFileDesc
     FDCount                              // Number of file descriptors
 };
 
+// Log interface record
+// Octet 0: BTS_LOG_RECORD | syslog level
+// Octet 1: source, see BtsLogSource
+// Octets 2-5: GSM frame number, network order, 0xffffffff if not known
+// Octets 6-7: number of records dropped before this one, network order
+// Followed by text
+// Records without BTS_LOG_RECORD hold a level (0xff: no level) and text
+#define BTS_LOG_RECORD 0x40
+#define BTS_LOG_HEADER 8
+
+enum BtsLogSource {
+    LogSourceBts = 0,
+    LogSourceTrx = 1
+};
+
 // Signalling interface protocol
 enum BtsPrimitive {
     SigL3Message        =   0,           // Connection related L3 message
@@ -59,6 +74,14 @@ enum BtsPagingChanType {
     ChanTypeSS     = 2,
 };
 
+// Binary paging identity, first octet of Start/Stop Paging data
+// Values match the Mobile Identity type (ETSI TS 124 008 Section 10.5.1.4)
+// Text identities (IMSI..., TMSI...) are still accepted
+enum BtsPagingIdentity {
+    PagingIdIMSI   = 1,                  // Followed by IMSI digits
+    PagingIdTMSI   = 4                   // Followed by 4 octets TMSI
+};
+
 // Traffic channel errors (subset of CC)
 enum BtsErrors {
     ErrCongestion       = 0x22,          // No circuit/channel available